@@ -0,0 +1,123 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+
+/**
+ * \file AdaptiveQuality.cpp
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#include "AdaptiveQuality.h"
+#include "jacktrip_globals.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+
+using std::cout; using std::endl;
+
+
+//*******************************************************************************
+AdaptiveQuality::AdaptiveQuality(int bit_resolution, int64_t packet_period_ns) :
+    mBitResolution(bit_resolution),
+    mPacketPeriodNs(packet_period_ns),
+    mRequestedBitResolution(bit_resolution),
+    mHasPacket(false),
+    mLastSeq(0),
+    mLastArrivalNs(0),
+    mJitterNs(0.0),
+    mIntervalStartNs(0),
+    mReceived(0),
+    mLost(0),
+    mCleanNs(0),
+    mRecoverNs(static_cast<int64_t>(gAdaptiveRecoverMs) * 1000000),
+    mRaiseNs(0)
+{}
+
+
+//*******************************************************************************
+void AdaptiveQuality::update(uint16_t seq, int lost, int revived, int64_t now_ns)
+{
+    // Interarrival jitter: difference between the arrival times of the
+    // packets and their send times, one packet period apart
+    if (mHasPacket) {
+        uint16_t seq_delta = seq - mLastSeq;
+        int64_t deviation = (now_ns - mLastArrivalNs) - mPacketPeriodNs * seq_delta;
+        mJitterNs += (std::abs(static_cast<double>(deviation)) - mJitterNs) / 16.0;
+    }
+    mHasPacket = true;
+    mLastSeq = seq;
+    mLastArrivalNs = now_ns;
+
+    mReceived += 1 + revived;
+    mLost += lost;
+    if (mIntervalStartNs == 0) { mIntervalStartNs = now_ns; }
+    int64_t interval_ns = now_ns - mIntervalStartNs;
+    if ( interval_ns < static_cast<int64_t>(gAdaptiveIntervalMs) * 1000000 ) { return; }
+
+    float loss = static_cast<float>(mLost) / (mReceived + mLost);
+    float jitter = static_cast<float>(mJitterNs / mPacketPeriodNs); // in packet periods
+    mIntervalStartNs = now_ns;
+    mReceived = 0;
+    mLost = 0;
+
+    int requested = mRequestedBitResolution;
+    if ( loss > gAdaptiveDegradeLoss || jitter > gAdaptiveDegradeJitter ) {
+        mCleanNs = 0;
+        if (requested > 8) {
+            // Undoing a recent raise, wait longer before the next one
+            if ( mRaiseNs != 0 && now_ns - mRaiseNs < mRecoverNs ) {
+                mRecoverNs = std::min<int64_t>(mRecoverNs * 2,
+                                               static_cast<int64_t>(gAdaptiveMaxRecoverMs) * 1000000);
+            }
+            requested -= 8;
+        }
+    }
+    else if ( loss < gAdaptiveRecoverLoss && jitter < gAdaptiveRecoverJitter ) {
+        mCleanNs += interval_ns;
+        if ( requested < mBitResolution && mCleanNs >= mRecoverNs ) {
+            mCleanNs = 0;
+            mRaiseNs = now_ns;
+            requested += 8;
+        }
+    }
+    else {
+        mCleanNs = 0;
+    }
+
+    if (requested != mRequestedBitResolution) {
+        mRequestedBitResolution = requested;
+        cout << "Adaptive resolution: asking the peer for " << requested
+             << " bits (loss " << loss * 100.0f << "%, jitter "
+             << static_cast<int>(mJitterNs / 1000) << " us)" << endl;
+    }
+}
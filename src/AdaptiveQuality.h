@@ -0,0 +1,91 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+
+/**
+ * \file AdaptiveQuality.h
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#ifndef __ADAPTIVEQUALITY_H__
+#define __ADAPTIVEQUALITY_H__
+
+#include "jacktrip_types.h"
+
+/** \brief Chooses the bit resolution to ask the peer for (--adaptive), from
+ * the loss and jitter of its packets.
+ *
+ * The receiver thread calls update() with each packet in order. Every
+ * gAdaptiveIntervalMs, an interval over gAdaptiveDegradeLoss or
+ * gAdaptiveDegradeJitter lowers the resolution by one byte, down to 8 bits.
+ * It goes back up by one byte after a clean time, which doubles each time
+ * the link degrades again right after a raise, so that a link at the limit
+ * doesn't keep switching.
+ */
+class AdaptiveQuality
+{
+public:
+    /** \brief The class constructor
+     * \param bit_resolution Resolution of the session, in bits
+     * \param packet_period_ns Time between two packets of the peer
+     */
+    AdaptiveQuality(int bit_resolution, int64_t packet_period_ns);
+
+    /** \brief Takes a packet of the peer (receiver thread)
+     * \param seq Sequence number of the packet
+     * \param lost Packets missing before this one, not counting the revived ones
+     * \param revived Packets before this one its redundant copies brought back
+     * \param now_ns Arrival time, monotonic
+     */
+    void update(uint16_t seq, int lost, int revived, int64_t now_ns);
+    /// \brief Resolution to ask the peer for, in bits
+    int getRequestedBitResolution() const { return mRequestedBitResolution; }
+
+private:
+    int mBitResolution; ///< Resolution of the session, in bits
+    int64_t mPacketPeriodNs;
+    int mRequestedBitResolution;
+
+    bool mHasPacket; ///< mLastSeq and mLastArrivalNs are set
+    uint16_t mLastSeq;
+    int64_t mLastArrivalNs;
+    double mJitterNs; ///< Interarrival jitter (RFC 3550)
+
+    int64_t mIntervalStartNs; ///< 0 = no interval yet
+    int mReceived; ///< Packets of the interval
+    int mLost;
+    int64_t mCleanNs; ///< Clean time since the last change
+    int64_t mRecoverNs; ///< Clean time needed to raise the resolution
+    int64_t mRaiseNs; ///< Time of the last raise, 0 = none
+};
+
+#endif // __ADAPTIVEQUALITY_H__
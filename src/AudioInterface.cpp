@@ -37,8 +37,13 @@
 
 #include "AudioInterface.h"
 #include "JackTrip.h"
+#include "Recorder.h"
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
 
 using std::cout; using std::endl;
 
@@ -57,18 +62,23 @@ AudioInterface::AudioInterface(JackTrip* jacktrip,
     mAudioBitResolution(AudioBitResolution*8),
     mBitResolutionMode(AudioBitResolution),
     mSampleRate(gDefaultSampleRate), mBufferSizeInSamples(gDefaultBufferSizeInSamples),
-    mInputPacket(NULL), mOutputPacket(NULL)
+    mInputPacket(NULL), mOutputPacket(NULL),
+    mDtxHangoverBlocks(1),
+    mRecorderTrack(NULL),
+    mCallbackLoad(NULL)
 {
 #ifndef WAIR
     //cc
     // Initialize and assign memory for ProcessPlugins Buffers
+    // The plugin outputs are added to the inputs sent, one per channel of the
+    // larger side when there are more inputs than outputs
     mInProcessBuffer.resize(mNumInChans);
-    mOutProcessBuffer.resize(mNumOutChans);
+    mOutProcessBuffer.resize(qMax(mNumInChans, mNumOutChans));
     // Set pointer to NULL
     for (int i = 0; i < mNumInChans; i++) {
         mInProcessBuffer[i] = NULL;
     }
-    for (int i = 0; i < mNumOutChans; i++) {
+    for (int i = 0; i < mOutProcessBuffer.size(); i++) {
         mOutProcessBuffer[i] = NULL;
     }
 #else // WAIR
@@ -98,7 +108,7 @@ AudioInterface::~AudioInterface()
         delete[] mInProcessBuffer[i];
     }
 
-    for (int i = 0; i < mNumOutChans; i++) {
+    for (int i = 0; i < mOutProcessBuffer.size(); i++) {
         delete[] mOutProcessBuffer[i];
     }
 #else // WAIR
@@ -148,18 +158,24 @@ void AudioInterface::setup()
 #endif // endwhere
     {
         mInProcessBuffer.resize(mNumInChans);
-        mOutProcessBuffer.resize(mNumOutChans);
+        mOutProcessBuffer.resize(qMax(mNumInChans, mNumOutChans));
     }
 
     int nframes = getBufferSizeInSamples();
 
+    // Silence gate, all the channels start silent
+    mDtxHangover.resize(mNumInChans);
+    for (int i = 0; i < mNumInChans; i++) { mDtxHangover[i] = 0; }
+    mDtxHangoverBlocks = qMax(1, static_cast<int>(
+                                  (int64_t)gDtxHangoverMs * getSampleRate() / 1000 / nframes));
+
 #ifndef WAIR // WAIR
     for (int i = 0; i < mNumInChans; i++) {
         mInProcessBuffer[i] = new sample_t[nframes];
         // set memory to 0
         std::memset(mInProcessBuffer[i], 0, sizeof(sample_t) * nframes);
     }
-    for (int i = 0; i < mNumOutChans; i++) {
+    for (int i = 0; i < mOutProcessBuffer.size(); i++) {
         mOutProcessBuffer[i] = new sample_t[nframes];
         // set memory to 0
         std::memset(mOutProcessBuffer[i], 0, sizeof(sample_t) * nframes);
@@ -190,6 +206,17 @@ void AudioInterface::setup()
 }
 
 
+//*******************************************************************************
+void AudioInterface::setCallbackLoad(CallbackLoad* load)
+{
+    mCallbackLoad = load;
+    if (load != NULL) {
+        load->periodNs = static_cast<uint32_t>(
+                    1e9 * getBufferSizeInSamples() / getSampleRate());
+    }
+}
+
+
 //*******************************************************************************
 size_t AudioInterface::getSizeInBytesPerChannel() const
 {
@@ -218,7 +245,11 @@ void AudioInterface::callback(QVarLengthArray<sample_t*>& in_buffer,
     }
 #endif // endwhere
 
+    int64_t start_ns = (mCallbackLoad != NULL) ? getMonotonicNs() : 0;
     computeProcessFromNetwork(out_buffer, n_frames);
+    // Never blocks, a full queue only counts a dropped block
+    if (mRecorderTrack != NULL) { mRecorderTrack->push(out_buffer.data(), n_frames); }
+    int64_t decoded_ns = (mCallbackLoad != NULL) ? getMonotonicNs() : 0;
 #ifdef WAIR // WAIR
     // nib16 result now in mNetInBuffer
 #endif // endwhere
@@ -230,11 +261,14 @@ void AudioInterface::callback(QVarLengthArray<sample_t*>& in_buffer,
     /// do it chaining outputs to inputs in the buffers. May need a tempo buffer
 
 #ifndef WAIR // WAIR
+    // The plugins take what was received, there may be fewer outputs than inputs
     for (int i = 0; i < mNumInChans; i++) {
         std::memset(mInProcessBuffer[i], 0, sizeof(sample_t) * n_frames);
-        std::memcpy(mInProcessBuffer[i], out_buffer[i], sizeof(sample_t) * n_frames);
+        if (i < mNumOutChans) {
+            std::memcpy(mInProcessBuffer[i], out_buffer[i], sizeof(sample_t) * n_frames);
+        }
     }
-    for (int i = 0; i < mNumOutChans; i++) {
+    for (int i = 0; i < mOutProcessBuffer.size(); i++) {
         std::memset(mOutProcessBuffer[i], 0, sizeof(sample_t) * n_frames);
     }
 
@@ -264,7 +298,14 @@ void AudioInterface::callback(QVarLengthArray<sample_t*>& in_buffer,
 
     // 3) Finally, send packets to peer
     // --------------------------------
+    int64_t encode_ns = (mCallbackLoad != NULL) ? getMonotonicNs() : 0;
     computeProcessToNetwork(in_buffer, n_frames);
+    if (mCallbackLoad != NULL) {
+        int64_t end_ns = getMonotonicNs();
+        updateLoadNs(mCallbackLoad->decodeNs, decoded_ns - start_ns);
+        updateLoadNs(mCallbackLoad->encodeNs, end_ns - encode_ns);
+        updateLoadNs(mCallbackLoad->callbackNs, end_ns - start_ns);
+    }
 
 #ifdef WAIR // WAIR
     // aib2 + cob16 to nob16
@@ -374,6 +415,12 @@ void AudioInterface::computeProcessFromNetwork(QVarLengthArray<sample_t*>& out_b
             //		mSizeInBytesPerChannel);
             //--------
             sample_t* tmp_sample = out_buffer[i]; //sample buffer for channel i
+            // Channels omitted by the peer (DTX) arrive zeroed, skip the conversion
+            if ( mJackTrip->isDtx() &&
+                 isZeroBlock(&mOutputPacket[i*mSizeInBytesPerChannel], mSizeInBytesPerChannel) ) {
+                std::memset(tmp_sample, 0, sizeof(sample_t) * n_frames);
+                continue;
+            }
             for (unsigned int j = 0; j < n_frames; j++) {
                 // Change the bit resolution on each sample
                 fromBitToSampleConversion(
@@ -421,6 +468,12 @@ void AudioInterface::computeProcessToNetwork(QVarLengthArray<sample_t*>& in_buff
             //--------
             sample_t* tmp_sample = in_buffer[i]; //sample buffer for channel i
             sample_t* tmp_process_sample = mOutProcessBuffer[i]; //sample buffer from the output process
+            // Silent channels are sent as zeros, and then omitted from the packet (DTX)
+            if ( mJackTrip->isDtx() &&
+                 !isChannelActive(i, tmp_sample, tmp_process_sample, n_frames) ) {
+                std::memset(&mInputPacket[i*mSizeInBytesPerChannel], 0, mSizeInBytesPerChannel);
+                continue;
+            }
             sample_t tmp_result;
             for (unsigned int j = 0; j < n_frames; j++) {
                 // Change the bit resolution on each sample
@@ -437,6 +490,59 @@ void AudioInterface::computeProcessToNetwork(QVarLengthArray<sample_t*>& in_buff
 }
 
 
+//*******************************************************************************
+// Peak and sum of squares of a + b, four samples at a time
+static void blockLevel(const sample_t* a, const sample_t* b, int n,
+                       float& peak, float& sum_squares)
+{
+    int i = 0;
+    peak = 0.0;
+    sum_squares = 0.0;
+#ifdef __SSE__
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 vpeak = _mm_setzero_ps();
+    __m128 vsum = _mm_setzero_ps();
+    for ( ; i + 4 <= n; i += 4) {
+        __m128 x = _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        vpeak = _mm_max_ps(vpeak, _mm_andnot_ps(sign, x));
+        vsum = _mm_add_ps(vsum, _mm_mul_ps(x, x));
+    }
+    float tmp_peak[4], tmp_sum[4];
+    _mm_storeu_ps(tmp_peak, vpeak);
+    _mm_storeu_ps(tmp_sum, vsum);
+    for (int k = 0; k < 4; k++) {
+        peak = std::max(peak, tmp_peak[k]);
+        sum_squares += tmp_sum[k];
+    }
+#endif
+    for ( ; i < n; i++) {
+        float x = a[i] + b[i];
+        peak = std::max(peak, std::fabs(x));
+        sum_squares += x * x;
+    }
+}
+
+
+//*******************************************************************************
+bool AudioInterface::isChannelActive(int chan, const sample_t* in, const sample_t* process,
+                                     unsigned int n_frames)
+{
+    float peak, sum_squares;
+    blockLevel(in, process, n_frames, peak, sum_squares);
+    float rms = std::sqrt(sum_squares / n_frames);
+
+    // Open right away, close after the hangover. Between the two thresholds the
+    // channel keeps its state.
+    if ( rms > gDtxOpenRms || peak > gDtxOpenPeak ) {
+        mDtxHangover[chan] = mDtxHangoverBlocks;
+    }
+    else if ( rms < gDtxCloseRms && mDtxHangover[chan] > 0 ) {
+        mDtxHangover[chan]--;
+    }
+    return mDtxHangover[chan] > 0;
+}
+
+
 //*******************************************************************************
 // This function quantize from 32 bit to a lower bit resolution
 // 24 bit is not working yet
@@ -543,8 +649,13 @@ void AudioInterface::appendProcessPlugin(ProcessPlugin* plugin)
 //*******************************************************************************
 AudioInterface::samplingRateT AudioInterface::getSampleRateType() const
 {
-    uint32_t rate = getSampleRate();
+    return getTypeFromSampleRate(getSampleRate());
+}
 
+
+//*******************************************************************************
+AudioInterface::samplingRateT AudioInterface::getTypeFromSampleRate(uint32_t rate)
+{
     if      ( rate == 22050 ) {
         return AudioInterface::SR22; }
     else if ( rate == 32000 ) {
@@ -557,7 +668,7 @@ AudioInterface::samplingRateT AudioInterface::getSampleRateType() const
         return AudioInterface::SR88; }
     else if ( rate == 96000 ) {
         return AudioInterface::SR96; }
-    else if ( rate == 19200 ) {
+    else if ( rate == 192000 ) {
         return AudioInterface::SR192; }
 
     return AudioInterface::UNDEF;
@@ -47,6 +47,8 @@
 
 // Forward declarations
 class JackTrip;
+class RecorderTrack;
+struct CallbackLoad;
 
 //using namespace JackTripNamespace;
 
@@ -160,6 +162,11 @@ public:
     { mBufferSizeInSamples = buf_size; }
     /// \brief Set Client Name to something different that the default (JackTrip)
     virtual void setClientName(const char* ClientName) = 0;
+    /// \brief Records the audio received from the network, set before starting
+    void setRecorderTrack(RecorderTrack* track)
+    { mRecorderTrack = track; }
+    /// \brief Measures the cost of the callback into load, set after setup()
+    void setCallbackLoad(CallbackLoad* load);
     //------------------------------------------------------------------
 
     //--------------GETTERS---------------------------------------------
@@ -189,6 +196,8 @@ public:
    * \return Sample Rate in Hz
    */
     static int getSampleRateFromType(samplingRateT rate_type);
+    /// \brief The samplingRateT of a sample rate in Hz, UNDEF if there's none
+    static samplingRateT getTypeFromSampleRate(uint32_t rate);
     //------------------------------------------------------------------
 
 
@@ -200,6 +209,11 @@ private:
     /// \brief Compute the process to send packets
     void computeProcessToNetwork(QVarLengthArray<sample_t*>& in_buffer,
                                  unsigned int n_frames);
+    /** \brief Silence gate of the discontinuous transmission mode, with hysteresis
+   * \return false if channel chan is silent in this block (input + process output)
+   */
+    bool isChannelActive(int chan, const sample_t* in, const sample_t* process,
+                         unsigned int n_frames);
 
     JackTrip* mJackTrip; ///< JackTrip Mediator Class pointer
     int mNumInChans;///< Number of Input Channels
@@ -220,6 +234,10 @@ private:
     QVarLengthArray<sample_t*> mOutProcessBuffer;///< Vector of Output buffers/channel for ProcessPlugin
     int8_t* mInputPacket; ///< Packet containing all the channels to read from the RingBuffer
     int8_t* mOutputPacket;  ///< Packet containing all the channels to send to the RingBuffer
+    QVarLengthArray<int> mDtxHangover; ///< Blocks each channel stays open, 0 = silent
+    int mDtxHangoverBlocks; ///< gDtxHangoverMs in blocks
+    RecorderTrack* mRecorderTrack; ///< Recording of the decoded network audio, or NULL
+    CallbackLoad* mCallbackLoad; ///< Cost of the callback (hub admission control), or NULL
 };
 
 #endif // __AUDIOINTERFACE_H__
@@ -56,6 +56,7 @@
 #include <QHostAddress>
 #include <QMutex>
 #include <QMutexLocker>
+#include <QVector>
 
 class JackTrip; // forward declaration
 
@@ -101,7 +102,8 @@ public:
     enum packetHeaderTypeT {
         DEFAULT, ///< Default application header
         JAMLINK, ///< Header to use with Jamlinks
-        EMPTY    ///< Empty Header
+        EMPTY,   ///< Empty Header
+        COMPACT  ///< Compact Header, the settings are sent once
     };
 
     /// \brief Enum to define class modes, SENDER or RECEIVER
@@ -171,15 +173,44 @@ public:
     virtual void setSocket(int &socket) = 0;
 #endif
 
+    /// \brief Pins the protocol thread to cpu when it starts (-1 = not pinned)
+    void setCpuAffinity(int cpu) { mCpuAffinity = cpu; }
+
+    /** \brief Sends an audio packet from the audio callback, bypassing the
+   * send RingBuffer (SENDER, JackTrip::setDirectSend())
+   * \return false if the protocol can't, the packet goes to the RingBuffer then
+   */
+    virtual bool sendDirect(const int8_t* /*audio_packet*/) { return false; }
+
     struct PktStat {
         uint32_t tot;
         uint32_t lost;
         uint32_t outOfOrder;
         uint32_t revived;
+        uint32_t syscalls; ///< Socket system calls
+        // Busy poll, since the last stats
+        uint32_t wakeCount; ///< Datagrams with a measured wake latency
+        uint32_t wakeP50Usec; ///< Median latency from arrival to the receiver thread
+        uint32_t wakeP99Usec;
+        uint32_t wakeMaxUsec;
+        uint32_t spinCaught; ///< Datagrams caught spinning
+        uint32_t spinUsec; ///< Time spent spinning
+        uint32_t sendDropped; ///< Datagrams dropped by the direct send queue
         uint32_t statCount;
     };
     virtual bool getStats(PktStat*) {return false;}
 
+    /// \brief A network path of the received datagrams (--multipath), since the last stats
+    struct PathStat {
+        QHostAddress address; ///< Source of the datagrams
+        uint32_t received; ///< Datagrams, first copies or not
+        uint32_t first; ///< Datagrams this path brought first
+        uint32_t lost; ///< Gaps in the sequence numbers of this path
+        uint32_t lateMeanUsec; ///< Delay of the copies that came after the first one
+        uint32_t lateMaxUsec;
+    };
+    virtual bool getPathStats(QVector<PathStat>&) {return false;}
+
 signals:
 
     void signalError(const char* error_message);
@@ -200,6 +231,7 @@ protected:
     /// Boolean that indicates if a packet was received
     volatile bool mHasPacketsToReceive;
     QMutex mMutex;
+    int mCpuAffinity; ///< CPU the thread is pinned to, -1 if not pinned
 
 
 private:
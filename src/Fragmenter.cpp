@@ -0,0 +1,176 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+
+/**
+ * \file Fragmenter.cpp
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#include "Fragmenter.h"
+
+#include <cstring>
+#include <algorithm>
+
+
+//*******************************************************************************
+Fragmenter::Fragmenter(int max_frame_size) :
+    mMaxDatagramSize(0),
+    mNextFrameId(0),
+    mMaxFrameSize(max_frame_size),
+    mAge(0),
+    mIncompleteFrames(0)
+{
+    for (int i = 0; i < gFragmentSlots; i++) {
+        Slot& slot = mSlots[i];
+        slot.used = false;
+        slot.buffer = (mMaxFrameSize > 0) ? new int8_t[mMaxFrameSize] : NULL;
+    }
+}
+
+
+//*******************************************************************************
+Fragmenter::~Fragmenter()
+{
+    for (int i = 0; i < gFragmentSlots; i++) {
+        delete[] mSlots[i].buffer;
+    }
+}
+
+
+//*******************************************************************************
+bool Fragmenter::isFragment(const int8_t* datagram, int size)
+{
+    if ( size <= getHeaderSizeInBytes() ) { return false; }
+    FragmentHeaderStruct header;
+    std::memcpy(&header, datagram, sizeof(header));
+    if ( header.Magic != FRAGMENT_MAGIC || header.Count < 2
+         || header.Index >= header.Count || header.FrameSize == 0 ) {
+        return false;
+    }
+    // The payload has to be this fragment's share of the frame
+    int share = (header.FrameSize + header.Count - 1) / header.Count;
+    int start = header.Index * share;
+    int end = std::min<int>(start + share, header.FrameSize);
+    return ( end > start && size - getHeaderSizeInBytes() == end - start );
+}
+
+
+//*******************************************************************************
+const int8_t* Fragmenter::getFrameStart(const int8_t* datagram, int size)
+{
+    if ( !isFragment(datagram, size) ) { return datagram; }
+    FragmentHeaderStruct header;
+    std::memcpy(&header, datagram, sizeof(header));
+    return (header.Index == 0) ? datagram + getHeaderSizeInBytes() : NULL;
+}
+
+
+//*******************************************************************************
+int Fragmenter::getNumFragments(int frame_size) const
+{
+    int max_size = mMaxDatagramSize;
+    if ( max_size <= 0 || frame_size <= max_size ) { return 1; }
+    int payload = max_size - getHeaderSizeInBytes();
+    // A UDP datagram never needs more with gMinMtu, but fewer fragments would
+    // each take more than the payload
+    int count = (frame_size + payload - 1) / payload;
+    return (count <= MAX_FRAGMENTS) ? count : 0;
+}
+
+
+//*******************************************************************************
+int Fragmenter::putFragment(const int8_t* frame, int frame_size, uint16_t frame_id,
+                            int index, int count, int8_t* datagram)
+{
+    FragmentHeaderStruct header;
+    header.Magic = FRAGMENT_MAGIC;
+    header.FrameId = frame_id;
+    header.Index = index;
+    header.Count = count;
+    header.FrameSize = frame_size;
+    std::memcpy(datagram, &header, sizeof(header));
+    int share = (frame_size + count - 1) / count;
+    int start = index * share;
+    int end = std::min(start + share, frame_size);
+    std::memcpy(datagram + getHeaderSizeInBytes(), frame + start, end - start);
+    return getHeaderSizeInBytes() + end - start;
+}
+
+
+//*******************************************************************************
+int8_t* Fragmenter::reassemble(const int8_t* datagram, int size, int& frame_size)
+{
+    FragmentHeaderStruct header;
+    std::memcpy(&header, datagram, sizeof(header));
+    if ( (int)header.FrameSize > mMaxFrameSize ) { return NULL; }
+
+    // Slot of the frame, else a free one, else the oldest
+    Slot* slot = NULL;
+    Slot* free_slot = NULL;
+    Slot* oldest = NULL;
+    for (int i = 0; i < gFragmentSlots; i++) {
+        Slot& s = mSlots[i];
+        if ( !s.used ) {
+            if (free_slot == NULL) { free_slot = &s; }
+        } else if ( s.frameId == header.FrameId && s.count == header.Count
+                    && s.frameSize == (int)header.FrameSize ) {
+            slot = &s;
+            break;
+        } else if ( oldest == NULL || (int32_t)(s.age - oldest->age) < 0 ) {
+            oldest = &s;
+        }
+    }
+    if (slot == NULL) {
+        slot = (free_slot != NULL) ? free_slot : oldest;
+        if (slot->used) { mIncompleteFrames++; }
+        slot->used = true;
+        slot->frameId = header.FrameId;
+        slot->count = header.Count;
+        slot->received = 0;
+        std::memset(slot->mask, 0, sizeof(slot->mask));
+        slot->frameSize = header.FrameSize;
+        slot->age = mAge++;
+    }
+
+    uint32_t bit = 1u << (header.Index & 31);
+    uint32_t& word = slot->mask[header.Index >> 5];
+    if (word & bit) { return NULL; } // Duplicate
+    word |= bit;
+    int share = (slot->frameSize + slot->count - 1) / slot->count;
+    std::memcpy(slot->buffer + header.Index * share, datagram + getHeaderSizeInBytes(),
+                size - getHeaderSizeInBytes());
+    if (++slot->received < slot->count) { return NULL; }
+    slot->used = false;
+    frame_size = slot->frameSize;
+    return slot->buffer;
+}
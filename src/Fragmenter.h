@@ -0,0 +1,145 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+
+/**
+ * \file Fragmenter.h
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#ifndef __FRAGMENTER_H__
+#define __FRAGMENTER_H__
+
+#include <atomic>
+
+#include "jacktrip_types.h"
+#include "jacktrip_globals.h"
+
+
+/// \brief Marks a fragment, "JTF1" in the byte order of the peers
+const uint32_t FRAGMENT_MAGIC = 0x3146544A;
+/// \brief Most fragments of a frame, FragmentHeaderStruct::Count is 8 bits
+const int MAX_FRAGMENTS = 255;
+
+/** \brief Header of each fragment of a datagram larger than the path MTU.
+ *
+ * A datagram (a frame here) is cut into Count fragments of the same size,
+ * the last one shorter: fragment Index carries the bytes from
+ * Index * ceil(FrameSize / Count) on.
+ */
+struct FragmentHeaderStruct {
+public:
+    uint32_t Magic; ///< FRAGMENT_MAGIC
+    uint16_t FrameId; ///< Frame counter of the sender
+    uint8_t  Index; ///< Fragment of the frame, from 0
+    uint8_t  Count; ///< Fragments in the frame
+    uint32_t FrameSize; ///< Bytes in the whole frame
+};
+
+
+/** \brief Splits the datagrams larger than the path MTU into fragments, and
+ * puts them back together on the receiving end.
+ *
+ * Datagrams that fit go out as they are, so the receivers take both kinds;
+ * a datagram that isn't a fragment is never mistaken for one unless it starts
+ * with FRAGMENT_MAGIC and a consistent fragment header. A lost fragment loses
+ * its frame, as a lost IP fragment would, but the frame never depends on IP
+ * reassembly in the routers and hosts on the way.
+ *
+ * The sending methods are thread safe (the audio callback and the sender
+ * thread both send with --directsend), the receiving ones are not.
+ */
+class Fragmenter
+{
+public:
+    /** \brief The class constructor
+     * \param max_frame_size Largest frame reassembled, 0 on the sending end
+     */
+    Fragmenter(int max_frame_size);
+    virtual ~Fragmenter();
+
+    /// \brief True if the datagram is a fragment
+    static bool isFragment(const int8_t* datagram, int size);
+    /** \brief Start of the frame in a datagram: the datagram itself, or what
+     * follows the header of the first fragment
+     * \return NULL for the other fragments
+     */
+    static const int8_t* getFrameStart(const int8_t* datagram, int size);
+    static int getHeaderSizeInBytes() { return sizeof(FragmentHeaderStruct); }
+
+    /// \brief Largest datagram the sender puts on the wire, header included
+    void setMaxDatagramSize(int size) { mMaxDatagramSize = size; }
+    int getMaxDatagramSize() const { return mMaxDatagramSize; }
+    /// \brief Fragments a frame takes, 1 = it goes out as it is, 0 = more
+    /// than MAX_FRAGMENTS, it can't be sent
+    int getNumFragments(int frame_size) const;
+    /// \brief Number of the next frame, one per fragmented frame
+    uint16_t newFrameId() { return mNextFrameId++; }
+    /** \brief Writes fragment index of count into datagram, which takes
+     * getMaxDatagramSize() bytes
+     * \param count From getNumFragments(), not 0
+     * \return Datagram size
+     */
+    static int putFragment(const int8_t* frame, int frame_size, uint16_t frame_id,
+                           int index, int count, int8_t* datagram);
+
+    /** \brief Takes a received fragment
+     * \param frame_size Set to the frame size when it is complete
+     * \return The frame once all its fragments arrived, NULL until then. It
+     * stays valid until the next call.
+     */
+    int8_t* reassemble(const int8_t* datagram, int size, int& frame_size);
+    /// \brief Frames dropped with fragments missing
+    uint32_t getIncompleteFrames() const { return mIncompleteFrames; }
+
+private:
+    /// \brief A frame being reassembled
+    struct Slot {
+        bool used;
+        uint16_t frameId;
+        int count; ///< Fragments in the frame
+        int received; ///< Fragments received
+        uint32_t mask[8]; ///< Bit i set = fragment i received
+        int frameSize;
+        uint32_t age; ///< Order of the first fragment, the oldest slot is reused
+        int8_t* buffer;
+    };
+
+    std::atomic<int> mMaxDatagramSize;
+    std::atomic<uint16_t> mNextFrameId;
+    int mMaxFrameSize;
+    Slot mSlots[gFragmentSlots];
+    uint32_t mAge;
+    uint32_t mIncompleteFrames;
+};
+
+#endif // __FRAGMENTER_H__
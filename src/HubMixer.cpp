@@ -0,0 +1,575 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+/**
+ * \file HubMixer.cpp
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include <QMutexLocker>
+#include <QUdpSocket>
+#include <QHostAddress>
+#include <QTextStream>
+
+#include "HubMixer.h"
+#include "Recorder.h"
+
+using std::cout; using std::endl;
+
+
+//*******************************************************************************
+// Mixing kernels: out = gain * in and out += gain * in, four samples at a time
+static void mixScale(sample_t* out, const sample_t* in, float gain, int n)
+{
+    int i = 0;
+#ifdef __SSE__
+    __m128 g = _mm_set1_ps(gain);
+    for ( ; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(out + i, _mm_mul_ps(g, _mm_loadu_ps(in + i)));
+    }
+#endif
+    for ( ; i < n; i++) { out[i] = gain * in[i]; }
+}
+
+static void mixAccumulate(sample_t* out, const sample_t* in, float gain, int n)
+{
+    int i = 0;
+#ifdef __SSE__
+    __m128 g = _mm_set1_ps(gain);
+    for ( ; i + 4 <= n; i += 4) {
+        __m128 acc = _mm_loadu_ps(out + i);
+        _mm_storeu_ps(out + i, _mm_add_ps(acc, _mm_mul_ps(g, _mm_loadu_ps(in + i))));
+    }
+#endif
+    for ( ; i < n; i++) { out[i] += gain * in[i]; }
+}
+
+// Same, with the gain going linearly from gain0 to gain1 over the block (crossfades)
+static void mixScaleRamp(sample_t* out, const sample_t* in, float gain0, float gain1, int n)
+{
+    int i = 0;
+    float step = (gain1 - gain0) / n;
+#ifdef __SSE__
+    __m128 g = _mm_setr_ps(gain0, gain0 + step, gain0 + 2*step, gain0 + 3*step);
+    __m128 dg = _mm_set1_ps(4*step);
+    for ( ; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(out + i, _mm_mul_ps(g, _mm_loadu_ps(in + i)));
+        g = _mm_add_ps(g, dg);
+    }
+#endif
+    for ( ; i < n; i++) { out[i] = (gain0 + i*step) * in[i]; }
+}
+
+static void mixAccumulateRamp(sample_t* out, const sample_t* in, float gain0, float gain1, int n)
+{
+    int i = 0;
+    float step = (gain1 - gain0) / n;
+#ifdef __SSE__
+    __m128 g = _mm_setr_ps(gain0, gain0 + step, gain0 + 2*step, gain0 + 3*step);
+    __m128 dg = _mm_set1_ps(4*step);
+    for ( ; i + 4 <= n; i += 4) {
+        __m128 acc = _mm_loadu_ps(out + i);
+        _mm_storeu_ps(out + i, _mm_add_ps(acc, _mm_mul_ps(g, _mm_loadu_ps(in + i))));
+        g = _mm_add_ps(g, dg);
+    }
+#endif
+    for ( ; i < n; i++) { out[i] += (gain0 + i*step) * in[i]; }
+}
+
+// Sum of the squares of the block
+static float sumSquares(const sample_t* in, int n)
+{
+    int i = 0;
+    float sum = 0.0;
+#ifdef __SSE__
+    __m128 acc = _mm_setzero_ps();
+    for ( ; i + 4 <= n; i += 4) {
+        __m128 x = _mm_loadu_ps(in + i);
+        acc = _mm_add_ps(acc, _mm_mul_ps(x, x));
+    }
+    float tmp[4];
+    _mm_storeu_ps(tmp, acc);
+    sum = tmp[0] + tmp[1] + tmp[2] + tmp[3];
+#endif
+    for ( ; i < n; i++) { sum += in[i] * in[i]; }
+    return sum;
+}
+
+
+//*******************************************************************************
+HubMixer::HubMixer(int control_port) :
+    mClient(NULL),
+    mControlPort(control_port),
+    mRemoteControl(false),
+    mStopped(false),
+    mTopN(0),
+    mRecorder(NULL),
+    mCallbackLoad(NULL),
+    mFront(0),
+    mReading(0)
+{}
+
+
+//*******************************************************************************
+HubMixer::~HubMixer()
+{
+    stop();
+    if ( mClient != NULL ) { jack_client_close(mClient); }
+}
+
+
+//*******************************************************************************
+void HubMixer::setup()
+{
+    jack_status_t status;
+    mClient = jack_client_open("HubMixer", JackNoStartServer, &status);
+    if (mClient == NULL) {
+        throw std::runtime_error("HubMixer: Could not open the JACK client");
+    }
+    if ( jack_set_process_callback(mClient, HubMixer::wrapperProcessCallback, this) ) {
+        throw std::runtime_error("HubMixer: Could not set the Jack process callback");
+    }
+    if ( jack_activate(mClient) ) {
+        throw std::runtime_error("HubMixer: Cannot activate client");
+    }
+    cout << "JackTrip HUB SERVER: Hub mixer running, control UDP port = "
+         << mControlPort << (mRemoteControl ? "" : " (local only)") << endl;
+}
+
+
+//*******************************************************************************
+void HubMixer::stop()
+{
+    mStopped = true;
+    wait();
+}
+
+
+//*******************************************************************************
+QString HubMixer::getPortName(const QString& name, int chan, bool input) const
+{
+    return QString(jack_get_client_name(mClient)) + ":" + name
+            + (input ? "_in_" : "_out_") + QString::number(chan);
+}
+
+
+//*******************************************************************************
+bool HubMixer::addClient(const QString& name, int numIn, int numOut)
+{
+    QMutexLocker lock(&mControlMutex);
+    if ( mSlots.contains(name) ) { return true; }
+
+    MixerSlot slot;
+    slot.state = NULL;
+    slot.track = NULL;
+    for (int l = 1; l<=numIn; l++) {
+        QString portName = name + "_in_" + QString::number(l);
+        jack_port_t* port = jack_port_register(mClient, portName.toLatin1(),
+                                               JACK_DEFAULT_AUDIO_TYPE, JackPortIsInput, 0);
+        if (port == NULL) { break; }
+        slot.inPorts.push_back(port);
+    }
+    for (int l = 1; l<=numOut; l++) {
+        QString portName = name + "_out_" + QString::number(l);
+        jack_port_t* port = jack_port_register(mClient, portName.toLatin1(),
+                                               JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0);
+        if (port == NULL) { break; }
+        slot.outPorts.push_back(port);
+    }
+    if ( (int)slot.inPorts.size() != numIn || (int)slot.outPorts.size() != numOut ) {
+        std::cerr << "HubMixer ERROR: could not register the ports of "
+                  << name.toStdString() << endl;
+        for (size_t i = 0; i<slot.inPorts.size(); i++) { jack_port_unregister(mClient, slot.inPorts[i]); }
+        for (size_t i = 0; i<slot.outPorts.size(); i++) { jack_port_unregister(mClient, slot.outPorts[i]); }
+        return false;
+    }
+
+    // New sources fade in if they make it to the top N
+    slot.state = new SourceState;
+    slot.state->energy = 0.0;
+    slot.state->presence = 0.0;
+    // The trunk slots send nothing back, they have no mix to record
+    if (mRecorder != NULL && numOut > 0) {
+        slot.track = mRecorder->openTrack("mix_" + name, numOut,
+                                          jack_get_sample_rate(mClient),
+                                          jack_get_buffer_size(mClient));
+    }
+    mSlots.insert(name, slot);
+    mClientNames.append(name);
+    publishParams();
+    return true;
+}
+
+
+//*******************************************************************************
+void HubMixer::removeClient(const QString& name)
+{
+    QMutexLocker lock(&mControlMutex);
+    if ( !mSlots.contains(name) ) { return; }
+
+    MixerSlot slot = mSlots.take(name);
+    mClientNames.removeAll(name);
+    mPinned.removeAll(name);
+    mGains.remove(name);
+    for (QHash<QString, QHash<QString, float> >::iterator it = mGains.begin();
+         it != mGains.end(); ++it) {
+        it.value().remove(name);
+    }
+    publishParams();
+
+    // The ports can only go once the audio thread has moved to the new block
+    if ( !waitForAudioThread() ) {
+        std::cerr << "HubMixer WARNING: audio thread not running, ports of "
+                  << name.toStdString() << " are left registered" << endl;
+        return;
+    }
+    for (size_t i = 0; i<slot.inPorts.size(); i++) { jack_port_unregister(mClient, slot.inPorts[i]); }
+    for (size_t i = 0; i<slot.outPorts.size(); i++) { jack_port_unregister(mClient, slot.outPorts[i]); }
+    delete slot.state;
+    if (slot.track != NULL) { mRecorder->closeTrack(slot.track); }
+}
+
+
+//*******************************************************************************
+bool HubMixer::setGain(const QString& listener, const QString& source, float gain)
+{
+    QMutexLocker lock(&mControlMutex);
+    if ( !mSlots.contains(listener) || !mSlots.contains(source) ) { return false; }
+    mGains[listener].insert(source, gain);
+    publishParams();
+    return true;
+}
+
+
+//*******************************************************************************
+void HubMixer::setTopN(int n)
+{
+    QMutexLocker lock(&mControlMutex);
+    mTopN = qMax(0, n);
+    publishParams();
+}
+
+
+//*******************************************************************************
+bool HubMixer::setPinned(const QString& source, bool pinned)
+{
+    QMutexLocker lock(&mControlMutex);
+    if ( !mSlots.contains(source) ) { return false; }
+    mPinned.removeAll(source);
+    if (pinned) { mPinned.append(source); }
+    publishParams();
+    return true;
+}
+
+
+//*******************************************************************************
+float HubMixer::getGain(const QString& listener, const QString& source) const
+{
+    // Default mix: every other client at unity gain, not self
+    float def = (listener == source) ? 0.0 : 1.0;
+    return mGains.value(listener).value(source, def);
+}
+
+
+//*******************************************************************************
+bool HubMixer::waitForAudioThread()
+{
+    // The audio thread picks up the published block at the start of each
+    // period, wait for a few periods at most
+    for (int i = 0; i<1000; i++) {
+        if ( mReading.load() == mFront.load() ) { return true; }
+        QThread::msleep(1);
+    }
+    return false;
+}
+
+
+//*******************************************************************************
+void HubMixer::publishParams()
+{
+    // The back block is only free once the audio thread reads the front one
+    if ( !waitForAudioThread() ) {
+        std::cerr << "HubMixer WARNING: audio thread not running, "
+                  << "updating the mixer anyway" << endl;
+    }
+    int back = 1 - mFront.load();
+    MixerParams& p = mParams[back];
+
+    int numSlots = mClientNames.size();
+    p.clients.resize(numSlots);
+    p.terms.resize(numSlots);
+    p.inOffset.resize(numSlots);
+    int numInBuffers = 0;
+    size_t maxOutBuffers = 0;
+    for (int s = 0; s<numSlots; s++) {
+        p.clients[s] = mSlots.value(mClientNames[s]);
+        p.inOffset[s] = numInBuffers;
+        numInBuffers += p.clients[s].inPorts.size();
+        maxOutBuffers = std::max(maxOutBuffers, p.clients[s].outPorts.size());
+    }
+    p.inBuffers.resize(numInBuffers);
+    p.outBuffers.resize(maxOutBuffers);
+
+    // Top-N selection, the scratch vectors are sized here so that the audio
+    // thread never allocates
+    p.topN = mTopN;
+    p.pinned.resize(numSlots);
+    p.presenceFrom.resize(numSlots);
+    p.presenceTo.resize(numSlots);
+    p.ranking.resize(numSlots);
+    for (int s = 0; s<numSlots; s++) {
+        p.pinned[s] = mPinned.contains(mClientNames[s]);
+        p.presenceFrom[s] = 1.0;
+        p.presenceTo[s] = 1.0;
+    }
+
+    // Keep only the non-zero terms, silent sources cost nothing in the callback
+    for (int d = 0; d<numSlots; d++) {
+        p.terms[d].clear();
+        for (int s = 0; s<numSlots; s++) {
+            float gain = getGain(mClientNames[d], mClientNames[s]);
+            if (gain != 0.0) {
+                MixerTerm term = { s, gain };
+                p.terms[d].push_back(term);
+            }
+        }
+    }
+
+    mFront.store(back);
+}
+
+
+//*******************************************************************************
+int HubMixer::wrapperProcessCallback(jack_nframes_t nframes, void *arg)
+{
+    return static_cast<HubMixer*>(arg)->processCallback(nframes);
+}
+
+
+//*******************************************************************************
+int HubMixer::processCallback(jack_nframes_t nframes)
+{
+    int64_t start_ns = (mCallbackLoad != NULL) ? getMonotonicNs() : 0;
+    int current = mFront.load();
+    mReading.store(current);
+    MixerParams& p = mParams[current];
+
+    int numSlots = p.clients.size();
+    for (int s = 0; s<numSlots; s++) {
+        const MixerSlot& slot = p.clients[s];
+        for (size_t l = 0; l<slot.inPorts.size(); l++) {
+            sample_t* in = (sample_t*) jack_port_get_buffer(slot.inPorts[l], nframes);
+            // Channels silenced by DTX (or just silent) are left out of every mix
+            p.inBuffers[p.inOffset[s] + l] =
+                    isZeroBlock(in, sizeof(sample_t) * nframes) ? NULL : in;
+        }
+    }
+
+    selectSources(p, nframes);
+
+    for (int d = 0; d<numSlots; d++) {
+        const MixerSlot& slot = p.clients[d];
+        const std::vector<MixerTerm>& terms = p.terms[d];
+        for (size_t l = 0; l<slot.outPorts.size(); l++) {
+            sample_t* out = (sample_t*) jack_port_get_buffer(slot.outPorts[l], nframes);
+            p.outBuffers[l] = out;
+            bool first = true;
+            for (size_t t = 0; t<terms.size(); t++) {
+                int s = terms[t].source;
+                if ( l >= p.clients[s].inPorts.size() ) { continue; }
+                const sample_t* in = p.inBuffers[p.inOffset[s] + l];
+                if (in == NULL) { continue; }
+                float gain0 = terms[t].gain * p.presenceFrom[s];
+                float gain1 = terms[t].gain * p.presenceTo[s];
+                if (gain0 == gain1) {
+                    if (gain1 == 0.0) { continue; } // out of the top N
+                    if (first) { mixScale(out, in, gain1, nframes); }
+                    else { mixAccumulate(out, in, gain1, nframes); }
+                }
+                else {
+                    if (first) { mixScaleRamp(out, in, gain0, gain1, nframes); }
+                    else { mixAccumulateRamp(out, in, gain0, gain1, nframes); }
+                }
+                first = false;
+            }
+            if (first) { std::memset(out, 0, sizeof(sample_t) * nframes); }
+        }
+        if (slot.track != NULL) { slot.track->push(p.outBuffers.data(), nframes); }
+    }
+
+    if (mCallbackLoad != NULL) {
+        if (mCallbackLoad->periodNs.load() == 0) {
+            mCallbackLoad->periodNs = static_cast<uint32_t>(
+                        1e9 * nframes / jack_get_sample_rate(mClient));
+        }
+        updateLoadNs(mCallbackLoad->callbackNs, getMonotonicNs() - start_ns);
+    }
+    return 0;
+}
+
+
+//*******************************************************************************
+void HubMixer::selectSources(MixerParams& p, jack_nframes_t nframes)
+{
+    float block_ms = 1000.0 * nframes / jack_get_sample_rate(mClient);
+    float decay = std::exp(-block_ms / gHubMixerEnergyMs);
+    float fade_step = std::min(1.0f, block_ms / gHubMixerFadeMs);
+    int numSlots = p.clients.size();
+
+    // Without top-N every source goes in, the ones left out fade in as well
+    if (p.topN == 0) {
+        for (int s = 0; s<numSlots; s++) { p.presenceTo[s] = 1.0; }
+        fadeSources(p, fade_step);
+        return;
+    }
+
+    // Short-term energy of each source, the silent channels don't count
+    int numRanked = 0;
+    for (int s = 0; s<numSlots; s++) {
+        const MixerSlot& slot = p.clients[s];
+        int numIn = slot.inPorts.size();
+        if (numIn == 0) { continue; }
+        float energy = 0.0;
+        for (int l = 0; l<numIn; l++) {
+            const sample_t* in = p.inBuffers[p.inOffset[s] + l];
+            if (in != NULL) { energy += sumSquares(in, nframes); }
+        }
+        energy /= numIn * nframes;
+        SourceState* state = slot.state;
+        state->energy = decay * state->energy + (1.0 - decay) * energy;
+        if ( !p.pinned[s] ) {
+            float bias = (state->presence > 0.0) ? gHubMixerSelectionBias : 1.0;
+            p.ranking[numRanked++] = std::make_pair(state->energy * bias, s);
+        }
+    }
+
+    // Loudest first, only the top N need to be in order
+    int numSelected = std::min(p.topN, numRanked);
+    std::nth_element(p.ranking.begin(), p.ranking.begin() + numSelected,
+                     p.ranking.begin() + numRanked,
+                     std::greater<std::pair<float, int> >());
+
+    for (int s = 0; s<numSlots; s++) {
+        p.presenceTo[s] = p.pinned[s] ? 1.0 : 0.0;
+    }
+    for (int r = 0; r<numSelected; r++) {
+        if (p.ranking[r].first > 0.0) { p.presenceTo[p.ranking[r].second] = 1.0; }
+    }
+    fadeSources(p, fade_step);
+}
+
+
+//*******************************************************************************
+void HubMixer::fadeSources(MixerParams& p, float fade_step)
+{
+    // Crossfade towards the new selection
+    int numSlots = p.clients.size();
+    for (int s = 0; s<numSlots; s++) {
+        SourceState* state = p.clients[s].state;
+        p.presenceFrom[s] = state->presence;
+        if (p.presenceTo[s] > state->presence) {
+            state->presence = std::min(p.presenceTo[s], state->presence + fade_step);
+        }
+        else {
+            state->presence = std::max(p.presenceTo[s], state->presence - fade_step);
+        }
+        p.presenceTo[s] = state->presence;
+    }
+}
+
+
+//*******************************************************************************
+void HubMixer::handleCommand(const QString& command, QString& reply)
+{
+    QStringList args = command.trimmed().split(" ", QString::SkipEmptyParts);
+    if ( args.size() == 4 && args[0] == "gain" ) {
+        bool ok;
+        float gain = args[3].toFloat(&ok);
+        if ( ok && setGain(args[1], args[2], gain) ) { reply = "OK"; }
+        else { reply = "ERROR: unknown client or bad gain"; }
+    }
+    else if ( args.size() == 2 && args[0] == "topn" ) {
+        bool ok;
+        int n = args[1].toInt(&ok);
+        if ( ok && n >= 0 ) { setTopN(n); reply = "OK"; }
+        else { reply = "ERROR: bad number of sources"; }
+    }
+    else if ( args.size() == 3 && args[0] == "pin" ) {
+        if ( setPinned(args[1], args[2] != "0") ) { reply = "OK"; }
+        else { reply = "ERROR: unknown client"; }
+    }
+    else {
+        reply = "ERROR: usage: gain <listener> <source> <gain> | topn <N> | pin <source> <0|1>";
+    }
+}
+
+
+//*******************************************************************************
+void HubMixer::run()
+{
+    QUdpSocket socket;
+    // The commands aren't authenticated, only the hub host sends them unless
+    // the operator opens the port (--hubremotecontrol)
+    if ( !socket.bind(mRemoteControl ? QHostAddress::Any : QHostAddress::LocalHost,
+                      mControlPort) ) {
+        std::cerr << "HubMixer ERROR: could not bind control port "
+                  << mControlPort << endl;
+        return;
+    }
+
+    char buf[512];
+    while ( !mStopped ) {
+        if ( !socket.waitForReadyRead(100) ) { continue; }
+        while ( socket.hasPendingDatagrams() ) {
+            QHostAddress sender;
+            quint16 senderPort;
+            qint64 size = socket.readDatagram(buf, sizeof(buf) - 1, &sender, &senderPort);
+            if (size <= 0) { continue; }
+            buf[size] = '\0';
+            QString reply;
+            handleCommand(QString(buf), reply);
+            if (gVerboseFlag) cout << "HubMixer: " << buf << " -> " << reply.toStdString() << endl;
+            QByteArray r = reply.toLatin1();
+            socket.writeDatagram(r.constData(), r.size(), sender, senderPort);
+        }
+    }
+}
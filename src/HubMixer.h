@@ -0,0 +1,199 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+/**
+ * \file HubMixer.h
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#ifndef __HUBMIXER_H__
+#define __HUBMIXER_H__
+
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <jack/jack.h>
+
+#include <QThread>
+#include <QMutex>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+#include "jacktrip_types.h"
+#include "jacktrip_globals.h"
+
+class Recorder;
+class RecorderTrack;
+
+
+/** \brief Per-listener monitor mixer for the hub server (hubpatch CUSTOMMIX).
+ *
+ * Each hub client is a slot of the mixer, with one input port per channel
+ * received from the client and one output port per channel sent back to it.
+ * Every listener gets its own mix of all the sources, set by a
+ * listener x source gain matrix that can be changed at runtime.
+ *
+ * The JACK process callback never locks. It reads a parameter block (ports and
+ * the non-zero gain terms of each mix) that the control side rebuilds in a
+ * second block and publishes with a single atomic store, so the gain update
+ * rate has no effect on the audio thread.
+ *
+ * The thread itself runs the control loop: UDP datagrams on the control port
+ * with text commands
+ * \code
+ * gain <listener> <source> <gain>
+ * topn <N>
+ * pin <source> <0|1>
+ * \endcode
+ * where listener and source are hub client names (as in the JACK graph).
+ *
+ * For very large sessions the mixer can run in top-N mode: each block the
+ * sources are ranked by short-term energy and only the N loudest, plus the
+ * pinned ones (e.g., the conductor), go into the mixes. Sources fade in and
+ * out over gHubMixerFadeMs, and the ones already in the mix are favoured in the
+ * ranking so that two similar sources don't take turns every block. The mixing
+ * cost is then O(N x listeners), whatever the size of the session.
+ */
+class HubMixer : public QThread
+{
+    Q_OBJECT;
+
+public:
+    HubMixer(int control_port = gHubMixerControlPort);
+    virtual ~HubMixer();
+
+    /// \brief Opens and activates the mixer JACK client
+    /// \exception std::runtime_error Can't open or activate the JACK client
+    void setup();
+
+    /// \brief Implements the Thread Loop (control commands). To start the thread,
+    /// call start() ( DO NOT CALL run() )
+    void run();
+    /// \brief Stops the control loop and waits for it
+    void stop();
+
+    /// \brief Adds a client slot with numIn channels from and numOut channels to
+    /// the client. Listeners hear every other client at unity gain by default.
+    bool addClient(const QString& name, int numIn, int numOut);
+    /// \brief Removes a client slot, its ports are unregistered once the audio
+    /// thread does not use them anymore
+    void removeClient(const QString& name);
+    /// \brief Sets the gain of source in the mix of listener
+    bool setGain(const QString& listener, const QString& source, float gain);
+    /// \brief Mixes only the n loudest sources (plus the pinned ones), 0 = all
+    void setTopN(int n);
+    /// \brief Keeps source in the mixes in top-N mode, whatever its level
+    bool setPinned(const QString& source, bool pinned);
+    /// \brief Records the mix of each listener, set before the clients are added
+    void setRecorder(Recorder* recorder) { mRecorder = recorder; }
+    /// \brief Measures the cost of the mixing into load, set before start()
+    void setCallbackLoad(CallbackLoad* load) { mCallbackLoad = load; }
+    /// \brief Takes the control commands from other hosts, set before start()
+    /// (default: from the hub host only)
+    void setRemoteControl(bool remote) { mRemoteControl = remote; }
+
+    /// \brief Full JACK name of a mixer port, input = true for the ports fed by
+    /// the client, chan is 1-based
+    QString getPortName(const QString& name, int chan, bool input) const;
+
+private:
+    /// Top-N state of a source, written by the audio thread only
+    typedef struct {
+        float energy; ///< Short-term energy (mean square)
+        float presence; ///< Crossfade gain of the source in the mixes, 0 = out
+    } SourceState;
+
+    typedef struct {
+        std::vector<jack_port_t*> inPorts; ///< Audio from the client
+        std::vector<jack_port_t*> outPorts; ///< Mix sent to the client
+        SourceState* state; ///< Shared by the copies of the slot
+        RecorderTrack* track; ///< Recording of the mix sent to the client, or NULL
+    } MixerSlot;
+
+    typedef struct {
+        int source; ///< Source slot index
+        float gain;
+    } MixerTerm;
+
+    /// Parameter block read by the audio thread. std::vector is used to avoid
+    /// implicit sharing on the audio thread.
+    typedef struct {
+        std::vector<MixerSlot> clients;
+        std::vector<std::vector<MixerTerm> > terms; ///< Non-zero terms of each mix
+        std::vector<int> inOffset; ///< First inBuffers index of each slot
+        std::vector<sample_t*> inBuffers; ///< Scratch, used by the audio thread only
+        std::vector<sample_t*> outBuffers; ///< Scratch, mix of one listener to record
+        int topN; ///< Number of sources mixed, 0 = all
+        std::vector<char> pinned; ///< Sources always mixed in top-N mode
+        std::vector<float> presenceFrom; ///< Scratch, crossfade gain at block start
+        std::vector<float> presenceTo; ///< Scratch, crossfade gain at block end
+        std::vector<std::pair<float, int> > ranking; ///< Scratch, energy and source
+    } MixerParams;
+
+    /// \brief Rebuilds the back parameter block from the slots and the gains and
+    /// publishes it. Must be called with mControlMutex locked.
+    void publishParams();
+    /// \brief Waits until the audio thread uses the published parameter block
+    bool waitForAudioThread();
+    float getGain(const QString& listener, const QString& source) const;
+    void handleCommand(const QString& command, QString& reply);
+    /// \brief Updates the energy of the sources, picks the top N (all of them with
+    /// topN 0) and advances the crossfades (audio thread)
+    void selectSources(MixerParams& p, jack_nframes_t nframes);
+    /// \brief Moves the presence of the sources towards p.presenceTo by fade_step,
+    /// and leaves the gains of the block in presenceFrom and presenceTo
+    void fadeSources(MixerParams& p, float fade_step);
+
+    static int wrapperProcessCallback(jack_nframes_t nframes, void *arg);
+    int processCallback(jack_nframes_t nframes);
+
+    jack_client_t* mClient;
+    int mControlPort;
+    bool mRemoteControl; ///< The control port listens on all the interfaces
+    volatile bool mStopped;
+
+    QMutex mControlMutex; ///< Serializes the control side, never taken by the audio thread
+    QStringList mClientNames; ///< Slot order
+    QHash<QString, MixerSlot> mSlots;
+    QHash<QString, QHash<QString, float> > mGains; ///< listener -> source -> gain
+    int mTopN; ///< Number of sources mixed, 0 = all
+    QStringList mPinned; ///< Sources always mixed in top-N mode
+    Recorder* mRecorder; ///< Session recorder, or NULL
+    CallbackLoad* mCallbackLoad; ///< Cost of processCallback(), or NULL
+
+    MixerParams mParams[2];
+    std::atomic<int> mFront; ///< Published parameter block
+    std::atomic<int> mReading; ///< Parameter block in use by the audio thread
+};
+
+#endif //__HUBMIXER_H__
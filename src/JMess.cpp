@@ -33,8 +33,11 @@
 #include "JMess.h"
 #include "JackTrip.h"
 #include "jacktrip_globals.h"
+#include "HubMixer.h"
 #include <QDebug>
 
+#include <cerrno>
+
 
 //-------------------------------------------------------------------------------
 /*! \brief Constructs a JMess object that has a jack client.
@@ -261,6 +264,218 @@ void JMess::connectSpawnedPorts(int nChans, int hubPatch)
     free(ports);
 }
 
+//*******************************************************************************
+void JMess::scanSpawnedPorts(QHash<QString, int>& endpoints, const char* portPrefix,
+                             unsigned long flags)
+{
+    endpoints.clear();
+    // Client ports (e.g. "171.64.197.121:receive_1") and trunk slot ports
+    // (e.g. "171.64.197.122:s3_receive_1")
+    QString pattern = QString(":(s[0-9]+_)?") + portPrefix + "[0-9]+$";
+    const char **ports = jack_get_ports (mClient, pattern.toLatin1(), NULL, flags);
+    if (ports == NULL) { return; }
+
+    for (unsigned int i = 0; ports[i]; ++i) {
+        QString str = QString(ports[i]);
+        if (str.section(':', 0, 0).contains(QString("system"))) { continue; }
+        QString name = getEndpoint(str);
+        int chan = str.section('_', -1, -1).toInt();
+        if (chan > endpoints.value(name, 0)) { endpoints.insert(name, chan); }
+    }
+    free(ports);
+}
+
+//*******************************************************************************
+QString JMess::getEndpoint(const QString& port)
+{
+    int i = port.lastIndexOf("receive_");
+    if (i < 0) { i = port.lastIndexOf("send_"); }
+    return (i < 0) ? QString() : port.left(i);
+}
+
+//*******************************************************************************
+QString JMess::getMixerName(const QString& endpoint)
+{
+    // "171.64.197.121:" -> "171.64.197.121", "171.64.197.122:s3_" -> "171.64.197.122/s3"
+    QString name = endpoint;
+    while (name.endsWith(":") || name.endsWith("_")) { name.chop(1); }
+    return name.replace(":", "/");
+}
+
+//*******************************************************************************
+int JMess::updateSpawnedPorts(int hubPatch, HubMixer* mixer)
+// called from PatchManager::run
+{
+    QHash<QString, int> receivePorts; // hub outputs, audio coming from each endpoint
+    QHash<QString, int> sendPorts; // hub inputs, audio going to each endpoint
+    scanSpawnedPorts(receivePorts, "receive_", JackPortIsOutput);
+    scanSpawnedPorts(sendPorts, "send_", JackPortIsInput);
+
+    // Endpoints that left (or re-registered with a different port count) and
+    // endpoints that joined since the last call
+    QSet<QString> removed;
+    QList<QString> added;
+    QList<QString> known = mSpawnedReceivePorts.keys();
+    for (int n = 0; n<known.size(); n++) {
+        const QString& endpoint = known[n];
+        if ( receivePorts.value(endpoint, -1) != mSpawnedReceivePorts.value(endpoint) ||
+             sendPorts.value(endpoint, -1) != mSpawnedSendPorts.value(endpoint) ) {
+            removed.insert(endpoint);
+        }
+    }
+    QList<QString> current = receivePorts.keys();
+    for (int n = 0; n<current.size(); n++) {
+        const QString& endpoint = current[n];
+        if ( !sendPorts.contains(endpoint) ) { continue; } // not fully registered yet
+        if ( removed.contains(endpoint) || !mSpawnedReceivePorts.contains(endpoint) ) {
+            added.append(endpoint);
+        }
+    }
+
+    int changes = 0;
+
+    // Drop the connections of the endpoints that left. Usually JACK already removed
+    // them together with the client ports, so in that case they are only forgotten.
+    if ( !removed.isEmpty() ) {
+        QSet<QPair<QString, QString> >::iterator it = mSpawnedConnections.begin();
+        while (it != mSpawnedConnections.end()) {
+            if ( !removed.contains(getEndpoint(it->first)) &&
+                 !removed.contains(getEndpoint(it->second)) ) {
+                ++it;
+                continue;
+            }
+            QByteArray out = it->first.toLatin1();
+            QByteArray in = it->second.toLatin1();
+            if ( jack_port_by_name(mClient, out) != NULL &&
+                 jack_port_by_name(mClient, in) != NULL ) {
+                if (jack_disconnect(mClient, out, in)) {
+                    cerr << "WARNING: port: " << out.constData()
+                         << "and port: " << in.constData()
+                         << " could not be disconnected.\n";
+                }
+                changes++;
+            }
+            it = mSpawnedConnections.erase(it);
+        }
+        known = removed.values();
+        for (int n = 0; n<known.size(); n++) {
+            mSpawnedReceivePorts.remove(known[n]);
+            mSpawnedSendPorts.remove(known[n]);
+            mTrunkSlots.remove(known[n]);
+            QList<QString> fed = mTrunkSlots.keys(known[n]); // trunk slot went away
+            for (int m = 0; m<fed.size(); m++) { mTrunkSlots.remove(fed[m]); }
+            if (mixer != NULL) { mixer->removeClient(getMixerName(known[n])); }
+        }
+    }
+
+    for (int n = 0; n<added.size(); n++) {
+        mSpawnedReceivePorts.insert(added[n], receivePorts.value(added[n]));
+        mSpawnedSendPorts.insert(added[n], sendPorts.value(added[n]));
+    }
+
+    // Local clients go out on their own trunk slot, whatever the patch mode
+    changes += assignTrunkSlots();
+
+    // Each endpoint only talks to its own mixer slot, the mixes are done there.
+    // Remote participants (trunk slots) are sources only.
+    if ( hubPatch == JackTrip::CUSTOMMIX ) {
+        if (mixer == NULL) { return changes; }
+        for (int n = 0; n<added.size(); n++) {
+            const QString& endpoint = added[n];
+            QString name = getMixerName(endpoint);
+            int numIn = receivePorts.value(endpoint);
+            int numOut = isTrunkEndpoint(endpoint) ? 0 : sendPorts.value(endpoint);
+            if ( !mixer->addClient(name, numIn, numOut) ) { continue; }
+            for (int l = 1; l<=numIn; l++) { // chans are 1-based
+                changes += connectAndTrack(endpoint + "receive_" + QString::number(l),
+                                           mixer->getPortName(name, l, true));
+            }
+            for (int l = 1; l<=numOut; l++) {
+                changes += connectAndTrack(mixer->getPortName(name, l, false),
+                                           endpoint + "send_" + QString::number(l));
+            }
+        }
+        return changes;
+    }
+
+    // Connect the new endpoints to everybody (themselves included) and everybody
+    // else to the new endpoints, the rest of the matrix is already in place
+    known = mSpawnedReceivePorts.keys();
+    for (int n = 0; n<added.size(); n++) {
+        for (int m = 0; m<known.size(); m++) {
+            changes += connectSpawnedPair(added[n], known[m], hubPatch);
+            if ( !added.contains(known[m]) ) {
+                changes += connectSpawnedPair(known[m], added[n], hubPatch);
+            }
+        }
+    }
+
+    return changes;
+}
+
+//*******************************************************************************
+int JMess::connectSpawnedPair(const QString& from, const QString& to, int hubPatch)
+{
+    // Trunk slots only carry the local client assigned to them (assignTrunkSlots)
+    if ( isTrunkEndpoint(to) ) { return 0; }
+
+    // FULLMIX is the union of CLIENTFOFI, CLIENTECHO
+    bool echo = (from == to);
+    if ( hubPatch == JackTrip::CLIENTECHO ) { if (!echo) return 0; }
+    else if ( hubPatch == JackTrip::CLIENTFOFI ) { if (echo) return 0; }
+    else if ( hubPatch != JackTrip::FULLMIX ) { return 0; }
+
+    int changes = 0;
+    int nChans = qMin(mSpawnedReceivePorts.value(from), mSpawnedSendPorts.value(to));
+    for (int l = 1; l<=nChans; l++) { // chans are 1-based
+        changes += connectAndTrack(from + "receive_" + QString::number(l),
+                                   to + "send_" + QString::number(l));
+    }
+    return changes;
+}
+
+//*******************************************************************************
+int JMess::assignTrunkSlots()
+{
+    QList<QString> endpoints = mSpawnedSendPorts.keys();
+    QList<QString> freeSlots;
+    for (int n = 0; n<endpoints.size(); n++) {
+        if ( isTrunkEndpoint(endpoints[n]) && mTrunkSlots.keys(endpoints[n]).isEmpty() ) {
+            freeSlots.append(endpoints[n]);
+        }
+    }
+
+    int changes = 0;
+    for (int n = 0; n<endpoints.size() && !freeSlots.isEmpty(); n++) {
+        const QString& client = endpoints[n];
+        if ( isTrunkEndpoint(client) || mTrunkSlots.contains(client) ) { continue; }
+        QString slot = freeSlots.takeFirst();
+        mTrunkSlots.insert(client, slot);
+        int nChans = qMin(mSpawnedReceivePorts.value(client), mSpawnedSendPorts.value(slot));
+        for (int l = 1; l<=nChans; l++) { // chans are 1-based
+            changes += connectAndTrack(client + "receive_" + QString::number(l),
+                                       slot + "send_" + QString::number(l));
+        }
+    }
+    return changes;
+}
+
+//*******************************************************************************
+int JMess::connectAndTrack(const QString& left, const QString& right)
+{
+    QPair<QString, QString> connection(left, right);
+    if ( mSpawnedConnections.contains(connection) ) { return 0; }
+    int rv = jack_connect(mClient, left.toLatin1(), right.toLatin1());
+    if ( rv != 0 && rv != EEXIST ) {
+        qDebug() << "WARNING: port: " << left
+                 << "and port: " << right
+                 << " could not be connected.";
+        return 0;
+    }
+    mSpawnedConnections.insert(connection);
+    return 1;
+}
+
 //*******************************************************************************
 // connectTUB is called when in hubpatch mode 4 = RESERVEDMATRIX
 // TU Berlin Raspberry Pi ensemble, Winter 2019
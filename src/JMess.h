@@ -40,6 +40,9 @@
 #include <QIODevice>
 #include <QString>
 #include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QPair>
 //#include <QtXml>
 //#include <QXmlSimpleReader>
 //#include <QXmlInputSource>
@@ -47,6 +50,8 @@
 
 #include <jack/jack.h>
 
+class HubMixer;
+
 using namespace std;
 
 const int Indent = 2;
@@ -73,9 +78,41 @@ public:
   /// \brief Cross connect ports between net combs, -l LAIR mode
   void connectSpawnedPorts(int nChans, int hubPatch);
   void connectTUB(int nChans);
+  /** \brief Incrementally patch the spawned hub clients.
+   *
+   * Keeps the hub patch graph in memory between calls and only issues the
+   * jack_connect / jack_disconnect calls for clients that joined or left since
+   * the previous call. Connections not made by this method are never touched.
+   * In CUSTOMMIX mode the clients are connected to their slot of mixer instead.
+   * \return Number of connections made or removed
+   */
+  int updateSpawnedPorts(int hubPatch, HubMixer* mixer = NULL);
 
 private:
   int parseXML(QString xmlInFile);
+  /** \brief Fills endpoints with the spawned hub endpoints and their number of
+   * ports named like portPrefix (e.g., "receive_"), excluding the system ports.
+   *
+   * An endpoint is the port name without the "receive_N" or "send_N" suffix:
+   * "client:" for a hub client, "client:sK_" for slot K of a hub trunk link.
+   */
+  void scanSpawnedPorts(QHash<QString, int>& endpoints, const char* portPrefix,
+                        unsigned long flags);
+  /// \brief Endpoint of a spawned port name, empty if it is not one
+  static QString getEndpoint(const QString& port);
+  /// \brief Name of an endpoint in the HubMixer (no ':' in JACK port names)
+  static QString getMixerName(const QString& endpoint);
+  /// \brief Trunk slot endpoints carry one remote participant each way
+  static bool isTrunkEndpoint(const QString& endpoint) { return !endpoint.endsWith(":"); }
+  /// \brief Connects endpoint from to endpoint to according to hubPatch, skipping
+  /// the connections already made. Returns the number of new connections.
+  int connectSpawnedPair(const QString& from, const QString& to, int hubPatch);
+  /// \brief Gives each local client without one a free trunk slot and connects
+  /// it. Returns the number of new connections.
+  int assignTrunkSlots();
+  /// \brief Connects the ports of a pair if not already connected, returns 1 if
+  /// a new connection is made
+  int connectAndTrack(const QString& left, const QString& right);
 
   jack_client_t *mClient; //Class client
   jack_status_t mStatus; //Class client status
@@ -87,5 +124,13 @@ private:
   //OuputPortN InputPortN
   QVector<QVector<QString> > mConnectedPorts;
   QVector<QVector<QString> > mPortsToConnect;
+
+  /// Endpoints known to updateSpawnedPorts(), endpoint -> receive/send port count
+  QHash<QString, int> mSpawnedReceivePorts;
+  QHash<QString, int> mSpawnedSendPorts;
+  /// Connections made by updateSpawnedPorts(), (output port, input port)
+  QSet<QPair<QString, QString> > mSpawnedConnections;
+  /// Local client endpoint -> trunk slot endpoint carrying it to the peer hub
+  QHash<QString, QString> mTrunkSlots;
 };
 #endif
@@ -81,6 +81,7 @@ JackAudioInterface::JackAudioInterface(JackTrip* jacktrip,
     mBitResolutionMode(AudioBitResolution),
     mClient(NULL),
     mClientName(ClientName),
+    mPortGroupSize(0),
     mJackTrip(jacktrip)
 {}
 
@@ -163,7 +164,7 @@ void JackAudioInterface::createChannels()
     for (int i = 0; i < mNumInChans; i++)
     {
         QString inName;
-        QTextStream (&inName) << "send_" << i+1;
+        QTextStream (&inName) << getPortGroupPrefix(i) << "send_" << getPortGroupChannel(i);
         mInPorts[i] = jack_port_register (mClient, inName.toLatin1(),
                                           JACK_DEFAULT_AUDIO_TYPE,
                                           JackPortIsInput, 0);
@@ -171,10 +172,10 @@ void JackAudioInterface::createChannels()
 
     //Create Output Ports
     mOutPorts.resize(mNumOutChans);
-    for (int i = 0; i < mNumInChans; i++)
+    for (int i = 0; i < mNumOutChans; i++)
     {
         QString outName;
-        QTextStream (&outName) << "receive_" << i+1;
+        QTextStream (&outName) << getPortGroupPrefix(i) << "receive_" << getPortGroupChannel(i);
         mOutPorts[i] = jack_port_register (mClient, outName.toLatin1(),
                                            JACK_DEFAULT_AUDIO_TYPE,
                                            JackPortIsOutput, 0);
@@ -182,6 +183,22 @@ void JackAudioInterface::createChannels()
 }
 
 
+//*******************************************************************************
+QString JackAudioInterface::getPortGroupPrefix(int chan) const
+{
+    if (mPortGroupSize <= 0) { return QString(); }
+    return QString("s") + QString::number(chan/mPortGroupSize + 1) + "_";
+}
+
+
+//*******************************************************************************
+int JackAudioInterface::getPortGroupChannel(int chan) const
+{
+    if (mPortGroupSize <= 0) { return chan + 1; }
+    return chan%mPortGroupSize + 1;
+}
+
+
 //*******************************************************************************
 uint32_t JackAudioInterface::getSampleRate() const
 {
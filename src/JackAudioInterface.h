@@ -100,6 +100,12 @@ public:
     /// \brief Set Client Name to something different that the default (JackTrip)
     virtual void setClientName(const char* ClientName)
     { mClientName = ClientName; }
+    /** \brief Split the channels in groups of groupSize, named
+   * "s<group>_send_<chan>" and "s<group>_receive_<chan>" (0 = no groups).
+   * Must be called before setup()
+   */
+    void setPortGroupSize(int groupSize)
+    { mPortGroupSize = groupSize; }
     virtual void setSampleRate(uint32_t /*sample_rate*/)
     { std::cout << "WARNING: Setting the Sample Rate in Jack mode has no effect." << std::endl; }
     virtual void setBufferSizeInSamples(uint32_t /*buf_size*/)
@@ -131,6 +137,10 @@ private:
     void setupClient();
     /// \brief Creates input and output channels in the Jack client
     void createChannels();
+    /// \brief Port name prefix of channel chan (0-based), empty without port groups
+    QString getPortGroupPrefix(int chan) const;
+    /// \brief Port number of channel chan (0-based) inside its port group
+    int getPortGroupChannel(int chan) const;
     /** \brief JACK calls this shutdown_callback if the server ever shuts down or
    * decides to disconnect the client.
    */
@@ -175,6 +185,7 @@ private:
 
     jack_client_t* mClient; ///< Jack Client
     const char* mClientName; ///< Jack Client Name
+    int mPortGroupSize; ///< Channels per port group, 0 for plain port names
     QVarLengthArray<jack_port_t*> mInPorts; ///< Vector of Input Ports (Channels)
     QVarLengthArray<jack_port_t*> mOutPorts; ///< Vector of Output Ports (Channels)
     QVarLengthArray<sample_t*> mInBuffer; ///< Vector of Input buffers/channel read from JACK
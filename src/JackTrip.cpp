@@ -40,12 +40,19 @@
 #include "RingBufferWavetable.h"
 #include "jacktrip_globals.h"
 #include "JackAudioInterface.h"
+#include "Recorder.h"
+#include "PacketCapture.h"
+#include "Reblocker.h"
+#include "Resampler.h"
+#include "ReplayAudioInterface.h"
 #ifdef __RT_AUDIO__
 #include "RtAudioInterface.h"
 #endif
 
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
+#include <algorithm>
 #include <stdexcept>
 
 #include <QHostAddress>
@@ -54,6 +61,7 @@
 #include <QTcpSocket>
 #include <QTimer>
 #include <QDateTime>
+#include <QElapsedTimer>
 
 using std::cout; using std::endl;
 
@@ -84,7 +92,8 @@ JackTrip::JackTrip(jacktripModeT JacktripMode,
     mDataProtocol(DataProtocolType),
     mPacketHeaderType(PacketHeaderType),
     mAudiointerfaceMode(JackTrip::JACK),
-    mNumChans(NumChans),
+    mNumInChans(NumChans),
+    mNumOutChans(NumChans),
     #ifdef WAIR // WAIR
     mNumNetRevChans(NumNetRevChans),
     #endif // endwhere
@@ -112,7 +121,38 @@ JackTrip::JackTrip(jacktripModeT JacktripMode,
     mTcpConnectionError(false),
     mStopped(false),
     mConnectDefaultAudioPorts(true),
-    mIOStatLogStream(std::cout.rdbuf())
+    mIOStatLogStream(std::cout.rdbuf()),
+    mCpuAffinity(-1),
+    mJackPortGroupSize(0),
+    mDtx(false),
+    mAdaptive(false),
+    mSendBitResolution(0),
+    mRequestedBitResolution(0),
+    mRecorder(NULL),
+    mRecorderTrack(NULL),
+    mCapture(NULL),
+    mCallbackLoad(NULL),
+    mSessionToken(0),
+    mUdpOffload(false),
+    mIoUring(false),
+    mBusyPollUsec(0),
+    mDirectSend(false),
+    mPacketFrames(0),
+    mSendReblocker(NULL),
+    mReceiveReblocker(NULL),
+    mSendPacket(NULL),
+    mReceivePeriod(NULL),
+    mNetworkSampleRate(0),
+    mResampleQuality(Resampler::MEDIUM),
+    mMtu(0),
+    mMulticastMode(NOMULTICAST),
+    mEncrypt(false),
+    mEncryptionKeys(false),
+    mSendResampler(NULL),
+    mReceiveResampler(NULL),
+    mSendResampled(NULL),
+    mReceiveResampled(NULL),
+    mResampleNs(0)
 {
     createHeader(mPacketHeaderType);
 }
@@ -124,10 +164,19 @@ JackTrip::~JackTrip()
     wait();
     delete mDataProtocolSender;
     delete mDataProtocolReceiver;
+    delete mCapture; // after the receiver thread is gone
     delete mAudioInterface;
     delete mPacketHeader;
     delete mSendRingBuffer;
     delete mReceiveRingBuffer;
+    delete mSendReblocker;
+    delete mReceiveReblocker;
+    delete[] mSendPacket;
+    delete[] mReceivePeriod;
+    delete mSendResampler;
+    delete mReceiveResampler;
+    delete[] mSendResampled;
+    delete[] mReceiveResampled;
 }
 
 
@@ -150,11 +199,13 @@ void JackTrip::setupAudio(
     if ( mAudiointerfaceMode == JackTrip::JACK ) {
 #ifndef __NO_JACK__
         if (gVerboseFlag) std::cout << "  JackTrip:setupAudio before new JackAudioInterface" << std::endl;
-        mAudioInterface = new JackAudioInterface(this, mNumChans, mNumChans,
-                                         #ifdef WAIR // wair
-                                                 mNumNetRevChans,
-                                         #endif // endwhere
-                                                 mAudioBitResolution);
+        JackAudioInterface* jackAudio = new JackAudioInterface(this, mNumInChans, mNumOutChans,
+                                                       #ifdef WAIR // wair
+                                                               mNumNetRevChans,
+                                                       #endif // endwhere
+                                                               mAudioBitResolution);
+        jackAudio->setPortGroupSize(mJackPortGroupSize);
+        mAudioInterface = jackAudio;
 
 #ifdef WAIRTOMASTER // WAIR
         qDebug() << "mPeerAddress" << mPeerAddress << mPeerAddress.contains(gDOMAIN_TRIPLE);
@@ -178,7 +229,7 @@ void JackTrip::setupAudio(
 #ifdef __NO_JACK__ /// \todo FIX THIS REPETITION OF CODE
 #ifdef __RT_AUDIO__
         cout << "Warning: using non jack version, RtAudio will be used instead" << endl;
-        mAudioInterface = new RtAudioInterface(this, mNumChans, mNumChans, mAudioBitResolution);
+        mAudioInterface = new RtAudioInterface(this, mNumInChans, mNumOutChans, mAudioBitResolution);
         mAudioInterface->setSampleRate(mSampleRate);
         mAudioInterface->setDeviceID(mDeviceID);
         mAudioInterface->setBufferSizeInSamples(mAudioBufferSize);
@@ -188,13 +239,33 @@ void JackTrip::setupAudio(
     }
     else if ( mAudiointerfaceMode == JackTrip::RTAUDIO ) {
 #ifdef __RT_AUDIO__
-        mAudioInterface = new RtAudioInterface(this, mNumChans, mNumChans, mAudioBitResolution);
+        mAudioInterface = new RtAudioInterface(this, mNumInChans, mNumOutChans, mAudioBitResolution);
         mAudioInterface->setSampleRate(mSampleRate);
         mAudioInterface->setDeviceID(mDeviceID);
         mAudioInterface->setBufferSizeInSamples(mAudioBufferSize);
         mAudioInterface->setup();
 #endif
     }
+    else if ( mAudiointerfaceMode == JackTrip::REPLAY ) {
+        mAudioInterface = new ReplayAudioInterface(this, mNumInChans, mNumOutChans,
+                                           #ifdef WAIR // wair
+                                                   mNumNetRevChans,
+                                           #endif // endwhere
+                                                   mAudioBitResolution);
+        mAudioInterface->setSampleRate(mSampleRate);
+        mAudioInterface->setBufferSizeInSamples(mAudioBufferSize);
+        mAudioInterface->setup();
+    }
+
+    if ( mRecorder != NULL && mAudioInterface != NULL ) {
+        mRecorderTrack = mRecorder->openTrack(mRecorderTrackName,
+                                              mAudioInterface->getNumOutputChannels(),
+                                              mSampleRate, mAudioBufferSize);
+        mAudioInterface->setRecorderTrack(mRecorderTrack);
+    }
+    if ( mCallbackLoad != NULL && mAudioInterface != NULL ) {
+        mAudioInterface->setCallbackLoad(mCallbackLoad);
+    }
 
     std::cout << "The Sampling Rate is: " << mSampleRate << std::endl;
     std::cout << gPrintSeparator << std::endl;
@@ -204,6 +275,9 @@ void JackTrip::setupAudio(
               << " bytes" << std::endl;
     std::cout << gPrintSeparator << std::endl;
     cout << "The Number of Channels is: " << mAudioInterface->getNumInputChannels() << endl;
+    if ( mAudioInterface->getNumOutputChannels() != mAudioInterface->getNumInputChannels() ) {
+        cout << "                 Received: " << mAudioInterface->getNumOutputChannels() << endl;
+    }
     std::cout << gPrintSeparator << std::endl;
     cout << "The RTAudio device ID is: " << mAudioInterface->getDeviceID() << endl;
     std::cout << gPrintSeparator << std::endl;
@@ -220,6 +294,12 @@ void JackTrip::closeAudio()
         delete mAudioInterface;
         mAudioInterface = NULL;
     }
+    // The audio thread is gone, the recorder finishes the file
+    if ( mRecorderTrack != NULL ) {
+        mRecorder->closeTrack(mRecorderTrack);
+        mRecorderTrack = NULL;
+    }
+    if ( mCallbackLoad != NULL ) { mCallbackLoad->clear(); }
 }
 
 
@@ -239,6 +319,8 @@ void JackTrip::setupDataProtocol()
         mDataProtocolReceiver =  new UdpDataProtocol(this, DataProtocol::RECEIVER,
                                                      mReceiverBindPort, mReceiverPeerPort,
                                                      mRedundancy);
+        mDataProtocolSender->setCpuAffinity(mCpuAffinity);
+        mDataProtocolReceiver->setCpuAffinity(mCpuAffinity);
         break;
     case TCP:
         throw std::invalid_argument("TCP Protocol is not implemented");
@@ -257,7 +339,31 @@ void JackTrip::setupDataProtocol()
     //mDataProtocolReceiver->setAudioPacketSize
     //  (mAudioInterface->getSizeInBytesPerChannel() * mNumChans);
     mDataProtocolSender->setAudioPacketSize(getTotalAudioPacketSizeInBytes());
-    mDataProtocolReceiver->setAudioPacketSize(getTotalAudioPacketSizeInBytes());
+    mDataProtocolReceiver->setAudioPacketSize(getReceiveAudioPacketSizeInBytes());
+}
+
+
+//*******************************************************************************
+void JackTrip::setupCapture()
+{
+    if ( mCaptureFile.isEmpty() || mDataProtocol != UDP ) { return; }
+    PacketCapture::CaptureHeader header;
+    std::memset(&header, 0, sizeof(header));
+    header.sampleRate = mSampleRate;
+    header.bufferSize = mAudioBufferSize;
+    header.packetFrames = getPacketFrames();
+    header.networkSampleRate = getNetworkSampleRate();
+    header.numChannels = mNumOutChans;
+    header.numSendChannels = mNumInChans;
+    header.bitResolution = mAudioBitResolution;
+    header.headerType = mPacketHeaderType;
+    header.redundancy = mRedundancy;
+    header.dtx = (mDtx ? 1 : 0) | (mAdaptive ? 2 : 0);
+    header.resumable = (mSessionToken != 0);
+    delete mCapture;
+    mCapture = new PacketCapture;
+    mCapture->create(mCaptureFile, header);
+    static_cast<UdpDataProtocol*>(mDataProtocolReceiver)->setCapture(mCapture);
 }
 
 
@@ -268,13 +374,14 @@ void JackTrip::setupRingBuffers()
     /// \todo Make all this operations cleaner
     //int total_audio_packet_size = getTotalAudioPacketSizeInBytes();
     int slot_size = getRingBuffersSlotSize();
+    int packet_slot_size = getTotalAudioPacketSizeInBytes();
 
     switch (mUnderRunMode) {
     case WAVETABLE:
-        mSendRingBuffer = new RingBufferWavetable(slot_size,
+        mSendRingBuffer = new RingBufferWavetable(packet_slot_size,
                                                   gDefaultOutputQueueLength);
         mReceiveRingBuffer = new RingBufferWavetable(slot_size,
-                                                     mBufferQueueLength);
+                                                     getReceiveQueueSlots());
         /*
     mSendRingBuffer = new RingBufferWavetable(mAudioInterface->getSizeInBytesPerChannel() * mNumChans,
                 gDefaultOutputQueueLength);
@@ -284,10 +391,10 @@ void JackTrip::setupRingBuffers()
 
         break;
     case ZEROS:
-        mSendRingBuffer = new RingBuffer(slot_size,
+        mSendRingBuffer = new RingBuffer(packet_slot_size,
                                          gDefaultOutputQueueLength);
         mReceiveRingBuffer = new RingBuffer(slot_size,
-                                            mBufferQueueLength);
+                                            getReceiveQueueSlots());
         /*
     mSendRingBuffer = new RingBuffer(mAudioInterface->getSizeInBytesPerChannel() * mNumChans,
              gDefaultOutputQueueLength);
@@ -299,6 +406,109 @@ void JackTrip::setupRingBuffers()
         throw std::invalid_argument("Underrun Mode undefined");
         break;
     }
+
+    // Network packets of another size than the audio period are regrouped
+    // on each side, a FIFO holds a packet and a period at most. Packets at
+    // another sample rate are converted before that.
+    bool resample = ( getNetworkSampleRate() != static_cast<int>(mSampleRate) );
+    if ( getPacketFrames() != mAudioBufferSize || resample ) {
+        int period_chan_size = getSizeInBytesPerChannel();
+        int send_chans = getTotalAudioPeriodSizeInBytes() / period_chan_size;
+        int receive_chans = slot_size / period_chan_size;
+        int sample_size = period_chan_size / mAudioBufferSize;
+        int send_frames = mAudioBufferSize; // Frames of a period, in the packets
+        int receive_frames = getPacketFrames(); // Frames of a packet, in the periods
+        if (resample) {
+            Resampler::qualityT quality = static_cast<Resampler::qualityT>(mResampleQuality);
+            mSendResampler = new Resampler(send_chans, mAudioBitResolution,
+                                           mSampleRate, getNetworkSampleRate(),
+                                           mAudioBufferSize, quality);
+            mReceiveResampler = new Resampler(receive_chans, mAudioBitResolution,
+                                              getNetworkSampleRate(), mSampleRate,
+                                              getPacketFrames(), quality);
+            send_frames = mSendResampler->getMaxOutFrames();
+            receive_frames = mReceiveResampler->getMaxOutFrames();
+            mSendResampled = new int8_t[send_frames * send_chans * sample_size];
+            mReceiveResampled = new int8_t[receive_frames * receive_chans * sample_size];
+            cout << "Network at " << getNetworkSampleRate() << " Hz, converted from and to "
+                 << mSampleRate << " Hz (" << mSendResampler->getTaps() << " taps)" << endl;
+        }
+        mSendReblocker = new Reblocker(send_chans, sample_size,
+                                       2 * (getPacketFrames() + send_frames));
+        mReceiveReblocker = new Reblocker(receive_chans, sample_size,
+                                          2 * (receive_frames + mAudioBufferSize));
+        mSendPacket = new int8_t[packet_slot_size];
+        mReceivePeriod = new int8_t[slot_size];
+        cout << "Network packets of " << getPacketFrames() << " samples ("
+             << mAudioBufferSize << " per audio period), jitter buffer of "
+             << getReceiveQueueSlots() * mAudioBufferSize << " samples" << endl;
+    }
+}
+
+
+//*******************************************************************************
+int JackTrip::getReceiveQueueSlots() const
+{
+    // Packets shorter than the period are regrouped before the RingBuffer,
+    // longer ones take several slots each
+    int64_t packet_frames = static_cast<int64_t>(getPacketFrames())
+            * mSampleRate / getNetworkSampleRate(); // At the audio rate
+    if ( packet_frames <= mAudioBufferSize ) { return mBufferQueueLength; }
+    int64_t queue_frames = mBufferQueueLength * packet_frames;
+    return (queue_frames + mAudioBufferSize - 1) / mAudioBufferSize;
+}
+
+
+//*******************************************************************************
+void JackTrip::sendNetworkPacket(const int8_t* ptrToSlot)
+{
+    if (mSendResampler != NULL) {
+        int64_t start_ns = getMonotonicNs();
+        int frames = mSendResampler->process(ptrToSlot, mAudioBufferSize, mSendResampled);
+        mResampleNs += getMonotonicNs() - start_ns;
+        mSendReblocker->write(mSendResampled, frames);
+    }
+    else if (mSendReblocker != NULL) {
+        mSendReblocker->write(ptrToSlot, mAudioBufferSize);
+    }
+    if (mSendReblocker != NULL) {
+        while ( mSendReblocker->read(mSendPacket, getPacketFrames()) ) {
+            sendAudioPacket(mSendPacket);
+        }
+        return;
+    }
+    sendAudioPacket(ptrToSlot);
+}
+
+
+//*******************************************************************************
+void JackTrip::sendAudioPacket(const int8_t* audio_packet)
+{
+    // The audio callback sends the packet itself, no sender thread wakeup
+    if ( mDirectSend && mDataProtocolSender->sendDirect(audio_packet) ) { return; }
+    mSendRingBuffer->insertSlotNonBlocking(audio_packet);
+}
+
+
+//*******************************************************************************
+void JackTrip::writeAudioBuffer(const int8_t* ptrToSlot)
+{
+    if (mReceiveResampler != NULL) {
+        int64_t start_ns = getMonotonicNs();
+        int frames = mReceiveResampler->process(ptrToSlot, getPacketFrames(), mReceiveResampled);
+        mResampleNs += getMonotonicNs() - start_ns;
+        mReceiveReblocker->write(mReceiveResampled, frames);
+    }
+    else if (mReceiveReblocker != NULL) {
+        mReceiveReblocker->write(ptrToSlot, getPacketFrames());
+    }
+    if (mReceiveReblocker != NULL) {
+        while ( mReceiveReblocker->read(mReceivePeriod, mAudioBufferSize) ) {
+            mReceiveRingBuffer->insertSlotNonBlocking(mReceivePeriod);
+        }
+        return;
+    }
+    mReceiveRingBuffer->insertSlotNonBlocking(ptrToSlot);
 }
 
 
@@ -341,9 +551,12 @@ void JackTrip::startProcess(
              << mReceiverBindPort<< mSenderBindPort;
     //        msleep(2000);
 #endif
-    checkIfPortIsBinded(mReceiverBindPort);
-    if (gVerboseFlag) std::cout << "  JackTrip:startProcess before checkIfPortIsBinded(mSenderBindPort)" << std::endl;
-    checkIfPortIsBinded(mSenderBindPort);
+    // The multicast listeners of a host share the port of the group
+    if (mMulticastMode != MULTICASTRECEIVE) {
+        checkIfPortIsBinded(mReceiverBindPort);
+        if (gVerboseFlag) std::cout << "  JackTrip:startProcess before checkIfPortIsBinded(mSenderBindPort)" << std::endl;
+        checkIfPortIsBinded(mSenderBindPort);
+    }
     // Set all classes and parameters
     // ------------------------------
     if (gVerboseFlag) std::cout << "  JackTrip:startProcess before setupAudio" << std::endl;
@@ -407,6 +620,9 @@ void JackTrip::startProcess(
         break;
     }
 
+    // After the handshake, the header has its final size
+    setupCapture();
+
     // Have the threads share a single socket that operates at full duplex.
 #if defined (__WIN_32__)
     SOCKET sock_fd = INVALID_SOCKET;
@@ -416,12 +632,13 @@ void JackTrip::startProcess(
     mDataProtocolReceiver->setSocket(sock_fd);
     mDataProtocolSender->setSocket(sock_fd);
 
-    // Start Threads
+    // Start Threads, a multicast sender receives nothing and the listeners
+    // send nothing
     if (gVerboseFlag) std::cout << "  JackTrip:startProcess before mDataProtocolReceiver->start" << std::endl;
-    mDataProtocolReceiver->start();
+    if (mMulticastMode != MULTICASTSEND) { mDataProtocolReceiver->start(); }
     QThread::msleep(1);
     if (gVerboseFlag) std::cout << "  JackTrip:startProcess before mDataProtocolSender->start" << std::endl;
-    mDataProtocolSender->start();
+    if (mMulticastMode != MULTICASTRECEIVE) { mDataProtocolSender->start(); }
     /*
      * changed order so that audio starts after receiver and sender
      * because UdpDataProtocol:run0 before setRealtimeProcessPriority()
@@ -440,6 +657,93 @@ void JackTrip::startProcess(
     if (mConnectDefaultAudioPorts) {  mAudioInterface->connectDefaultPorts(); }
 }
 
+//*******************************************************************************
+void JackTrip::replayCapture(const QString& captureFile)
+{
+    PacketCapture capture;
+    capture.open(captureFile);
+    const PacketCapture::CaptureHeader& header = capture.getHeader();
+    mNumOutChans = header.numChannels;
+    mNumInChans = (header.numSendChannels != 0) ? header.numSendChannels : mNumOutChans;
+    mSampleRate = header.sampleRate;
+    mAudioBufferSize = header.bufferSize;
+    mPacketFrames = header.packetFrames; // 0 in older captures, one period
+    mNetworkSampleRate = header.networkSampleRate; // 0 in older captures, the audio one
+    mAudioBitResolution = static_cast<AudioInterface::audioBitResolutionT>(header.bitResolution);
+    mRedundancy = header.redundancy;
+    mDtx = (header.dtx & 1);
+    mAdaptive = (header.dtx & 2);
+    // The token only sizes the header here, the source is not checked
+    mSessionToken = header.resumable ? 1 : 0;
+    mDataProtocol = UDP;
+    mCaptureFile.clear();
+    setPacketHeaderType(static_cast<DataProtocol::packetHeaderTypeT>(header.headerType));
+    if ( mNumOutChans <= 0 || mSampleRate == 0 || mAudioBufferSize == 0 || mRedundancy == 0 ) {
+        throw std::runtime_error("Invalid stream settings in the capture file");
+    }
+
+    cout << "Replaying " << captureFile.toStdString() << ": " << mNumOutChans << " channels, "
+         << mSampleRate << " Hz, " << mAudioBufferSize << " samples, redundancy "
+         << mRedundancy << (mDtx ? ", DTX" : "") << (mAdaptive ? ", adaptive" : "") << endl;
+    cout << gPrintSeparator << endl;
+
+    mAudiointerfaceMode = REPLAY;
+    setupAudio(
+            #ifdef WAIRTOMASTER // wair
+                0
+            #endif // endwhere
+                );
+    setupDataProtocol();
+    setupRingBuffers();
+    UdpDataProtocol* receiver = static_cast<UdpDataProtocol*>(mDataProtocolReceiver);
+    receiver->setupReplay();
+    ReplayAudioInterface* audio = static_cast<ReplayAudioInterface*>(mAudioInterface);
+
+    // Virtual clock: the datagrams go in at their arrival time, the audio
+    // callback runs every period from the first one
+    const double period_ns = 1e9 * mAudioBufferSize / mSampleRate;
+    QElapsedTimer timer;
+    timer.start();
+    uint64_t num_datagrams = 0;
+    uint64_t num_periods = 0;
+    int64_t time_ns;
+    const int8_t* datagram;
+    int size;
+    bool more = capture.next(time_ns, datagram, size);
+    while (more) {
+        double callback_ns = num_periods * period_ns;
+        while ( more && time_ns <= callback_ns ) {
+            receiver->replayDatagram(datagram, size);
+            num_datagrams++;
+            more = capture.next(time_ns, datagram, size);
+        }
+        // The recorder is the only thing slower than the replay, wait for it
+        while ( mRecorderTrack != NULL && mRecorderTrack->isFull() ) { QThread::msleep(1); }
+        audio->processBlock();
+        num_periods++;
+    }
+    // Play out the jitter buffer
+    for (int i = 0; i < getReceiveQueueSlots(); i++) {
+        while ( mRecorderTrack != NULL && mRecorderTrack->isFull() ) { QThread::msleep(1); }
+        audio->processBlock();
+        num_periods++;
+    }
+
+    DataProtocol::PktStat pkt_stat;
+    receiver->getStats(&pkt_stat);
+    RingBuffer::IOStat recv_io_stat;
+    mReceiveRingBuffer->getStats(&recv_io_stat, false);
+    double audio_sec = num_periods * period_ns / 1e9;
+    cout << "Replayed " << num_datagrams << " datagrams, " << audio_sec << " s of audio in "
+         << timer.elapsed() / 1000.0 << " s" << endl;
+    cout << "recv: " << recv_io_stat.underruns << "/" << recv_io_stat.overflows
+         << " prot: " << pkt_stat.lost << "/" << pkt_stat.outOfOrder << "/" << pkt_stat.revived
+         << " tot: " << pkt_stat.tot << endl;
+    cout << gPrintSeparator << endl;
+    closeAudio();
+}
+
+
 //*******************************************************************************
 void JackTrip::startIOStatTimer(int timeout_sec, const std::ostream& log_stream)
 {
@@ -465,6 +769,10 @@ void JackTrip::onStatTimer()
     if (!mSendRingBuffer->getStats(&send_io_stat, reset)) {
         return;
     }
+    DataProtocol::PktStat send_pkt_stat;
+    if (!mDataProtocolSender->getStats(&send_pkt_stat)) {
+        return;
+    }
     QString now = QDateTime::currentDateTime().toString(Qt::ISODate);
     int32_t skew = recv_io_stat.underruns - recv_io_stat.overflows
                 - pkt_stat.lost + pkt_stat.revived;
@@ -486,7 +794,44 @@ void JackTrip::onStatTimer()
       << " tot: "
       << pkt_stat.tot
       << " skew: " << skew
-      << endl;
+      << " sys: " << pkt_stat.syscalls
+      << "/" << send_pkt_stat.syscalls;
+    if (mDirectSend) {
+        mIOStatLogStream << " direct: " << send_pkt_stat.sendDropped;
+    }
+    if (mBusyPollUsec > 0) {
+        // Percentiles are histogram bucket bounds (powers of 2)
+        mIOStatLogStream << " wake: " << pkt_stat.wakeP50Usec
+          << "/" << pkt_stat.wakeP99Usec
+          << "/" << pkt_stat.wakeMaxUsec << "us"
+          << " spin: " << pkt_stat.spinCaught
+          << "/" << pkt_stat.wakeCount
+          << " " << pkt_stat.spinUsec / 1000 << "ms";
+    }
+    if (mSendResampler != NULL) {
+        // Both directions, since the last stats
+        mIOStatLogStream << " src: " << mResampleNs.exchange(0) / 1000 << "us";
+    }
+    if (mAdaptive) {
+        // Bit resolution of the packets sent, and asked to the peer
+        mIOStatLogStream << " bits: " << static_cast<int>(getSendBitResolution())
+          << "/" << static_cast<int>(getRequestedBitResolution());
+    }
+    QVector<DataProtocol::PathStat> path_stats;
+    if ( mDataProtocolReceiver->getPathStats(path_stats) ) {
+        // Each source of the datagrams (--multipath), since the last stats:
+        // first copies/received/lost, delay of the later copies
+        for (int i = 0; i < path_stats.size(); i++) {
+            const DataProtocol::PathStat& path = path_stats[i];
+            mIOStatLogStream << " path " << path.address.toString().toLocal8Bit().constData()
+              << ": " << path.first
+              << "/" << path.received
+              << "/" << path.lost
+              << " late: " << path.lateMeanUsec
+              << "/" << path.lateMaxUsec << "us";
+        }
+    }
+    mIOStatLogStream << endl;
 }
 
 //*******************************************************************************
@@ -671,12 +1016,35 @@ int JackTrip::clientPingToServerStart()
     if (gVerboseFlag) cout << "TCP Socket Connected to Server!" << endl;
     emit signalTcpClientConnected();
 
-    // Send Client Port Number to Server
-    // ---------------------------------
-    char port_buf[sizeof(mReceiverBindPort)];
-    std::memcpy(port_buf, &mReceiverBindPort, sizeof(mReceiverBindPort));
+    // Send Client Port Number to Server, with the request of what older
+    // hubs don't take: the compact header, and our public key to encrypt.
+    // The hub reads the size of the request with the port.
+    // -------------------------------------------------------------------
+    uint8_t private_key[PacketCipher::KEY_SIZE];
+    char port_buf[sizeof(mReceiverBindPort) + gHandshakeRequestSize
+                  + sizeof(gKeyExchangeMagic) + PacketCipher::KEY_SIZE];
+    char* request = port_buf + sizeof(mReceiverBindPort);
+    std::memset(request, 0, gHandshakeRequestSize);
+    std::memcpy(request, &gHandshakeMagic, sizeof(gHandshakeMagic));
+    request[4] = gHandshakeVersion;
+    int request_size = gHandshakeRequestSize;
+    if (mPacketHeaderType == DataProtocol::COMPACT) { request[5] |= gHandshakeCompactHeader; }
+    if (mEncrypt) {
+        request[5] |= gHandshakeEncrypt;
+        uint8_t public_key[PacketCipher::KEY_SIZE];
+        if ( !PacketCipher::generateKeyPair(private_key, public_key) ) {
+            std::cerr << "JackTrip ERROR: No random source for the encryption keys" << endl;
+            return -1;
+        }
+        std::memcpy(request + request_size, public_key, PacketCipher::KEY_SIZE);
+        request_size += PacketCipher::KEY_SIZE;
+    }
+    // Older hubs take the port alone, the request only goes when it's needed
+    if (request[5] == 0) { request_size = 0; }
+    int port_word = mReceiverBindPort | (request_size << gHandshakeRequestShift);
+    std::memcpy(port_buf, &port_word, sizeof(port_word));
 
-    tcpClient.write(port_buf, sizeof(mReceiverBindPort));
+    tcpClient.write(port_buf, sizeof(port_word) + request_size);
     while ( tcpClient.bytesToWrite() > 0 ) {
         tcpClient.waitForBytesWritten(-1);
     }
@@ -702,6 +1070,60 @@ int JackTrip::clientPingToServerStart()
     tcpClient.read(port_buf, size);
     std::memcpy(&udp_port, port_buf, size);
     //cout << "Received UDP Port Number: " << udp_port << endl;
+    if (udp_port == gHubFullReply) {
+        std::cerr << "JackTrip HUB SERVER is full, try again later" << endl;
+        tcpClient.close();
+        return -1;
+    }
+    if (udp_port == gHubEncryptionRequiredReply) {
+        std::cerr << "JackTrip HUB SERVER only takes encrypted clients, use --encrypt" << endl;
+        tcpClient.close();
+        return -1;
+    }
+
+    // Read the Session Token, the server sends one before its key to the
+    // clients that encrypt, only their sessions resume from another address
+    // ---------------------------------------------------------------------
+    uint32_t token = 0;
+    if (mEncrypt) {
+        while ( tcpClient.bytesAvailable() < (int)sizeof(token) ) {
+            if ( !tcpClient.waitForReadyRead(gSessionTokenTimeoutMs) ) { break; }
+        }
+        if ( tcpClient.bytesAvailable() >= (int)sizeof(token) ) {
+            tcpClient.read(port_buf, sizeof(token));
+            std::memcpy(&token, port_buf, sizeof(token));
+        }
+    }
+    setSessionToken(token);
+    if (gVerboseFlag && token != 0) cout << "Session can resume from another address" << endl;
+
+    // Read the public key of the Server and agree the session keys
+    // ------------------------------------------------------------
+    if (mEncrypt) {
+        const int key_reply_size = sizeof(gKeyExchangeMagic) + PacketCipher::KEY_SIZE;
+        while ( tcpClient.bytesAvailable() < key_reply_size ) {
+            if ( !tcpClient.waitForReadyRead(gSessionTokenTimeoutMs) ) { break; }
+        }
+        uint32_t magic = 0;
+        uint8_t hub_public_key[PacketCipher::KEY_SIZE];
+        if ( tcpClient.bytesAvailable() >= key_reply_size ) {
+            tcpClient.read(port_buf, key_reply_size);
+            std::memcpy(&magic, port_buf, sizeof(magic));
+            std::memcpy(hub_public_key, port_buf + sizeof(magic), PacketCipher::KEY_SIZE);
+        }
+        uint8_t send_key[PacketCipher::KEY_SIZE];
+        uint8_t receive_key[PacketCipher::KEY_SIZE];
+        if ( magic != gKeyExchangeMagic ||
+             !PacketCipher::deriveKeys(private_key, hub_public_key, true,
+                                       send_key, receive_key) ) {
+            std::cerr << "JackTrip ERROR: The HUB SERVER doesn't support encryption" << endl;
+            tcpClient.close();
+            return -1;
+        }
+        setEncryptionKeys(send_key, receive_key);
+        std::memset(private_key, 0, sizeof(private_key));
+        cout << "Datagrams are encrypted (ChaCha20-Poly1305)" << endl;
+    }
 
     // Close the TCP Socket
     // --------------------
@@ -844,6 +1266,9 @@ void JackTrip::createHeader(const DataProtocol::packetHeaderTypeT headertype)
     case DataProtocol::EMPTY :
         mPacketHeader = new EmptyHeader(this);
         break;
+    case DataProtocol::COMPACT :
+        mPacketHeader = new CompactHeader(this);
+        break;
     default :
         throw std::invalid_argument("Undefined Header Type");
         break;
@@ -852,7 +1277,7 @@ void JackTrip::createHeader(const DataProtocol::packetHeaderTypeT headertype)
 
 
 //*******************************************************************************
-void JackTrip::putHeaderInPacket(int8_t* full_packet, int8_t* audio_packet)
+void JackTrip::putHeaderInPacket(int8_t* full_packet, const int8_t* audio_packet)
 {
     mPacketHeader->fillHeaderCommonFromAudio();
     mPacketHeader->putHeaderInPacket(full_packet);
@@ -876,6 +1301,14 @@ int JackTrip::getPacketSizeInBytes()
 }
 
 
+//*******************************************************************************
+int JackTrip::getReceivePacketSizeInBytes()
+{
+    return (getReceiveAudioPacketSizeInBytes() +
+            mPacketHeader->getHeaderSizeInBytes());
+}
+
+
 //*******************************************************************************
 void JackTrip::parseAudioPacket(int8_t* full_packet, int8_t* audio_packet)
 {
@@ -883,7 +1316,147 @@ void JackTrip::parseAudioPacket(int8_t* full_packet, int8_t* audio_packet)
     audio_part = full_packet + mPacketHeader->getHeaderSizeInBytes();
     //std::memcpy(audio_packet, audio_part, mAudioInterface->getBufferSizeInBytes());
     //std::memcpy(audio_packet, audio_part, mAudioInterface->getSizeInBytesPerChannel() * mNumChans);
-    std::memcpy(audio_packet, audio_part, getTotalAudioPacketSizeInBytes());
+    std::memcpy(audio_packet, audio_part, getReceiveAudioPacketSizeInBytes());
+}
+
+
+//*******************************************************************************
+// Converts the frames samples of a channel from one bit resolution to another
+// (AudioInterface::audioBitResolutionT, the bytes per sample)
+static void convertBitResolution(const int8_t* input, int input_bytes,
+                                 int8_t* output, int output_bytes, int frames)
+{
+    AudioInterface::audioBitResolutionT input_resolution =
+            static_cast<AudioInterface::audioBitResolutionT>(input_bytes);
+    AudioInterface::audioBitResolutionT output_resolution =
+            static_cast<AudioInterface::audioBitResolutionT>(output_bytes);
+    for (int i = 0; i < frames; i++) {
+        sample_t sample;
+        AudioInterface::fromBitToSampleConversion(input + i*input_bytes, &sample,
+                                                  input_resolution);
+        AudioInterface::fromSampleToBitConversion(&sample, output + i*output_bytes,
+                                                  output_resolution);
+    }
+}
+
+
+//*******************************************************************************
+int JackTrip::getPackedBytesPerSample(const int8_t* dtx_packet) const
+{
+    const QualityStruct* quality = mAdaptive ? mPacketHeader->getPeerQuality(dtx_packet) : NULL;
+    if (quality == NULL) { return mAudioBitResolution; }
+    int bytes = quality->BitResolution / 8;
+    if ( bytes < AudioInterface::BIT8 || bytes > mAudioBitResolution ) { return -1; }
+    return bytes;
+}
+
+
+//*******************************************************************************
+int JackTrip::packDtxPacket(const int8_t* full_packet, int8_t* dtx_packet)
+{
+    int header_size = mPacketHeader->getHeaderSizeInBytes();
+    int chan_size = getPacketSizeInBytesPerChannel();
+    int num_chans = getTotalAudioPacketSizeInBytes() / chan_size;
+    // Adaptive bit resolution: the channels go with the one of the header
+    int bytes = mAudioBitResolution;
+    int packed_bytes = getPackedBytesPerSample(full_packet);
+
+    std::memcpy(dtx_packet, full_packet, header_size);
+    return header_size + packDtxAudio(full_packet + header_size, num_chans, chan_size / bytes,
+                                      bytes, packed_bytes, dtx_packet + header_size);
+}
+
+
+//*******************************************************************************
+int JackTrip::unpackDtxPacket(const int8_t* dtx_packet, int size, int8_t* full_packet)
+{
+    int header_size = mPacketHeader->getHeaderSizeInBytes();
+    int chan_size = getPacketSizeInBytesPerChannel();
+    int num_chans = getReceiveAudioPacketSizeInBytes() / chan_size;
+    if ( size < header_size ) { return -1; }
+    int bytes = mAudioBitResolution;
+    int packed_bytes = getPackedBytesPerSample(dtx_packet);
+    if (packed_bytes < 0) { return -1; }
+
+    int used = unpackDtxAudio(dtx_packet + header_size, size - header_size, num_chans,
+                              chan_size / bytes, bytes, packed_bytes, full_packet + header_size);
+    if (used < 0) { return -1; }
+    std::memcpy(full_packet, dtx_packet, header_size);
+    return header_size + used;
+}
+
+
+//*******************************************************************************
+int JackTrip::packDtxAudio(const int8_t* audio, int num_chans, int frames,
+                           int bytes, int packed_bytes, int8_t* dtx_audio)
+{
+    int chan_size = frames * bytes;
+    int mask_size = (num_chans + 7) / 8;
+    uint8_t* mask = reinterpret_cast<uint8_t*>(dtx_audio);
+    std::memset(mask, 0, mask_size);
+    int8_t* packed = dtx_audio + mask_size;
+    // The silence gate in AudioInterface zeroes the silent channels
+    for (int i = 0; i < num_chans; i++) {
+        const int8_t* chan = audio + i*chan_size;
+        if ( isZeroBlock(chan, chan_size) ) { continue; }
+        mask[i/8] |= (1 << (i%8));
+        if (packed_bytes == bytes) {
+            std::memcpy(packed, chan, chan_size);
+        } else {
+            convertBitResolution(chan, bytes, packed, packed_bytes, frames);
+        }
+        packed += frames * packed_bytes;
+    }
+    return packed - dtx_audio;
+}
+
+
+//*******************************************************************************
+int JackTrip::unpackDtxAudio(const int8_t* dtx_audio, int size, int num_chans, int frames,
+                             int bytes, int packed_bytes, int8_t* audio)
+{
+    int chan_size = frames * bytes;
+    int packed_chan_size = frames * packed_bytes;
+    int mask_size = (num_chans + 7) / 8;
+    if ( size < mask_size ) { return -1; }
+
+    const uint8_t* mask = reinterpret_cast<const uint8_t*>(dtx_audio);
+    int used = mask_size;
+    for (int i = 0; i < num_chans; i++) {
+        if ( mask[i/8] & (1 << (i%8)) ) { used += packed_chan_size; }
+    }
+    if ( size < used ) { return -1; }
+
+    const int8_t* packed = dtx_audio + mask_size;
+    for (int i = 0; i < num_chans; i++) {
+        int8_t* chan = audio + i*chan_size;
+        if ( mask[i/8] & (1 << (i%8)) ) {
+            if (packed_bytes == bytes) {
+                std::memcpy(chan, packed, chan_size);
+            } else {
+                convertBitResolution(packed, packed_bytes, chan, bytes, frames);
+            }
+            packed += packed_chan_size;
+        }
+        else {
+            std::memset(chan, 0, chan_size);
+        }
+    }
+    return used;
+}
+
+
+//*******************************************************************************
+void JackTrip::setSendBitResolution(uint8_t bits)
+{
+    // Whole bytes, from 8 bits to the session's
+    int bytes = std::max<int>(AudioInterface::BIT8,
+                              std::min<int>(bits / 8, mAudioBitResolution));
+    uint8_t send_bits = (bytes == mAudioBitResolution) ? 0 : bytes * 8;
+    if ( mSendBitResolution.exchange(send_bits) != send_bits ) {
+        cout << "Adaptive resolution: sending " << getSendBitResolution()
+             << "-bit packets to " << mPeerAddress.toStdString() << endl;
+    }
 }
 
 
@@ -894,6 +1467,22 @@ void JackTrip::checkPeerSettings(int8_t* full_packet)
 }
 
 
+//*******************************************************************************
+void JackTrip::setEncryptionKeys(const uint8_t* send_key, const uint8_t* receive_key)
+{
+    std::memcpy(mSendKey, send_key, PacketCipher::KEY_SIZE);
+    std::memcpy(mReceiveKey, receive_key, PacketCipher::KEY_SIZE);
+    mEncryptionKeys = true;
+}
+
+
+//*******************************************************************************
+void JackTrip::peerAddressChanged(const QHostAddress& address, uint16_t port)
+{
+    static_cast<UdpDataProtocol*>(mDataProtocolSender)->movePeer(address, port);
+}
+
+
 //*******************************************************************************
 void JackTrip::checkIfPortIsBinded(int port)
 {
@@ -40,9 +40,11 @@
 
 //#include <tr1/memory> //for shared_ptr
 #include <stdexcept>
+#include <atomic>
 
 #include <QObject>
 #include <QString>
+#include <QStringList>
 #include <QUdpSocket>
 
 #include "DataProtocol.h"
@@ -52,10 +54,18 @@
 #include "JackAudioInterface.h"
 #endif //__NO_JACK__
 
+#include "PacketCipher.h"
 #include "PacketHeader.h"
 #include "RingBuffer.h"
 
 #include <signal.h>
+
+class Recorder;
+class RecorderTrack;
+class PacketCapture;
+class Reblocker;
+class Resampler;
+
 /** \brief Main class to creates a SERVER (to listen) or a CLIENT (to connect
  * to a listening server) to send audio streams in the network.
  *
@@ -95,7 +105,15 @@ public:
     /// \brief Enum for Audio Interface Mode
     enum audiointerfaceModeT {
         JACK, ///< Jack Mode
-        RTAUDIO  ///< RtAudio Mode
+        RTAUDIO, ///< RtAudio Mode
+        REPLAY ///< No audio device, driven by replayCapture()
+    };
+
+    /// \brief Enum for the multicast distribution of one sender to many listeners
+    enum multicastModeT {
+        NOMULTICAST, ///< Unicast to the peer
+        MULTICASTSEND, ///< Send to the group of the peer address, receive nothing
+        MULTICASTRECEIVE ///< Receive from the group of the peer address, send nothing
     };
 
     /// \brief Enum for Connection Mode (in packet header)
@@ -111,7 +129,8 @@ public:
         CLIENTECHO,  ///< Client Echo (client self-to-self)
         CLIENTFOFI,  ///< Client Fan Out to Clients and Fan In from Clients (but not self-to-self)
         RESERVEDMATRIX,  ///< Reserved for custom patch matrix (for TUB ensemble)
-        FULLMIX  ///< Client Fan Out to Clients and Fan In from Clients (including self-to-self)
+        FULLMIX,  ///< Client Fan Out to Clients and Fan In from Clients (including self-to-self)
+        CUSTOMMIX ///< Per-client monitor mixes through the HubMixer gain matrix
     };
     //---------------------------------------------------------
 
@@ -119,7 +138,8 @@ public:
     /** \brief The class Constructor with Default Parameters
    * \param JacktripMode JackTrip::CLIENT or JackTrip::SERVER
    * \param DataProtocolType JackTrip::dataProtocolT
-   * \param NumChans Number of Audio Channels (same for inputs and outputs)
+   * \param NumChans Number of Audio Channels (same for inputs and outputs, see
+   * setNumOutputChannels())
    * \param BufferQueueLength Audio Buffer for receiving packets
    * \param AudioBitResolution Audio Sample Resolutions in bits
    * \param redundancy redundancy factor for network data
@@ -166,6 +186,13 @@ public:
         #endif // endwhere
             );
 
+    /** \brief Replays a capture made with setCaptureFile() through the receiver,
+   * the jitter buffer and the audio callback, on a virtual clock and as fast as
+   * possible. The stream settings come from the capture, the buffer queue length
+   * and the underrun mode from this object. Throws std::runtime_error.
+   */
+    void replayCapture(const QString& captureFile);
+
     /// \brief Stop the processing threads
     virtual void stop();
 
@@ -228,9 +255,157 @@ public:
     /// \brief Set Client Name to something different that the default (JackTrip)
     virtual void setClientName(const char* ClientName)
     { mJackClientName = ClientName; }
-    /// \brief Set the number of audio channels
+    /// \brief Set the number of audio channels, inputs and outputs
     virtual void setNumChannels(int num_chans)
-    { mNumChans = num_chans; }
+    { mNumInChans = num_chans; mNumOutChans = num_chans; }
+    /// \brief Set the number of audio inputs, the channels sent to the peer
+    void setNumInputChannels(int num_chans)
+    { mNumInChans = num_chans; }
+    /// \brief Set the number of audio outputs, the channels received from the peer
+    void setNumOutputChannels(int num_chans)
+    { mNumOutChans = num_chans; }
+
+    /// \brief Pin the network threads to one CPU (sharded hub), -1 = not pinned
+    void setCpuAffinity(int cpu)
+    { mCpuAffinity = cpu; }
+    /** \brief Records the audio received from the peer as a track of recorder,
+   * named after trackName. Must be called before startProcess()
+   */
+    void setRecorder(Recorder* recorder, const QString& trackName)
+    { mRecorder = recorder; mRecorderTrackName = trackName; }
+    /// \brief Measures the cost of the audio callback into load (hub admission
+    /// control), must be called before startProcess()
+    void setCallbackLoad(CallbackLoad* load)
+    { mCallbackLoad = load; }
+    /// \brief Logs the received datagrams to captureFile, for replayCapture()
+    void setCaptureFile(const QString& captureFile)
+    { mCaptureFile = captureFile; }
+    /// \brief Omit the silent channels from the packets (discontinuous transmission)
+    void setDtx(bool dtx)
+    { mDtx = dtx; }
+    bool isDtx() const
+    { return mDtx; }
+    /** \brief Adaptive bit resolution (--adaptive): each end asks the other
+     * for fewer bits per sample while its packets get lost or jittery, and
+     * for more again once the link is clean (AdaptiveQuality). Every packet
+     * carries its own resolution.
+     */
+    void setAdaptive(bool adaptive)
+    { mAdaptive = adaptive; }
+    bool isAdaptive() const
+    { return mAdaptive; }
+    /// \brief The packets have no fixed size, they go packed (packDtxPacket())
+    bool isPacked() const
+    { return mDtx || mAdaptive; }
+    /// \brief Bit resolution of the packets sent (--adaptive), the one the peer asked for
+    uint8_t getSendBitResolution() const
+    { uint8_t bits = mSendBitResolution; return (bits != 0) ? bits : getAudioBitResolution(); }
+    /// \brief Takes the bit resolution the peer asks for, at most the session's
+    void setSendBitResolution(uint8_t bits);
+    /// \brief Bit resolution we ask the peer for (--adaptive)
+    uint8_t getRequestedBitResolution() const
+    { uint8_t bits = mRequestedBitResolution; return (bits != 0) ? bits : getAudioBitResolution(); }
+    void setRequestedBitResolution(uint8_t bits)
+    { mRequestedBitResolution = bits; }
+    /// \brief Use UDP segmentation (GSO) and receive coalescing (GRO) on Linux
+    void setUdpOffload(bool offload)
+    { mUdpOffload = offload; }
+    bool isUdpOffload() const
+    { return mUdpOffload; }
+    /// \brief Receives with io_uring (Linux 6.0 or later), the socket otherwise
+    void setIoUring(bool uring)
+    { mIoUring = uring; }
+    bool isIoUring() const
+    { return mIoUring; }
+    /// \brief Spins on the socket around the expected packet arrival, with a
+    /// SO_BUSY_POLL budget of usec microseconds (Linux), 0 = off
+    void setBusyPoll(int usec)
+    { mBusyPollUsec = usec; }
+    int getBusyPoll() const
+    { return mBusyPollUsec; }
+    /// \brief The audio callback sends the packets, the sender thread only
+    /// sends what the socket couldn't take right away
+    void setDirectSend(bool direct)
+    { mDirectSend = direct; }
+    bool isDirectSend() const
+    { return mDirectSend; }
+    /** \brief Frames of audio in each network packet, 0 = one audio period.
+     * The periods are regrouped into packets of that size, and back on the
+     * receiving end, the peer has to use the same. A hub takes the one of
+     * each client, so clients can run another period than the hub.
+     */
+    void setPacketFrames(int frames)
+    { mPacketFrames = frames; }
+    uint32_t getPacketFrames() const
+    { return mPacketFrames > 0 ? mPacketFrames : mAudioBufferSize; }
+    /** \brief Sample rate of the network packets, 0 = the audio one. A hub
+     * takes the one of each client, and converts between the two.
+     */
+    void setNetworkSampleRate(int rate)
+    { mNetworkSampleRate = rate; }
+    int getNetworkSampleRate() const
+    { return mNetworkSampleRate > 0 ? mNetworkSampleRate : static_cast<int>(mSampleRate); }
+    AudioInterface::samplingRateT getNetworkSampleRateType() const
+    { return AudioInterface::getTypeFromSampleRate(getNetworkSampleRate()); }
+    /// \brief Resampler::qualityT of the sample rate conversion
+    void setResampleQuality(int quality)
+    { mResampleQuality = quality; }
+    /** \brief Largest IP packet to the peer, 0 = no limit. Larger datagrams
+     * go in fragments, under the path MTU found by the kernel when it tells.
+     */
+    void setMtu(int mtu)
+    { mMtu = mtu; }
+    int getMtu() const
+    { return mMtu; }
+    /** \brief Multicast distribution (--multicast): the peer address is the
+     * group, the sender's datagrams reach all its listeners at the cost of
+     * one. Each listener keeps its own loss statistics.
+     */
+    void setMulticastMode(multicastModeT mode)
+    { mMulticastMode = mode; }
+    multicastModeT getMulticastMode() const
+    { return mMulticastMode; }
+    /** \brief Multipath redundancy (--multipath): each datagram goes to the
+     * peer once from each of these local addresses, out of its interface.
+     * The receiver keeps the first copy and the statistics of each path.
+     */
+    void setMultipathAddresses(const QStringList& addresses)
+    { mMultipathAddresses = addresses; }
+    const QStringList& getMultipathAddresses() const
+    { return mMultipathAddresses; }
+    bool isMultipath() const
+    { return !mMultipathAddresses.isEmpty(); }
+    /** \brief Authenticated encryption of the datagrams (--encrypt). The
+     * client agrees the keys with the hub in clientPingToServerStart().
+     */
+    void setEncrypt(bool encrypt)
+    { mEncrypt = encrypt; }
+    bool isEncrypt() const
+    { return mEncrypt; }
+    /// \brief Session keys, PacketCipher::KEY_SIZE bytes each
+    void setEncryptionKeys(const uint8_t* send_key, const uint8_t* receive_key);
+    /// \brief Key of the sent datagrams, NULL when they are not encrypted
+    const uint8_t* getSendKey() const
+    { return mEncryptionKeys ? mSendKey : NULL; }
+    /// \brief Key of the received datagrams, NULL when they are not encrypted
+    const uint8_t* getReceiveKey() const
+    { return mEncryptionKeys ? mReceiveKey : NULL; }
+    /// \brief Number of packets waiting to be sent
+    int getSendQueueLength() const
+    { return mSendRingBuffer->getNumFullSlots(); }
+    /** \brief Session token of a resumable hub session, 0 = none. Carried by
+   * every packet, so the hub finds the session when the client address changes
+   */
+    void setSessionToken(uint32_t token)
+    { mSessionToken = token; }
+    uint32_t getSessionToken() const
+    { return mSessionToken; }
+    /// \brief Sends to a new peer address, called by the receiver when the
+    /// session resumes from another address
+    void peerAddressChanged(const QHostAddress& address, uint16_t port);
+    /// \brief Name the JACK ports in groups of groupSize channels (hub trunk slots)
+    void setJackPortGroupSize(int groupSize)
+    { mJackPortGroupSize = groupSize; }
 
     /// Set to connect or not default audio ports (only implemented in Jack)
     virtual void setConnectDefaultAudioPorts(bool connect)
@@ -266,8 +441,10 @@ public:
     virtual void setPacketHeader(PacketHeader* const PacketHeader)
     { mPacketHeader = PacketHeader; }
 
+    /// \brief Slot of the receive RingBuffer, one audio period (the send
+    /// RingBuffer has network packets)
     virtual int getRingBuffersSlotSize()
-    { return getTotalAudioPacketSizeInBytes(); }
+    { return getReceiveAudioPeriodSizeInBytes(); }
 
     virtual void setAudiointerfaceMode(JackTrip::audiointerfaceModeT audiointerface_mode)
     { mAudiointerfaceMode = audiointerface_mode; }
@@ -313,17 +490,53 @@ public:
     //@{
     /// \todo Document all these functions
     virtual void createHeader(const DataProtocol::packetHeaderTypeT headertype);
-    void putHeaderInPacket(int8_t* full_packet, int8_t* audio_packet);
+    void putHeaderInPacket(int8_t* full_packet, const int8_t* audio_packet);
+    /// \brief Size of the packets sent, header and audio
     virtual int getPacketSizeInBytes();
+    /// \brief Size of the packets received, they have getNumOutputChannels()
+    int getReceivePacketSizeInBytes();
     void parseAudioPacket(int8_t* full_packet, int8_t* audio_packet);
-    virtual void sendNetworkPacket(const int8_t* ptrToSlot)
-    { mSendRingBuffer->insertSlotNonBlocking(ptrToSlot); }
+    /** \brief Packs a full packet (header+audio) into its discontinuous
+   * transmission form: header, mask of the channels present and the non-silent
+   * channels only, at the bit resolution of its header (--adaptive)
+   * \return Size of dtx_packet in bytes, at most getDtxPacketMaxSizeInBytes()
+   */
+    int packDtxPacket(const int8_t* full_packet, int8_t* dtx_packet);
+    /** \brief Expands a packet from packDtxPacket into a full packet, silent
+   * channels are zeroed, the others back to the session bit resolution
+   * \return Bytes of dtx_packet used, -1 if size is too short for the packet
+   */
+    int unpackDtxPacket(const int8_t* dtx_packet, int size, int8_t* full_packet);
+    /** \brief Packs the audio of a packet, frames of bytes per sample in each
+   * of its num_chans channels: mask of the channels present, then the
+   * non-silent channels at packed_bytes per sample
+   * \return Size of dtx_audio in bytes
+   */
+    static int packDtxAudio(const int8_t* audio, int num_chans, int frames,
+                            int bytes, int packed_bytes, int8_t* dtx_audio);
+    /** \brief Expands the audio packed by packDtxAudio
+   * \return Bytes of dtx_audio used, -1 if size is too short for it
+   */
+    static int unpackDtxAudio(const int8_t* dtx_audio, int size, int num_chans, int frames,
+                              int bytes, int packed_bytes, int8_t* audio);
+    /// \brief Bytes per sample of the audio of a packed packet, -1 if not valid
+    int getPackedBytesPerSample(const int8_t* dtx_packet) const;
+    int getDtxMaskSizeInBytes() const
+    { return (getTotalAudioPacketSizeInBytes()/getPacketSizeInBytesPerChannel() + 7) / 8; }
+    int getDtxPacketMaxSizeInBytes()
+    { return getPacketSizeInBytes() + getDtxMaskSizeInBytes(); }
+    int getReceiveDtxMaskSizeInBytes() const
+    { return (getReceiveAudioPacketSizeInBytes()/getPacketSizeInBytesPerChannel() + 7) / 8; }
+    int getReceiveDtxPacketMaxSizeInBytes()
+    { return getReceivePacketSizeInBytes() + getReceiveDtxMaskSizeInBytes(); }
+    /// \brief Sends one audio period, from the audio callback
+    virtual void sendNetworkPacket(const int8_t* ptrToSlot);
     virtual void receiveNetworkPacket(int8_t* ptrToReadSlot)
     { mReceiveRingBuffer->readSlotNonBlocking(ptrToReadSlot); }
     virtual void readAudioBuffer(int8_t* ptrToReadSlot)
     { mSendRingBuffer->readSlotBlocking(ptrToReadSlot); }
-    virtual void writeAudioBuffer(const int8_t* ptrToSlot)
-    { mReceiveRingBuffer->insertSlotNonBlocking(ptrToSlot); }
+    /// \brief Queues the audio of one network packet for the audio callback
+    virtual void writeAudioBuffer(const int8_t* ptrToSlot);
     uint32_t getBufferSizeInSamples() const
     { return mAudioBufferSize; /*return mAudioInterface->getBufferSizeInSamples();*/ }
     uint32_t getDeviceID() const
@@ -336,10 +549,12 @@ public:
 
     uint8_t getAudioBitResolution() const
     { return mAudioBitResolution*8; /*return mAudioInterface->getAudioBitResolution();*/ }
+    /// \brief Audio inputs, the channels sent to the peer
     unsigned int getNumInputChannels() const
-    { return mNumChans; /*return mAudioInterface->getNumInputChannels();*/ }
+    { return mNumInChans; /*return mAudioInterface->getNumInputChannels();*/ }
+    /// \brief Audio outputs, the channels received from the peer
     unsigned int getNumOutputChannels() const
-    { return mNumChans; /*return mAudioInterface->getNumOutputChannels();*/ }
+    { return mNumOutChans; /*return mAudioInterface->getNumOutputChannels();*/ }
     unsigned int getNumChannels() const
     {
         if (getNumInputChannels() == getNumOutputChannels())
@@ -367,25 +582,60 @@ public:
     uint8_t getPeerBitResolution(int8_t* full_packet) const
     { return mPacketHeader->getPeerBitResolution(full_packet); }
 
-    uint8_t  getPeerNumChannels(int8_t* full_packet) const
+    uint16_t getPeerNumChannels(int8_t* full_packet) const
     { return mPacketHeader->getPeerNumChannels(full_packet); }
 
+    uint16_t getPeerNumOutChannels(int8_t* full_packet) const
+    { return mPacketHeader->getPeerNumOutChannels(full_packet); }
+
     uint8_t  getPeerConnectionMode(int8_t* full_packet) const
     { return mPacketHeader->getPeerConnectionMode(full_packet); }
 
+    uint32_t getPeerSessionToken(const int8_t* full_packet) const
+    { return mPacketHeader->getPeerSessionToken(full_packet); }
+
+    const QualityStruct* getPeerQuality(const int8_t* full_packet) const
+    { return mPacketHeader->getPeerQuality(full_packet); }
+
+    /// \brief True if the datagram has no audio, see PacketHeader::parsePeerHeader()
+    bool parsePeerHeader(const int8_t* datagram, int size)
+    { return mPacketHeader->parsePeerHeader(datagram, size); }
+    bool putCapabilityPacket(int8_t* datagram, int size)
+    { return mPacketHeader->putCapabilityPacket(datagram, size); }
+
     size_t getSizeInBytesPerChannel() const
     { return mAudioInterface->getSizeInBytesPerChannel(); }
     int getHeaderSizeInBytes() const
     { return mPacketHeader->getHeaderSizeInBytes(); }
-    virtual int getTotalAudioPacketSizeInBytes() const
+    /// \brief Bytes of one channel in a network packet
+    size_t getPacketSizeInBytesPerChannel() const
+    { return getSizeInBytesPerChannel() / mAudioBufferSize * getPacketFrames(); }
+    /// \brief Audio of one period sent, as taken from the audio interface
+    int getTotalAudioPeriodSizeInBytes() const
     {
 #ifdef WAIR // WAIR
         if (mNumNetRevChans)
             return mAudioInterface->getSizeInBytesPerChannel() * mNumNetRevChans;
         else // not wair
 #endif // endwhere
-            return mAudioInterface->getSizeInBytesPerChannel() * mNumChans;
+            return mAudioInterface->getSizeInBytesPerChannel() * mNumInChans;
     }
+    /// \brief Audio of one period received, as given to the audio interface
+    int getReceiveAudioPeriodSizeInBytes() const
+    {
+#ifdef WAIR // WAIR
+        if (mNumNetRevChans)
+            return mAudioInterface->getSizeInBytesPerChannel() * mNumNetRevChans;
+        else // not wair
+#endif // endwhere
+            return mAudioInterface->getSizeInBytesPerChannel() * mNumOutChans;
+    }
+    /// \brief Audio of one network packet sent, getPacketFrames() frames
+    virtual int getTotalAudioPacketSizeInBytes() const
+    { return getTotalAudioPeriodSizeInBytes() / mAudioBufferSize * getPacketFrames(); }
+    /// \brief Audio of one network packet received
+    int getReceiveAudioPacketSizeInBytes() const
+    { return getReceiveAudioPeriodSizeInBytes() / mAudioBufferSize * getPacketFrames(); }
     //@}
     //------------------------------------------------------------------------------------
 
@@ -447,6 +697,13 @@ public:
     virtual void setupDataProtocol();
     /// \brief Set the RingBuffer objects
     void setupRingBuffers();
+    /** \brief Receive RingBuffer slots (audio periods) for the queue length,
+     * which counts network packets: the jitter buffer holds as many frames
+     * whatever the period of the peer
+     */
+    int getReceiveQueueSlots() const;
+    /// \brief Creates the capture of the received datagrams, if one was set
+    void setupCapture();
     /// \brief Starts for the CLIENT mode
     void clientStart();
     /// \brief Starts for the SERVER mode
@@ -459,6 +716,9 @@ public:
     virtual int clientPingToServerStart();
 
 private:
+    /// \brief Sends the audio of one network packet
+    void sendAudioPacket(const int8_t* audio_packet);
+
     //void bindReceiveSocket(QUdpSocket& UdpSocket, int bind_port,
     //                       QHostAddress PeerHostAddress, int peer_port)
     //throw(std::runtime_error);
@@ -469,7 +729,8 @@ private:
     DataProtocol::packetHeaderTypeT mPacketHeaderType; ///< Packet Header Type
     JackTrip::audiointerfaceModeT mAudiointerfaceMode;
 
-    int mNumChans; ///< Number of Channels (inputs = outputs)
+    int mNumInChans; ///< Number of Input Channels, sent to the peer
+    int mNumOutChans; ///< Number of Output Channels, received from the peer
 #ifdef WAIR // WAIR
     int mNumNetRevChans; ///< Number of Network Audio Channels (net comb filters)
 #endif // endwhere
@@ -513,6 +774,42 @@ private:
 
     bool mConnectDefaultAudioPorts; ///< Connect or not default audio ports
     std::ostream mIOStatLogStream;
+    int mCpuAffinity; ///< CPU of the network threads, -1 if not pinned
+    int mJackPortGroupSize; ///< Channels per JACK port group, 0 = no groups
+    bool mDtx; ///< Discontinuous transmission, silent channels are not sent
+    bool mAdaptive; ///< Adaptive bit resolution of the packets
+    std::atomic<uint8_t> mSendBitResolution; ///< Of the packets sent, 0 = the session's
+    std::atomic<uint8_t> mRequestedBitResolution; ///< Asked to the peer, 0 = the session's
+    Recorder* mRecorder; ///< Session recorder, or NULL
+    QString mRecorderTrackName;
+    RecorderTrack* mRecorderTrack; ///< Track of the received audio, while the audio runs
+    QString mCaptureFile; ///< Capture of the received datagrams, empty = none
+    PacketCapture* mCapture;
+    CallbackLoad* mCallbackLoad; ///< Cost of the audio callback, or NULL
+    uint32_t mSessionToken; ///< Token of a resumable hub session, 0 = none
+    bool mUdpOffload; ///< UDP GSO/GRO (Linux)
+    bool mIoUring; ///< io_uring receive engine (Linux)
+    int mBusyPollUsec; ///< Busy-poll receive budget, 0 = off
+    bool mDirectSend; ///< Send from the audio callback
+    uint32_t mPacketFrames; ///< Frames in a network packet, 0 = one period
+    Reblocker* mSendReblocker; ///< Periods into packets, NULL if they are the same
+    Reblocker* mReceiveReblocker; ///< Packets into periods, NULL if they are the same
+    int8_t* mSendPacket; ///< Audio of the packet taken from mSendReblocker
+    int8_t* mReceivePeriod; ///< Audio of the period taken from mReceiveReblocker
+    int mNetworkSampleRate; ///< Sample rate of the packets, 0 = mSampleRate
+    int mResampleQuality; ///< Resampler::qualityT
+    int mMtu; ///< Largest IP packet to the peer, 0 = no limit
+    multicastModeT mMulticastMode; ///< Multicast sender or listener
+    QStringList mMultipathAddresses; ///< Local address of each path, empty = one path
+    bool mEncrypt; ///< Encrypt the datagrams, the client agrees the keys
+    bool mEncryptionKeys; ///< mSendKey and mReceiveKey are set
+    uint8_t mSendKey[PacketCipher::KEY_SIZE];
+    uint8_t mReceiveKey[PacketCipher::KEY_SIZE];
+    Resampler* mSendResampler; ///< Periods to the network rate, NULL if it's the same
+    Resampler* mReceiveResampler; ///< Packets to the audio rate, NULL if it's the same
+    int8_t* mSendResampled; ///< Output of mSendResampler
+    int8_t* mReceiveResampled; ///< Output of mReceiveResampler
+    std::atomic<int64_t> mResampleNs; ///< Time spent converting, since the last stats
 };
 
 #endif
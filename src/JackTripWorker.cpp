@@ -47,6 +47,8 @@
 #include "UdpMasterListener.h"
 #include "NetKS.h"
 #include "LoopBack.h"
+#include "Fragmenter.h"
+#include "PacketCipher.h"
 #include "Settings.h"
 #ifdef WAIR // wair
 #include "dcblock2gain.dsp.h"
@@ -65,7 +67,8 @@ JackTripWorker::JackTripWorker(UdpMasterListener* udpmasterlistener, int BufferQ
     mUnderRunMode(UnderRunMode),
     mSpawning(false),
     mID(0),
-    mNumChans(1)
+    mNumChans(1),
+    mCpuAffinity(-1)
   #ifdef WAIR // wair
   ,mNumNetRevChans(0),
     mWAIR(false)
@@ -117,6 +120,9 @@ void JackTripWorker::run()
 
     { QMutexLocker locker(&mMutex); mSpawning = true; }
 
+    // Sharded hub: the pool thread moves to the core that owns this session
+    if (mCpuAffinity >= 0) { setThreadAffinity(mCpuAffinity); }
+
     //QHostAddress ClientAddress;
 
     // Try catching any exceptions that come from JackTrip
@@ -181,9 +187,24 @@ void JackTripWorker::run()
 #endif
 
         jacktrip.setConnectDefaultAudioPorts(m_connectDefaultAudioPorts);
+        jacktrip.setCpuAffinity(mCpuAffinity);
+        jacktrip.setCallbackLoad(mUdpMasterListener->getSessionLoad(mID));
+        jacktrip.setUdpOffload(settings->isUdpOffload());
+        jacktrip.setIoUring(settings->isIoUring());
+        jacktrip.setBusyPoll(settings->getBusyPoll());
+        jacktrip.setDirectSend(settings->isDirectSend());
+        jacktrip.setPacketFrames(settings->getPacketFrames());
+        jacktrip.setResampleQuality(settings->getResampleQuality());
 
         // Set our underrun mode
         jacktrip.setUnderRunMode(mUnderRunMode);
+        // One track per client, what the hub receives from it
+        jacktrip.setRecorder(settings->getRecorder(),
+                             mClientAddress + "_" + QString::number(mClientPort));
+        if ( !settings->getCaptureFile().isEmpty() ) {
+            jacktrip.setCaptureFile(settings->getCaptureFile() + "_" + mClientAddress
+                                    + "_" + QString::number(mClientPort));
+        }
 
         // Connect signals and slots
         // -------------------------
@@ -295,31 +316,128 @@ int JackTripWorker::setJackTripFromClientHeader(JackTrip& jacktrip)
             if (gVerboseFlag) cout << "---------> ELAPSED TIME: " << elapsedTime << endl;
         }
     }
+    // Clients with the compact header, announced in the handshake, send their
+    // settings in capability packets, their audio packets before the first of
+    // those are skipped. Clients with --mtu send the large datagrams in
+    // fragments, put back together, and clients with --encrypt send them encrypted.
+    bool compact = mUdpMasterListener->isCompactHeader(mID);
+    if (compact) {
+        if (gVerboseFlag) cout << "--->JackTripWorker: Client uses the compact header" << endl;
+        jacktrip.setPacketHeaderType(DataProtocol::COMPACT);
+    }
+    uint8_t send_key[PacketCipher::KEY_SIZE];
+    uint8_t receive_key[PacketCipher::KEY_SIZE];
+    bool encrypt = mUdpMasterListener->getSessionKeys(mID, send_key, receive_key);
+    PacketCipher* cipher = encrypt ? new PacketCipher(receive_key) : NULL;
+    Fragmenter fragmenter(gUdpOffloadMaxBytes);
+    QByteArray packet;
+    while ( UdpSockTemp.hasPendingDatagrams() ) {
+        packet.resize(UdpSockTemp.pendingDatagramSize());
+        UdpSockTemp.readDatagram(packet.data(), packet.size());
+        int size = packet.size();
+        int8_t* frame = reinterpret_cast<int8_t*>(packet.data());
+        if ( Fragmenter::isFragment(frame, size) ) {
+            frame = fragmenter.reassemble(frame, size, size);
+        }
+        if ( frame != NULL && cipher != NULL ) {
+            size = cipher->open(frame, size);
+            if (size < 0) { frame = NULL; }
+        }
+        if (frame != NULL) {
+            if ( frame != reinterpret_cast<int8_t*>(packet.data()) ) {
+                packet = QByteArray(reinterpret_cast<const char*>(frame), size);
+            } else {
+                packet.resize(size);
+            }
+            const int8_t* datagram = reinterpret_cast<const int8_t*>(packet.constData());
+            if ( !compact || CompactHeader::isCapabilityPacket(datagram, packet.size()) ) {
+                break;
+            }
+        }
+        packet.clear();
+        QMutexLocker lock(&mutex);
+        while ( (!UdpSockTemp.hasPendingDatagrams()) && (elapsedTime <= udpTimeout) ) {
+            sleep.wait(&mutex,sleepTime);
+            elapsedTime += sleepTime;
+        }
+    }
+    delete cipher;
     // Check if we time out or not
-    if (!UdpSockTemp.hasPendingDatagrams()) {
+    if ( packet.isEmpty() ) {
         std::cerr << "--->JackTripWorker: is not receiving Datagrams (timeout)" << endl;
         UdpSockTemp.close();
         return -1;
     }
-    int packet_size = UdpSockTemp.pendingDatagramSize();
-    char packet[packet_size];
-    UdpSockTemp.readDatagram(packet, packet_size);
     UdpSockTemp.close(); // close the socket
-    int8_t* full_packet = reinterpret_cast<int8_t*>(packet);
+    int packet_size = packet.size();
+    int8_t* full_packet = reinterpret_cast<int8_t*>(packet.data());
 
     int PeerBufferSize = jacktrip.getPeerBufferSize(full_packet);
     int PeerSamplingRate = jacktrip.getPeerSamplingRate(full_packet);
     int PeerBitResolution = jacktrip.getPeerBitResolution(full_packet);
     int PeerNumChannels = jacktrip.getPeerNumChannels(full_packet);
+    int PeerNumOutChannels = jacktrip.getPeerNumOutChannels(full_packet);
     int PeerConnectionMode = jacktrip.getPeerConnectionMode(full_packet);
 
     if (gVerboseFlag) cout << "--->JackTripWorker: getPeerBufferSize = " << PeerBufferSize << endl;
     if (gVerboseFlag) cout << "--->JackTripWorker: getPeerSamplingRate = " << PeerSamplingRate << endl;
     if (gVerboseFlag) cout << "--->JackTripWorker: getPeerBitResolution = " << PeerBitResolution << endl;
     cout << "--->JackTripWorker: PeerNumChannels = " << PeerNumChannels << endl;
+    if (PeerNumOutChannels != PeerNumChannels) {
+        cout << "--->JackTripWorker: PeerNumOutChannels = " << PeerNumOutChannels << endl;
+    }
     if (gVerboseFlag) cout << "--->JackTripWorker: getPeerConnectionMode = " << PeerConnectionMode << endl;
 
-    jacktrip.setNumChannels(PeerNumChannels);
+    // The hub sends the client what it receives, and receives what it sends
+    jacktrip.setNumInputChannels(PeerNumOutChannels);
+    jacktrip.setNumOutputChannels(PeerNumChannels);
+    PeerConnectionMode &= ~CHANNELS_FLAG;
+    // Clients running another period than the hub: the hub regroups its
+    // periods into packets of theirs, and back
+    if (PeerBufferSize > 0) {
+        jacktrip.setPacketFrames(PeerBufferSize);
+    }
+    // Same with the sample rate, the hub keeps its own and converts
+    jacktrip.setNetworkSampleRate(AudioInterface::getSampleRateFromType(
+                                      static_cast<AudioInterface::samplingRateT>(PeerSamplingRate)));
+    // Clients in discontinuous transmission get it back from the hub
+    if ( PeerConnectionMode & DTX_FLAG ) {
+        cout << "--->JackTripWorker: Client uses DTX" << endl;
+        jacktrip.setDtx(true);
+        PeerConnectionMode &= ~DTX_FLAG;
+    }
+    // Clients adapting their bit resolution get it adapted by the hub as well
+    if ( PeerConnectionMode & ADAPTIVE_FLAG ) {
+        cout << "--->JackTripWorker: Client adapts its bit resolution" << endl;
+        jacktrip.setAdaptive(true);
+        PeerConnectionMode &= ~ADAPTIVE_FLAG;
+    }
+    // Clients with the session token can resume it from another address
+    if ( PeerConnectionMode & RESUME_FLAG ) {
+        uint32_t token = 0;
+        if ( packet_size >= jacktrip.getHeaderSizeInBytes() + (int)sizeof(token) ) {
+            token = jacktrip.getPeerSessionToken(full_packet);
+        }
+        if ( token != mUdpMasterListener->getSessionToken(mID) ) {
+            std::cerr << "--->JackTripWorker: Wrong session token" << endl;
+            return -1;
+        }
+        jacktrip.setSessionToken(token);
+        PeerConnectionMode &= ~RESUME_FLAG;
+    }
+    // Clients that encrypt their datagrams get them encrypted as well
+    if (encrypt) {
+        cout << "--->JackTripWorker: Client encrypts its datagrams" << endl;
+        jacktrip.setEncryptionKeys(send_key, receive_key);
+    }
+    // Clients that fragment their datagrams get them in fragments as well
+    if ( PeerConnectionMode & FRAGMENT_FLAG ) {
+        int mtu = mUdpMasterListener->getSettings()->getMtu();
+        jacktrip.setMtu( (mtu > 0) ? mtu : gDefaultMtu );
+        cout << "--->JackTripWorker: Client fragments its datagrams, MTU "
+             << jacktrip.getMtu() << endl;
+        PeerConnectionMode &= ~FRAGMENT_FLAG;
+    }
     return PeerConnectionMode;
 }
 
@@ -90,6 +90,8 @@ public:
                      int num_channels,
                      bool connectDefaultAudioPorts
                      );
+    /// \brief Sets the CPU (hub shard) of the session, -1 = not pinned
+    void setCpuAffinity(int cpu) { mCpuAffinity = cpu; }
     /// Stop and remove thread from pool
     void stopThread();
     int getID()
@@ -129,6 +131,7 @@ private:
 
     int mID; ///< ID thread number
     int mNumChans; ///< Number of Channels
+    int mCpuAffinity; ///< CPU of the session shard, -1 if not pinned
 #ifdef WAIR // wair
     int mNumNetRevChans; ///< Number of Net Channels = net combs
     bool mWAIR;
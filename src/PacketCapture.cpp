@@ -0,0 +1,193 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+/**
+ * \file PacketCapture.cpp
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#include <iostream>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+
+#include "PacketCapture.h"
+
+using std::cout; using std::endl;
+
+static_assert(sizeof(PacketCapture::CaptureHeader) == 32, "CaptureHeader is part of the file format");
+
+static const char sCaptureMagic[8] = { 'J', 'T', 'C', 'A', 'P', '0', '0', '1' };
+/// Arrival time and size before each datagram
+static const qint64 sRecordHeaderSize = sizeof(int64_t) + sizeof(uint16_t);
+
+
+//*******************************************************************************
+PacketCapture::PacketCapture() :
+    mMap(NULL),
+    mMapSize(0),
+    mPos(0),
+    mWriting(false)
+{
+    std::memset(&mHeader, 0, sizeof(mHeader));
+}
+
+
+//*******************************************************************************
+PacketCapture::~PacketCapture()
+{
+    close();
+}
+
+
+//*******************************************************************************
+void PacketCapture::create(const QString& fileName, const CaptureHeader& header)
+{
+    close();
+    mFile.setFileName(fileName);
+    if ( !mFile.open(QIODevice::ReadWrite | QIODevice::Truncate) ) {
+        throw std::runtime_error("Could not create the capture file "
+                                 + fileName.toStdString());
+    }
+    mWriting = true;
+    if ( !remap(gCaptureChunkBytes) ) {
+        close();
+        throw std::runtime_error("Could not map the capture file "
+                                 + fileName.toStdString());
+    }
+    mHeader = header;
+    std::memcpy(mHeader.magic, sCaptureMagic, sizeof(mHeader.magic));
+    std::memcpy(mMap, &mHeader, sizeof(mHeader));
+    mPos = sizeof(mHeader);
+    mClock.invalidate();
+    cout << "Capturing the received packets to " << qPrintable(fileName) << endl;
+}
+
+
+//*******************************************************************************
+void PacketCapture::open(const QString& fileName)
+{
+    close();
+    mFile.setFileName(fileName);
+    if ( !mFile.open(QIODevice::ReadOnly) ) {
+        throw std::runtime_error("Could not open the capture file "
+                                 + fileName.toStdString());
+    }
+    mMapSize = mFile.size();
+    if ( mMapSize >= static_cast<qint64>(sizeof(mHeader)) ) {
+        mMap = mFile.map(0, mMapSize);
+    }
+    if (mMap != NULL) {
+        std::memcpy(&mHeader, mMap, sizeof(mHeader));
+    }
+    if ( mMap == NULL || std::memcmp(mHeader.magic, sCaptureMagic, sizeof(mHeader.magic)) != 0 ) {
+        close();
+        throw std::runtime_error(fileName.toStdString() + " is not a JackTrip capture file");
+    }
+    mPos = sizeof(mHeader);
+}
+
+
+//*******************************************************************************
+void PacketCapture::close()
+{
+    if (mMap != NULL) {
+        mFile.unmap(mMap);
+        mMap = NULL;
+    }
+    if ( mWriting && mFile.isOpen() ) {
+        mFile.resize(mPos);
+        cout << "PacketCapture: closed " << qPrintable(mFile.fileName()) << ", "
+             << mPos << " bytes" << endl;
+    }
+    mFile.close();
+    mWriting = false;
+    mMapSize = 0;
+    mPos = 0;
+}
+
+
+//*******************************************************************************
+bool PacketCapture::remap(qint64 size)
+{
+    if (mMap != NULL) {
+        mFile.unmap(mMap);
+        mMap = NULL;
+    }
+    if ( !mFile.resize(size) ) { return false; }
+    mMap = mFile.map(0, size);
+    if (mMap == NULL) { return false; }
+    mMapSize = size;
+    return true;
+}
+
+
+//*******************************************************************************
+void PacketCapture::record(const int8_t* datagram, int size)
+{
+    if ( mMap == NULL || !mWriting || size <= 0 ) { return; }
+
+    int64_t time_ns = 0;
+    if ( mClock.isValid() ) { time_ns = mClock.nsecsElapsed(); }
+    else { mClock.start(); }
+
+    qint64 end = mPos + sRecordHeaderSize + size;
+    if (end > mMapSize) {
+        // Every gCaptureChunkBytes only, the capture is a debugging aid
+        if ( !remap(mMapSize + std::max<qint64>(gCaptureChunkBytes, size)) ) {
+            std::cerr << "PacketCapture ERROR: could not grow "
+                      << qPrintable(mFile.fileName()) << ", capture stopped" << endl;
+            return;
+        }
+    }
+    uint16_t size16 = size; // UDP datagrams are smaller than 64 kB
+    std::memcpy(mMap + mPos, &time_ns, sizeof(time_ns));
+    std::memcpy(mMap + mPos + sizeof(time_ns), &size16, sizeof(size16));
+    std::memcpy(mMap + mPos + sRecordHeaderSize, datagram, size);
+    mPos = end;
+}
+
+
+//*******************************************************************************
+bool PacketCapture::next(int64_t& time_ns, const int8_t*& datagram, int& size)
+{
+    if ( mMap == NULL || mWriting || mPos + sRecordHeaderSize > mMapSize ) { return false; }
+
+    uint16_t size16;
+    std::memcpy(&time_ns, mMap + mPos, sizeof(time_ns));
+    std::memcpy(&size16, mMap + mPos + sizeof(time_ns), sizeof(size16));
+    if ( size16 == 0 || mPos + sRecordHeaderSize + size16 > mMapSize ) { return false; }
+    datagram = reinterpret_cast<const int8_t*>(mMap + mPos + sRecordHeaderSize);
+    size = size16;
+    mPos += sRecordHeaderSize + size16;
+    return true;
+}
@@ -0,0 +1,113 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+/**
+ * \file PacketCapture.h
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#ifndef __PACKETCAPTURE_H__
+#define __PACKETCAPTURE_H__
+
+#include <QFile>
+#include <QString>
+#include <QElapsedTimer>
+
+#include "jacktrip_types.h"
+#include "jacktrip_globals.h"
+
+
+/** \brief Memory-mapped capture of the datagrams received by a UdpDataProtocol,
+ * with their arrival time, to replay them offline (JackTrip::replayCapture()).
+ *
+ * The file is a CaptureHeader with the stream settings followed by one record
+ * per datagram: the arrival time in nanoseconds since the first datagram
+ * (64 bits), the size (16 bits) and the datagram bytes. Numbers are in host
+ * byte order. The file grows by gCaptureChunkBytes and is cut to size when
+ * closed; a record of size 0 ends a capture that was not closed.
+ */
+class PacketCapture
+{
+public:
+
+    /// \brief Stream settings needed to replay the capture, 32 bytes
+    typedef struct {
+        char magic[8];
+        uint32_t sampleRate;
+        uint32_t bufferSize; ///< Audio period, in samples
+        uint16_t numChannels; ///< Channels received, in the datagrams
+        uint8_t bitResolution; ///< AudioInterface::audioBitResolutionT
+        uint8_t headerType; ///< DataProtocol::packetHeaderTypeT
+        uint16_t redundancy;
+        uint8_t dtx; ///< Datagrams are packed, bit flags: 1 = discontinuous transmission, 2 = adaptive bit resolution
+        uint8_t resumable; ///< Headers carry a session token
+        uint16_t packetFrames; ///< Samples in a packet, 0 = one period
+        uint16_t numSendChannels; ///< Channels sent, 0 = numChannels
+        uint32_t networkSampleRate; ///< Sample rate of the packets, 0 = sampleRate
+    } CaptureHeader;
+
+    PacketCapture();
+    virtual ~PacketCapture();
+
+    /// \brief Creates fileName to capture a stream, throws std::runtime_error
+    void create(const QString& fileName, const CaptureHeader& header);
+    /// \brief Opens a capture to read it, throws std::runtime_error
+    void open(const QString& fileName);
+    /// \brief Writes what was captured and closes the file
+    void close();
+
+    /// \brief Appends a received datagram, stamped with the current time. Never
+    /// throws, the capture stops if the file can't grow.
+    void record(const int8_t* datagram, int size);
+    /** \brief Reads the next datagram of a capture opened with open()
+     * \param time_ns Arrival time in nanoseconds since the first datagram
+     * \param datagram Points to the datagram in the mapped file
+     * \return false at the end of the capture
+     */
+    bool next(int64_t& time_ns, const int8_t*& datagram, int& size);
+
+    const CaptureHeader& getHeader() const { return mHeader; }
+
+private:
+    /// \brief Maps the file again after resizing it to hold at least size bytes
+    bool remap(qint64 size);
+
+    QFile mFile;
+    uchar* mMap; ///< Mapped file, NULL when not mapped
+    qint64 mMapSize;
+    qint64 mPos; ///< Next record
+    bool mWriting;
+    QElapsedTimer mClock; ///< Started with the first datagram
+    CaptureHeader mHeader;
+};
+
+#endif // __PACKETCAPTURE_H__
@@ -0,0 +1,698 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+
+/**
+ * \file PacketCipher.cpp
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#include "PacketCipher.h"
+#include "jacktrip_globals.h"
+
+#include <cstdio>
+#include <cstring>
+
+#if defined (__WIN_32__)
+#include <windows.h>
+#include <ntsecapi.h> // RtlGenRandom(), in advapi32
+#endif
+
+using std::endl;
+
+
+//*******************************************************************************
+// Little endian loads and stores, the wire format doesn't depend on the host
+static inline uint32_t load32(const uint8_t* p)
+{
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+static inline void store32(uint8_t* p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static inline uint64_t load64(const uint8_t* p)
+{
+    return uint64_t(load32(p)) | (uint64_t(load32(p + 4)) << 32);
+}
+
+static inline void store64(uint8_t* p, uint64_t v)
+{
+    store32(p, uint32_t(v));
+    store32(p + 4, uint32_t(v >> 32));
+}
+
+
+//*******************************************************************************
+// ChaCha20 (RFC 8439 section 2.3)
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define QUARTERROUND(a, b, c, d) \
+    a += b; d ^= a; d = ROTL32(d, 16); \
+    c += d; b ^= c; b = ROTL32(b, 12); \
+    a += b; d ^= a; d = ROTL32(d, 8);  \
+    c += d; b ^= c; b = ROTL32(b, 7);
+
+template<typename T>
+static void chachaRounds(T x[16])
+{
+    for (int i = 0; i < 10; i++) {
+        QUARTERROUND(x[0], x[4], x[8],  x[12]);
+        QUARTERROUND(x[1], x[5], x[9],  x[13]);
+        QUARTERROUND(x[2], x[6], x[10], x[14]);
+        QUARTERROUND(x[3], x[7], x[11], x[15]);
+        QUARTERROUND(x[0], x[5], x[10], x[15]);
+        QUARTERROUND(x[1], x[6], x[11], x[12]);
+        QUARTERROUND(x[2], x[7], x[8],  x[13]);
+        QUARTERROUND(x[3], x[4], x[9],  x[14]);
+    }
+}
+
+static void chachaInit(uint32_t state[16], const uint32_t key[8])
+{
+    state[0] = 0x61707865; state[1] = 0x3320646e; // "expand 32-byte k"
+    state[2] = 0x79622d32; state[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++) { state[4 + i] = key[i]; }
+}
+
+/// \brief Nonce of a datagram, 32 zero bits and the 64-bit counter
+static void datagramNonce(uint64_t counter, uint32_t nonce[3])
+{
+    nonce[0] = 0;
+    nonce[1] = uint32_t(counter);
+    nonce[2] = uint32_t(counter >> 32);
+}
+
+/// \brief Key stream block of a 96-bit nonce
+static void chachaBlock(const uint32_t key[8], uint32_t block, const uint32_t nonce[3],
+                        uint32_t out[16])
+{
+    uint32_t state[16];
+    chachaInit(state, key);
+    state[12] = block;
+    for (int i = 0; i < 3; i++) { state[13 + i] = nonce[i]; }
+    for (int i = 0; i < 16; i++) { out[i] = state[i]; }
+    chachaRounds(out);
+    for (int i = 0; i < 16; i++) { out[i] += state[i]; }
+}
+
+#if defined (__GNUC__)
+// Four blocks at once, one per vector lane (SSE2, NEON, or scalar code where
+// the target has no vectors)
+typedef uint32_t vec4 __attribute__ ((vector_size (16)));
+
+static void chachaXor4(const uint32_t key[8], uint32_t block, const uint32_t nonce[3],
+                       uint8_t* data)
+{
+    uint32_t init[16];
+    chachaInit(init, key);
+    for (int i = 0; i < 3; i++) { init[13 + i] = nonce[i]; }
+    vec4 state[16];
+    vec4 x[16];
+    for (int i = 0; i < 16; i++) {
+        vec4 v = { init[i], init[i], init[i], init[i] };
+        state[i] = v;
+    }
+    vec4 blocks = { block, block + 1, block + 2, block + 3 };
+    state[12] = blocks;
+    for (int i = 0; i < 16; i++) { x[i] = state[i]; }
+    chachaRounds(x);
+    for (int i = 0; i < 16; i++) { x[i] += state[i]; }
+    for (int j = 0; j < 4; j++) {
+        uint8_t* out = data + 64 * j;
+        for (int i = 0; i < 16; i++) {
+            store32(out + 4 * i, load32(out + 4 * i) ^ x[i][j]);
+        }
+    }
+}
+#endif
+
+/// \brief XORs the key stream from block 1 on into data
+static void chachaXor(const uint32_t key[8], const uint32_t nonce[3], uint8_t* data, int size)
+{
+    uint32_t stream[16];
+    uint8_t bytes[64];
+    uint32_t block = 1;
+#if defined (__GNUC__)
+    for (; size >= 256; block += 4, data += 256, size -= 256) {
+        chachaXor4(key, block, nonce, data);
+    }
+#endif
+    for (; size > 0; block++) {
+        chachaBlock(key, block, nonce, stream);
+        int n = (size < 64) ? size : 64;
+        if (n == 64) {
+            for (int i = 0; i < 16; i++) {
+                store32(data + 4 * i, load32(data + 4 * i) ^ stream[i]);
+            }
+        } else {
+            for (int i = 0; i < 16; i++) { store32(bytes + 4 * i, stream[i]); }
+            for (int i = 0; i < n; i++) { data[i] ^= bytes[i]; }
+        }
+        data += n;
+        size -= n;
+    }
+}
+
+/// \brief HChaCha20, a 256-bit key from a key and a 128-bit nonce
+static void hchacha(const uint8_t* key, const uint8_t* nonce, uint8_t* out)
+{
+    uint32_t k[8];
+    for (int i = 0; i < 8; i++) { k[i] = load32(key + 4 * i); }
+    uint32_t x[16];
+    chachaInit(x, k);
+    for (int i = 0; i < 4; i++) { x[12 + i] = load32(nonce + 4 * i); }
+    chachaRounds(x);
+    for (int i = 0; i < 4; i++) {
+        store32(out + 4 * i, x[i]);
+        store32(out + 16 + 4 * i, x[12 + i]);
+    }
+}
+
+
+//*******************************************************************************
+// Poly1305 (RFC 8439 section 2.5), 26-bit limbs. The AEAD construction pads
+// everything to 16 bytes, so all its blocks are full.
+struct Poly1305 {
+    uint32_t r[5], s[4], h[5], pad[4];
+
+    Poly1305(const uint8_t* key)
+    {
+        r[0] = (load32(key + 0)) & 0x3ffffff;
+        r[1] = (load32(key + 3) >> 2) & 0x3ffff03;
+        r[2] = (load32(key + 6) >> 4) & 0x3ffc0ff;
+        r[3] = (load32(key + 9) >> 6) & 0x3f03fff;
+        r[4] = (load32(key + 12) >> 8) & 0x00fffff;
+        for (int i = 0; i < 4; i++) { s[i] = r[i + 1] * 5; }
+        for (int i = 0; i < 5; i++) { h[i] = 0; }
+        for (int i = 0; i < 4; i++) { pad[i] = load32(key + 16 + 4 * i); }
+    }
+
+    /// \brief Block of 16 bytes, hibit is the 2^128 bit (0 for a short last
+    /// block, with its 0x01 byte)
+    void block(const uint8_t* m, uint32_t hibit = 1 << 24)
+    {
+        h[0] += (load32(m + 0)) & 0x3ffffff;
+        h[1] += (load32(m + 3) >> 2) & 0x3ffffff;
+        h[2] += (load32(m + 6) >> 4) & 0x3ffffff;
+        h[3] += (load32(m + 9) >> 6) & 0x3ffffff;
+        h[4] += (load32(m + 12) >> 8) | hibit;
+        uint64_t d0 = (uint64_t)h[0] * r[0] + (uint64_t)h[1] * s[3] + (uint64_t)h[2] * s[2]
+                      + (uint64_t)h[3] * s[1] + (uint64_t)h[4] * s[0];
+        uint64_t d1 = (uint64_t)h[0] * r[1] + (uint64_t)h[1] * r[0] + (uint64_t)h[2] * s[3]
+                      + (uint64_t)h[3] * s[2] + (uint64_t)h[4] * s[1];
+        uint64_t d2 = (uint64_t)h[0] * r[2] + (uint64_t)h[1] * r[1] + (uint64_t)h[2] * r[0]
+                      + (uint64_t)h[3] * s[3] + (uint64_t)h[4] * s[2];
+        uint64_t d3 = (uint64_t)h[0] * r[3] + (uint64_t)h[1] * r[2] + (uint64_t)h[2] * r[1]
+                      + (uint64_t)h[3] * r[0] + (uint64_t)h[4] * s[3];
+        uint64_t d4 = (uint64_t)h[0] * r[4] + (uint64_t)h[1] * r[3] + (uint64_t)h[2] * r[2]
+                      + (uint64_t)h[3] * r[1] + (uint64_t)h[4] * r[0];
+        uint32_t c;
+        c = uint32_t(d0 >> 26); h[0] = uint32_t(d0) & 0x3ffffff; d1 += c;
+        c = uint32_t(d1 >> 26); h[1] = uint32_t(d1) & 0x3ffffff; d2 += c;
+        c = uint32_t(d2 >> 26); h[2] = uint32_t(d2) & 0x3ffffff; d3 += c;
+        c = uint32_t(d3 >> 26); h[3] = uint32_t(d3) & 0x3ffffff; d4 += c;
+        c = uint32_t(d4 >> 26); h[4] = uint32_t(d4) & 0x3ffffff;
+        h[0] += c * 5; c = h[0] >> 26; h[0] &= 0x3ffffff;
+        h[1] += c;
+    }
+
+    /// \brief Message of size bytes, zero padded to 16
+    void padded(const uint8_t* m, int size)
+    {
+        for (; size >= 16; m += 16, size -= 16) { block(m); }
+        if (size > 0) {
+            uint8_t last[16] = { 0 };
+            std::memcpy(last, m, size);
+            block(last);
+        }
+    }
+
+    /// \brief Message of size bytes, a short last block as such
+    void message(const uint8_t* m, int size)
+    {
+        for (; size >= 16; m += 16, size -= 16) { block(m); }
+        if (size > 0) {
+            uint8_t last[16] = { 0 };
+            std::memcpy(last, m, size);
+            last[size] = 1;
+            block(last, 0);
+        }
+    }
+
+    void finish(uint8_t* tag)
+    {
+        uint32_t c;
+        c = h[1] >> 26; h[1] &= 0x3ffffff; h[2] += c;
+        c = h[2] >> 26; h[2] &= 0x3ffffff; h[3] += c;
+        c = h[3] >> 26; h[3] &= 0x3ffffff; h[4] += c;
+        c = h[4] >> 26; h[4] &= 0x3ffffff; h[0] += c * 5;
+        c = h[0] >> 26; h[0] &= 0x3ffffff; h[1] += c;
+        // h - p, kept if h >= p
+        uint32_t g[5];
+        g[0] = h[0] + 5; c = g[0] >> 26; g[0] &= 0x3ffffff;
+        g[1] = h[1] + c; c = g[1] >> 26; g[1] &= 0x3ffffff;
+        g[2] = h[2] + c; c = g[2] >> 26; g[2] &= 0x3ffffff;
+        g[3] = h[3] + c; c = g[3] >> 26; g[3] &= 0x3ffffff;
+        g[4] = h[4] + c - (1 << 26);
+        uint32_t mask = (g[4] >> 31) - 1;
+        for (int i = 0; i < 5; i++) { h[i] = (h[i] & ~mask) | (g[i] & mask); }
+        uint32_t w0 = h[0] | (h[1] << 26);
+        uint32_t w1 = (h[1] >> 6) | (h[2] << 20);
+        uint32_t w2 = (h[2] >> 12) | (h[3] << 14);
+        uint32_t w3 = (h[3] >> 18) | (h[4] << 8);
+        uint64_t f;
+        f = (uint64_t)w0 + pad[0];             store32(tag + 0, uint32_t(f));
+        f = (uint64_t)w1 + pad[1] + (f >> 32); store32(tag + 4, uint32_t(f));
+        f = (uint64_t)w2 + pad[2] + (f >> 32); store32(tag + 8, uint32_t(f));
+        f = (uint64_t)w3 + pad[3] + (f >> 32); store32(tag + 12, uint32_t(f));
+    }
+};
+
+
+//*******************************************************************************
+// X25519 (RFC 7748), field elements in 16 limbs of 16 bits, constant time
+typedef int64_t gf[16];
+
+static void carry25519(gf o)
+{
+    for (int i = 0; i < 16; i++) {
+        o[i] += (int64_t(1) << 16);
+        int64_t c = o[i] >> 16;
+        o[(i + 1) * (i < 15)] += c - 1 + 37 * (c - 1) * (i == 15);
+        o[i] -= c * 65536;
+    }
+}
+
+static void select25519(gf p, gf q, int64_t b)
+{
+    int64_t c = ~(b - 1);
+    for (int i = 0; i < 16; i++) {
+        int64_t t = c & (p[i] ^ q[i]);
+        p[i] ^= t;
+        q[i] ^= t;
+    }
+}
+
+static void pack25519(uint8_t* o, const gf n)
+{
+    gf m, t;
+    for (int i = 0; i < 16; i++) { t[i] = n[i]; }
+    carry25519(t);
+    carry25519(t);
+    carry25519(t);
+    for (int j = 0; j < 2; j++) {
+        m[0] = t[0] - 0xffed;
+        for (int i = 1; i < 15; i++) {
+            m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+            m[i - 1] &= 0xffff;
+        }
+        m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+        int64_t b = (m[15] >> 16) & 1;
+        m[14] &= 0xffff;
+        select25519(t, m, 1 - b);
+    }
+    for (int i = 0; i < 16; i++) {
+        o[2 * i] = t[i] & 0xff;
+        o[2 * i + 1] = t[i] >> 8;
+    }
+}
+
+static void unpack25519(gf o, const uint8_t* n)
+{
+    for (int i = 0; i < 16; i++) { o[i] = n[2 * i] + (int64_t(n[2 * i + 1]) << 8); }
+    o[15] &= 0x7fff;
+}
+
+static void add25519(gf o, const gf a, const gf b)
+{
+    for (int i = 0; i < 16; i++) { o[i] = a[i] + b[i]; }
+}
+
+static void sub25519(gf o, const gf a, const gf b)
+{
+    for (int i = 0; i < 16; i++) { o[i] = a[i] - b[i]; }
+}
+
+static void mul25519(gf o, const gf a, const gf b)
+{
+    int64_t t[31];
+    for (int i = 0; i < 31; i++) { t[i] = 0; }
+    for (int i = 0; i < 16; i++) {
+        for (int j = 0; j < 16; j++) { t[i + j] += a[i] * b[j]; }
+    }
+    for (int i = 0; i < 15; i++) { t[i] += 38 * t[i + 16]; }
+    for (int i = 0; i < 16; i++) { o[i] = t[i]; }
+    carry25519(o);
+    carry25519(o);
+}
+
+static void invert25519(gf o, const gf in)
+{
+    gf c;
+    for (int i = 0; i < 16; i++) { c[i] = in[i]; }
+    for (int a = 253; a >= 0; a--) {
+        mul25519(c, c, c);
+        if (a != 2 && a != 4) { mul25519(c, c, in); }
+    }
+    for (int i = 0; i < 16; i++) { o[i] = c[i]; }
+}
+
+static void x25519(uint8_t* q, const uint8_t* n, const uint8_t* p)
+{
+    static const gf a24 = { 0xDB41, 1 }; // 121665
+    uint8_t z[32];
+    for (int i = 0; i < 31; i++) { z[i] = n[i]; }
+    z[31] = (n[31] & 127) | 64;
+    z[0] &= 248;
+    gf x, a, b, c, d, e, f;
+    unpack25519(x, p);
+    for (int i = 0; i < 16; i++) {
+        b[i] = x[i];
+        d[i] = a[i] = c[i] = 0;
+    }
+    a[0] = d[0] = 1;
+    for (int i = 254; i >= 0; --i) {
+        int64_t r = (z[i >> 3] >> (i & 7)) & 1;
+        select25519(a, b, r);
+        select25519(c, d, r);
+        add25519(e, a, c);
+        sub25519(a, a, c);
+        add25519(c, b, d);
+        sub25519(b, b, d);
+        mul25519(d, e, e);
+        mul25519(f, a, a);
+        mul25519(a, c, a);
+        mul25519(c, b, e);
+        add25519(e, a, c);
+        sub25519(a, a, c);
+        mul25519(b, a, a);
+        sub25519(c, d, f);
+        mul25519(a, c, a24);
+        add25519(a, a, d);
+        mul25519(c, c, a);
+        mul25519(a, d, f);
+        mul25519(d, b, x);
+        mul25519(b, e, e);
+        select25519(a, b, r);
+        select25519(c, d, r);
+    }
+    invert25519(c, c);
+    mul25519(a, a, c);
+    pack25519(q, a);
+}
+
+
+//*******************************************************************************
+PacketCipher::PacketCipher(const uint8_t* key) :
+    mSendCounter(1),
+    mNewestCounter(0),
+    mWindow(0),
+    mRejected(0)
+{
+    for (int i = 0; i < 8; i++) { mKey[i] = load32(key + 4 * i); }
+}
+
+
+//*******************************************************************************
+PacketCipher::~PacketCipher()
+{
+    for (int i = 0; i < 8; i++) { mKey[i] = 0; }
+}
+
+
+//*******************************************************************************
+// ChaCha20-Poly1305 tag (RFC 8439 section 2.8) of the additional data and the
+// ciphertext, with the one-time key of the nonce
+static void aeadTag(const uint32_t key[8], const uint32_t nonce[3],
+                    const uint8_t* aad, int aad_size,
+                    const uint8_t* ciphertext, int size, uint8_t* tag)
+{
+    // One-time Poly1305 key from block 0 of the key stream
+    uint32_t block[16];
+    chachaBlock(key, 0, nonce, block);
+    uint8_t poly_key[32];
+    for (int i = 0; i < 8; i++) { store32(poly_key + 4 * i, block[i]); }
+    Poly1305 poly(poly_key);
+    poly.padded(aad, aad_size);
+    poly.padded(ciphertext, size);
+    uint8_t lengths[16];
+    store64(lengths, uint64_t(aad_size));
+    store64(lengths + 8, uint64_t(size));
+    poly.block(lengths);
+    poly.finish(tag);
+}
+
+
+//*******************************************************************************
+void PacketCipher::computeTag(const uint8_t* ciphertext, int size, uint64_t counter,
+                              uint8_t* tag) const
+{
+    // No additional data, the counter is the nonce
+    uint32_t nonce[3];
+    datagramNonce(counter, nonce);
+    aeadTag(mKey, nonce, NULL, 0, ciphertext, size, tag);
+}
+
+
+//*******************************************************************************
+int PacketCipher::seal(int8_t* datagram, int size)
+{
+    uint8_t* data = reinterpret_cast<uint8_t*>(datagram);
+    uint64_t counter = mSendCounter.fetch_add(1);
+    uint32_t nonce[3];
+    datagramNonce(counter, nonce);
+    chachaXor(mKey, nonce, data, size);
+    store64(data + size, counter);
+    computeTag(data, size, counter, data + size + COUNTER_SIZE);
+    return size + getOverheadInBytes();
+}
+
+
+//*******************************************************************************
+int PacketCipher::open(int8_t* datagram, int size)
+{
+    uint8_t* data = reinterpret_cast<uint8_t*>(datagram);
+    size -= getOverheadInBytes();
+    if (size < 0) { mRejected++; return -1; }
+    uint64_t counter = load64(data + size);
+    // Replayed, or too old for the window
+    uint64_t age = mNewestCounter - counter;
+    if ( counter == 0 ||
+         (counter <= mNewestCounter && (age >= 64 || (mWindow >> age) & 1)) ) {
+        mRejected++;
+        return -1;
+    }
+    uint8_t tag[TAG_SIZE];
+    computeTag(data, size, counter, tag);
+    uint8_t diff = 0; // Constant time compare
+    for (int i = 0; i < TAG_SIZE; i++) { diff |= tag[i] ^ data[size + COUNTER_SIZE + i]; }
+    if (diff != 0) { mRejected++; return -1; }
+    uint32_t nonce[3];
+    datagramNonce(counter, nonce);
+    chachaXor(mKey, nonce, data, size);
+    if (counter > mNewestCounter) {
+        uint64_t shift = counter - mNewestCounter;
+        mWindow = (shift >= 64) ? 1 : ((mWindow << shift) | 1);
+        mNewestCounter = counter;
+    } else {
+        mWindow |= uint64_t(1) << age;
+    }
+    return size;
+}
+
+
+//*******************************************************************************
+bool PacketCipher::isNewest(const int8_t* datagram, int size) const
+{
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(datagram);
+    size -= getOverheadInBytes();
+    if (size < 0) { return false; }
+    uint64_t counter = load64(data + size);
+    if (counter <= mNewestCounter) { return false; }
+    uint8_t tag[TAG_SIZE];
+    computeTag(data, size, counter, tag);
+    uint8_t diff = 0;
+    for (int i = 0; i < TAG_SIZE; i++) { diff |= tag[i] ^ data[size + COUNTER_SIZE + i]; }
+    return (diff == 0);
+}
+
+
+//*******************************************************************************
+bool PacketCipher::getRandomBytes(uint8_t* buf, int size)
+{
+    // The system CSPRNG, never std::random_device: MinGW's is deterministic
+    // before GCC 9.2
+#if defined (__WIN_32__)
+    return RtlGenRandom(buf, size) != FALSE;
+#else
+    FILE* random = std::fopen("/dev/urandom", "rb");
+    if (random == NULL) { return false; }
+    size_t n = std::fread(buf, 1, size, random);
+    std::fclose(random);
+    return (n == static_cast<size_t>(size));
+#endif
+}
+
+
+//*******************************************************************************
+bool PacketCipher::generateKeyPair(uint8_t* private_key, uint8_t* public_key)
+{
+    if ( !getRandomBytes(private_key, KEY_SIZE) ) { return false; }
+    static const uint8_t base_point[32] = { 9 };
+    x25519(public_key, private_key, base_point);
+    return true;
+}
+
+
+//*******************************************************************************
+bool PacketCipher::deriveKeys(const uint8_t* private_key, const uint8_t* peer_public_key,
+                              bool client, uint8_t* send_key, uint8_t* receive_key)
+{
+    uint8_t shared[32];
+    x25519(shared, private_key, peer_public_key);
+    uint8_t zero = 0; // A low order point of the peer gives 0
+    for (int i = 0; i < 32; i++) { zero |= shared[i]; }
+    if (zero == 0) { return false; }
+
+    // Session key, then one key per direction from its first key stream block
+    static const uint8_t label[16] = { 'J','a','c','k','T','r','i','p',
+                                       ' ','s','e','s','s','i','o','n' };
+    uint8_t session[32];
+    hchacha(shared, label, session);
+    uint32_t key[8];
+    for (int i = 0; i < 8; i++) { key[i] = load32(session + 4 * i); }
+    uint32_t nonce[3];
+    datagramNonce(0, nonce);
+    uint32_t block[16];
+    chachaBlock(key, 0, nonce, block);
+    uint8_t* client_key = client ? send_key : receive_key;
+    uint8_t* hub_key = client ? receive_key : send_key;
+    for (int i = 0; i < 8; i++) {
+        store32(client_key + 4 * i, block[i]);
+        store32(hub_key + 4 * i, block[8 + i]);
+    }
+    std::memset(shared, 0, sizeof(shared));
+    std::memset(session, 0, sizeof(session));
+    std::memset(block, 0, sizeof(block));
+    return true;
+}
+
+
+//*******************************************************************************
+void PacketCipher::scalarMult(uint8_t* out, const uint8_t* scalar, const uint8_t* point)
+{
+    x25519(out, scalar, point);
+}
+
+
+//*******************************************************************************
+static void loadKeyAndNonce(const uint8_t* key, const uint8_t* nonce,
+                            uint32_t key_words[8], uint32_t nonce_words[3])
+{
+    for (int i = 0; i < 8; i++) { key_words[i] = load32(key + 4 * i); }
+    for (int i = 0; i < 3; i++) { nonce_words[i] = load32(nonce + 4 * i); }
+}
+
+
+//*******************************************************************************
+void PacketCipher::chacha20Block(const uint8_t* key, const uint8_t* nonce, uint32_t block,
+                                 uint8_t* out)
+{
+    uint32_t key_words[8], nonce_words[3], stream[16];
+    loadKeyAndNonce(key, nonce, key_words, nonce_words);
+    chachaBlock(key_words, block, nonce_words, stream);
+    for (int i = 0; i < 16; i++) { store32(out + 4 * i, stream[i]); }
+}
+
+
+//*******************************************************************************
+void PacketCipher::poly1305(const uint8_t* key, const uint8_t* message, int size,
+                            uint8_t* tag)
+{
+    Poly1305 poly(key);
+    poly.message(message, size);
+    poly.finish(tag);
+}
+
+
+//*******************************************************************************
+void PacketCipher::aeadEncrypt(const uint8_t* key, const uint8_t* nonce,
+                               const uint8_t* aad, int aad_size,
+                               uint8_t* data, int size, uint8_t* tag)
+{
+    uint32_t key_words[8], nonce_words[3];
+    loadKeyAndNonce(key, nonce, key_words, nonce_words);
+    chachaXor(key_words, nonce_words, data, size);
+    aeadTag(key_words, nonce_words, aad, aad_size, data, size, tag);
+}
+
+
+//*******************************************************************************
+void PacketCipher::benchmark(std::ostream& out)
+{
+    // Header and audio of common sessions: 16-bit stereo and 24-bit 8 channels
+    // of 128 samples, a full Ethernet datagram, redundancy 2 of 32 channels
+    static const int sizes[] = { 64, 528, 1472, 3088, 8208 };
+    const int iterations = 20000;
+    uint8_t key[KEY_SIZE];
+    for (int i = 0; i < KEY_SIZE; i++) { key[i] = i; }
+    out << "Authenticated encryption (ChaCha20-Poly1305), per datagram:" << endl;
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int size = sizes[s];
+        PacketCipher sender(key);
+        PacketCipher receiver(key);
+        int8_t* datagram = new int8_t[size + getOverheadInBytes()];
+        std::memset(datagram, 0x55, size);
+        int64_t seal_ns = 0;
+        int64_t open_ns = 0;
+        for (int i = 0; i < iterations; i++) {
+            int64_t t0 = getMonotonicNs();
+            int sealed = sender.seal(datagram, size);
+            int64_t t1 = getMonotonicNs();
+            int opened = receiver.open(datagram, sealed);
+            int64_t t2 = getMonotonicNs();
+            if (opened != size) {
+                out << "ERROR: the datagram doesn't authenticate" << endl;
+                delete[] datagram;
+                return;
+            }
+            seal_ns += t1 - t0;
+            open_ns += t2 - t1;
+        }
+        out << "  " << size << " bytes: seal " << seal_ns / iterations << " ns, open "
+            << open_ns / iterations << " ns ("
+            << double(seal_ns) / iterations / size << " ns/byte)" << endl;
+        delete[] datagram;
+    }
+}
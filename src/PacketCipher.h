@@ -0,0 +1,141 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+
+/**
+ * \file PacketCipher.h
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#ifndef __PACKETCIPHER_H__
+#define __PACKETCIPHER_H__
+
+#include <atomic>
+#include <iostream>
+
+#include "jacktrip_types.h"
+
+
+/** \brief Authenticated encryption of the datagrams of a session (--encrypt),
+ * ChaCha20-Poly1305 (RFC 8439) with the keys agreed with X25519 (RFC 7748).
+ *
+ * Each end has one PacketCipher to send, with its send key, and one to
+ * receive, with the key of the peer. A sealed datagram is the ciphertext
+ * followed by the 64-bit nonce counter and the 16-byte tag:
+ *
+ *   | ciphertext (size) | counter (8) | tag (16) |
+ *
+ * The receiver drops the datagrams that don't authenticate and the ones it
+ * already took (a 64-datagram window, as the network reorders them). The
+ * code is portable, without a crypto library, and runs four ChaCha20 blocks
+ * at once in SSE2/NEON vectors with GCC and Clang: a few microseconds per
+ * datagram of a stereo session, see benchmark() (--cryptobench).
+ */
+class PacketCipher
+{
+public:
+    static const int KEY_SIZE = 32;
+    static const int COUNTER_SIZE = 8;
+    static const int TAG_SIZE = 16;
+
+    /// \brief Cipher with a 32-byte key
+    PacketCipher(const uint8_t* key);
+    virtual ~PacketCipher();
+
+    /// \brief Bytes a sealed datagram has more than its plaintext
+    static int getOverheadInBytes() { return COUNTER_SIZE + TAG_SIZE; }
+
+    /** \brief Encrypts size bytes of datagram in place and appends the counter
+     * and the tag, the buffer takes size + getOverheadInBytes() bytes. Thread
+     * safe, each call takes the next counter.
+     * \return Size of the sealed datagram
+     */
+    int seal(int8_t* datagram, int size);
+    /** \brief Authenticates and decrypts a sealed datagram in place (receiver)
+     * \return Size of the plaintext, -1 if the datagram is forged, damaged or
+     * replayed
+     */
+    int open(int8_t* datagram, int size);
+    /// \brief True if a sealed datagram authenticates and is newer than all the
+    /// ones opened, without decrypting it (session resumption)
+    bool isNewest(const int8_t* datagram, int size) const;
+    /// \brief Datagrams dropped by open()
+    uint32_t getRejected() const { return mRejected; }
+
+    /** \brief Fills buf with size bytes of the system CSPRNG
+     * \return false if the system has no random source
+     */
+    static bool getRandomBytes(uint8_t* buf, int size);
+    /** \brief New X25519 key pair of a handshake
+     * \return false if the system has no random source
+     */
+    static bool generateKeyPair(uint8_t* private_key, uint8_t* public_key);
+    /** \brief Session keys from our private key and the public key of the peer.
+     * The client sends with the first key, the hub with the second one.
+     * \return false if the public key of the peer is not valid
+     */
+    static bool deriveKeys(const uint8_t* private_key, const uint8_t* peer_public_key,
+                           bool client, uint8_t* send_key, uint8_t* receive_key);
+    /// \brief The X25519 function of RFC 7748, out = scalar * point, for its
+    /// test vectors
+    static void scalarMult(uint8_t* out, const uint8_t* scalar, const uint8_t* point);
+    /** \brief The primitives of RFC 8439 with any 12-byte nonce and additional
+     * data, the code seal() and open() run, for its test vectors
+     */
+    //@{
+    /// \brief Key stream block (64 bytes) of a 32-byte key (section 2.3)
+    static void chacha20Block(const uint8_t* key, const uint8_t* nonce, uint32_t block,
+                              uint8_t* out);
+    /// \brief Tag (16 bytes) of a message with a one-time 32-byte key (section 2.5)
+    static void poly1305(const uint8_t* key, const uint8_t* message, int size, uint8_t* tag);
+    /// \brief Encrypts data in place and computes its tag (section 2.8)
+    static void aeadEncrypt(const uint8_t* key, const uint8_t* nonce,
+                            const uint8_t* aad, int aad_size,
+                            uint8_t* data, int size, uint8_t* tag);
+    //@}
+
+    /// \brief Prints the cost of seal() and open() for common datagram sizes
+    static void benchmark(std::ostream& out);
+
+private:
+    /// \brief Poly1305 tag of the ciphertext, with the one-time key of counter
+    void computeTag(const uint8_t* ciphertext, int size, uint64_t counter,
+                    uint8_t* tag) const;
+
+    uint32_t mKey[8];
+    std::atomic<uint64_t> mSendCounter; ///< Next counter of seal()
+    uint64_t mNewestCounter; ///< Newest counter opened, 0 = none
+    uint64_t mWindow; ///< Bit i set = counter mNewestCounter - i opened
+    uint32_t mRejected;
+};
+
+#endif // __PACKETCIPHER_H__
@@ -42,6 +42,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
 
 using std::cout; using std::endl;
 
@@ -113,68 +114,184 @@ DefaultHeader::DefaultHeader(JackTrip* jacktrip) :
 void DefaultHeader::fillHeaderCommonFromAudio()
 {
     mHeader.TimeStamp = PacketHeader::usecTime();
-    mHeader.BufferSize = mJackTrip->getBufferSizeInSamples();
-    mHeader.SamplingRate = mJackTrip->getSampleRateType ();
+    mHeader.BufferSize = mJackTrip->getPacketFrames();
+    mHeader.SamplingRate = mJackTrip->getNetworkSampleRateType();
     mHeader.BitResolution = mJackTrip->getAudioBitResolution();
-    mHeader.NumChannels = mJackTrip->getNumChannels();
+    mHeader.NumChannels = std::min(255u, mJackTrip->getNumInputChannels());
     mHeader.ConnectionMode = static_cast<int>(mJackTrip->getConnectionMode());
+    if ( mJackTrip->isDtx() ) { mHeader.ConnectionMode |= DTX_FLAG; }
+    if ( mJackTrip->getSessionToken() != 0 ) { mHeader.ConnectionMode |= RESUME_FLAG; }
+    if ( hasChannelsStruct() ) { mHeader.ConnectionMode |= CHANNELS_FLAG; }
+    if ( mJackTrip->getMtu() > 0 ) { mHeader.ConnectionMode |= FRAGMENT_FLAG; }
+    if ( mJackTrip->isAdaptive() ) { mHeader.ConnectionMode |= ADAPTIVE_FLAG; }
     //printHeader();
 }
 
 
 //***********************************************************************
-void DefaultHeader::checkPeerSettings(int8_t* full_packet)
+int DefaultHeader::getHeaderSizeInBytes() const
 {
-    bool error = false;
+    int size = sizeof(mHeader);
+    if ( mJackTrip->getSessionToken() != 0 ) { size += sizeof(uint32_t); }
+    if ( hasChannelsStruct() ) { size += sizeof(ChannelsStruct); }
+    if ( mJackTrip->isAdaptive() ) { size += sizeof(QualityStruct); }
+    return size;
+}
 
-    DefaultHeaderStruct* peer_header;
-    peer_header =  reinterpret_cast<DefaultHeaderStruct*>(full_packet);
+
+//***********************************************************************
+bool DefaultHeader::hasChannelsStruct() const
+{
+    return ( mJackTrip->getNumInputChannels() != mJackTrip->getNumOutputChannels() ||
+             mJackTrip->getNumInputChannels() > 255 );
+}
+
+
+//***********************************************************************
+void DefaultHeader::putHeaderInPacket(int8_t* full_packet)
+{
+    std::memcpy(full_packet, &mHeader, sizeof(mHeader));
+    int8_t* extra = full_packet + sizeof(mHeader);
+    uint32_t token = mJackTrip->getSessionToken();
+    if ( token != 0 ) {
+        std::memcpy(extra, &token, sizeof(token));
+        extra += sizeof(token);
+    }
+    if (mHeader.ConnectionMode & CHANNELS_FLAG) {
+        ChannelsStruct channels;
+        channels.NumChannels = mJackTrip->getNumInputChannels();
+        channels.NumOutChannels = mJackTrip->getNumOutputChannels();
+        std::memcpy(extra, &channels, sizeof(channels));
+        extra += sizeof(channels);
+    }
+    if (mHeader.ConnectionMode & ADAPTIVE_FLAG) {
+        QualityStruct quality;
+        quality.BitResolution = mJackTrip->getSendBitResolution();
+        quality.RequestedBitResolution = mJackTrip->getRequestedBitResolution();
+        std::memcpy(extra, &quality, sizeof(quality));
+    }
+}
+
+
+//***********************************************************************
+// Prints the settings of the peer that don't match the local ones
+// \return true if they match
+static bool checkSettings(const CompactCapsStruct& peer, const CompactCapsStruct& local)
+{
+    bool error = false;
 
     // Check Buffer Size
-    if ( peer_header->BufferSize != mHeader.BufferSize )
+    if ( peer.BufferSize != local.BufferSize )
     {
-        std::cerr << "ERROR: Peer Buffer Size is  : " << peer_header->BufferSize << endl;
-        std::cerr << "       Local Buffer Size is : " << mHeader.BufferSize << endl;
-        std::cerr << "Make sure both machines use same buffer size" << endl;
+        std::cerr << "ERROR: Peer Buffer Size is  : " << peer.BufferSize << endl;
+        std::cerr << "       Local Buffer Size is : " << local.BufferSize << endl;
+        std::cerr << "Make sure both machines use same buffer size, or the same --packetframes" << endl;
         std::cerr << gPrintSeparator << endl;
         error = true;
     }
 
     // Check Sampling Rate
-    if ( peer_header->SamplingRate != mHeader.SamplingRate )
+    if ( peer.SamplingRate != local.SamplingRate )
     {
         std::cerr << "ERROR: Peer Sampling Rate is   : " <<
                      AudioInterface::getSampleRateFromType
-                     ( static_cast<AudioInterface::samplingRateT>(peer_header->SamplingRate) ) << endl;
+                     ( static_cast<AudioInterface::samplingRateT>(peer.SamplingRate) ) << endl;
         std::cerr << "       Local Sampling Rate is  : " <<
                      AudioInterface::getSampleRateFromType
-                     ( static_cast<AudioInterface::samplingRateT>(mHeader.SamplingRate) ) << endl;
+                     ( static_cast<AudioInterface::samplingRateT>(local.SamplingRate) ) << endl;
         std::cerr << "Make sure both machines use the same Sampling Rate" << endl;
         std::cerr << gPrintSeparator << endl;
         error = true;
     }
 
     // Check Audio Bit Resolution
-    if ( peer_header->BitResolution != mHeader.BitResolution )
+    if ( peer.BitResolution != local.BitResolution )
     {
         std::cerr << "ERROR: Peer Audio Bit Resolution is  : "
-                  << static_cast<int>(peer_header->BitResolution) << endl;
+                  << static_cast<int>(peer.BitResolution) << endl;
         std::cerr << "       Local Audio Bit Resolution is : "
-                  << static_cast<int>(mHeader.BitResolution) << endl;
+                  << static_cast<int>(local.BitResolution) << endl;
         std::cerr << "Make sure both machines use the same Bit Resolution" << endl;
         std::cerr << gPrintSeparator << endl;
         error = true;
     }
 
+    // Check Discontinuous Transmission
+    if ( (peer.ConnectionMode & DTX_FLAG) != (local.ConnectionMode & DTX_FLAG) )
+    {
+        std::cerr << "ERROR: Peer DTX is  : " << ((peer.ConnectionMode & DTX_FLAG) ? "on" : "off") << endl;
+        std::cerr << "       Local DTX is : " << ((local.ConnectionMode & DTX_FLAG) ? "on" : "off") << endl;
+        std::cerr << "Make sure both machines use --dtx, or none of them" << endl;
+        std::cerr << gPrintSeparator << endl;
+        error = true;
+    }
+
+    // Check Adaptive Bit Resolution, the packets of both ends carry a QualityStruct or none
+    if ( (peer.ConnectionMode & ADAPTIVE_FLAG) != (local.ConnectionMode & ADAPTIVE_FLAG) )
+    {
+        std::cerr << "ERROR: Peer adaptive resolution is  : " << ((peer.ConnectionMode & ADAPTIVE_FLAG) ? "on" : "off") << endl;
+        std::cerr << "       Local adaptive resolution is : " << ((local.ConnectionMode & ADAPTIVE_FLAG) ? "on" : "off") << endl;
+        std::cerr << "Make sure both machines use --adaptive, or none of them" << endl;
+        std::cerr << gPrintSeparator << endl;
+        error = true;
+    }
+
+    // Check Session Token, the packets of both ends carry it or none
+    if ( (peer.ConnectionMode & RESUME_FLAG) != (local.ConnectionMode & RESUME_FLAG) )
+    {
+        std::cerr << "ERROR: Peer session token is  : " << ((peer.ConnectionMode & RESUME_FLAG) ? "on" : "off") << endl;
+        std::cerr << "       Local session token is : " << ((local.ConnectionMode & RESUME_FLAG) ? "on" : "off") << endl;
+        std::cerr << "Make sure both machines run the same version of JackTrip" << endl;
+        std::cerr << gPrintSeparator << endl;
+        error = true;
+    }
+    // Check Number of Channels, what one end sends the other receives
+    int peer_out = (peer.NumOutChannels != 0) ? peer.NumOutChannels : peer.NumChannels;
+    int local_out = (local.NumOutChannels != 0) ? local.NumOutChannels : local.NumChannels;
+    if ( peer.NumChannels != local_out || peer_out != local.NumChannels )
+    {
+        std::cerr << "ERROR: Peer Channels are  : " << static_cast<int>(peer.NumChannels)
+                  << " sent, " << peer_out << " received" << endl;
+        std::cerr << "       Local Channels are : " << static_cast<int>(local.NumChannels)
+                  << " sent, " << local_out << " received" << endl;
+        std::cerr << "Make sure each machine receives the channels the other one sends (-n, --receivechannels)" << endl;
+        std::cerr << gPrintSeparator << endl;
+        error = true;
+    }
+    /// \todo Check other parameters
+    return !error;
+}
+
+
+//***********************************************************************
+void DefaultHeader::checkPeerSettings(int8_t* full_packet)
+{
+    DefaultHeaderStruct* peer_header;
+    peer_header =  reinterpret_cast<DefaultHeaderStruct*>(full_packet);
+
+    CompactCapsStruct peer;
+    CompactCapsStruct local;
+    peer.BufferSize = peer_header->BufferSize;
+    peer.SamplingRate = peer_header->SamplingRate;
+    peer.BitResolution = peer_header->BitResolution;
+    peer.NumChannels = getPeerNumChannels(full_packet);
+    peer.ConnectionMode = peer_header->ConnectionMode;
+    peer.NumOutChannels = getPeerNumOutChannels(full_packet);
+    local.BufferSize = mHeader.BufferSize;
+    local.SamplingRate = mHeader.SamplingRate;
+    local.BitResolution = mHeader.BitResolution;
+    local.NumChannels = mJackTrip->getNumInputChannels();
+    local.ConnectionMode = mHeader.ConnectionMode;
+    local.NumOutChannels = mJackTrip->getNumOutputChannels();
+
     // Exit program if error
-    if (error)
+    if ( !checkSettings(peer, local) )
     {
         //std::cerr << "Exiting program..." << endl;
         //std::exit(1);
         //throw std::logic_error("Local and Peer Settings don't match");
         emit signalError("Local and Peer Settings don't match");
     }
-    /// \todo Check number of channels and other parameters
 }
 
 
@@ -247,11 +364,12 @@ uint8_t DefaultHeader::getPeerBitResolution(int8_t* full_packet) const
 
 
 //***********************************************************************
-uint8_t DefaultHeader::getPeerNumChannels(int8_t* full_packet) const
+uint16_t DefaultHeader::getPeerNumChannels(int8_t* full_packet) const
 {
     DefaultHeaderStruct* peer_header;
     peer_header =  reinterpret_cast<DefaultHeaderStruct*>(full_packet);
-    return peer_header->NumChannels;
+    if ( !(peer_header->ConnectionMode & CHANNELS_FLAG) ) { return peer_header->NumChannels; }
+    return getPeerChannels(full_packet).NumChannels;
 }
 
 
@@ -264,6 +382,345 @@ uint8_t DefaultHeader::getPeerConnectionMode(int8_t* full_packet) const
 }
 
 
+//***********************************************************************
+uint32_t DefaultHeader::getPeerSessionToken(const int8_t* full_packet) const
+{
+    const DefaultHeaderStruct* peer_header;
+    peer_header =  reinterpret_cast<const DefaultHeaderStruct*>(full_packet);
+    if ( !(peer_header->ConnectionMode & RESUME_FLAG) ) { return 0; }
+    uint32_t token;
+    std::memcpy(&token, full_packet + sizeof(DefaultHeaderStruct), sizeof(token));
+    return token;
+}
+
+
+//***********************************************************************
+uint16_t DefaultHeader::getPeerNumOutChannels(int8_t* full_packet) const
+{
+    DefaultHeaderStruct* peer_header;
+    peer_header =  reinterpret_cast<DefaultHeaderStruct*>(full_packet);
+    if ( !(peer_header->ConnectionMode & CHANNELS_FLAG) ) { return peer_header->NumChannels; }
+    return getPeerChannels(full_packet).NumOutChannels;
+}
+
+
+//***********************************************************************
+const QualityStruct* DefaultHeader::getPeerQuality(const int8_t* full_packet) const
+{
+    const DefaultHeaderStruct* peer_header;
+    peer_header =  reinterpret_cast<const DefaultHeaderStruct*>(full_packet);
+    if ( !(peer_header->ConnectionMode & ADAPTIVE_FLAG) ) { return NULL; }
+    int offset = sizeof(DefaultHeaderStruct);
+    if (peer_header->ConnectionMode & RESUME_FLAG) { offset += sizeof(uint32_t); }
+    if (peer_header->ConnectionMode & CHANNELS_FLAG) { offset += sizeof(ChannelsStruct); }
+    return reinterpret_cast<const QualityStruct*>(full_packet + offset);
+}
+
+
+//***********************************************************************
+ChannelsStruct DefaultHeader::getPeerChannels(const int8_t* full_packet)
+{
+    const DefaultHeaderStruct* peer_header;
+    peer_header =  reinterpret_cast<const DefaultHeaderStruct*>(full_packet);
+    int offset = sizeof(DefaultHeaderStruct);
+    if (peer_header->ConnectionMode & RESUME_FLAG) { offset += sizeof(uint32_t); }
+    ChannelsStruct channels;
+    std::memcpy(&channels, full_packet + offset, sizeof(channels));
+    return channels;
+}
+
+
+
+
+
+
+//#######################################################################
+//####################### CompactHeader #################################
+//#######################################################################
+//***********************************************************************
+CompactHeader::CompactHeader(JackTrip* jacktrip) :
+    PacketHeader(jacktrip),
+    mPeerCapsReceived(false),
+    mCapsAcked(false),
+    mLastCapsUsec(0),
+    mJackTrip(jacktrip)
+{
+    mHeader.Version = COMPACT_HEADER_MAGIC | COMPACT_HEADER_VERSION;
+    mHeader.Flags = 0;
+    mHeader.SeqNumber = 0;
+    mHeader.TimeStamp = 0;
+}
+
+
+//***********************************************************************
+bool CompactHeader::isCompactPacket(const int8_t* datagram, int size)
+{
+    return ( size >= static_cast<int>(sizeof(CompactHeaderStruct)) &&
+             (static_cast<uint8_t>(datagram[0]) & 0xF0) == COMPACT_HEADER_MAGIC );
+}
+
+
+//***********************************************************************
+bool CompactHeader::isCapabilityPacket(const int8_t* datagram, int size)
+{
+    if ( !isCompactPacket(datagram, size) ) { return false; }
+    const CompactHeaderStruct* peer_header =
+            reinterpret_cast<const CompactHeaderStruct*>(datagram);
+    int caps_size = sizeof(CompactHeaderStruct) + sizeof(CompactCapsStruct);
+    if (peer_header->Flags & RESUME_FLAG) { caps_size += sizeof(uint32_t); }
+    return ( (peer_header->Flags & CAPS_FLAG) && size >= caps_size );
+}
+
+
+//***********************************************************************
+void CompactHeader::fillHeaderCommonFromAudio()
+{
+    mHeader.TimeStamp = static_cast<uint32_t>(PacketHeader::usecTime());
+    mHeader.Flags = getFlags();
+}
+
+
+//***********************************************************************
+uint8_t CompactHeader::getFlags() const
+{
+    uint8_t flags = 0;
+    if ( mJackTrip->isDtx() ) { flags |= DTX_FLAG; }
+    if ( mJackTrip->getSessionToken() != 0 ) { flags |= RESUME_FLAG; }
+    if (mPeerCapsReceived) { flags |= CAPS_ACK_FLAG; }
+    if ( mJackTrip->isAdaptive() ) { flags |= ADAPTIVE_FLAG; }
+    return flags;
+}
+
+
+//***********************************************************************
+void CompactHeader::fillCaps(CompactCapsStruct& caps) const
+{
+    caps.BufferSize = mJackTrip->getPacketFrames();
+    caps.SamplingRate = mJackTrip->getNetworkSampleRateType();
+    caps.BitResolution = mJackTrip->getAudioBitResolution();
+    caps.NumChannels = mJackTrip->getNumInputChannels();
+    caps.ConnectionMode = static_cast<int>(mJackTrip->getConnectionMode());
+    if ( mJackTrip->isDtx() ) { caps.ConnectionMode |= DTX_FLAG; }
+    if ( mJackTrip->getSessionToken() != 0 ) { caps.ConnectionMode |= RESUME_FLAG; }
+    if ( mJackTrip->getMtu() > 0 ) { caps.ConnectionMode |= FRAGMENT_FLAG; }
+    if ( mJackTrip->isAdaptive() ) { caps.ConnectionMode |= ADAPTIVE_FLAG; }
+    caps.Reserved = 0;
+    caps.NumOutChannels = mJackTrip->getNumOutputChannels();
+}
+
+
+//***********************************************************************
+int CompactHeader::getHeaderSizeInBytes() const
+{
+    int size = sizeof(mHeader);
+    if ( mJackTrip->getSessionToken() != 0 ) { size += sizeof(uint32_t); }
+    if ( mJackTrip->isAdaptive() ) { size += sizeof(QualityStruct); }
+    return size;
+}
+
+
+//***********************************************************************
+void CompactHeader::putHeaderInPacket(int8_t* full_packet)
+{
+    std::memcpy(full_packet, &mHeader, sizeof(mHeader));
+    int8_t* extra = full_packet + sizeof(mHeader);
+    uint32_t token = mJackTrip->getSessionToken();
+    if ( token != 0 ) {
+        std::memcpy(extra, &token, sizeof(token));
+        extra += sizeof(token);
+    }
+    if (mHeader.Flags & ADAPTIVE_FLAG) {
+        QualityStruct quality;
+        quality.BitResolution = mJackTrip->getSendBitResolution();
+        quality.RequestedBitResolution = mJackTrip->getRequestedBitResolution();
+        std::memcpy(extra, &quality, sizeof(quality));
+    }
+}
+
+
+//***********************************************************************
+bool CompactHeader::putCapabilityPacket(int8_t* datagram, int size)
+{
+    // Until the peer has them, a few times per second in case they're lost
+    if (mCapsAcked) { return false; }
+    uint64_t now = PacketHeader::usecTime();
+    if ( mLastCapsUsec != 0 && now - mLastCapsUsec < gCompactCapsIntervalUsec ) { return false; }
+    // The capabilities take the place of the QualityStruct (--adaptive)
+    uint32_t token = mJackTrip->getSessionToken();
+    int header_size = sizeof(mHeader) + ((token != 0) ? sizeof(token) : 0);
+    if ( size < header_size + static_cast<int>(sizeof(CompactCapsStruct)) ) { return false; }
+    mLastCapsUsec = now;
+
+    // The audio packets may be built in the audio callback, mHeader is theirs
+    CompactHeaderStruct header = mHeader;
+    header.TimeStamp = static_cast<uint32_t>(now);
+    header.Flags = getFlags() | CAPS_FLAG;
+    std::memset(datagram, 0, size);
+    std::memcpy(datagram, &header, sizeof(header));
+    if ( token != 0 ) { std::memcpy(datagram + sizeof(header), &token, sizeof(token)); }
+    CompactCapsStruct caps;
+    fillCaps(caps);
+    std::memcpy(datagram + header_size, &caps, sizeof(caps));
+    return true;
+}
+
+
+//***********************************************************************
+bool CompactHeader::parsePeerHeader(const int8_t* datagram, int size)
+{
+    if ( !isCompactPacket(datagram, size) ) { return false; }
+    const CompactHeaderStruct* peer_header =
+            reinterpret_cast<const CompactHeaderStruct*>(datagram);
+    if (peer_header->Flags & CAPS_ACK_FLAG) { mCapsAcked = true; }
+    if ( !(peer_header->Flags & CAPS_FLAG) ) { return false; }
+    if ( !mPeerCapsReceived && isCapabilityPacket(datagram, size) ) {
+        checkPeerSettings(const_cast<int8_t*>(datagram));
+    }
+    return true;
+}
+
+
+//***********************************************************************
+void CompactHeader::checkPeerSettings(int8_t* full_packet)
+{
+    const CompactHeaderStruct* peer_header =
+            reinterpret_cast<const CompactHeaderStruct*>(full_packet);
+    if ( (peer_header->Version & 0xF0) != COMPACT_HEADER_MAGIC ) {
+        std::cerr << "ERROR: Peer doesn't use the compact header" << endl;
+        std::cerr << "Make sure both machines use --compactheader, or none of them" << endl;
+        std::cerr << gPrintSeparator << endl;
+        emit signalError("Local and Peer Settings don't match");
+        return;
+    }
+    if ( peer_header->Version != mHeader.Version ) {
+        std::cerr << "ERROR: Peer compact header version is  : "
+                  << static_cast<int>(peer_header->Version & 0x0F) << endl;
+        std::cerr << "       Local compact header version is : "
+                  << static_cast<int>(mHeader.Version & 0x0F) << endl;
+        std::cerr << "Make sure both machines run the same version of JackTrip" << endl;
+        std::cerr << gPrintSeparator << endl;
+        emit signalError("Local and Peer Settings don't match");
+        return;
+    }
+
+    // Audio packets come first when capability packets were lost, these
+    // are checked with the first capability packet (parsePeerHeader())
+    const CompactCapsStruct* peer = getPeerCaps(full_packet);
+    if (peer == NULL) { return; }
+    mPeerCapsReceived = true;
+    CompactCapsStruct local;
+    fillCaps(local);
+    if ( !checkSettings(*peer, local) ) {
+        emit signalError("Local and Peer Settings don't match");
+    }
+}
+
+
+//***********************************************************************
+const CompactCapsStruct* CompactHeader::getPeerCaps(const int8_t* full_packet)
+{
+    const CompactHeaderStruct* peer_header =
+            reinterpret_cast<const CompactHeaderStruct*>(full_packet);
+    if ( !(peer_header->Flags & CAPS_FLAG) ) { return NULL; }
+    int offset = sizeof(CompactHeaderStruct);
+    if (peer_header->Flags & RESUME_FLAG) { offset += sizeof(uint32_t); }
+    return reinterpret_cast<const CompactCapsStruct*>(full_packet + offset);
+}
+
+
+//***********************************************************************
+uint64_t CompactHeader::getPeerTimeStamp(int8_t* full_packet) const
+{
+    return reinterpret_cast<CompactHeaderStruct*>(full_packet)->TimeStamp;
+}
+
+
+//***********************************************************************
+uint16_t CompactHeader::getPeerSequenceNumber(int8_t* full_packet) const
+{
+    return reinterpret_cast<CompactHeaderStruct*>(full_packet)->SeqNumber;
+}
+
+
+//***********************************************************************
+uint16_t CompactHeader::getPeerBufferSize(int8_t* full_packet) const
+{
+    const CompactCapsStruct* caps = getPeerCaps(full_packet);
+    return (caps != NULL) ? caps->BufferSize : 0;
+}
+
+
+//***********************************************************************
+uint8_t CompactHeader::getPeerSamplingRate(int8_t* full_packet) const
+{
+    const CompactCapsStruct* caps = getPeerCaps(full_packet);
+    return (caps != NULL) ? caps->SamplingRate : 0;
+}
+
+
+//***********************************************************************
+uint8_t CompactHeader::getPeerBitResolution(int8_t* full_packet) const
+{
+    const CompactCapsStruct* caps = getPeerCaps(full_packet);
+    return (caps != NULL) ? caps->BitResolution : 0;
+}
+
+
+//***********************************************************************
+uint16_t CompactHeader::getPeerNumChannels(int8_t* full_packet) const
+{
+    const CompactCapsStruct* caps = getPeerCaps(full_packet);
+    return (caps != NULL) ? caps->NumChannels : 0;
+}
+
+
+//***********************************************************************
+uint16_t CompactHeader::getPeerNumOutChannels(int8_t* full_packet) const
+{
+    const CompactCapsStruct* caps = getPeerCaps(full_packet);
+    if (caps == NULL) { return 0; }
+    return (caps->NumOutChannels != 0) ? caps->NumOutChannels : caps->NumChannels;
+}
+
+
+//***********************************************************************
+uint8_t CompactHeader::getPeerConnectionMode(int8_t* full_packet) const
+{
+    // The flags of every packet, the rest of the mode in capability packets
+    const CompactCapsStruct* caps = getPeerCaps(full_packet);
+    if (caps != NULL) { return caps->ConnectionMode; }
+    return reinterpret_cast<CompactHeaderStruct*>(full_packet)->Flags
+            & (DTX_FLAG | RESUME_FLAG | ADAPTIVE_FLAG);
+}
+
+
+//***********************************************************************
+uint32_t CompactHeader::getPeerSessionToken(const int8_t* full_packet) const
+{
+    const CompactHeaderStruct* peer_header =
+            reinterpret_cast<const CompactHeaderStruct*>(full_packet);
+    if ( !(peer_header->Flags & RESUME_FLAG) ) { return 0; }
+    uint32_t token;
+    std::memcpy(&token, full_packet + sizeof(CompactHeaderStruct), sizeof(token));
+    return token;
+}
+
+
+//***********************************************************************
+const QualityStruct* CompactHeader::getPeerQuality(const int8_t* full_packet) const
+{
+    // The capability packets have their CompactCapsStruct there instead
+    const CompactHeaderStruct* peer_header =
+            reinterpret_cast<const CompactHeaderStruct*>(full_packet);
+    if ( !(peer_header->Flags & ADAPTIVE_FLAG) || (peer_header->Flags & CAPS_FLAG) ) {
+        return NULL;
+    }
+    int offset = sizeof(CompactHeaderStruct);
+    if (peer_header->Flags & RESUME_FLAG) { offset += sizeof(uint32_t); }
+    return reinterpret_cast<const QualityStruct*>(full_packet + offset);
+}
+
+
 
 
 
@@ -41,6 +41,7 @@
 #include <iostream>
 //#include <tr1/memory> // for shared_ptr
 #include <cstring>
+#include <atomic>
 
 #include <QObject>
 #include <QString>
@@ -60,15 +61,87 @@ public:
     // watch out for alignment...
     uint64_t TimeStamp; ///< Time Stamp
     uint16_t SeqNumber; ///< Sequence Number
-    uint16_t BufferSize; ///< Buffer Size in Samples
+    uint16_t BufferSize; ///< Buffer Size in Samples, of the packet (see JackTrip::setPacketFrames())
     uint8_t  SamplingRate; ///< Sampling Rate in JackAudioInterface::samplingRateT
     uint8_t BitResolution; ///< Audio Bit Resolution
     //uint8_t  NumInChannels; ///< Number of Input Channels
     //uint8_t  NumOutChannels; ///<  Number of Output Channels
-    uint8_t  NumChannels; ///< Number of Channels, we assume input and outputs are the same
+    uint8_t  NumChannels; ///< Number of Channels of the packet, the inputs of the sender, at most 255 (see CHANNELS_FLAG)
     uint8_t  ConnectionMode;
 };
 
+/// \brief ConnectionMode bit of the packets sent with discontinuous transmission
+/// (--dtx). In those packets a bit mask of the channels present follows the header
+/// (bit i of byte i/8 set = channel i sent) and the silent channels are omitted
+/// from the audio part.
+const uint8_t DTX_FLAG = (1<<7);
+
+/// \brief ConnectionMode bit of the packets of a resumable hub session. The
+/// 32-bit session token given by the hub in the TCP handshake follows the
+/// header, so the hub can recognize the client after a change of address.
+const uint8_t RESUME_FLAG = (1<<6);
+
+/// \brief ConnectionMode bit of the packets of an end that receives another
+/// number of channels than it sends, or more than 255. A ChannelsStruct
+/// follows the header (and session token); the other sessions don't carry it.
+const uint8_t CHANNELS_FLAG = (1<<5);
+
+/// \brief ConnectionMode bit of an end that sends its datagrams larger than
+/// the path MTU in fragments (--mtu), a hub then does the same toward it
+const uint8_t FRAGMENT_FLAG = (1<<4);
+
+/// \brief ConnectionMode bit of the packets of an end with adaptive bit
+/// resolution (--adaptive). A QualityStruct follows the header (and session
+/// token and ChannelsStruct), the packets go packed as with DTX_FLAG.
+const uint8_t ADAPTIVE_FLAG = (1<<3);
+
+/// \brief Channel counts of the packets with CHANNELS_FLAG
+struct ChannelsStruct
+{
+    uint16_t NumChannels; ///< Number of Channels sent
+    uint16_t NumOutChannels; ///< Number of Channels received
+};
+
+/// \brief Bit resolutions of the packets with ADAPTIVE_FLAG, in bits
+struct QualityStruct
+{
+    uint8_t BitResolution; ///< Of the audio of this packet, at most the session's
+    uint8_t RequestedBitResolution; ///< Of the packets the sender wants from its peer
+};
+
+/// \brief Compact Header Struct, the settings that don't change during the
+/// session go once at its start, in capability packets (see CompactHeader)
+struct CompactHeaderStruct : public HeaderStruct
+{
+public:
+    uint8_t  Version; ///< COMPACT_HEADER_MAGIC | COMPACT_HEADER_VERSION
+    uint8_t  Flags; ///< DTX_FLAG, RESUME_FLAG, CAPS_FLAG, CAPS_ACK_FLAG, ADAPTIVE_FLAG
+    uint16_t SeqNumber; ///< Sequence Number
+    uint32_t TimeStamp; ///< Time Stamp, lower 32 bits of PacketHeader::usecTime()
+};
+
+/// \brief Settings of a compact header session, they follow the header (and
+/// session token) in the capability packets
+struct CompactCapsStruct
+{
+    uint16_t BufferSize; ///< Buffer Size in Samples, of the packet
+    uint8_t  SamplingRate; ///< Sampling Rate in JackAudioInterface::samplingRateT
+    uint8_t  BitResolution; ///< Audio Bit Resolution
+    uint8_t  ConnectionMode; ///< With DTX_FLAG, RESUME_FLAG, FRAGMENT_FLAG and ADAPTIVE_FLAG, as in DefaultHeaderStruct
+    uint8_t  Reserved; ///< 0, for new modes
+    uint16_t NumChannels; ///< Number of Channels sent
+    uint16_t NumOutChannels; ///< Number of Channels received, 0 = NumChannels
+};
+
+/// \brief High nibble of CompactHeaderStruct::Version, the low one is the version
+const uint8_t COMPACT_HEADER_MAGIC = 0xC0;
+const uint8_t COMPACT_HEADER_VERSION = 2; // 2: 16-bit channel counts
+/// \brief Flags bit of the capability packets, CompactCapsStruct instead of audio
+const uint8_t CAPS_FLAG = (1<<5);
+/// \brief Flags bit of the packets of a peer that has our capabilities
+const uint8_t CAPS_ACK_FLAG = (1<<4);
+// ADAPTIVE_FLAG is bit 3, the lower Flags bits are free for new per packet modes
+
 //---------------------------------------------------------
 //JamLink UDP Header:
 /************************************************************************/
@@ -140,8 +213,22 @@ public:
     virtual uint16_t getPeerBufferSize(int8_t* full_packet) const = 0;
     virtual uint8_t  getPeerSamplingRate(int8_t* full_packet) const = 0;
     virtual uint8_t getPeerBitResolution(int8_t* full_packet) const = 0;
-    virtual uint8_t  getPeerNumChannels(int8_t* full_packet) const = 0;
+    virtual uint16_t getPeerNumChannels(int8_t* full_packet) const = 0;
     virtual uint8_t  getPeerConnectionMode(int8_t* full_packet) const = 0;
+    /// \brief Channels the peer receives, its audio outputs
+    virtual uint16_t getPeerNumOutChannels(int8_t* full_packet) const
+    { return getPeerNumChannels(full_packet); }
+    /// \brief Session token of the packet, 0 if it has none
+    virtual uint32_t getPeerSessionToken(const int8_t* /*full_packet*/) const { return 0; }
+    /// \brief Bit resolutions of the packet (ADAPTIVE_FLAG), NULL if it has none
+    virtual const QualityStruct* getPeerQuality(const int8_t* /*full_packet*/) const { return NULL; }
+    /// \brief Look at the header of every datagram received, before its audio
+    /// \return true if the datagram has no audio, only header information
+    virtual bool parsePeerHeader(const int8_t* /*datagram*/, int /*size*/) { return false; }
+    /// \brief Put a packet with the settings of the session in datagram, for
+    /// the headers that don't carry them in every packet
+    /// \return false if there's nothing to send now
+    virtual bool putCapabilityPacket(int8_t* /*datagram*/, int /*size*/) { return false; }
 
     /// \brief Increase sequence number for counter, a 16bit number
     virtual void increaseSequenceNumber()
@@ -195,9 +282,8 @@ public:
     { mHeader.SeqNumber++; }
     virtual uint16_t getSequenceNumber() const
     { return mHeader.SeqNumber; }
-    virtual int getHeaderSizeInBytes() const { return sizeof(mHeader); }
-    virtual void putHeaderInPacket(int8_t* full_packet)
-    { putHeaderInPacketBaseClass(full_packet, mHeader); }
+    virtual int getHeaderSizeInBytes() const;
+    virtual void putHeaderInPacket(int8_t* full_packet);
     void printHeader() const;
     uint8_t getConnectionMode() const
     { return mHeader.ConnectionMode; }
@@ -210,11 +296,18 @@ public:
     virtual uint16_t getPeerBufferSize(int8_t* full_packet) const;
     virtual uint8_t  getPeerSamplingRate(int8_t* full_packet) const;
     virtual uint8_t getPeerBitResolution(int8_t* full_packet) const;
-    virtual uint8_t  getPeerNumChannels(int8_t* full_packet) const;
+    virtual uint16_t getPeerNumChannels(int8_t* full_packet) const;
     virtual uint8_t  getPeerConnectionMode(int8_t* full_packet) const;
+    virtual uint16_t getPeerNumOutChannels(int8_t* full_packet) const;
+    virtual uint32_t getPeerSessionToken(const int8_t* full_packet) const;
+    virtual const QualityStruct* getPeerQuality(const int8_t* full_packet) const;
 
 
 private:
+    /// \brief True if the packets carry a ChannelsStruct (CHANNELS_FLAG)
+    bool hasChannelsStruct() const;
+    static ChannelsStruct getPeerChannels(const int8_t* full_packet);
+
     DefaultHeaderStruct mHeader;///< Default Header Struct
     JackTrip* mJackTrip; ///< JackTrip mediator class
 };
@@ -222,6 +315,69 @@ private:
 
 
 
+//#######################################################################
+//####################### CompactHeader #################################
+//#######################################################################
+/** \brief Versioned header without the session settings in every packet
+ *
+ * Each side sends its settings in capability packets (CAPS_FLAG) at the
+ * start of the session, until the packets of the peer come with
+ * CAPS_ACK_FLAG. The audio packets only have the sequence number, a
+ * truncated time stamp and the flags, 8 bytes instead of 16.
+ */
+class CompactHeader : public PacketHeader
+{
+public:
+
+    CompactHeader(JackTrip* jacktrip);
+    virtual ~CompactHeader() {}
+
+    /// \brief True if the datagram starts with a compact header. A default
+    /// header may look like one, only for the datagrams of a compact session
+    /// (announced in the TCP handshake, or --compactheader on both ends)
+    static bool isCompactPacket(const int8_t* datagram, int size);
+    /// \brief True if the datagram is a capability packet
+    static bool isCapabilityPacket(const int8_t* datagram, int size);
+
+    virtual void fillHeaderCommonFromAudio();
+    virtual void parseHeader() {}
+    virtual void checkPeerSettings(int8_t* full_packet);
+    virtual bool parsePeerHeader(const int8_t* datagram, int size);
+    virtual bool putCapabilityPacket(int8_t* datagram, int size);
+    virtual void increaseSequenceNumber()
+    { mHeader.SeqNumber++; }
+    virtual uint16_t getSequenceNumber() const
+    { return mHeader.SeqNumber; }
+    virtual int getHeaderSizeInBytes() const;
+    virtual void putHeaderInPacket(int8_t* full_packet);
+
+    virtual uint64_t getPeerTimeStamp(int8_t* full_packet) const;
+    virtual uint16_t getPeerSequenceNumber(int8_t* full_packet) const;
+    virtual uint16_t getPeerBufferSize(int8_t* full_packet) const;
+    virtual uint8_t  getPeerSamplingRate(int8_t* full_packet) const;
+    virtual uint8_t getPeerBitResolution(int8_t* full_packet) const;
+    virtual uint16_t getPeerNumChannels(int8_t* full_packet) const;
+    virtual uint8_t  getPeerConnectionMode(int8_t* full_packet) const;
+    virtual uint16_t getPeerNumOutChannels(int8_t* full_packet) const;
+    virtual uint32_t getPeerSessionToken(const int8_t* full_packet) const;
+    virtual const QualityStruct* getPeerQuality(const int8_t* full_packet) const;
+
+private:
+    /// \brief Capabilities of a capability packet, NULL if it isn't one
+    static const CompactCapsStruct* getPeerCaps(const int8_t* full_packet);
+    uint8_t getFlags() const;
+    void fillCaps(CompactCapsStruct& caps) const;
+
+    CompactHeaderStruct mHeader; ///< Compact Header Struct
+    std::atomic<bool> mPeerCapsReceived; ///< The settings of the peer were checked
+    std::atomic<bool> mCapsAcked; ///< The peer has our settings
+    uint64_t mLastCapsUsec; ///< Time of the last capability packet sent
+    JackTrip* mJackTrip; ///< JackTrip mediator class
+};
+
+
+
+
 //#######################################################################
 //####################### JamLinkHeader #################################
 //#######################################################################
@@ -244,7 +400,7 @@ public:
     virtual uint16_t getPeerBufferSize(int8_t* /*full_packet*/) const { return 0; }
     virtual uint8_t  getPeerSamplingRate(int8_t* /*full_packet*/) const { return 0; }
     virtual uint8_t getPeerBitResolution(int8_t* /*full_packet*/) const { return 0; }
-    virtual uint8_t  getPeerNumChannels(int8_t* /*full_packet*/) const { return 0; }
+    virtual uint16_t getPeerNumChannels(int8_t* /*full_packet*/) const { return 0; }
     virtual uint8_t  getPeerConnectionMode(int8_t* /*full_packet*/) const { return 0; }
 
     virtual void increaseSequenceNumber() {}
@@ -283,7 +439,7 @@ public:
     virtual uint16_t getPeerBufferSize(int8_t* /*full_packet*/) const { return 0; }
     virtual uint8_t  getPeerSamplingRate(int8_t* /*full_packet*/) const { return 0; }
     virtual uint8_t getPeerBitResolution(int8_t* /*full_packet*/) const { return 0; }
-    virtual uint8_t  getPeerNumChannels(int8_t* /*full_packet*/) const { return 0; }
+    virtual uint16_t getPeerNumChannels(int8_t* /*full_packet*/) const { return 0; }
     virtual uint8_t  getPeerConnectionMode(int8_t* /*full_packet*/) const { return 0; }
 
     virtual void putHeaderInPacket(int8_t* /*full_packet*/) {}
@@ -0,0 +1,151 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+/**
+ * \file PatchManager.cpp
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#include <iostream>
+#include <stdexcept>
+
+#include <QMutexLocker>
+#include <QElapsedTimer>
+
+#include "PatchManager.h"
+#include "JMess.h"
+#include "HubMixer.h"
+#include "JackTrip.h"
+#include "jacktrip_globals.h"
+
+using std::cout; using std::endl;
+
+
+//*******************************************************************************
+PatchManager::PatchManager(unsigned int hubPatch, int topN) :
+    mHubPatch(hubPatch),
+    mTopN(topN),
+    mRecorder(NULL),
+    mMixerLoad(NULL),
+    mMixerRemoteControl(false),
+    mPending(false),
+    mStopped(false)
+{}
+
+
+//*******************************************************************************
+PatchManager::~PatchManager()
+{
+    stop();
+}
+
+
+//*******************************************************************************
+void PatchManager::stop()
+{
+    {
+        QMutexLocker lock(&mMutex);
+        mStopped = true;
+        mPatchRequested.wakeAll();
+    }
+    wait();
+}
+
+
+//*******************************************************************************
+void PatchManager::requestPatch(bool spawn)
+{
+    if (gVerboseFlag) cout << ((spawn)?"spawning":"releasing")
+                           << " jacktripWorker so change patch" << endl;
+    QMutexLocker lock(&mMutex);
+    mPending = true;
+    mPatchRequested.wakeAll();
+}
+
+
+//*******************************************************************************
+void PatchManager::run()
+{
+    // The JACK client lives as long as the hub, created in this thread
+    JMess jmess;
+    QElapsedTimer timer;
+
+    HubMixer* mixer = NULL;
+    if (mHubPatch == JackTrip::CUSTOMMIX) {
+        mixer = new HubMixer;
+        try {
+            mixer->setup();
+            mixer->setTopN(mTopN);
+            mixer->setRecorder(mRecorder);
+            mixer->setCallbackLoad(mMixerLoad);
+            mixer->setRemoteControl(mMixerRemoteControl);
+            mixer->start();
+        }
+        catch (const std::exception& e) {
+            std::cerr << "JackTrip HUB SERVER: " << e.what() << endl;
+            delete mixer;
+            mixer = NULL;
+        }
+    }
+
+    while (true) {
+        {
+            QMutexLocker lock(&mMutex);
+            while ( !mPending && !mStopped ) { mPatchRequested.wait(&mMutex); }
+            if (mStopped) { break; }
+            mPending = false;
+        }
+
+        timer.start();
+        int changes = 0;
+        // default is patch 0, which connects server audio to all clients
+        // these are the other cases:
+        if (mHubPatch == JackTrip::RESERVEDMATRIX) { // special patch for TU Berlin ensemble
+            jmess.connectTUB(gDefaultNumInChannels);
+        }
+        else if ((mHubPatch == JackTrip::CLIENTECHO) || // client loopback for testing
+                 (mHubPatch == JackTrip::CLIENTFOFI) || // all clients to all clients except self
+                 (mHubPatch == JackTrip::FULLMIX) || // all clients to all clients including self
+                 (mHubPatch == JackTrip::CUSTOMMIX)) { // clients to their own mix
+            changes = jmess.updateSpawnedPorts(mHubPatch, mixer);
+        }
+        else {
+            continue;
+        }
+        cout << "JackTrip HUB SERVER: Patch updated in "
+             << timer.nsecsElapsed() / 1000000.0 << " ms ("
+             << changes << " connections changed)" << endl;
+    }
+
+    delete mixer;
+    if (mMixerLoad != NULL) { mMixerLoad->clear(); }
+}
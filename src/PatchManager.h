@@ -0,0 +1,95 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+/**
+ * \file PatchManager.h
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#ifndef __PATCHMANAGER_H__
+#define __PATCHMANAGER_H__
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+class JMess;
+class Recorder;
+struct CallbackLoad;
+
+/** \brief Persistent hub patcher.
+ *
+ * Owns a single JMess (and so a single JACK client) for the lifetime of the hub.
+ * Join and leave notifications only flag that the graph changed; the patch is
+ * then applied incrementally (see JMess::updateSpawnedPorts()) from this
+ * non real-time thread, so neither the audio threads nor the
+ * UdpMasterListener wait for the JACK graph changes. Requests that arrive
+ * while a patch is being applied are coalesced into the next one.
+ */
+class PatchManager : public QThread
+{
+    Q_OBJECT;
+
+public:
+    /// \param topN Sources mixed in each HubMixer mix (hubpatch CUSTOMMIX), 0 = all
+    PatchManager(unsigned int hubPatch, int topN = 0);
+    virtual ~PatchManager();
+
+    /// \brief Implements the Thread Loop. To start the thread, call start()
+    /// ( DO NOT CALL run() )
+    void run();
+
+    /// \brief Stops the execution of the Thread and waits for it
+    void stop();
+
+    /// \brief Requests a patch update after a client joined (spawn = true) or left
+    void requestPatch(bool spawn);
+    /// \brief Records the HubMixer mixes, must be called before start()
+    void setRecorder(Recorder* recorder) { mRecorder = recorder; }
+    /// \brief Measures the cost of the HubMixer into load, must be called before start()
+    void setMixerLoad(CallbackLoad* load) { mMixerLoad = load; }
+    /// \brief Opens the HubMixer control port to other hosts, must be called before start()
+    void setMixerRemoteControl(bool remote) { mMixerRemoteControl = remote; }
+
+private:
+    unsigned int mHubPatch;
+    int mTopN;
+    Recorder* mRecorder; ///< Session recorder, or NULL
+    CallbackLoad* mMixerLoad; ///< Cost of the HubMixer, or NULL
+    bool mMixerRemoteControl; ///< HubMixer control commands from other hosts
+    QMutex mMutex;
+    QWaitCondition mPatchRequested;
+    bool mPending; ///< A patch update was requested
+    bool mStopped;
+};
+
+#endif //__PATCHMANAGER_H__
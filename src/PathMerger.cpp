@@ -0,0 +1,169 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+
+/**
+ * \file PathMerger.cpp
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#include "PathMerger.h"
+
+#include <cstring>
+
+
+//*******************************************************************************
+PathMerger::PathMerger(const struct sockaddr_storage& peer) :
+    mPeer(peer), mNumPaths(0)
+{
+    for (int i = 0; i < gMaxPaths; i++) {
+        Path& path = mPaths[i];
+        std::memset(&path.address, 0, sizeof(path.address));
+        path.hasSeq = false;
+        path.lastSeq = 0;
+        path.received = 0;
+        path.first = 0;
+        path.lost = 0;
+        path.late = 0;
+        path.lateUsec = 0;
+        path.lateMaxUsec = 0;
+    }
+    for (int i = 0; i < gMultipathWindow; i++) {
+        mSeq[i] = 0;
+        mArrivalNs[i] = 0;
+        mSeen[i] = false;
+    }
+}
+
+
+//*******************************************************************************
+static bool isSameAddress(const struct sockaddr_storage& a, const struct sockaddr_storage& b)
+{
+    if (a.ss_family != b.ss_family) { return false; }
+    if (a.ss_family == AF_INET6) {
+        const struct sockaddr_in6& a6 = reinterpret_cast<const struct sockaddr_in6&>(a);
+        const struct sockaddr_in6& b6 = reinterpret_cast<const struct sockaddr_in6&>(b);
+        return a6.sin6_port == b6.sin6_port &&
+                std::memcmp(&a6.sin6_addr, &b6.sin6_addr, sizeof(a6.sin6_addr)) == 0;
+    }
+    const struct sockaddr_in& a4 = reinterpret_cast<const struct sockaddr_in&>(a);
+    const struct sockaddr_in& b4 = reinterpret_cast<const struct sockaddr_in&>(b);
+    return a4.sin_port == b4.sin_port && a4.sin_addr.s_addr == b4.sin_addr.s_addr;
+}
+
+
+//*******************************************************************************
+bool PathMerger::isPeerAddress(const struct sockaddr_storage& address) const
+{
+    if (address.ss_family != mPeer.ss_family) { return false; }
+    if (address.ss_family == AF_INET6) {
+        const struct sockaddr_in6& a6 = reinterpret_cast<const struct sockaddr_in6&>(address);
+        const struct sockaddr_in6& p6 = reinterpret_cast<const struct sockaddr_in6&>(mPeer);
+        return std::memcmp(&a6.sin6_addr, &p6.sin6_addr, sizeof(a6.sin6_addr)) == 0;
+    }
+    const struct sockaddr_in& a4 = reinterpret_cast<const struct sockaddr_in&>(address);
+    const struct sockaddr_in& p4 = reinterpret_cast<const struct sockaddr_in&>(mPeer);
+    return a4.sin_addr.s_addr == p4.sin_addr.s_addr;
+}
+
+
+//*******************************************************************************
+int PathMerger::findPath(const struct sockaddr_storage& address)
+{
+    int num_paths = mNumPaths.load(std::memory_order_relaxed);
+    for (int i = 0; i < num_paths; i++) {
+        if ( isSameAddress(mPaths[i].address, address) ) { return i; }
+    }
+    if (num_paths == gMaxPaths) { return -1; }
+    mPaths[num_paths].address = address;
+    mNumPaths.store(num_paths + 1, std::memory_order_release);
+    return num_paths;
+}
+
+
+//*******************************************************************************
+bool PathMerger::isFirstCopy(const struct sockaddr_storage& from, bool authenticated,
+                             uint16_t seq, int64_t now_ns)
+{
+    // Any JackTrip has the peer's port, only the key proves another address
+    // is the peer's. Its sequence numbers would hide the peer's datagrams.
+    if ( !authenticated && !isPeerAddress(from) ) { return false; }
+    int index = findPath(from);
+    Path* path = (index >= 0) ? &mPaths[index] : NULL;
+    if (path != NULL) {
+        path->received++;
+        // Losses of this path alone, the others may have brought the datagrams
+        int16_t gap = seq - path->lastSeq - 1;
+        if (path->hasSeq && gap > 0) { path->lost += gap; }
+        if (!path->hasSeq || gap >= 0) {
+            path->lastSeq = seq;
+            path->hasSeq = true;
+        }
+    }
+
+    int slot = seq % gMultipathWindow;
+    if ( mSeen[slot] && mSeq[slot] == seq ) {
+        // A later copy, how far behind the first one
+        if (path != NULL) {
+            uint32_t late_usec = static_cast<uint32_t>((now_ns - mArrivalNs[slot]) / 1000);
+            path->late++;
+            path->lateUsec += late_usec;
+            if (late_usec > path->lateMaxUsec) { path->lateMaxUsec = late_usec; }
+        }
+        return false;
+    }
+    mSeq[slot] = seq;
+    mArrivalNs[slot] = now_ns;
+    mSeen[slot] = true;
+    if (path != NULL) { path->first++; }
+    return true;
+}
+
+
+//*******************************************************************************
+void PathMerger::getStats(QVector<DataProtocol::PathStat>& stats)
+{
+    int num_paths = mNumPaths.load(std::memory_order_acquire);
+    stats.resize(num_paths);
+    for (int i = 0; i < num_paths; i++) {
+        Path& path = mPaths[i];
+        DataProtocol::PathStat& stat = stats[i];
+        stat.address = QHostAddress(reinterpret_cast<const struct sockaddr*>(&path.address));
+        stat.received = path.received.exchange(0);
+        stat.first = path.first.exchange(0);
+        stat.lost = path.lost.exchange(0);
+        uint32_t late = path.late.exchange(0);
+        uint64_t late_usec = path.lateUsec.exchange(0);
+        stat.lateMeanUsec = (late > 0) ? static_cast<uint32_t>(late_usec / late) : 0;
+        stat.lateMaxUsec = path.lateMaxUsec.exchange(0);
+    }
+}
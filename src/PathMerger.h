@@ -0,0 +1,110 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+
+/**
+ * \file PathMerger.h
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#ifndef __PATHMERGER_H__
+#define __PATHMERGER_H__
+
+#include <atomic>
+
+#include <QVector>
+
+#include "DataProtocol.h"
+#include "jacktrip_types.h"
+#include "jacktrip_globals.h"
+
+/** \brief Merges the copies of each datagram a peer sends over several
+ * network paths (--multipath): the first copy goes on, the later ones are
+ * dropped.
+ *
+ * A path is a source address of the datagrams. The receiver thread calls
+ * isFirstCopy() with the sequence number of each datagram, which also counts
+ * the losses of each path and how late its copies arrive after the first
+ * one. Another thread may read these statistics with getStats().
+ *
+ * Only the peer's address, on any port (a NAT may map it), or datagrams that
+ * authenticate (--encrypt) from any address, are paths of the session. The
+ * datagrams of the other sources are dropped before they take a path or a
+ * sequence number of the window.
+ */
+class PathMerger
+{
+public:
+    /// \brief The constructor
+    /// \param peer Address and port of the peer
+    PathMerger(const struct sockaddr_storage& peer);
+
+    /** \brief Takes the datagram of sequence number seq from address from
+     * (receiver thread)
+     * \param authenticated The datagram was opened with the session key
+     * \param now_ns Arrival time, monotonic
+     * \return true if no other path brought it before, false also for
+     * a source outside the session
+     */
+    bool isFirstCopy(const struct sockaddr_storage& from, bool authenticated,
+                     uint16_t seq, int64_t now_ns);
+    /// \brief Statistics of each path since the last call (thread safe)
+    void getStats(QVector<DataProtocol::PathStat>& stats);
+
+private:
+    /// \brief Index of the path of address, added if new, -1 if there are too many
+    int findPath(const struct sockaddr_storage& address);
+    /// \brief True if address is the peer's, on any port
+    bool isPeerAddress(const struct sockaddr_storage& address) const;
+
+    struct Path {
+        struct sockaddr_storage address; ///< Written once, before mNumPaths counts it
+        bool hasSeq; ///< lastSeq is set (receiver thread only)
+        uint16_t lastSeq; ///< Newest sequence number of the path (receiver thread only)
+        std::atomic<uint32_t> received;
+        std::atomic<uint32_t> first;
+        std::atomic<uint32_t> lost;
+        std::atomic<uint32_t> late; ///< Copies that came after the first one
+        std::atomic<uint64_t> lateUsec; ///< Sum of their delays
+        std::atomic<uint32_t> lateMaxUsec;
+    };
+    struct sockaddr_storage mPeer; ///< Address and port the peer was reached at
+    Path mPaths[gMaxPaths];
+    std::atomic<int> mNumPaths;
+
+    // Recent sequence numbers and their first arrival, by seq % gMultipathWindow
+    uint16_t mSeq[gMultipathWindow];
+    int64_t mArrivalNs[gMultipathWindow];
+    bool mSeen[gMultipathWindow];
+};
+
+#endif // __PATHMERGER_H__
@@ -0,0 +1,104 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+/**
+ * \file Reblocker.cpp
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#include "Reblocker.h"
+
+#include <cstring>
+#include <algorithm>
+
+
+//*******************************************************************************
+Reblocker::Reblocker(int num_channels, int sample_size, int max_frames) :
+    mNumChannels(num_channels),
+    mSampleSize(sample_size),
+    mMaxFrames(max_frames),
+    mStart(0),
+    mFrames(0)
+{
+    mBuffer = new int8_t[mNumChannels * mMaxFrames * mSampleSize];
+    std::memset(mBuffer, 0, mNumChannels * mMaxFrames * mSampleSize);
+}
+
+
+//*******************************************************************************
+Reblocker::~Reblocker()
+{
+    delete[] mBuffer;
+}
+
+
+//*******************************************************************************
+void Reblocker::write(const int8_t* block, int frames)
+{
+    int stride = frames; // Channel i of the block at i * stride samples
+    // Too many frames: keep the newest
+    int skipped = std::max(0, frames - mMaxFrames);
+    frames -= skipped;
+    int dropped = std::max(0, mFrames + frames - mMaxFrames);
+    mStart += dropped;
+    mFrames -= dropped;
+    // Move the buffered frames to the front when the block doesn't fit after them
+    if (mStart + mFrames + frames > mMaxFrames) {
+        for (int i = 0; i < mNumChannels; i++) {
+            int8_t* chan = mBuffer + i * mMaxFrames * mSampleSize;
+            std::memmove(chan, chan + mStart * mSampleSize, mFrames * mSampleSize);
+        }
+        mStart = 0;
+    }
+    for (int i = 0; i < mNumChannels; i++) {
+        std::memcpy(mBuffer + (i * mMaxFrames + mStart + mFrames) * mSampleSize,
+                    block + (i * stride + skipped) * mSampleSize,
+                    frames * mSampleSize);
+    }
+    mFrames += frames;
+}
+
+
+//*******************************************************************************
+bool Reblocker::read(int8_t* block, int frames)
+{
+    if (frames > mFrames) { return false; }
+    for (int i = 0; i < mNumChannels; i++) {
+        std::memcpy(block + i * frames * mSampleSize,
+                    mBuffer + (i * mMaxFrames + mStart) * mSampleSize,
+                    frames * mSampleSize);
+    }
+    mStart += frames;
+    mFrames -= frames;
+    if (mFrames == 0) { mStart = 0; }
+    return true;
+}
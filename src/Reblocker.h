@@ -0,0 +1,81 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+/**
+ * \file Reblocker.h
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#ifndef __REBLOCKER_H__
+#define __REBLOCKER_H__
+
+#include "jacktrip_types.h"
+
+
+/** \brief FIFO of planar audio frames, to regroup blocks of one size into
+ * blocks of another size (audio periods into network packets and back).
+ *
+ * Blocks are laid out as in the audio packets: all the samples of channel 0,
+ * then those of channel 1, and so on. Not thread safe, each side of a
+ * JackTrip has its own.
+ */
+class Reblocker
+{
+public:
+    /** \brief The class constructor
+     * \param num_channels Channels in each block
+     * \param sample_size Bytes per sample
+     * \param max_frames Most frames buffered, older frames are dropped beyond
+     */
+    Reblocker(int num_channels, int sample_size, int max_frames);
+    virtual ~Reblocker();
+
+    /// \brief Appends a block of frames
+    void write(const int8_t* block, int frames);
+    /// \brief Takes the oldest frames into block
+    /// \return false, and block is not touched, if fewer frames are buffered
+    bool read(int8_t* block, int frames);
+    /// \brief Frames buffered
+    int getFrames() const { return mFrames; }
+    /// \brief Drops the buffered frames
+    void clear() { mStart = 0; mFrames = 0; }
+
+private:
+    int mNumChannels;
+    int mSampleSize;
+    int mMaxFrames;
+    int8_t* mBuffer; ///< Channel i at i * mMaxFrames samples
+    int mStart; ///< First buffered frame
+    int mFrames; ///< Buffered frames
+};
+
+#endif // __REBLOCKER_H__
@@ -0,0 +1,393 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+/**
+ * \file Recorder.cpp
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#include <iostream>
+#include <cstring>
+
+#if defined ( __LINUX__ )
+#include <fcntl.h>
+#endif
+
+#include <QMutexLocker>
+#include <QDateTime>
+#include <QDir>
+
+#include "Recorder.h"
+
+using std::cout; using std::endl;
+
+// WAV header, padded so that the audio starts at gRecorderAlignment
+static const int sHeaderSize = gRecorderAlignment;
+static const int sDs64Offset = 12; // JUNK chunk turned into ds64 for RF64
+static const int sFactOffset = 74;
+static const int sDataOffset = sHeaderSize - 8;
+
+static void putU16(char* p, uint16_t v)
+{ p[0] = v & 0xff; p[1] = (v >> 8) & 0xff; }
+static void putU32(char* p, uint32_t v)
+{ putU16(p, v & 0xffff); putU16(p + 2, v >> 16); }
+static void putU64(char* p, uint64_t v)
+{ putU32(p, v & 0xffffffff); putU32(p + 4, v >> 32); }
+
+
+//*******************************************************************************
+RecorderTrack::RecorderTrack(const QString& fileName, int numChannels, int sampleRate,
+                             int maxFrames, int numBlocks) :
+    mNumChannels(numChannels),
+    mSampleRate(sampleRate),
+    mMaxFrames(maxFrames),
+    mNumBlocks(numBlocks),
+    mBlocks(numBlocks * numChannels * maxFrames),
+    mFrames(numBlocks),
+    mSilenceBefore(numBlocks),
+    mUnqueuedSilence(0),
+    mWrite(0),
+    mRead(0),
+    mDroppedBlocks(0),
+    mDroppedFrames(0),
+    mFile(fileName),
+    mBufferUsed(0),
+    mDataBytes(0),
+    mReportedDrops(0),
+    mClosing(false)
+{
+    mBufferMemory = new char[gRecorderWriteBufferBytes + gRecorderAlignment];
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(mBufferMemory) + gRecorderAlignment - 1)
+            & ~static_cast<uintptr_t>(gRecorderAlignment - 1);
+    mBuffer = reinterpret_cast<char*>(aligned);
+}
+
+
+//*******************************************************************************
+RecorderTrack::~RecorderTrack()
+{
+    delete[] mBufferMemory;
+}
+
+
+//*******************************************************************************
+bool RecorderTrack::push(const sample_t* const* buffers, unsigned int n_frames)
+{
+    unsigned int w = mWrite.load(std::memory_order_relaxed);
+    unsigned int r = mRead.load(std::memory_order_acquire);
+    if ( w - r >= static_cast<unsigned int>(mNumBlocks) ||
+         n_frames > static_cast<unsigned int>(mMaxFrames) ) {
+        // The writer is behind, the block becomes silence in the file
+        mDroppedBlocks++;
+        mDroppedFrames += n_frames;
+        mUnqueuedSilence += n_frames;
+        return false;
+    }
+
+    int idx = w % mNumBlocks;
+    sample_t* block = &mBlocks[idx * mNumChannels * mMaxFrames];
+    for (int c = 0; c < mNumChannels; c++) {
+        std::memcpy(block + c * mMaxFrames, buffers[c], sizeof(sample_t) * n_frames);
+    }
+    mFrames[idx] = n_frames;
+    mSilenceBefore[idx] = mUnqueuedSilence;
+    mUnqueuedSilence = 0;
+    mWrite.store(w + 1, std::memory_order_release);
+    return true;
+}
+
+
+
+
+//*******************************************************************************
+Recorder::Recorder(const QString& directory) :
+    mDirectory(directory),
+    mStopped(false)
+{
+    QDir().mkpath(mDirectory);
+}
+
+
+//*******************************************************************************
+Recorder::~Recorder()
+{
+    stop();
+}
+
+
+//*******************************************************************************
+void Recorder::stop()
+{
+    mStopped = true;
+    wait();
+}
+
+
+//*******************************************************************************
+RecorderTrack* Recorder::openTrack(const QString& name, int numChannels, int sampleRate,
+                                   int maxFrames)
+{
+    // The writer computes the frames from the bytes, a track needs channels
+    if (numChannels <= 0 || maxFrames <= 0) {
+        std::cerr << "Recorder ERROR: no channels to record in "
+                  << qPrintable(name) << endl;
+        return NULL;
+    }
+    QString fileName = QString(name).replace(":", ".").replace("/", "_")
+            + "_" + QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss") + ".wav";
+    int numBlocks = qMax(2, static_cast<int>(
+                             (int64_t)gRecorderQueueMs * sampleRate / 1000 / maxFrames));
+    RecorderTrack* track = new RecorderTrack(QDir(mDirectory).filePath(fileName),
+                                             numChannels, sampleRate, maxFrames, numBlocks);
+    if ( !track->mFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered) ) {
+        std::cerr << "Recorder ERROR: could not create " << qPrintable(track->mFile.fileName()) << endl;
+        delete track;
+        return NULL;
+    }
+    writeHeader(track);
+
+    cout << "Recording " << numChannels << " channels to "
+         << qPrintable(track->mFile.fileName()) << endl;
+    QMutexLocker lock(&mTracksMutex);
+    mTracks.append(track);
+    return track;
+}
+
+
+//*******************************************************************************
+void Recorder::closeTrack(RecorderTrack* track)
+{
+    if (track == NULL) { return; }
+    QMutexLocker lock(&mTracksMutex);
+    track->mClosing = true;
+}
+
+
+//*******************************************************************************
+void Recorder::run()
+{
+    while (true) {
+        bool stopping = mStopped;
+        QList<RecorderTrack*> tracks;
+        QList<bool> closing;
+        {
+            QMutexLocker lock(&mTracksMutex);
+            tracks = mTracks;
+            for (int i = 0; i < tracks.size(); i++) {
+                closing.append(tracks[i]->mClosing || stopping);
+            }
+        }
+
+        bool busy = false;
+        for (int i = 0; i < tracks.size(); i++) {
+            RecorderTrack* track = tracks[i];
+            busy |= drainTrack(track);
+            if ( track->mDroppedBlocks.load() != track->mReportedDrops ) {
+                track->mReportedDrops = track->mDroppedBlocks.load();
+                std::cerr << "Recorder WARNING: " << qPrintable(track->mFile.fileName())
+                          << " dropped " << track->mReportedDrops << " blocks so far" << endl;
+            }
+            if ( closing[i] ) {
+                drainTrack(track); // pushed before closeTrack()
+                // Dropped at the very end, nothing queued after them
+                uint32_t silence = track->mUnqueuedSilence;
+                if (silence > 0) {
+                    std::vector<char> zeros(sizeof(sample_t) * track->mNumChannels * silence, 0);
+                    writeData(track, zeros.data(), zeros.size());
+                }
+                flushBuffer(track);
+                finishHeader(track);
+                track->mFile.close();
+                cout << "Recorder: closed " << qPrintable(track->mFile.fileName()) << ", "
+                     << track->mDataBytes / (sizeof(sample_t) * track->mNumChannels
+                                             * track->mSampleRate)
+                     << " s, " << track->mDroppedBlocks.load() << " dropped blocks" << endl;
+                {
+                    QMutexLocker lock(&mTracksMutex);
+                    mTracks.removeAll(track);
+                }
+                delete track;
+            }
+        }
+
+        if (stopping) { break; }
+        if (!busy) { QThread::msleep(10); }
+    }
+}
+
+
+//*******************************************************************************
+bool Recorder::drainTrack(RecorderTrack* track)
+{
+    unsigned int r = track->mRead.load(std::memory_order_relaxed);
+    unsigned int w = track->mWrite.load(std::memory_order_acquire);
+    if (r == w) { return false; }
+
+    int numChannels = track->mNumChannels;
+    int maxFrames = track->mMaxFrames;
+    mInterleaved.resize(numChannels * maxFrames);
+    for ( ; r != w; r++) {
+        int idx = r % track->mNumBlocks;
+        // Keep the timeline: blocks dropped before this one become silence
+        uint32_t silence = track->mSilenceBefore[idx];
+        if (silence > 0) {
+            std::vector<char> zeros(sizeof(sample_t) * numChannels * silence, 0);
+            writeData(track, zeros.data(), zeros.size());
+        }
+        const sample_t* block = &track->mBlocks[idx * numChannels * maxFrames];
+        unsigned int n_frames = track->mFrames[idx];
+        for (unsigned int f = 0; f < n_frames; f++) {
+            for (int c = 0; c < numChannels; c++) {
+                mInterleaved[f * numChannels + c] = block[c * maxFrames + f];
+            }
+        }
+        // The slot can be reused as soon as it is copied
+        track->mRead.store(r + 1, std::memory_order_release);
+        writeData(track, reinterpret_cast<const char*>(mInterleaved.data()),
+                  sizeof(sample_t) * numChannels * n_frames);
+    }
+    return true;
+}
+
+
+//*******************************************************************************
+void Recorder::writeData(RecorderTrack* track, const char* data, size_t size)
+{
+    while (size > 0) {
+        size_t n = qMin(size, static_cast<size_t>(gRecorderWriteBufferBytes) - track->mBufferUsed);
+        std::memcpy(track->mBuffer + track->mBufferUsed, data, n);
+        track->mBufferUsed += n;
+        track->mDataBytes += n;
+        data += n;
+        size -= n;
+        if ( track->mBufferUsed == static_cast<size_t>(gRecorderWriteBufferBytes) ) {
+            flushBuffer(track);
+        }
+    }
+}
+
+
+//*******************************************************************************
+void Recorder::flushBuffer(RecorderTrack* track)
+{
+    if (track->mBufferUsed == 0) { return; }
+    qint64 offset = track->mFile.pos();
+    if ( track->mFile.write(track->mBuffer, track->mBufferUsed)
+         != static_cast<qint64>(track->mBufferUsed) ) {
+        std::cerr << "Recorder ERROR: could not write to "
+                  << qPrintable(track->mFile.fileName()) << endl;
+    }
+#if defined ( __LINUX__ )
+    // Recordings are not read back, keep them out of the page cache
+    posix_fadvise(track->mFile.handle(), offset, track->mBufferUsed, POSIX_FADV_DONTNEED);
+#else
+    (void) offset;
+#endif
+    track->mBufferUsed = 0;
+    // Keep the header up to date, a killed jacktrip still leaves a valid file
+    finishHeader(track);
+}
+
+
+//*******************************************************************************
+void Recorder::writeHeader(RecorderTrack* track)
+{
+    int block_align = sizeof(sample_t) * track->mNumChannels;
+    std::vector<char> header(sHeaderSize, 0);
+    char* h = header.data();
+    std::memcpy(h, "RIFF", 4); // sizes are written by finishHeader()
+    std::memcpy(h + 8, "WAVE", 4);
+    std::memcpy(h + sDs64Offset, "JUNK", 4);
+    putU32(h + sDs64Offset + 4, 28);
+    std::memcpy(h + 48, "fmt ", 4);
+    putU32(h + 52, 18);
+    putU16(h + 56, 3); // WAVE_FORMAT_IEEE_FLOAT
+    putU16(h + 58, track->mNumChannels);
+    putU32(h + 60, track->mSampleRate);
+    putU32(h + 64, track->mSampleRate * block_align);
+    putU16(h + 68, block_align);
+    putU16(h + 70, 8 * sizeof(sample_t));
+    putU16(h + 72, 0);
+    std::memcpy(h + sFactOffset, "fact", 4);
+    putU32(h + sFactOffset + 4, 4);
+    std::memcpy(h + 86, "JUNK", 4); // padding up to the data chunk
+    putU32(h + 90, sDataOffset - 94);
+    std::memcpy(h + sDataOffset, "data", 4);
+    track->mFile.write(h, sHeaderSize);
+}
+
+
+//*******************************************************************************
+void Recorder::finishHeader(RecorderTrack* track)
+{
+    // Only the audio on disk, the write buffer is flushed before
+    qint64 end = track->mFile.pos();
+    uint64_t data_bytes = end - sHeaderSize;
+    uint64_t riff_bytes = sHeaderSize - 8 + data_bytes;
+    uint64_t frames = data_bytes / (sizeof(sample_t) * track->mNumChannels);
+    char h[32];
+
+    if ( riff_bytes <= 0xffffffffULL ) {
+        putU32(h, riff_bytes);
+        track->mFile.seek(4);
+        track->mFile.write(h, 4);
+        putU32(h, frames);
+        track->mFile.seek(sFactOffset + 8);
+        track->mFile.write(h, 4);
+        putU32(h, data_bytes);
+        track->mFile.seek(sDataOffset + 4);
+        track->mFile.write(h, 4);
+        track->mFile.seek(end);
+        return;
+    }
+
+    // RF64 (EBU Tech 3306): 64 bit sizes in the ds64 chunk, 0xffffffff elsewhere
+    std::memcpy(h, "RF64", 4);
+    putU32(h + 4, 0xffffffff);
+    track->mFile.seek(0);
+    track->mFile.write(h, 8);
+    std::memcpy(h, "ds64", 4);
+    putU32(h + 4, 28);
+    putU64(h + 8, riff_bytes);
+    putU64(h + 16, data_bytes);
+    putU64(h + 24, frames);
+    track->mFile.seek(sDs64Offset);
+    track->mFile.write(h, 32);
+    putU32(h, 0); // table length
+    track->mFile.write(h, 4);
+    putU32(h, 0xffffffff);
+    track->mFile.seek(sFactOffset + 8);
+    track->mFile.write(h, 4);
+    track->mFile.seek(sDataOffset + 4);
+    track->mFile.write(h, 4);
+    track->mFile.seek(end);
+}
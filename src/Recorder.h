@@ -0,0 +1,153 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+/**
+ * \file Recorder.h
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+
+#include <atomic>
+#include <vector>
+
+#include <QThread>
+#include <QMutex>
+#include <QList>
+#include <QFile>
+#include <QString>
+
+#include "jacktrip_types.h"
+#include "jacktrip_globals.h"
+
+
+/** \brief One recorded file: a lock-free single producer single consumer queue of
+ * audio blocks, filled by an audio thread and written to disk by the Recorder.
+ *
+ * push() never blocks nor allocates. When the queue is full the block is
+ * dropped and counted; the Recorder then writes silence in its place, so all
+ * the tracks of a session stay aligned.
+ */
+class RecorderTrack
+{
+public:
+    /// \brief Pushes one block of numChannels planar buffers (audio thread)
+    /// \return false if the block was dropped
+    bool push(const sample_t* const* buffers, unsigned int n_frames);
+    /// \brief The next push() would be dropped
+    bool isFull() const
+    { return mWrite.load() - mRead.load() >= static_cast<unsigned int>(mNumBlocks); }
+    /// \brief Blocks dropped so far
+    uint32_t getDroppedBlocks() const { return mDroppedBlocks.load(); }
+
+private:
+    friend class Recorder;
+    RecorderTrack(const QString& fileName, int numChannels, int sampleRate,
+                  int maxFrames, int numBlocks);
+    ~RecorderTrack();
+
+    int mNumChannels;
+    int mSampleRate;
+    int mMaxFrames; ///< Largest block, in frames
+    int mNumBlocks; ///< Queue length, in blocks
+    std::vector<sample_t> mBlocks; ///< Queue storage, planar blocks of mMaxFrames
+    std::vector<unsigned int> mFrames; ///< Frames in each queued block
+    std::vector<uint32_t> mSilenceBefore; ///< Dropped frames just before each queued block
+    uint32_t mUnqueuedSilence; ///< Dropped frames not attached to a block yet (audio thread)
+    std::atomic<unsigned int> mWrite; ///< Blocks pushed, written by the audio thread only
+    std::atomic<unsigned int> mRead; ///< Blocks popped, written by the Recorder only
+    std::atomic<uint32_t> mDroppedBlocks;
+    std::atomic<uint32_t> mDroppedFrames;
+
+    // Writer side, used by the Recorder thread only
+    QFile mFile;
+    char* mBufferMemory; ///< Unaligned allocation of mBuffer
+    char* mBuffer; ///< Aligned write buffer, gRecorderWriteBufferBytes
+    size_t mBufferUsed;
+    uint64_t mDataBytes; ///< Audio bytes written to the data chunk
+    uint32_t mReportedDrops; ///< Dropped blocks already reported
+    bool mClosing;
+};
+
+
+/** \brief Session recorder, writes the RecorderTrack<EM>s</EM> to disk from its
+ * own thread.
+ *
+ * Tracks are written as 32 bit float WAV files that turn into RF64 when they
+ * go over 4 GB. The audio is interleaved in a large aligned buffer per track,
+ * written in one go; the header is padded so that the audio starts at a block boundary
+ * of the file, and on Linux the written pages are dropped from the page cache.
+ */
+class Recorder : public QThread
+{
+    Q_OBJECT;
+
+public:
+    /// \param directory Where the files are written
+    Recorder(const QString& directory);
+    virtual ~Recorder();
+
+    /// \brief Implements the Thread Loop. To start the thread, call start()
+    /// ( DO NOT CALL run() )
+    void run();
+    /// \brief Writes what is left in the queues, closes the files and stops
+    void stop();
+
+    /** \brief Opens a new track, the file is named after name and the time
+     * \return NULL if the file can't be created, or numChannels isn't positive
+     */
+    RecorderTrack* openTrack(const QString& name, int numChannels, int sampleRate,
+                             int maxFrames);
+    /** \brief Closes a track once its queue is written. The audio thread must
+     * not push to the track anymore. The track is deleted by the Recorder.
+     */
+    void closeTrack(RecorderTrack* track);
+
+private:
+    /// \brief Writes the queued blocks of track, true if there were any
+    bool drainTrack(RecorderTrack* track);
+    /// \brief Appends bytes to the file through the aligned write buffer
+    void writeData(RecorderTrack* track, const char* data, size_t size);
+    void flushBuffer(RecorderTrack* track);
+    void writeHeader(RecorderTrack* track);
+    /// \brief Writes the sizes of the audio on disk in the header, RF64 if needed
+    void finishHeader(RecorderTrack* track);
+
+    QString mDirectory;
+    volatile bool mStopped;
+    QMutex mTracksMutex; ///< Protects mTracks, never taken by the audio threads
+    QList<RecorderTrack*> mTracks;
+    std::vector<sample_t> mInterleaved; ///< Scratch, one interleaved block
+};
+
+#endif //__RECORDER_H__
@@ -0,0 +1,89 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+/**
+ * \file ReplayAudioInterface.cpp
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#include <cstring>
+
+#include "ReplayAudioInterface.h"
+
+
+//*******************************************************************************
+ReplayAudioInterface::ReplayAudioInterface(JackTrip* jacktrip,
+                                           int NumInChans, int NumOutChans,
+                                           #ifdef WAIR // wair
+                                           int NumNetRevChans,
+                                           #endif // endwhere
+                                           AudioInterface::audioBitResolutionT AudioBitResolution) :
+    AudioInterface(jacktrip,
+                   NumInChans, NumOutChans,
+                   #ifdef WAIR // wair
+                   NumNetRevChans,
+                   #endif // endwhere
+                   AudioBitResolution)
+{}
+
+
+//*******************************************************************************
+ReplayAudioInterface::~ReplayAudioInterface()
+{
+    for (int i = 0; i < mInBuffer.size(); i++) { delete[] mInBuffer[i]; }
+    for (int i = 0; i < mOutBuffer.size(); i++) { delete[] mOutBuffer[i]; }
+}
+
+
+//*******************************************************************************
+void ReplayAudioInterface::setup()
+{
+    AudioInterface::setup();
+
+    int nframes = getBufferSizeInSamples();
+    mInBuffer.resize(getNumInputChannels());
+    for (int i = 0; i < mInBuffer.size(); i++) {
+        mInBuffer[i] = new sample_t[nframes];
+        std::memset(mInBuffer[i], 0, sizeof(sample_t) * nframes);
+    }
+    mOutBuffer.resize(getNumOutputChannels());
+    for (int i = 0; i < mOutBuffer.size(); i++) {
+        mOutBuffer[i] = new sample_t[nframes];
+    }
+}
+
+
+//*******************************************************************************
+void ReplayAudioInterface::processBlock()
+{
+    AudioInterface::callback(mInBuffer, mOutBuffer, getBufferSizeInSamples());
+}
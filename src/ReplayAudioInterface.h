@@ -0,0 +1,87 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+/**
+ * \file ReplayAudioInterface.h
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#ifndef __REPLAYAUDIOINTERFACE_H__
+#define __REPLAYAUDIOINTERFACE_H__
+
+#include "AudioInterface.h"
+#include "jacktrip_globals.h"
+class JackTrip; // Forward declaration
+
+/** \brief Audio interface without a device, for the packet capture replay.
+ *
+ * The audio callback doesn't run on its own, JackTrip::replayCapture() runs
+ * one period at a time with processBlock() on its virtual clock.
+ */
+class ReplayAudioInterface : public AudioInterface
+{
+public:
+
+    /** \brief The class constructor
+   * \param jacktrip Pointer to the JackTrip class that connects all classes (mediator)
+   * \param NumInChans Number of Input Channels
+   * \param NumOutChans Number of Output Channels
+   * \param AudioBitResolution Audio Sample Resolutions in bits
+   */
+    ReplayAudioInterface(JackTrip* jacktrip,
+                         int NumInChans, int NumOutChans,
+                     #ifdef WAIR // wair
+                         int NumNetRevChans,
+                     #endif // endwhere
+                         AudioInterface::audioBitResolutionT AudioBitResolution);
+    /// \brief The class destructor
+    virtual ~ReplayAudioInterface();
+
+    virtual void setup();
+    /// \brief This has no effect, see processBlock()
+    virtual int startProcess() const { return 0; }
+    /// \brief This has no effect, see processBlock()
+    virtual int stopProcess() const { return 0; }
+    /// \brief This has no effect without a device
+    virtual void connectDefaultPorts() {}
+    /// \brief This has no effect without a device
+    virtual void setClientName(const char* /*ClientName*/) {}
+
+    /// \brief Runs the audio callback for one period, with silent inputs
+    void processBlock();
+
+private:
+    QVarLengthArray<sample_t*> mInBuffer; ///< Silent inputs
+    QVarLengthArray<sample_t*> mOutBuffer; ///< What the device would play
+};
+
+#endif // __REPLAYAUDIOINTERFACE_H__
@@ -0,0 +1,191 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+
+/**
+ * \file Resampler.cpp
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#include "Resampler.h"
+
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+// Taps per phase and passband of the qualities, see Resampler::qualityT
+static const int sTaps[] = { 8, 16, 32 };
+static const double sBandwidth[] = { 0.80, 0.90, 0.95 };
+
+
+//*******************************************************************************
+static int gcd(int a, int b)
+{
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+
+//*******************************************************************************
+// Sum of a[i] * b[i], four at a time
+static float dotProduct(const float* a, const float* b, int n)
+{
+    int i = 0;
+    float sum = 0.0;
+#ifdef __SSE__
+    __m128 vsum = _mm_setzero_ps();
+    for ( ; i + 4 <= n; i += 4) {
+        vsum = _mm_add_ps(vsum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    float tmp_sum[4];
+    _mm_storeu_ps(tmp_sum, vsum);
+    sum = tmp_sum[0] + tmp_sum[1] + tmp_sum[2] + tmp_sum[3];
+#endif
+    for ( ; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+
+//*******************************************************************************
+Resampler::Resampler(int num_channels, AudioInterface::audioBitResolutionT bit_resolution,
+                     int in_rate, int out_rate, int max_in_frames, qualityT quality) :
+    mNumChannels(num_channels),
+    mBitResolution(bit_resolution),
+    mMaxInFrames(max_in_frames)
+{
+    int divisor = gcd(in_rate, out_rate);
+    mUp = out_rate / divisor;
+    mDown = in_rate / divisor;
+    mTaps = sTaps[quality];
+
+    // Lowpass at the upsampled rate, below the Nyquist frequency of the
+    // lower of the two rates, Blackman window. M_PI is not standard C++.
+    const double kPi = 3.14159265358979323846;
+    int length = mTaps * mUp;
+    double cutoff = sBandwidth[quality] * 0.5 * std::min(1.0, double(mUp) / mDown) / mUp;
+    double center = (length - 1) / 2.0;
+    mCoefficients = new float[length];
+    for (int phase = 0; phase < mUp; phase++) {
+        double sum = 0.0;
+        for (int k = 0; k < mTaps; k++) {
+            int n = phase + k * mUp;
+            double x = 2.0 * cutoff * (n - center);
+            double sinc = (x == 0.0) ? 1.0 : std::sin(kPi * x) / (kPi * x);
+            double window = 0.42 - 0.5 * std::cos(2.0 * kPi * n / (length - 1))
+                    + 0.08 * std::cos(4.0 * kPi * n / (length - 1));
+            // Reversed, to run over the history forward
+            mCoefficients[phase * mTaps + mTaps - 1 - k] = sinc * window;
+            sum += sinc * window;
+        }
+        // Unity gain on every phase, no ripple on DC
+        for (int k = 0; k < mTaps; k++) {
+            mCoefficients[phase * mTaps + k] /= sum;
+        }
+    }
+
+    mHistory = new float[mNumChannels * (mTaps - 1 + mMaxInFrames)];
+    clear();
+}
+
+
+//*******************************************************************************
+Resampler::~Resampler()
+{
+    delete[] mCoefficients;
+    delete[] mHistory;
+}
+
+
+//*******************************************************************************
+void Resampler::clear()
+{
+    std::memset(mHistory, 0, sizeof(float) * mNumChannels * (mTaps - 1 + mMaxInFrames));
+    mPosition = static_cast<int64_t>(mTaps - 1) * mUp;
+}
+
+
+//*******************************************************************************
+int Resampler::getMaxOutFrames() const
+{
+    return (static_cast<int64_t>(mMaxInFrames) * mUp + mDown - 1) / mDown + 1;
+}
+
+
+//*******************************************************************************
+int Resampler::process(const int8_t* in_block, int in_frames, int8_t* out_block)
+{
+    in_frames = std::min(in_frames, mMaxInFrames);
+    int history_size = mTaps - 1 + mMaxInFrames;
+    int sample_size = mBitResolution;
+    // Outputs up to the last input sample, the same for every channel
+    int64_t end = static_cast<int64_t>(mTaps - 1 + in_frames) * mUp;
+    int out_frames = 0;
+    if (mPosition < end) {
+        out_frames = static_cast<int>((end - mPosition + mDown - 1) / mDown);
+    }
+    // Full scale integers would wrap on the overshoot of the filter
+    float max_sample = (mBitResolution == AudioInterface::BIT32) ? HUGE_VALF : 1.0f - 1.0f / 32768;
+
+    for (int i = 0; i < mNumChannels; i++) {
+        float* history = mHistory + i * history_size;
+        const int8_t* in = in_block + i * in_frames * sample_size;
+        for (int j = 0; j < in_frames; j++) {
+            AudioInterface::fromBitToSampleConversion(in + j * sample_size,
+                                                      &history[mTaps - 1 + j], mBitResolution);
+        }
+        int8_t* out = out_block + i * out_frames * sample_size;
+        int64_t position = mPosition;
+        for (int j = 0; j < out_frames; j++) {
+            int index = static_cast<int>(position / mUp);
+            int phase = static_cast<int>(position % mUp);
+            float sample = dotProduct(mCoefficients + phase * mTaps,
+                                      history + index - (mTaps - 1), mTaps);
+            sample = std::max(-1.0f, std::min(sample, max_sample));
+            AudioInterface::fromSampleToBitConversion(&sample, out + j * sample_size,
+                                                      mBitResolution);
+            position += mDown;
+        }
+        // Keep the last mTaps-1 samples for the next block
+        std::memmove(history, history + in_frames, sizeof(float) * (mTaps - 1));
+    }
+    mPosition += static_cast<int64_t>(out_frames) * mDown - static_cast<int64_t>(in_frames) * mUp;
+    return out_frames;
+}
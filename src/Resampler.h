@@ -0,0 +1,100 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+
+/**
+ * \file Resampler.h
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#ifndef __RESAMPLER_H__
+#define __RESAMPLER_H__
+
+#include "jacktrip_types.h"
+#include "AudioInterface.h"
+
+
+/** \brief Streaming polyphase sample rate converter, for peers at another
+ * sample rate than the local audio.
+ *
+ * The ratio of the rates is reduced to up/down integers, the windowed sinc
+ * lowpass is split in up phases of getTaps() coefficients each, computed once
+ * in the constructor: process() doesn't allocate. Blocks are planar audio in
+ * the bit resolution of the packets, as with Reblocker. Not thread safe, each
+ * direction has its own.
+ */
+class Resampler
+{
+public:
+    /// \brief Filter length and bandwidth (--srcquality)
+    enum qualityT {
+        LOW, ///< 8 taps per phase, 80% of the lower Nyquist frequency
+        MEDIUM, ///< 16 taps per phase, 90%
+        HIGH ///< 32 taps per phase, 95%
+    };
+
+    /** \brief The class constructor
+     * \param num_channels Channels in each block
+     * \param bit_resolution Sample format of the blocks
+     * \param in_rate Sample rate of the blocks given to process()
+     * \param out_rate Sample rate of the blocks it returns
+     * \param max_in_frames Largest block given to process()
+     */
+    Resampler(int num_channels, AudioInterface::audioBitResolutionT bit_resolution,
+              int in_rate, int out_rate, int max_in_frames, qualityT quality);
+    virtual ~Resampler();
+
+    /** \brief Converts a block
+     * \param in_block in_frames frames at the input rate
+     * \param out_block Room for getMaxOutFrames() frames at the output rate
+     * \return Frames in out_block, channel i starts at i times that
+     */
+    int process(const int8_t* in_block, int in_frames, int8_t* out_block);
+    /// \brief Largest block process() returns
+    int getMaxOutFrames() const;
+    int getTaps() const { return mTaps; }
+    /// \brief Forgets the past input
+    void clear();
+
+private:
+    int mNumChannels;
+    AudioInterface::audioBitResolutionT mBitResolution;
+    int mUp; ///< Interpolation factor, out_rate / gcd
+    int mDown; ///< Decimation factor, in_rate / gcd
+    int mTaps; ///< Coefficients per phase
+    int mMaxInFrames;
+    float* mCoefficients; ///< mUp phases of mTaps coefficients, reversed
+    float* mHistory; ///< Per channel, mTaps-1 past samples and an input block
+    int64_t mPosition; ///< Next output, in 1/mUp samples of mHistory
+};
+
+#endif // __RESAMPLER_H__
@@ -147,6 +147,14 @@ void RingBuffer::readSlotBlocking(int8_t* ptrToReadSlot)
 }
 
 
+//*******************************************************************************
+int RingBuffer::getNumFullSlots()
+{
+    QMutexLocker locker(&mMutex); // lock the mutex
+    return mFullSlots;
+}
+
+
 //*******************************************************************************
 void RingBuffer::insertSlotNonBlocking(const int8_t* ptrToSlot)
 {
@@ -100,6 +100,9 @@ public:
    */
     void readSlotNonBlocking(int8_t* ptrToReadSlot);
 
+    /// \brief Number of slots waiting to be read
+    int getNumFullSlots();
+
     struct IOStat {
         uint32_t underruns;
         uint32_t overflows;
@@ -46,11 +46,19 @@
 
 #include "UdpMasterListener.h"
 #include "JackTripWorker.h"
+#include "Resampler.h"
+#include "PacketCipher.h"
+#include "UdpDataProtocol.h"
+#include "UringReceiver.h"
 #include "jacktrip_globals.h"
 
 #include <iostream>
 #include <getopt.h> // for command line parsing
 #include <cstdlib>
+#include <cstring>
+
+#include <QStringList>
+#include <QHostAddress>
 
 #include "ThreadPoolTest.h"
 
@@ -65,6 +73,7 @@ Settings::Settings() :
     mJackTripMode(JackTrip::SERVER),
     mDataProtocol(JackTrip::UDP),
     mNumChans(2),
+    mNumOutChans(0),
     mBufferQueueLength(gDefaultQueueLength),
     mAudioBitResolution(AudioInterface::BIT16),
     mBindPortNum(gDefaultPort), mPeerPortNum(gDefaultPort),
@@ -77,6 +86,7 @@ Settings::Settings() :
     #endif // endwhere
     mJamLink(false),
     mEmptyHeader(false),
+    mCompactHeader(false),
     mJackTripServer(false),
     mLocalAddress(gDefaultLocalAddress),
     mRedundancy(1),
@@ -86,7 +96,24 @@ Settings::Settings() :
     mChanfeDefaultBS(false),
     mHubConnectionMode(JackTrip::SERVERTOCLIENT),
     mConnectDefaultAudioPorts(true),
-    mIOStatTimeout(0)
+    mIOStatTimeout(0),
+    mHubShards(0),
+    mTrunkSlots(gDefaultTrunkSlots),
+    mDtx(false),
+    mAdaptive(false),
+    mHubMixerTopN(0),
+    mHubRemoteControl(false),
+    mHubLoadLimit(gDefaultHubLoadLimit),
+    mRecorder(NULL),
+    mUdpOffload(false),
+    mIoUring(false),
+    mBusyPollUsec(0),
+    mDirectSend(false),
+    mPacketFrames(0),
+    mResampleQuality(Resampler::MEDIUM),
+    mMtu(0),
+    mEncrypt(false),
+    mMulticastMode(JackTrip::NOMULTICAST)
 {}
 
 //*******************************************************************************
@@ -94,6 +121,8 @@ Settings::~Settings()
 {
     stopJackTrip();
     delete mJackTrip;
+    // After the JackTrip objects, the tracks are closed by then
+    delete mRecorder;
 }
 
 //*******************************************************************************
@@ -107,11 +136,15 @@ void Settings::parseInput(int argc, char** argv)
 
     // Usage example at:
     // http://www.gnu.org/software/libc/manual/html_node/Getopt-Long-Option-Example.html#Getopt-Long-Option-Example
-    // options descriptor
+    // options descriptor, the options without a short one take the values
+    // past the characters
     //----------------------------------------------------------------------------
+    enum { OPT_MULTICAST = 256, OPT_MULTIPATH, OPT_ADAPTIVE, OPT_HUBREMOTECONTROL,
+           OPT_OFFLOADBENCH, OPT_URINGBENCH };
     static struct option longopts[] = {
         // These options don't set a flag.
     { "numchannels", required_argument, NULL, 'n' }, // Number of input and output channels
+    { "receivechannels", required_argument, NULL, 'i' }, // Number of output channels
 #ifdef WAIR // WAIR
     { "wair", no_argument, NULL, 'w' }, // Run in LAIR mode, sets numnetrevchannels
     { "addcombfilterlength", required_argument, NULL, 'N' }, // added comb filter length
@@ -143,6 +176,32 @@ void Settings::parseInput(int argc, char** argv)
     { "hubpatch", required_argument, NULL, 'p' }, // Set hubConnectionMode for auto patch in Jack
     { "iostat", required_argument, NULL, 'I' }, // Set IO stat timeout
     { "iostatlog", required_argument, NULL, 'G' }, // Set IO stat log file
+    { "hubshards", required_argument, NULL, 'Y' }, // Number of core-pinned hub shards
+    { "hubcpus", required_argument, NULL, 'U' }, // CPU list of the hub shards
+    { "trunk", required_argument, NULL, 'K' }, // Trunk link to another hub server
+    { "trunkslots", required_argument, NULL, 'k' }, // Participants carried by the trunk
+    { "dtx", no_argument, NULL, 'X' }, // Discontinuous transmission of silent channels
+    { "hubtopn", required_argument, NULL, 'M' }, // Sources mixed by the hub mixer
+    { "hubremotecontrol", no_argument, NULL, OPT_HUBREMOTECONTROL }, // Hub mixer commands from other hosts
+    { "record", required_argument, NULL, 'A' }, // Record the session to a directory
+    { "capture", required_argument, NULL, 'O' }, // Capture the received packets
+    { "replay", required_argument, NULL, 'Q' }, // Replay a packet capture offline
+    { "hubload", required_argument, NULL, 'E' }, // Hub admission control limit
+    { "udpoffload", no_argument, NULL, 'W' }, // UDP GSO/GRO (Linux)
+    { "offloadbench", no_argument, NULL, OPT_OFFLOADBENCH }, // Cost of the UDP syscalls, then exit
+    { "iouring", no_argument, NULL, 'Z' }, // io_uring receive engine (Linux)
+    { "uringbench", no_argument, NULL, OPT_URINGBENCH }, // Cost of recv() and io_uring, then exit
+    { "busypoll", required_argument, NULL, 'y' }, // Spin-then-block receive (Linux)
+    { "directsend", no_argument, NULL, 'x' }, // Send from the audio callback
+    { "packetframes", required_argument, NULL, 'f' }, // Samples per network packet
+    { "compactheader", no_argument, NULL, 'g' }, // Settings sent once, 8-byte header
+    { "srcquality", required_argument, NULL, 'a' }, // Hub sample rate conversion quality
+    { "mtu", required_argument, NULL, 'm' }, // Largest IP packet, larger datagrams in fragments
+    { "encrypt", no_argument, NULL, 't' }, // Authenticated encryption of the datagrams
+    { "cryptobench", no_argument, NULL, 'u' }, // Cost of the encryption, then exit
+    { "multicast", required_argument, NULL, OPT_MULTICAST }, // One sender, many listeners
+    { "multipath", required_argument, NULL, OPT_MULTIPATH }, // Send over several network paths
+    { "adaptive", no_argument, NULL, OPT_ADAPTIVE }, // Bit resolution adapted to the loss
     { "help", no_argument, NULL, 'h' }, // Print Help
     { NULL, 0, NULL, 0 }
 };
@@ -159,6 +218,15 @@ void Settings::parseInput(int argc, char** argv)
             //-------------------------------------------------------
             mNumChans = atoi(optarg);
             break;
+        case 'i': // Number of output channels, received from the peer
+            //-------------------------------------------------------
+            mNumOutChans = atoi(optarg);
+            if ( mNumOutChans <= 0 || mNumOutChans > 65535 ) {
+                std::cerr << "--receivechannels ERROR: The number of channels has to be between 1 and 65535" << endl;
+                printUsage();
+                std::exit(1);
+            }
+            break;
 #ifdef WAIR
         case 'w':
             //-------------------------------------------------------
@@ -261,6 +329,10 @@ void Settings::parseInput(int argc, char** argv)
             //-------------------------------------------------------
             mJamLink = true;
             break;
+        case 'g': // compact header
+            //-------------------------------------------------------
+            mCompactHeader = true;
+            break;
         case 'J': // Set client Name
             //-------------------------------------------------------
             mClientName = optarg;
@@ -313,6 +385,8 @@ void Settings::parseInput(int argc, char** argv)
                 mHubConnectionMode = JackTrip::RESERVEDMATRIX; }
             else if ( atoi(optarg) == 4 ) {
                 mHubConnectionMode = JackTrip::FULLMIX; }
+            else if ( atoi(optarg) == 5 ) {
+                mHubConnectionMode = JackTrip::CUSTOMMIX; }
             else {
                 std::cerr << "-p ERROR: Wrong HubConnectionMode: "
                           << atoi(optarg) << " is not supported." << endl;
@@ -338,6 +412,181 @@ void Settings::parseInput(int argc, char** argv)
                 std::exit(1);
             }
             break;
+        case 'Y': // Hub shards
+            //-------------------------------------------------------
+            mHubShards = atoi(optarg);
+            if (0 >= mHubShards) {
+                std::cerr << "--hubshards ERROR: needs at least one shard." << endl;
+                printUsage();
+                std::exit(1);
+            }
+            break;
+        case 'U': // Hub shard CPUs
+            //-------------------------------------------------------
+        {
+            mHubCpus.clear();
+            QStringList cpus = QString(optarg).split(",");
+            for (int i = 0; i<cpus.size(); i++) {
+                bool ok;
+                int cpu = cpus[i].toInt(&ok);
+                if (!ok || cpu < 0) {
+                    std::cerr << "--hubcpus ERROR: wrong CPU list " << optarg << endl;
+                    printUsage();
+                    std::exit(1);
+                }
+                mHubCpus.append(cpu);
+            }
+            break;
+        }
+        case 'K': // Hub trunk
+            //-------------------------------------------------------
+            mTrunkAddress = optarg;
+            break;
+        case 'k': // Hub trunk slots
+            //-------------------------------------------------------
+            mTrunkSlots = atoi(optarg);
+            if (0 >= mTrunkSlots) {
+                std::cerr << "--trunkslots ERROR: needs at least one slot." << endl;
+                printUsage();
+                std::exit(1);
+            }
+            break;
+        case 'X': // Discontinuous transmission
+            //-------------------------------------------------------
+            mDtx = true;
+            break;
+        case 'M': // Hub mixer top N
+            //-------------------------------------------------------
+            mHubMixerTopN = atoi(optarg);
+            if (0 > mHubMixerTopN) {
+                std::cerr << "--hubtopn ERROR: needs a positive number of sources." << endl;
+                printUsage();
+                std::exit(1);
+            }
+            break;
+        case 'A': // Session recording
+            //-------------------------------------------------------
+            mRecordDirectory = optarg;
+            break;
+        case 'O': // Packet capture
+            //-------------------------------------------------------
+            mCaptureFile = optarg;
+            break;
+        case 'Q': // Packet capture replay
+            //-------------------------------------------------------
+            mReplayFile = optarg;
+            break;
+        case 'W': // UDP segmentation offload
+            //-------------------------------------------------------
+            mUdpOffload = true;
+            break;
+        case 'Z': // io_uring receive engine
+            //-------------------------------------------------------
+            mIoUring = true;
+            break;
+        case 'x': // Direct send from the audio callback
+            //-------------------------------------------------------
+            mDirectSend = true;
+            break;
+        case 'a': // Sample rate conversion quality
+            //-------------------------------------------------------
+            mResampleQuality = atoi(optarg);
+            if ( mResampleQuality < Resampler::LOW || mResampleQuality > Resampler::HIGH ) {
+                std::cerr << "--srcquality ERROR: The quality has to be 0 (low), 1 (medium) or 2 (high)" << endl;
+                printUsage();
+                std::exit(1);
+            }
+            break;
+        case 'm': // Largest IP packet to the peer
+            //-------------------------------------------------------
+            mMtu = atoi(optarg);
+            if ( mMtu != 0 && (mMtu < gMinMtu || mMtu > gMaxMtu) ) {
+                std::cerr << "--mtu ERROR: The MTU has to be 0 (off) or between "
+                          << gMinMtu << " and " << gMaxMtu << " bytes" << endl;
+                printUsage();
+                std::exit(1);
+            }
+            break;
+        case 't': // Authenticated encryption of the datagrams
+            //-------------------------------------------------------
+            mEncrypt = true;
+            break;
+        case 'u': // Cost of the encryption
+            //-------------------------------------------------------
+            PacketCipher::benchmark(cout);
+            std::exit(0);
+            break;
+        case OPT_OFFLOADBENCH: // Cost of the UDP syscalls, with and without GSO/GRO
+            //-------------------------------------------------------
+            UdpDataProtocol::benchmarkOffload(cout);
+            std::exit(0);
+            break;
+        case OPT_URINGBENCH: // Cost of receiving with recv() and with io_uring
+            //-------------------------------------------------------
+            UringReceiver::benchmark(cout);
+            std::exit(0);
+            break;
+        case OPT_MULTICAST: // Multicast sender or listener
+            //-------------------------------------------------------
+            if ( std::strcmp(optarg, "send") == 0 ) {
+                mMulticastMode = JackTrip::MULTICASTSEND;
+            } else if ( std::strcmp(optarg, "receive") == 0 ) {
+                mMulticastMode = JackTrip::MULTICASTRECEIVE;
+            } else {
+                std::cerr << "--multicast ERROR: The role has to be send or receive" << endl;
+                printUsage();
+                std::exit(1);
+            }
+            break;
+        case OPT_MULTIPATH: // Local address of each network path
+            //-------------------------------------------------------
+        {
+            mMultipathAddresses = QString(optarg).split(",");
+            for (int i = 0; i<mMultipathAddresses.size(); i++) {
+                QHostAddress address;
+                if ( !address.setAddress(mMultipathAddresses[i]) ) {
+                    std::cerr << "--multipath ERROR: wrong address list " << optarg << endl;
+                    printUsage();
+                    std::exit(1);
+                }
+            }
+            break;
+        }
+        case OPT_HUBREMOTECONTROL: // Hub mixer control from other hosts
+            //-------------------------------------------------------
+            mHubRemoteControl = true;
+            break;
+        case OPT_ADAPTIVE: // Loss-adaptive bit resolution
+            //-------------------------------------------------------
+            mAdaptive = true;
+            break;
+        case 'f': // Samples per network packet
+            //-------------------------------------------------------
+            mPacketFrames = atoi(optarg);
+            if ( mPacketFrames <= 0 || mPacketFrames > 65535 ) {
+                std::cerr << "--packetframes ERROR: The packet size has to be between 1 and 65535 samples" << endl;
+                printUsage();
+                std::exit(1);
+            }
+            break;
+        case 'y': // Busy-poll receive
+            //-------------------------------------------------------
+            mBusyPollUsec = atoi(optarg);
+            if (mBusyPollUsec <= 0) {
+                std::cerr << "--busypoll ERROR: The budget has to be a positive number of microseconds" << endl;
+                printUsage();
+                std::exit(1);
+            }
+            break;
+        case 'E': // Hub admission control
+            //-------------------------------------------------------
+            mHubLoadLimit = atof(optarg);
+            if (0.0 > mHubLoadLimit || mHubLoadLimit > 1.0) {
+                std::cerr << "--hubload ERROR: needs a fraction of the audio period between 0 and 1." << endl;
+                printUsage();
+                std::exit(1);
+            }
+            break;
         case 'h':
             //-------------------------------------------------------
             printUsage();
@@ -350,6 +599,46 @@ void Settings::parseInput(int argc, char** argv)
             break;
         }
 
+    // The keys of the encryption are agreed in the TCP handshake of the hub mode
+    //----------------------------------------------------------------------------
+    if ( mEncrypt && !mJackTripServer && mJackTripMode != JackTrip::CLIENTTOPINGSERVER ) {
+        std::cerr << "--encrypt ERROR: Encryption needs the HUB mode, as a client (-C) or a server (-S)" << endl;
+        printUsage();
+        std::exit(1);
+    }
+    // The group is the peer address of a client (-c)
+    if ( mMulticastMode != JackTrip::NOMULTICAST ) {
+        if ( mJackTripServer || mJackTripMode != JackTrip::CLIENT ||
+             !QHostAddress(mPeerAddress).isMulticast() ) {
+            std::cerr << "--multicast ERROR: The group has to be the peer address of a client (-c), "
+                      << "224.0.0.0 to 239.255.255.255 or ff00::/8" << endl;
+            printUsage();
+            std::exit(1);
+        }
+    }
+    // Both ends of a peer-to-peer session, the hub sessions have one path
+    if ( !mMultipathAddresses.isEmpty() ) {
+        if ( mJackTripServer || mMulticastMode != JackTrip::NOMULTICAST ||
+             (mJackTripMode != JackTrip::CLIENT && mJackTripMode != JackTrip::SERVER) ) {
+            std::cerr << "--multipath ERROR: Several paths need a peer-to-peer session (-c or -s), "
+                      << "without --multicast" << endl;
+            printUsage();
+            std::exit(1);
+        }
+    }
+    // The resolution goes down by bytes, and rides in the packet header
+    if (mAdaptive) {
+        if ( mAudioBitResolution == AudioInterface::BIT8 || mJamLink || mEmptyHeader ) {
+            std::cerr << "--adaptive ERROR: Adapting the resolution needs more than 8 bits (-b), "
+                      << "and a packet header (not --jamlink or --emptyheader)" << endl;
+            printUsage();
+            std::exit(1);
+        }
+    }
+    if ( mEncrypt && !mCaptureFile.isEmpty() ) {
+        std::cerr << "WARNING: --capture logs the datagrams encrypted, --replay can't read them" << endl;
+    }
+
     // Warn user if undefined options where entered
     //----------------------------------------------------------------------------
     if (optind < argc) {
@@ -387,6 +676,7 @@ void Settings::printUsage()
     cout << "OPTIONAL ARGUMENTS: " << endl;
     cout << " -n, --numchannels #                      Number of Input and Output Channels (default: "
          << 2 << ")" << endl;
+    cout << " --receivechannels #                      Number of Output Channels, received from the peer, when it's not the same (the peer sends this many)" << endl;
 #ifdef WAIR // WAIR
     cout << " -w, --wair                               Run in WAIR Mode" << endl;
     cout << " -N, --addcombfilterlength #              comb length adjustment for WAIR (default "
@@ -402,13 +692,39 @@ void Settings::printUsage()
     cout << " --bindport        #                      Set only the bind port number (default: 4464)" << endl;
     cout << " --peerport        #                      Set only the Peer port number (default: 4464)" << endl;
     cout << " -b, --bitres      # (8, 16, 24, 32)      Audio Bit Rate Resolutions (default: 16)" << endl;
-    cout << " -p, --hubpatch    # (0, 1, 2, 3, 4)      Hub auto audio patch, only has effect if running HUB SERVER mode, 0=server-to-clients, 1=client loopback, 2=client fan out/in but not loopback, 3=reserved for TUB, 4=full mix (default: 0)" << endl;
+    cout << " -p, --hubpatch    # (0, 1, 2, 3, 4, 5)   Hub auto audio patch, only has effect if running HUB SERVER mode, 0=server-to-clients, 1=client loopback, 2=client fan out/in but not loopback, 3=reserved for TUB, 4=full mix, 5=per-client custom mix, gains set on UDP port " << gHubMixerControlPort << " of the hub host (default: 0)" << endl;
     cout << " -z, --zerounderrun                       Set buffer to zeros when underrun occurs (default: wavetable)" << endl;
     cout << " -l, --loopback                           Run in Loop-Back Mode" << endl;
     cout << " -j, --jamlink                            Run in JamLink Mode (Connect to a JamLink Box)" << endl;
     cout << " --clientname                             Change default client name (default: JackTrip)" << endl;
     cout << " --localaddress                           Change default local host IP address (default: 127.0.0.1)" << endl;
     cout << " --nojackportsconnect                     Don't connect default audio ports in jack" << endl;
+    cout << " --dtx                                    Don't send the silent channels, only a small header (both ends, automatic in HUB SERVER mode)" << endl;
+    cout << " --hubshards       #                      HUB SERVER: number of core-pinned shards, each session is owned by one (default: 0, not sharded)" << endl;
+    cout << " --hubcpus         #,#,...                HUB SERVER: CPUs of the shards (default: 0 to hubshards-1)" << endl;
+    cout << " --trunk           <peer_hub>             HUB SERVER: exchange the participants with another hub on UDP port " << gHubTrunkPort << ", run it on both hubs" << endl;
+    cout << " --trunkslots      #                      HUB SERVER: participants carried each way by the trunk (default: " << gDefaultTrunkSlots << ")" << endl;
+    cout << " --hubtopn         #                      HUB SERVER: with -p5, mix only the # loudest sources (plus the pinned ones) for each listener (default: 0, all)" << endl;
+    cout << " --hubremotecontrol                       HUB SERVER: with -p5, take the mixer commands from any host, they aren't authenticated (default: from the hub host only)" << endl;
+    cout << " --hubload         #                      HUB SERVER: refuse new clients when the projected load goes over this fraction of the audio period, e.g. 0.75; clients older than this option take the refusal for a UDP port (default: 0, no limit)" << endl;
+    cout << " --udpoffload                             Batch the UDP datagrams in the kernel (Linux GSO/GRO), the IO stats (-I) count the syscalls" << endl;
+    cout << " --offloadbench                           Print the cost of sending and receiving datagrams on the loopback, with and without GSO/GRO, then exit" << endl;
+    cout << " --iouring                                Receive with io_uring, one syscall per wakeup (Linux 6.0 or later, falls back to the socket)" << endl;
+    cout << " --uringbench                             Print the cost of receiving datagrams on the loopback with recv() and with io_uring, then exit" << endl;
+    cout << " --busypoll        #                      Spin on the socket around the expected packet arrival, SO_BUSY_POLL budget of # usec (Linux), wake latency in the IO stats (-I)" << endl;
+    cout << " --packetframes    #                      Samples per network packet, several audio periods or part of one (default: the audio period, the peer has to use the same, HUB SERVER: the one of each client)" << endl;
+    cout << " --srcquality      # (0, 1, 2)            HUB SERVER: quality of the conversion for clients at another sample rate, the IO stats (-I) show its cost (default: 1)" << endl;
+    cout << " --compactheader                          Send the settings once at the start and an 8-byte header with the audio (both ends, automatic in HUB SERVER mode)" << endl;
+    cout << " --mtu             #                      Send the datagrams larger than the path MTU in fragments, # is the largest IP packet to the peer, the kernel may find a smaller one (Linux) (default: 0, off; HUB SERVER: 1500 to the clients that fragment)" << endl;
+    cout << " --encrypt                                Encrypt and authenticate the datagrams (ChaCha20-Poly1305), keys agreed with the hub (-C), the session resumes if the client address changes; HUB SERVER: refuse the clients without it" << endl;
+    cout << " --cryptobench                            Print the cost of the encryption for common packet sizes, then exit" << endl;
+    cout << " --multicast       send|receive           With -c <group>: send to a multicast group and receive nothing, or listen to the group and send nothing; one sender reaches every listener at the cost of one (set -B on the sender to test on one host)" << endl;
+    cout << " --multipath       <addr>,<addr>...       Send each packet from each of these local addresses, out of its interface (wired and LTE, two ISPs), and keep the first copy that arrives; both ends need it, even with one address, paths from other addresses than the peer's need --encrypt, the IO stats (-I) show each path (Linux and macOS, -c or -s)" << endl;
+    cout << " --adaptive                               Lower the bit resolution of the packets while the peer's link loses packets or jitters, back up once it's clean; both ends, automatic in HUB SERVER mode, the IO stats (-I) show the bits sent/asked" << endl;
+    cout << " --directsend                             Send the packets from the audio callback, without the sender thread (Linux and macOS)" << endl;
+    cout << " --record          <directory>            Record the received audio (and the hub mixes) to 32-bit float WAV files in directory" << endl;
+    cout << " --capture         <file>                 Log the received packets and their arrival time to file (HUB SERVER: file_<client>_<port>)" << endl;
+    cout << " --replay          <file>                 Replay a capture offline through the jitter buffer (-q, -z apply), then exit; with --record the output is recorded" << endl;
     cout << endl;
     cout << "ARGUMENTS TO USE JACKTRIP WITHOUT JACK:" << endl;
     cout << " --rtaudio                                Use system's default sound system instead of Jack" << endl;
@@ -431,6 +747,28 @@ void Settings::printUsage()
 //*******************************************************************************
 void Settings::startJackTrip()
 {
+    // The recorder runs before any audio, each JackTrip opens its own track
+    if ( !mRecordDirectory.isEmpty() && mRecorder == NULL ) {
+        mRecorder = new Recorder(mRecordDirectory);
+        mRecorder->start();
+    }
+
+    // Offline replay of a capture, no audio device nor network
+    if ( !mReplayFile.isEmpty() ) {
+        {
+            JackTrip replay(JackTrip::CLIENT, mDataProtocol, mNumChans,
+                        #ifdef WAIR // wair
+                            0,
+                        #endif // endwhere
+                            mBufferQueueLength, mRedundancy, mAudioBitResolution);
+            if ( mUnderrrunZero ) { replay.setUnderRunMode(JackTrip::ZEROS); }
+            replay.setRecorder(mRecorder, "replay");
+            replay.replayCapture(mReplayFile);
+        }
+        delete mRecorder; // finishes the files
+        mRecorder = NULL;
+        std::exit(0);
+    }
 
     /// \todo Change this, just here to test
     if ( mJackTripServer ) {
@@ -440,6 +778,8 @@ void Settings::startJackTrip()
         udpmaster->setWAIR(mWAIR);
 #endif // endwhere
         udpmaster->setHubPatch(mHubConnectionMode);
+        udpmaster->setHubMixerTopN(mHubMixerTopN);
+        udpmaster->setHubLoadLimit(mHubLoadLimit);
         udpmaster->setConnectDefaultAudioPorts(mConnectDefaultAudioPorts);
         if (gVerboseFlag) std::cout << "Settings:startJackTrip before udpmaster->start" << std::endl;
         // Set buffers to zero when underrun
@@ -449,8 +789,28 @@ void Settings::startJackTrip()
             udpmaster->setUnderRunMode(JackTrip::ZEROS);
         }
         udpmaster->setBufferQueueLength(mBufferQueueLength);
+        // Core-pinned shards, the CPU list sets the number of shards if given
+        if ( mHubShards > 0 || !mHubCpus.isEmpty() ) {
+            QVector<int> cpus = mHubCpus;
+            if ( cpus.isEmpty() ) {
+                for (int i = 0; i<mHubShards; i++) { cpus.append(i); }
+            }
+            else if ( mHubShards > cpus.size() ) {
+                throw std::invalid_argument("--hubshards is larger than the --hubcpus list");
+            }
+            else if ( mHubShards > 0 ) {
+                cpus.resize(mHubShards);
+            }
+            cout << "JackTrip HUB SERVER: Running " << cpus.size() << " core-pinned shards" << endl;
+            cout << gPrintSeparator << std::endl;
+            udpmaster->setShardCpus(cpus);
+        }
         udpmaster->start();
 
+        if ( !mTrunkAddress.isEmpty() ) {
+            startTrunk();
+        }
+
         //---Thread Pool Test--------------------------------------------
         /*
     cout << "BEFORE START" << endl;
@@ -482,6 +842,20 @@ void Settings::startJackTrip()
 
         // Set connect or not default audio ports. Only work for jack
         mJackTrip->setConnectDefaultAudioPorts(mConnectDefaultAudioPorts);
+        if (mNumOutChans > 0) { mJackTrip->setNumOutputChannels(mNumOutChans); }
+        mJackTrip->setDtx(mDtx);
+        mJackTrip->setAdaptive(mAdaptive);
+        mJackTrip->setUdpOffload(mUdpOffload);
+        mJackTrip->setIoUring(mIoUring);
+        mJackTrip->setBusyPoll(mBusyPollUsec);
+        mJackTrip->setDirectSend(mDirectSend);
+        mJackTrip->setPacketFrames(mPacketFrames);
+        mJackTrip->setMtu(mMtu);
+        mJackTrip->setEncrypt(mEncrypt);
+        mJackTrip->setMulticastMode(mMulticastMode);
+        mJackTrip->setMultipathAddresses(mMultipathAddresses);
+        mJackTrip->setRecorder(mRecorder, mPeerAddress.isEmpty() ? QString("peer") : mPeerAddress);
+        mJackTrip->setCaptureFile(mCaptureFile);
 
         // Connect Signals and Slots
         QObject::connect(mJackTrip, SIGNAL( signalProcessesStopped() ),
@@ -529,6 +903,11 @@ void Settings::startJackTrip()
             mJackTrip->setPacketHeaderType(DataProtocol::EMPTY);
         }
 
+        // Set in CompactHeader Mode
+        if ( mCompactHeader ) {
+            mJackTrip->setPacketHeaderType(DataProtocol::COMPACT);
+        }
+
         // Set RtAudio
 #ifdef __RT_AUDIO__
         if (!mUseJack) {
@@ -616,6 +995,56 @@ void Settings::startJackTrip()
 }
 
 
+//*******************************************************************************
+void Settings::startTrunk()
+{
+    // One JackTrip to the peer hub, mTrunkSlots participants of mNumChans
+    // channels each way, under the same header, sequence number and redundancy.
+    // Both hubs run the same symmetric link on gHubTrunkPort.
+    int numChans = mTrunkSlots * mNumChans;
+    if ( numChans > 65535 ) { // 16 bits in the packet header
+        throw std::invalid_argument("--trunkslots times the number of channels is larger than 65535");
+    }
+
+    mJackTrip = new JackTrip(JackTrip::CLIENT, mDataProtocol, numChans,
+                         #ifdef WAIR // wair
+                             0,
+                         #endif // endwhere
+                             mBufferQueueLength, mRedundancy, mAudioBitResolution);
+    // The hub patches the trunk ports, one port group per participant
+    mJackTrip->setConnectDefaultAudioPorts(false);
+    mJackTrip->setJackPortGroupSize(mNumChans);
+    mJackTrip->setDtx(mDtx);
+    mJackTrip->setAdaptive(mAdaptive);
+    mJackTrip->setUdpOffload(mUdpOffload);
+    mJackTrip->setIoUring(mIoUring);
+    mJackTrip->setBusyPoll(mBusyPollUsec);
+    mJackTrip->setDirectSend(mDirectSend);
+    mJackTrip->setPacketFrames(mPacketFrames);
+    mJackTrip->setMtu(mMtu);
+    if (mEncrypt) {
+        std::cerr << "WARNING: The trunk link has no key exchange, it is not encrypted (--encrypt)" << endl;
+    }
+    mJackTrip->setRecorder(mRecorder, "trunk_" + mTrunkAddress);
+    if ( mUnderrrunZero ) { mJackTrip->setUnderRunMode(JackTrip::ZEROS); }
+    mJackTrip->setPeerAddress(mTrunkAddress.toLatin1().data());
+    mJackTrip->setBindPorts(gHubTrunkPort);
+    mJackTrip->setPeerPorts(gHubTrunkPort);
+
+    cout << "JackTrip HUB SERVER: Trunk to " << mTrunkAddress.toStdString() << " with "
+         << mTrunkSlots << " slots of " << mNumChans << " channels" << endl;
+    cout << gPrintSeparator << std::endl;
+    mJackTrip->startProcess(
+        #ifdef WAIRTOMASTER // WAIR
+                0 // for WAIR compatibility, ID in jack client name
+        #endif // endwhere
+                );
+    if (0 < getIOStatTimeout()) {
+        mJackTrip->startIOStatTimer(getIOStatTimeout(), getIOStatStream());
+    }
+}
+
+
 //*******************************************************************************
 void Settings::stopJackTrip()
 {
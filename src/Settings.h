@@ -49,6 +49,7 @@
 #endif //__NO_JACK__
 
 #include "JackTrip.h"
+#include "Recorder.h"
 
 /** \brief Class to set usage options and parse settings from input
  */
@@ -69,6 +70,29 @@ public:
     /// \brief Prints usage help
     void printUsage();
 
+    /// \brief Session recorder (--record), NULL when not recording
+    Recorder* getRecorder() const { return mRecorder; }
+    /// \brief Capture file of the received datagrams (--capture), empty = none
+    const QString& getCaptureFile() const { return mCaptureFile; }
+    /// \brief UDP segmentation and receive coalescing (--udpoffload, Linux)
+    bool isUdpOffload() const { return mUdpOffload; }
+    /// \brief io_uring receive engine (--iouring, Linux)
+    bool isIoUring() const { return mIoUring; }
+    /// \brief Busy-poll receive budget in microseconds (--busypoll, Linux), 0 = off
+    int getBusyPoll() const { return mBusyPollUsec; }
+    /// \brief Send from the audio callback (--directsend)
+    bool isDirectSend() const { return mDirectSend; }
+    /// \brief Samples per network packet (--packetframes), 0 = one audio period
+    int getPacketFrames() const { return mPacketFrames; }
+    /// \brief Resampler::qualityT of the hub sample rate conversion (--srcquality)
+    int getResampleQuality() const { return mResampleQuality; }
+    /// \brief Largest IP packet to the peer (--mtu), 0 = no fragmentation
+    int getMtu() const { return mMtu; }
+    /// \brief Authenticated encryption of the datagrams (--encrypt)
+    bool isEncrypt() const { return mEncrypt; }
+    /// \brief Hub mixer control commands from other hosts (--hubremotecontrol)
+    bool isHubRemoteControl() const { return mHubRemoteControl; }
+
     bool getLoopBack() { return mLoopBack; }
     int getIOStatTimeout() const {return mIOStatTimeout;}
     const std::ostream& getIOStatStream() const
@@ -85,10 +109,14 @@ public slots:
     }
 
 private:
-    JackTrip* mJackTrip; ///< JackTrip class
+    /// \brief Starts the trunk link to the peer hub (hub server mode)
+    void startTrunk();
+
+    JackTrip* mJackTrip; ///< JackTrip class (the trunk link in hub server mode)
     JackTrip::jacktripModeT mJackTripMode; ///< JackTrip::jacktripModeT
     JackTrip::dataProtocolT mDataProtocol; ///< Data Protocol
-    int mNumChans; ///< Number of Channels (inputs = outputs)
+    int mNumChans; ///< Number of Channels (inputs, and outputs unless mNumOutChans)
+    int mNumOutChans; ///< Number of Output Channels, 0 = mNumChans
     int mBufferQueueLength; ///< Audio Buffer from network queue length
     AudioInterface::audioBitResolutionT mAudioBitResolution;
     QString mPeerAddress; ///< Peer Address to use in jacktripModeT::CLIENT Mode
@@ -107,6 +135,7 @@ private:
     bool mLoopBack; ///< Loop-back mode
     bool mJamLink; ///< JamLink mode
     bool mEmptyHeader; ///< EmptyHeader mode
+    bool mCompactHeader; ///< CompactHeader mode
     bool mJackTripServer; ///< JackTrip Server mode
     QString mLocalAddress; ///< Local Address
     unsigned int mRedundancy; ///< Redundancy factor for data in the network
@@ -121,6 +150,29 @@ private:
     bool mConnectDefaultAudioPorts; ///< Connect or not jack audio ports
     int mIOStatTimeout;
     std::ofstream mIOStatStream;
+    int mHubShards; ///< Number of hub shards, 0 = not sharded
+    QVector<int> mHubCpus; ///< CPU of each hub shard
+    QString mTrunkAddress; ///< Peer hub of the trunk link, empty = no trunk
+    int mTrunkSlots; ///< Participants carried each way by the trunk link
+    bool mDtx; ///< Discontinuous transmission, silent channels are not sent
+    bool mAdaptive; ///< Bit resolution of the packets adapted to the peer's loss
+    int mHubMixerTopN; ///< Sources in each hub mix (hubpatch 5), 0 = all
+    bool mHubRemoteControl; ///< Hub mixer control port open to other hosts
+    float mHubLoadLimit; ///< Fraction of the audio period the hub may use, 0 = no limit
+    QString mRecordDirectory; ///< Directory of the session recording, empty = no recording
+    Recorder* mRecorder; ///< Session recorder, created in startJackTrip()
+    QString mCaptureFile; ///< Capture of the received datagrams, prefix in hub mode
+    QString mReplayFile; ///< Capture to replay instead of connecting
+    bool mUdpOffload; ///< UDP GSO/GRO on the sockets (Linux)
+    bool mIoUring; ///< Receive with io_uring (Linux)
+    int mBusyPollUsec; ///< Spin-then-block receive, SO_BUSY_POLL budget, 0 = off
+    bool mDirectSend; ///< The audio callback sends the packets
+    int mPacketFrames; ///< Samples per network packet, 0 = one audio period
+    int mResampleQuality; ///< Resampler::qualityT
+    int mMtu; ///< Largest IP packet to the peer, 0 = no fragmentation
+    bool mEncrypt; ///< Encrypt the datagrams, hub clients must (hub server mode)
+    JackTrip::multicastModeT mMulticastMode; ///< Multicast sender or listener
+    QStringList mMultipathAddresses; ///< Local address of each path, empty = one path
 };
 
 #endif
@@ -38,6 +38,12 @@
 #include "UdpDataProtocol.h"
 #include "jacktrip_globals.h"
 #include "JackTrip.h"
+#include "PacketCapture.h"
+#include "UringReceiver.h"
+#include "Fragmenter.h"
+#include "PacketCipher.h"
+#include "PathMerger.h"
+#include "AdaptiveQuality.h"
 
 #include <QHostInfo>
 
@@ -54,6 +60,38 @@
 #if defined (__LINUX__) || (__MAC__OSX__)
 #include <sys/socket.h> // for POSIX Sockets
 #endif
+#if defined (__LINUX__) || defined (__MAC_OSX__)
+#include <ifaddrs.h> // local addresses of the paths (--multipath)
+#include <net/if.h>
+#include <fcntl.h> // wakeup pipe of the direct send (--directsend)
+#include <poll.h>
+#include <unistd.h>
+#endif
+#if defined (__LINUX__)
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46 // Linux 3.11
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69 // Linux 5.11
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103 // Linux 4.18, older headers don't have it
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104 // Linux 5.0
+#endif
+#ifndef IP_MULTICAST_ALL
+#define IP_MULTICAST_ALL 49 // Linux 2.6.31
+#endif
+#ifndef IPV6_MULTICAST_ALL
+#define IPV6_MULTICAST_ALL 29 // Linux 4.20
+#endif
+#endif
 
 using std::cout; using std::endl;
 
@@ -72,12 +110,37 @@ UdpDataProtocol::UdpDataProtocol(JackTrip* jacktrip, const runModeT runmode,
     mBindPort(bind_port), mPeerPort(peer_port),
     mRunMode(runmode),
     mAudioPacket(NULL), mFullPacket(NULL),
+    mDtxPacket(NULL), mDtxPacketSize(0),
+    mCapsPacket(NULL), mCapsPacketSize(0),
+    mCapture(NULL),
+    mResumable(false), mMulticastListener(false),
+    mGro(false), mGso(false),
+    mOffloadPacket(NULL), mOffloadSize(0), mOffloadMaxSize(0),
+    mSyscallCount(0),
+    mFragmenter(NULL), mPathMtu(0), mPathMtuCheckNs(0),
+    mPathMerger(NULL),
+    mAdaptive(NULL),
+    mCipher(NULL), mSealPacket(NULL),
+    mUring(NULL),
+    mBusyPollUsec(0), mExpectedArrivalNs(0), mArrivalJitterNs(0),
+    mWakeMaxUsec(0), mSpinCaught(0), mSpinNs(0),
+    mDirectReady(false), mDirectUnavailable(false),
+    mDirectRedundantPacket(NULL), mDirectSealPacket(NULL),
+    mDirectRedundantPacketSize(0), mDirectPacketSize(0),
+    mDirectQueue(NULL), mDirectSlotSize(0), mDirectSizes(NULL),
+    mDirectWrite(0), mDirectRead(0), mDirectDropped(0),
+    mReplayRedundantPacket(NULL), mReplayConnected(false),
+    mReplayCurrentSeqNum(0), mReplayLastSeqNum(0), mReplayNewerSeqNum(0),
     mUdpRedundancyFactor(udp_redundancy_factor)
 {
     mStopped = false;
     mIPv6 = false;
     std::memset(&mPeerAddr, 0, sizeof(mPeerAddr));
     std::memset(&mPeerAddr6, 0, sizeof(mPeerAddr6));
+    std::memset(&mFromAddr, 0, sizeof(mFromAddr));
+    std::memset(&mMulticastSender, 0, sizeof(mMulticastSender));
+    for (int i = 0; i < gWakeLatencyBuckets; i++) { mWakeLatency[i] = 0; }
+    mDirectWakeup[0] = mDirectWakeup[1] = -1;
     mPeerAddr.sin_port = htons(mPeerPort);
     mPeerAddr6.sin6_port = htons(mPeerPort);
     
@@ -93,6 +156,23 @@ UdpDataProtocol::~UdpDataProtocol()
 {
     delete[] mAudioPacket;
     delete[] mFullPacket;
+    delete[] mDtxPacket;
+    delete[] mCapsPacket;
+    delete[] mReplayRedundantPacket;
+    delete[] mOffloadPacket;
+    delete[] mDirectRedundantPacket;
+    delete[] mDirectSealPacket;
+    delete[] mDirectQueue;
+    delete[] mDirectSizes;
+#if defined (MSG_DONTWAIT)
+    if (mDirectWakeup[0] >= 0) { ::close(mDirectWakeup[0]); }
+    if (mDirectWakeup[1] >= 0) { ::close(mDirectWakeup[1]); }
+#endif
+    delete mFragmenter;
+    delete mPathMerger;
+    delete mAdaptive;
+    delete[] mSealPacket;
+    delete mCipher;
     wait();
 }
 
@@ -156,6 +236,12 @@ void UdpDataProtocol::setSocket(SOCKET &socket)
 void UdpDataProtocol::setSocket(int &socket)
 #endif
 {
+    // An encrypted hub session with a token takes the client back from any
+    // address, the datagrams authenticate it
+    mResumable = ( mJackTrip->getSessionToken() != 0 && mJackTrip->getReceiveKey() != NULL &&
+                   mJackTrip->getJackTripMode() == JackTrip::SERVERPINGSERVER );
+    mMulticastListener = ( mJackTrip->getMulticastMode() == JackTrip::MULTICASTRECEIVE );
+
     //If we haven't been passed a valid socket, then we should bind one.
 #if defined (__WIN_32__)
     if (socket == INVALID_SOCKET) {
@@ -235,6 +321,14 @@ int UdpDataProtocol::bindSocket()
         local_addr.sin_addr.s_addr = htonl(INADDR_ANY); //INADDR_ANY: let the kernel decide the active address
         local_addr.sin_port = htons(mBindPort); //set local port
     }
+#if !defined (__WIN_32__)
+    // Multicast listeners take the datagrams to the group only, not the
+    // unicast ones to the port (Windows can't bind a group address)
+    if (mMulticastListener) {
+        local_addr6.sin6_addr = mPeerAddr6.sin6_addr;
+        local_addr.sin_addr = mPeerAddr.sin_addr;
+    }
+#endif
 
     // Set socket to be reusable, this is platform dependent
     int one = 1;
@@ -269,8 +363,16 @@ int UdpDataProtocol::bindSocket()
         UdpSocket.setSocketDescriptor(sock_fd, QUdpSocket::BoundState,
                                       QUdpSocket::WriteOnly);
     }*/
-    if (!mIPv6) {
-        // Connect only if we're using IPv4.
+    if ( mJackTrip->getMulticastMode() != JackTrip::NOMULTICAST ) {
+        setupMulticast(sock_fd);
+    }
+    if ( !mIPv6 && !mResumable && !mJackTrip->isMultipath() &&
+         mJackTrip->getMulticastMode() != JackTrip::MULTICASTRECEIVE ) {
+        // Connect only if we're using IPv4, and the peer can't move.
+        // (A connected socket drops the datagrams of a resumed session, the
+        // ones a multicast listener gets, which come from the sender, and the
+        // copies of the other paths of a multipath peer. A multipath sender
+        // picks the source address of each datagram.)
         // (Connecting presents an issue when a host has multiple IP addresses and the peer decides to send from
         // a different address. While this generally won't be a problem for IPv4, it will for IPv6.)
         if ( (::connect(sock_fd, (struct sockaddr *) &mPeerAddr, sizeof(mPeerAddr))) < 0)
@@ -315,18 +417,243 @@ int UdpDataProtocol::bindSocket()
 }
 
 
+//*******************************************************************************
+#if defined (__WIN_32__)
+void UdpDataProtocol::setupMulticast(SOCKET sock_fd)
+#else
+void UdpDataProtocol::setupMulticast(int sock_fd)
+#endif
+{
+    // The listeners join the group on the interface the kernel picks. The
+    // sender sets how far its datagrams go, and loops them back to the
+    // listeners on its own host.
+    bool listener = mMulticastListener;
+    int hops = gMulticastHops;
+    int loop = 1;
+    int error;
+    if (mIPv6) {
+        if ( !IN6_IS_ADDR_MULTICAST(&mPeerAddr6.sin6_addr) ) {
+            throw std::runtime_error("ERROR: The peer address is not a multicast group");
+        }
+        if (listener) {
+            struct ipv6_mreq mreq;
+            std::memset(&mreq, 0, sizeof(mreq));
+            mreq.ipv6mr_multiaddr = mPeerAddr6.sin6_addr;
+            mreq.ipv6mr_interface = 0;
+            error = ::setsockopt(sock_fd, IPPROTO_IPV6, IPV6_JOIN_GROUP,
+                                 (char*)&mreq, sizeof(mreq));
+#if defined (__LINUX__)
+            // Not the groups other programs joined on the same port
+            int all = 0;
+            ::setsockopt(sock_fd, IPPROTO_IPV6, IPV6_MULTICAST_ALL, &all, sizeof(all));
+#endif
+        } else {
+            error = ::setsockopt(sock_fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS,
+                                 (char*)&hops, sizeof(hops));
+            ::setsockopt(sock_fd, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, (char*)&loop, sizeof(loop));
+        }
+    } else {
+        if ( !IN_MULTICAST(ntohl(mPeerAddr.sin_addr.s_addr)) ) {
+            throw std::runtime_error("ERROR: The peer address is not a multicast group");
+        }
+        if (listener) {
+            struct ip_mreq mreq;
+            std::memset(&mreq, 0, sizeof(mreq));
+            mreq.imr_multiaddr = mPeerAddr.sin_addr;
+            mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+            error = ::setsockopt(sock_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+                                 (char*)&mreq, sizeof(mreq));
+#if defined (__LINUX__)
+            // Not the groups other programs joined on the same port
+            int all = 0;
+            ::setsockopt(sock_fd, IPPROTO_IP, IP_MULTICAST_ALL, &all, sizeof(all));
+#endif
+        } else {
+            error = ::setsockopt(sock_fd, IPPROTO_IP, IP_MULTICAST_TTL,
+                                 (char*)&hops, sizeof(hops));
+            ::setsockopt(sock_fd, IPPROTO_IP, IP_MULTICAST_LOOP, (char*)&loop, sizeof(loop));
+        }
+    }
+    if (error < 0) {
+        throw std::runtime_error(listener ? "ERROR: Could not join the multicast group"
+                                          : "ERROR: Could not set the multicast hops");
+    }
+}
+
+
 //*******************************************************************************
 int UdpDataProtocol::receivePacket(QUdpSocket& UdpSocket, char* buf, const size_t n)
 {
     // Block until There's something to read
-    while ( (UdpSocket.pendingDatagramSize() < n) && !mStopped ) { QThread::usleep(100); }
-    int n_bytes = UdpSocket.readDatagram(buf, n);
+    waitForDatagram(UdpSocket);
+    return readDatagram(UdpSocket, buf, n);
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::waitForDatagram(QUdpSocket& UdpSocket)
+{
+    while ( !mStopped ) {
+        qint64 size = UdpSocket.pendingDatagramSize();
+        if (size > 0) { return; }
+        if (size == 0) {
+            // Anyone can send one to an unconnected socket
+            char byte;
+            ::recv(mSocket, &byte, 0, 0);
+            mSyscallCount++;
+            continue;
+        }
+        QThread::usleep(100);
+    }
+}
+
+
+//*******************************************************************************
+int UdpDataProtocol::readDatagram(QUdpSocket& UdpSocket, char* buf, const size_t n)
+{
+    int n_bytes;
+    if ( mResumable || mPathMerger != NULL || mMulticastListener ) {
+        socklen_t from_size = sizeof(mFromAddr);
+        n_bytes = ::recvfrom(mSocket, buf, n, 0,
+                             reinterpret_cast<struct sockaddr*>(&mFromAddr), &from_size);
+    }
+    else {
+        n_bytes = UdpSocket.readDatagram(buf, n);
+    }
+    mSyscallCount++;
+    if (mCapture != NULL) { mCapture->record(reinterpret_cast<int8_t*>(buf), n_bytes); }
     return n_bytes;
 }
 
 
+//*******************************************************************************
+bool UdpDataProtocol::checkPeer(int8_t* datagram, int size)
+{
+    bool from_peer;
+    uint16_t from_port;
+    if (mFromAddr.ss_family == AF_INET6) {
+        const struct sockaddr_in6* from = reinterpret_cast<struct sockaddr_in6*>(&mFromAddr);
+        from_peer = ( from->sin6_port == mPeerAddr6.sin6_port &&
+                      std::memcmp(&from->sin6_addr, &mPeerAddr6.sin6_addr,
+                                  sizeof(from->sin6_addr)) == 0 );
+        from_port = ntohs(from->sin6_port);
+    }
+    else {
+        const struct sockaddr_in* from = reinterpret_cast<struct sockaddr_in*>(&mFromAddr);
+        from_peer = ( from->sin_port == mPeerAddr.sin_port &&
+                      from->sin_addr.s_addr == mPeerAddr.sin_addr.s_addr );
+        from_port = ntohs(from->sin_port);
+    }
+    if (from_peer) { return true; }
+
+    // Only the client has the key (--encrypt), and the datagram must be newer
+    // than all the ones received, so that late or replayed datagrams don't
+    // move the session. Fragmented datagrams can't be authenticated one
+    // fragment at a time, they don't move the session.
+    if ( mCipher == NULL || Fragmenter::isFragment(datagram, size) ||
+         !mCipher->isNewest(datagram, size) ) {
+        return false;
+    }
+
+    QHostAddress from_address(reinterpret_cast<struct sockaddr*>(&mFromAddr));
+    movePeer(from_address, from_port);
+    mJackTrip->peerAddressChanged(from_address, from_port);
+    cout << "Session resumed from " << from_address.toString().toStdString()
+         << " port " << from_port << endl;
+    return true;
+}
+
+
+//*******************************************************************************
+bool UdpDataProtocol::checkMulticastSender()
+{
+    // Anyone can send to the group, the first source is taken as its sender
+    if (mMulticastSender.ss_family == 0) {
+        mMulticastSender = mFromAddr;
+        QHostAddress address(reinterpret_cast<struct sockaddr*>(&mFromAddr));
+        cout << "Multicast sender: " << address.toString().toStdString() << endl;
+        return true;
+    }
+    if (mFromAddr.ss_family != mMulticastSender.ss_family) { return false; }
+    if (mFromAddr.ss_family == AF_INET6) {
+        const struct sockaddr_in6* from = reinterpret_cast<struct sockaddr_in6*>(&mFromAddr);
+        const struct sockaddr_in6* sender = reinterpret_cast<struct sockaddr_in6*>(&mMulticastSender);
+        return ( from->sin6_port == sender->sin6_port &&
+                 std::memcmp(&from->sin6_addr, &sender->sin6_addr, sizeof(from->sin6_addr)) == 0 );
+    }
+    const struct sockaddr_in* from = reinterpret_cast<struct sockaddr_in*>(&mFromAddr);
+    const struct sockaddr_in* sender = reinterpret_cast<struct sockaddr_in*>(&mMulticastSender);
+    return ( from->sin_port == sender->sin_port &&
+             from->sin_addr.s_addr == sender->sin_addr.s_addr );
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::movePeer(const QHostAddress& address, uint16_t port)
+{
+    QMutexLocker lock(&mPeerMutex);
+    mPeerAddress = address;
+    mPeerPort = port;
+    if (mIPv6) {
+        Q_IPV6ADDR address6 = address.toIPv6Address();
+        std::memcpy(&mPeerAddr6.sin6_addr, &address6, sizeof(mPeerAddr6.sin6_addr));
+        mPeerAddr6.sin6_port = htons(port);
+    } else {
+        mPeerAddr.sin_addr.s_addr = htonl(address.toIPv4Address());
+        mPeerAddr.sin_port = htons(port);
+    }
+}
+
+
 //*******************************************************************************
 int UdpDataProtocol::sendPacket(const char* buf, const size_t n)
+{
+    return sendDatagram(buf, n, 0);
+}
+
+
+//*******************************************************************************
+int UdpDataProtocol::sendDatagram(const char* buf, const size_t n, int flags)
+{
+    if (mFragmenter == NULL) { return sendToPeer(buf, n, flags); }
+    // The path MTU may go back up, the kernel tells now and then
+    int64_t now = getMonotonicNs();
+    if (now >= mPathMtuCheckNs) {
+        mPathMtuCheckNs = now + gPathMtuCheckMs * 1000000LL;
+        updatePathMtu(false);
+    }
+    // EMSGSIZE: the path MTU went down, send again in smaller fragments
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int count = mFragmenter->getNumFragments(n);
+        if (count == 0) {
+            // More fragments than the header counts, a smaller MTU won't help
+            errno = EMSGSIZE;
+            return -1;
+        }
+        int n_bytes;
+        if (count == 1) {
+            n_bytes = sendToPeer(buf, n, flags);
+        } else {
+            uint16_t frame_id = mFragmenter->newFrameId();
+            int8_t fragment[gMaxMtu];
+            n_bytes = n;
+            for (int i = 0; i < count && n_bytes >= 0; i++) {
+                int size = Fragmenter::putFragment(reinterpret_cast<const int8_t*>(buf), n,
+                                                   frame_id, i, count, fragment);
+                if ( sendToPeer(reinterpret_cast<const char*>(fragment), size, flags) < 0 ) {
+                    n_bytes = -1;
+                }
+            }
+        }
+        if ( n_bytes >= 0 || errno != EMSGSIZE ) { return n_bytes; }
+        updatePathMtu(true);
+    }
+    return -1;
+}
+
+
+//*******************************************************************************
+int UdpDataProtocol::sendToPeer(const char* buf, const size_t n, int flags)
 {
 /*#if defined (__WIN_32__)
     //Alternative windows specific code that uses winsock equivalents of the bsd socket functions.
@@ -346,17 +673,214 @@ int UdpDataProtocol::sendPacket(const char* buf, const size_t n)
     }
     return (int)n_bytes;
 #else*/
+    if ( !mPaths.isEmpty() ) { return sendToPaths(buf, n, flags); }
     int n_bytes;
-    if (mIPv6) {
-        n_bytes = ::sendto(mSocket, buf, n, 0, (struct sockaddr *) &mPeerAddr6, sizeof(mPeerAddr6));
+    if (mResumable) {
+        // Unconnected, the receiver may move the session to another address.
+        // The audio callback (sendDirect()) doesn't wait for movePeer(), it
+        // leaves the datagram to the sender thread as if the socket was full.
+#if defined (MSG_DONTWAIT)
+        if (flags & MSG_DONTWAIT) {
+            if ( !mPeerMutex.tryLock() ) {
+                errno = EAGAIN;
+                return -1;
+            }
+        } else {
+            mPeerMutex.lock();
+        }
+#else
+        mPeerMutex.lock();
+#endif
+        if (mIPv6) {
+            n_bytes = ::sendto(mSocket, buf, n, flags, (struct sockaddr *) &mPeerAddr6, sizeof(mPeerAddr6));
+        } else {
+            n_bytes = ::sendto(mSocket, buf, n, flags, (struct sockaddr *) &mPeerAddr, sizeof(mPeerAddr));
+        }
+        mPeerMutex.unlock();
+    } else if (mIPv6) {
+        n_bytes = ::sendto(mSocket, buf, n, flags, (struct sockaddr *) &mPeerAddr6, sizeof(mPeerAddr6));
     } else {
-        n_bytes = ::send(mSocket, buf, n, 0);
+        n_bytes = ::send(mSocket, buf, n, flags);
     }
+    mSyscallCount++;
     return n_bytes;
 //#endif
 }
 
 
+//*******************************************************************************
+void UdpDataProtocol::setupMultipath()
+{
+#if defined (__LINUX__) || defined (__MAC_OSX__)
+    // Each path is a local address, its copies go out of its interface. With
+    // a default route on each interface, or source routing, they take
+    // separate ways to the peer.
+    struct ifaddrs* interfaces = NULL;
+    if ( ::getifaddrs(&interfaces) < 0 ) {
+        std::cerr << "WARNING: --multipath can't list the local addresses, "
+                  << "sending on the default route" << endl;
+        return;
+    }
+    const QStringList& addresses = mJackTrip->getMultipathAddresses();
+    int family = mIPv6 ? AF_INET6 : AF_INET;
+    for (int i = 0; i < addresses.size(); i++) {
+        QHostAddress address(addresses[i]);
+        struct ifaddrs* ifa = interfaces;
+        for ( ; ifa != NULL; ifa = ifa->ifa_next) {
+            if ( ifa->ifa_addr != NULL && ifa->ifa_addr->sa_family == family &&
+                 QHostAddress(ifa->ifa_addr) == address ) { break; }
+        }
+        if (ifa == NULL) {
+            std::cerr << "WARNING: " << addresses[i].toLocal8Bit().constData()
+                      << " is not an " << (mIPv6 ? "IPv6" : "IPv4")
+                      << " address of this host, --multipath skips it" << endl;
+            continue;
+        }
+        NetworkPath path;
+        std::memset(&path, 0, sizeof(path));
+        std::memcpy(&path.source, ifa->ifa_addr,
+                    mIPv6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+        path.ifindex = ::if_nametoindex(ifa->ifa_name);
+        mPaths.append(path);
+        cout << "Multipath: sending from " << addresses[i].toLocal8Bit().constData()
+             << " on " << ifa->ifa_name << endl;
+    }
+    ::freeifaddrs(interfaces);
+    if ( mPaths.isEmpty() ) {
+        std::cerr << "WARNING: --multipath has no path, sending on the default route" << endl;
+    }
+#else
+    std::cerr << "WARNING: --multipath is only available on Linux and macOS, "
+              << "sending on the default route" << endl;
+#endif
+}
+
+
+//*******************************************************************************
+int UdpDataProtocol::sendToPaths(const char* buf, const size_t n, int flags)
+{
+#if defined (__LINUX__) || defined (__MAC_OSX__)
+    // One socket for all the paths, the source address and the interface of
+    // each copy go with it. The peer sees the same port on every path.
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(buf);
+    iov.iov_len = n;
+#if defined (IPV6_PKTINFO)
+    char control[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+#else
+    char control[CMSG_SPACE(sizeof(struct in_pktinfo))];
+#endif
+    int sent = -1;
+    for (int i = 0; i < mPaths.size(); i++) {
+        const NetworkPath& path = mPaths[i];
+        std::memset(control, 0, sizeof(control));
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        if (mIPv6) {
+            msg.msg_name = &mPeerAddr6;
+            msg.msg_namelen = sizeof(mPeerAddr6);
+#if defined (IPV6_PKTINFO) // macOS wants __APPLE_USE_RFC_3542, the kernel picks then
+            msg.msg_controllen = CMSG_SPACE(sizeof(struct in6_pktinfo));
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = IPPROTO_IPV6;
+            cmsg->cmsg_type = IPV6_PKTINFO;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
+            struct in6_pktinfo info;
+            std::memset(&info, 0, sizeof(info));
+            info.ipi6_addr = reinterpret_cast<const struct sockaddr_in6&>(path.source).sin6_addr;
+            info.ipi6_ifindex = path.ifindex;
+            std::memcpy(CMSG_DATA(cmsg), &info, sizeof(info));
+#endif
+        } else {
+            msg.msg_name = &mPeerAddr;
+            msg.msg_namelen = sizeof(mPeerAddr);
+            msg.msg_controllen = CMSG_SPACE(sizeof(struct in_pktinfo));
+            struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = IPPROTO_IP;
+            cmsg->cmsg_type = IP_PKTINFO;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
+            struct in_pktinfo info;
+            std::memset(&info, 0, sizeof(info));
+            info.ipi_spec_dst = reinterpret_cast<const struct sockaddr_in&>(path.source).sin_addr;
+            info.ipi_ifindex = path.ifindex;
+            std::memcpy(CMSG_DATA(cmsg), &info, sizeof(info));
+        }
+        int n_bytes = ::sendmsg(mSocket, &msg, flags);
+        mSyscallCount++;
+        // A path that fails (its link is down) doesn't stop the others
+        if (n_bytes >= 0) { sent = n_bytes; }
+    }
+    return sent;
+#else
+    (void) buf; (void) n; (void) flags;
+    return -1;
+#endif
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::setupPathMtu()
+{
+    mPathMtu = mJackTrip->getMtu();
+#if defined (__LINUX__)
+    // Don't fragment, the kernel then learns the path MTU from the ICMP replies
+    int result;
+    if (mIPv6) {
+        int value = IPV6_PMTUDISC_DO;
+        result = ::setsockopt(mSocket, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &value, sizeof(value));
+    } else {
+        int value = IP_PMTUDISC_DO;
+        result = ::setsockopt(mSocket, IPPROTO_IP, IP_MTU_DISCOVER, &value, sizeof(value));
+    }
+    if (result < 0) {
+        std::cerr << "WARNING: Path MTU discovery is not available: "
+                  << std::strerror(errno) << endl;
+    }
+#else
+    std::cerr << "WARNING: Path MTU discovery is only available on Linux, "
+              << "--mtu is used as it is" << endl;
+#endif
+    mFragmenter->setMaxDatagramSize(0);
+    updatePathMtu(false);
+    mPathMtuCheckNs = getMonotonicNs() + gPathMtuCheckMs * 1000000LL;
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::updatePathMtu(bool lower)
+{
+    int min_mtu = mIPv6 ? 1280 : gMinMtu; // Smallest the IP version allows
+    int mtu = mPathMtu;
+#if defined (__LINUX__)
+    // Only known on a connected socket
+    int kernel_mtu = 0;
+    socklen_t size = sizeof(kernel_mtu);
+    int result = mIPv6 ? ::getsockopt(mSocket, IPPROTO_IPV6, IPV6_MTU, &kernel_mtu, &size)
+                       : ::getsockopt(mSocket, IPPROTO_IP, IP_MTU, &kernel_mtu, &size);
+    if (result == 0 && kernel_mtu > 0) {
+        mtu = std::max(min_mtu, std::min(mJackTrip->getMtu(), kernel_mtu));
+    }
+#endif
+    if ( lower && mtu >= mPathMtu ) {
+        // The kernel can't tell, take the next common MTU (RFC 1191) down
+        static const int plateaus[] = { 1492, 1280, 1006, 576 };
+        mtu = min_mtu;
+        for (unsigned int i = 0; i < sizeof(plateaus) / sizeof(plateaus[0]); i++) {
+            if (plateaus[i] < mPathMtu) { mtu = std::max(min_mtu, plateaus[i]); break; }
+        }
+    }
+    if ( mtu == mPathMtu && mFragmenter->getMaxDatagramSize() > 0 ) { return; }
+    mPathMtu = mtu;
+    // IP and UDP headers
+    mFragmenter->setMaxDatagramSize(mtu - (mIPv6 ? 40 : 20) - 8);
+    cout << "Path MTU to the peer: " << mtu << " bytes, larger datagrams go in fragments"
+         << endl;
+}
+
+
 //*******************************************************************************
 void UdpDataProtocol::getPeerAddressFromFirstPacket(QUdpSocket& UdpSocket,
                                                     QHostAddress& peerHostAddress,
@@ -388,11 +912,15 @@ void UdpDataProtocol::run()
     //                 mJackTrip, SLOT(slotStopProcesses()),
     //                 Qt::QueuedConnection);
 
+    // Sharded hub: stay on the core that owns this session
+    if (mCpuAffinity >= 0) { setThreadAffinity(mCpuAffinity); }
+
     //Wrap our socket in a QUdpSocket object if we're the receiver, for convenience.
     //If we're the sender, we'll just write directly to our socket.
     QUdpSocket UdpSocket;
     if (mRunMode == RECEIVER) {
-        if (mIPv6) {
+        if ( mIPv6 || mResumable || mJackTrip->isMultipath() ||
+             mJackTrip->getMulticastMode() == JackTrip::MULTICASTRECEIVE ) {
             UdpSocket.setSocketDescriptor(mSocket, QUdpSocket::BoundState,
                                           QUdpSocket::ReadOnly);
         } else {
@@ -404,30 +932,20 @@ void UdpDataProtocol::run()
     }
 
     if (gVerboseFlag) std::cout << "    UdpDataProtocol:run" << mRunMode << " before Setup Audio Packet buffer, Full Packet buffer, Redundancy Variables" << std::endl;
-    // Setup Audio Packet buffer
-    size_t audio_packet_size = getAudioPacketSizeInBites();
-    //cout << "audio_packet_size: " << audio_packet_size << endl;
-    mAudioPacket = new int8_t[audio_packet_size];
-    std::memset(mAudioPacket, 0, audio_packet_size); // set buffer to 0
-
-    // Setup Full Packet buffer
-    int full_packet_size = mJackTrip->getPacketSizeInBytes();
-    //cout << "full_packet_size: " << full_packet_size << endl;
-    mFullPacket = new int8_t[full_packet_size];
-    std::memset(mFullPacket, 0, full_packet_size); // set buffer to 0
+    setupPacketBuffers();
+    int full_packet_size = getFullPacketSize();
 
     //  bool timeout = false; // Time out flag for packets that arrive too late
 
-    // Put header in first packet
-    mJackTrip->putHeaderInPacket(mFullPacket, mAudioPacket);
-
     // Redundancy Variables
     // (Algorithm explained at the end of this file)
     // ---------------------------------------------
     int full_redundant_packet_size = full_packet_size * mUdpRedundancyFactor;
     int8_t* full_redundant_packet;
-    full_redundant_packet = new int8_t[full_redundant_packet_size];
+    // Room for the counter and tag of an encrypted datagram (--encrypt)
+    full_redundant_packet = new int8_t[full_redundant_packet_size + getCipherOverhead()];
     std::memset(full_redundant_packet, 0, full_redundant_packet_size); // Initialize to 0
+    setupUdpOffload(full_redundant_packet_size);
 
     // Set realtime priority (function in jacktrip_globals.h)
     if (gVerboseFlag) std::cout << "    UdpDataProtocol:run" << mRunMode << " before setRealtimeProcessPriority()" << std::endl;
@@ -506,22 +1024,35 @@ void UdpDataProtocol::run()
         // from that packet
         if (gVerboseFlag) std::cout << "    UdpDataProtocol:run" << mRunMode << " before !UdpSocket.hasPendingDatagrams()" << std::endl;
         std::cout << "Waiting for Peer..." << std::endl;
-        // This blocks waiting for the first packet
-        while ( !UdpSocket.hasPendingDatagrams() ) {
-            if (mStopped) { return; }
-            QThread::msleep(100);
-            if (gVerboseFlag) std::cout << "100ms  " << std::flush;
-        }
-        int first_packet_size = UdpSocket.pendingDatagramSize();
-        // The following line is the same as
-        int8_t* first_packet = new int8_t[first_packet_size];
-        /// \todo fix this to avoid memory leaks
-        // but avoids memory leaks
-        //std::tr1::shared_ptr<int8_t> first_packet(new int8_t[first_packet_size]);
-        receivePacket( UdpSocket, reinterpret_cast<char*>(first_packet), first_packet_size);
+        // This blocks waiting for the first packet, the whole datagram when
+        // it comes in fragments (--mtu), and one that authenticates (--encrypt)
+        int8_t* first_packet = NULL;
+        const int8_t* first_header = NULL;
+        while (first_header == NULL) {
+            while ( !UdpSocket.hasPendingDatagrams() ) {
+                if (mStopped) { delete[] first_packet; return; }
+                QThread::msleep(100);
+                if (gVerboseFlag) std::cout << "100ms  " << std::flush;
+            }
+            waitForDatagram(UdpSocket);
+            if (mStopped) { delete[] first_packet; return; }
+            int first_packet_size = UdpSocket.pendingDatagramSize();
+            delete[] first_packet;
+            first_packet = new int8_t[first_packet_size];
+            first_packet_size = receivePacket( UdpSocket, reinterpret_cast<char*>(first_packet),
+                                               first_packet_size);
+            // The same sources as the packets that follow. A multicast
+            // listener takes the source of the first packet as the sender.
+            if ( mResumable && !checkPeer(first_packet, first_packet_size) ) { continue; }
+            first_header = unwrapDatagram(first_packet, first_packet_size);
+            if ( first_header != NULL && mMulticastListener && !checkMulticastSender() ) {
+                first_header = NULL;
+            }
+        }
         // Check that peer has the same audio settings
         if (gVerboseFlag) std::cout << std::endl << "    UdpDataProtocol:run" << mRunMode << " before mJackTrip->checkPeerSettings()" << std::endl;
-        mJackTrip->checkPeerSettings(first_packet);
+        mJackTrip->checkPeerSettings(const_cast<int8_t*>(first_header));
+        delete[] first_packet;
         if (gVerboseFlag) std::cout << "step 7" << std::endl;
         if (gVerboseFlag) std::cout << "    UdpDataProtocol:run" << mRunMode << " before mJackTrip->parseAudioPacket()" << std::endl;
         mJackTrip->parseAudioPacket(mFullPacket, mAudioPacket);
@@ -540,17 +1071,35 @@ void UdpDataProtocol::run()
         mOutOfOrderCount = 0;
         mRevivedCount = 0;
         mStatCount = 0;
+        // io_uring: one system call for all the datagrams of a wakeup
+        setupUring(full_redundant_packet_size);
+        setupBusyPoll();
+        int ring_wait_msec = 0;
 
         if (gVerboseFlag) std::cout << "step 8" << std::endl;
         while ( !mStopped )
         {
+            if (mUring != NULL) {
+                receiveRingPackets(full_redundant_packet,
+                                   full_redundant_packet_size,
+                                   full_packet_size,
+                                   current_seq_num,
+                                   last_seq_num,
+                                   newer_seq_num,
+                                   ring_wait_msec);
+                continue;
+            }
             // Timer to report packets arriving too late
             // This QT method gave me a lot of trouble, so I replaced it with my own 'waitForReady'
             // that uses signals and slots and can also report with packets have not
             // arrive for a longer time
             //timeout = UdpSocket.waitForReadyRead(30);
             //        timeout = cc unused!
-            waitForReady(UdpSocket, 60000); //60 seconds
+            if (mBusyPollUsec > 0) {
+                waitBusyPoll(60000);
+            } else {
+                waitForReady(UdpSocket, 60000); //60 seconds
+            }
 
             // OLD CODE WITHOUT REDUNDANCY----------------------------------------------------
             /*
@@ -573,11 +1122,20 @@ void UdpDataProtocol::run()
                                     last_seq_num,
                                     newer_seq_num);
         }
+        delete mUring;
+        mUring = NULL;
         break; }
 
     case SENDER : {
         //Make sure we don't start sending packets too soon.
         QThread::msleep(100);
+        if ( mJackTrip->isDirectSend() ) {
+            setupDirectSend(full_redundant_packet_size, full_packet_size);
+            if (mDirectQueue != NULL) {
+                drainDirectSendQueue();
+                break;
+            }
+        }
         //-----------------------------------------------------------------------------------
         while ( !mStopped )
         {
@@ -600,6 +1158,174 @@ void UdpDataProtocol::run()
 }
 
 
+//*******************************************************************************
+void UdpDataProtocol::setupPacketBuffers()
+{
+    // Datagrams encrypted with the session keys (--encrypt)
+    const uint8_t* key = (mRunMode == RECEIVER) ? mJackTrip->getReceiveKey()
+                                                : mJackTrip->getSendKey();
+    if (key != NULL) { mCipher = new PacketCipher(key); }
+
+    // Setup Audio Packet buffer
+    size_t audio_packet_size = getAudioPacketSizeInBites();
+    //cout << "audio_packet_size: " << audio_packet_size << endl;
+    mAudioPacket = new int8_t[audio_packet_size];
+    std::memset(mAudioPacket, 0, audio_packet_size); // set buffer to 0
+
+    // Setup Full Packet buffer
+    int full_packet_size = getFullPacketSize();
+    //cout << "full_packet_size: " << full_packet_size << endl;
+    mFullPacket = new int8_t[full_packet_size];
+    std::memset(mFullPacket, 0, full_packet_size); // set buffer to 0
+
+    // Put header in first packet, the received ones may have another size
+    if (mRunMode == SENDER) { mJackTrip->putHeaderInPacket(mFullPacket, mAudioPacket); }
+
+    // Capability packets have the size of the audio ones, for the receivers
+    // that only take those
+    mCapsPacketSize = full_packet_size * mUdpRedundancyFactor;
+    mCapsPacket = new int8_t[mCapsPacketSize + getCipherOverhead()];
+
+    // Discontinuous transmission: the packets go packed on the wire, with one
+    // extra slot to pack the newest packet before shifting the older ones
+    if ( mJackTrip->isPacked() ) {
+        int max_size = (mRunMode == RECEIVER) ? mJackTrip->getReceiveDtxPacketMaxSizeInBytes()
+                                              : mJackTrip->getDtxPacketMaxSizeInBytes();
+        mDtxPacketSize = max_size * mUdpRedundancyFactor;
+        mDtxPacket = new int8_t[mDtxPacketSize + std::max(max_size, getCipherOverhead())];
+        std::memset(mDtxPacket, 0, mDtxPacketSize + max_size);
+        mDtxSizes.fill(0, mUdpRedundancyFactor);
+    }
+
+    // Datagrams larger than the path MTU go in fragments (--mtu), the
+    // receivers take them whatever their own setting
+    if (mRunMode == RECEIVER) {
+        mFragmenter = new Fragmenter(std::max(mCapsPacketSize, mDtxPacketSize)
+                                     + getCipherOverhead());
+    } else if (mJackTrip->getMtu() > 0) {
+        mFragmenter = new Fragmenter(0);
+        setupPathMtu();
+    }
+
+    // Several network paths (--multipath): the sender sends a copy on each,
+    // the receiver keeps the first one
+    if ( mJackTrip->isMultipath() ) {
+        if (mRunMode == RECEIVER) {
+            struct sockaddr_storage peer;
+            std::memset(&peer, 0, sizeof(peer));
+            if (mIPv6) { std::memcpy(&peer, &mPeerAddr6, sizeof(mPeerAddr6)); }
+            else { std::memcpy(&peer, &mPeerAddr, sizeof(mPeerAddr)); }
+            mPathMerger = new PathMerger(peer);
+            if (mCipher == NULL) {
+                std::cerr << "WARNING: --multipath without --encrypt only takes "
+                          << "the paths from the peer's address" << endl;
+            }
+        }
+        else { setupMultipath(); }
+    }
+
+    // Adaptive bit resolution (--adaptive): the receiver measures the peer's
+    // packets and asks it for a resolution in the headers of ours
+    if ( mJackTrip->isAdaptive() && mRunMode == RECEIVER ) {
+        mAdaptive = new AdaptiveQuality(mJackTrip->getAudioBitResolution(),
+                                        static_cast<int64_t>(mJackTrip->getPacketFrames()) * 1000000000
+                                        / mJackTrip->getNetworkSampleRate());
+    }
+
+    // The redundant packets keep the plaintext of the older ones, the sender
+    // thread seals a copy of each datagram
+    if (mCipher != NULL && mRunMode == SENDER) {
+        mSealPacket = new int8_t[std::max(mCapsPacketSize, mDtxPacketSize) + getCipherOverhead()];
+    }
+}
+
+
+//*******************************************************************************
+int8_t* UdpDataProtocol::unwrapDatagram(int8_t* datagram, int& size)
+{
+    if ( Fragmenter::isFragment(datagram, size) ) {
+        datagram = mFragmenter->reassemble(datagram, size, size);
+        if (datagram == NULL) { return NULL; }
+    }
+    if (mCipher != NULL) {
+        size = mCipher->open(datagram, size);
+        if (size < 0) { return NULL; }
+    }
+    return datagram;
+}
+
+
+//*******************************************************************************
+const int8_t* UdpDataProtocol::sealDatagram(const int8_t* datagram, int& size, int8_t* buffer)
+{
+    if (mCipher == NULL) { return datagram; }
+    std::memcpy(buffer, datagram, size);
+    size = mCipher->seal(buffer, size);
+    return buffer;
+}
+
+
+//*******************************************************************************
+int UdpDataProtocol::getCipherOverhead() const
+{
+    return (mCipher != NULL) ? PacketCipher::getOverheadInBytes() : 0;
+}
+
+
+//*******************************************************************************
+int UdpDataProtocol::getFullPacketSize() const
+{
+    // Each end may receive another number of channels than it sends
+    if (mRunMode == RECEIVER) { return mJackTrip->getReceivePacketSizeInBytes(); }
+    return mJackTrip->getPacketSizeInBytes();
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::setupReplay()
+{
+    setupPacketBuffers();
+    int full_redundant_packet_size = getFullPacketSize() * mUdpRedundancyFactor;
+    mReplayRedundantPacket = new int8_t[full_redundant_packet_size];
+    std::memset(mReplayRedundantPacket, 0, full_redundant_packet_size);
+    mReplayConnected = false;
+    mReplayCurrentSeqNum = 0;
+    mReplayLastSeqNum = 0;
+    mReplayNewerSeqNum = 0;
+    mTotCount = 0;
+    mLostCount = 0;
+    mOutOfOrderCount = 0;
+    mRevivedCount = 0;
+    mStatCount = 1; // getStats() resets the counts on its first call
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::replayDatagram(const int8_t* datagram, int size)
+{
+    int full_packet_size = getFullPacketSize();
+    int full_redundant_packet_size = full_packet_size * mUdpRedundancyFactor;
+    if ( !mReplayConnected ) {
+        // Like the first packet of a live receiver, only checked
+        const int8_t* header = Fragmenter::getFrameStart(datagram, size);
+        if (header == NULL) { return; }
+        size -= header - datagram;
+        std::memcpy(mReplayRedundantPacket, header,
+                    std::min(size, full_redundant_packet_size));
+        mJackTrip->checkPeerSettings(mReplayRedundantPacket);
+        mReplayConnected = true;
+        return;
+    }
+    processPacketRedundancy(datagram, size,
+                            mReplayRedundantPacket,
+                            full_redundant_packet_size,
+                            full_packet_size,
+                            mReplayCurrentSeqNum,
+                            mReplayLastSeqNum,
+                            mReplayNewerSeqNum);
+}
+
+
 //*******************************************************************************
 //bool
 void UdpDataProtocol::waitForReady(QUdpSocket& UdpSocket, int timeout_msec)
@@ -611,7 +1337,7 @@ void UdpDataProtocol::waitForReady(QUdpSocket& UdpSocket, int timeout_msec)
 
     while ( ( !(
                   UdpSocket.hasPendingDatagrams() &&
-                  (UdpSocket.pendingDatagramSize() > 0)
+                  (UdpSocket.pendingDatagramSize() >= 0) // empty too, dropped after
                   ) && (elapsed_time_usec <= timeout_usec) )
             && !mStopped ){
         //    if (mStopped) { return false; }
@@ -632,6 +1358,151 @@ void UdpDataProtocol::waitForReady(QUdpSocket& UdpSocket, int timeout_msec)
 }
 
 
+//*******************************************************************************
+void UdpDataProtocol::setupBusyPoll()
+{
+    if (mJackTrip->getBusyPoll() <= 0) { return; }
+#if defined (__LINUX__)
+    if (mUring != NULL) {
+        std::cerr << "WARNING: --busypoll is ignored with --iouring" << endl;
+        return;
+    }
+    // The kernel polls the device queue on the non-blocking reads, going over
+    // net.core.busy_read takes CAP_NET_ADMIN. Spinning works without it.
+    int usec = mJackTrip->getBusyPoll();
+    if ( ::setsockopt(mSocket, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0 ) {
+        std::cerr << "WARNING: SO_BUSY_POLL refused (CAP_NET_ADMIN), spinning on the socket only" << endl;
+    }
+    int one = 1;
+    ::setsockopt(mSocket, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+    // Kernel arrival time of each datagram, for the wake latency
+    if ( ::setsockopt(mSocket, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) < 0 ) {
+        std::cerr << "WARNING: no packet timestamps, the wake latency is not measured" << endl;
+    }
+    mBusyPollUsec = usec;
+    mExpectedArrivalNs = 0;
+    mArrivalJitterNs = 0;
+#else
+    std::cerr << "WARNING: --busypoll is only available on Linux" << endl;
+#endif
+}
+
+
+//*******************************************************************************
+bool UdpDataProtocol::peekArrival(int64_t& arrival_ns)
+{
+    arrival_ns = 0;
+#if defined (__LINUX__)
+    char byte;
+    struct iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len = sizeof(byte);
+    char control[CMSG_SPACE(sizeof(struct timespec))];
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    int size = ::recvmsg(mSocket, &msg, MSG_PEEK | MSG_DONTWAIT);
+    mSyscallCount++;
+    if (size < 0) { return false; }
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if ( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS ) {
+            struct timespec ts;
+            std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            arrival_ns = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::waitBusyPoll(int timeout_msec)
+{
+#if defined (__LINUX__)
+    int64_t period_ns = static_cast<int64_t>(mJackTrip->getPacketFrames())
+            * 1000000000 / mJackTrip->getNetworkSampleRate();
+    int64_t window_ns = std::min(period_ns / 2,
+                                 gBusyPollMinWindowUsec * 1000 + 4 * mArrivalJitterNs);
+    int64_t expected_ns = mExpectedArrivalNs;
+    // Nothing to spin for until a datagram gives the schedule
+    bool spin = expected_ns > 0 && getMonotonicNs() <= expected_ns + window_ns;
+    bool caught_spinning = false;
+    int64_t arrival_ns = 0;
+    int emit_resolution_msec = 10;
+    int wait_msec = 0;
+    struct pollfd pfd;
+    pfd.fd = mSocket;
+    pfd.events = POLLIN;
+
+    while ( !mStopped ) {
+        int64_t now_ns = getMonotonicNs();
+        if ( spin && now_ns >= expected_ns - window_ns ) {
+            // In the window: non-blocking reads until the datagram shows up
+            bool queued = false;
+            while ( !mStopped && !(queued = peekArrival(arrival_ns))
+                    && getMonotonicNs() <= expected_ns + window_ns ) {}
+            mSpinNs += getMonotonicNs() - now_ns;
+            if (queued) { caught_spinning = true; break; }
+            spin = false; // Late, block until it comes
+            continue;
+        }
+        // Before the window, or late: block
+        int64_t block_ns = spin ? expected_ns - window_ns - now_ns
+                                : emit_resolution_msec * 1000000;
+        struct timespec ts;
+        ts.tv_sec = block_ns / 1000000000;
+        ts.tv_nsec = block_ns % 1000000000;
+        pfd.revents = 0;
+        int ready = ::ppoll(&pfd, 1, &ts, NULL);
+        mSyscallCount++;
+        if (ready > 0) {
+            if ( peekArrival(arrival_ns) ) { break; }
+        }
+        else if (!spin) {
+            wait_msec += emit_resolution_msec;
+            emit signalWaitingTooLong(wait_msec);
+            if (wait_msec >= timeout_msec) { return; }
+        }
+    }
+    if (mStopped) { return; }
+
+    // Wake latency: from the kernel receiving the datagram to here
+    int64_t wake_ns = 0;
+    if (arrival_ns > 0) {
+        struct timespec now;
+        ::clock_gettime(CLOCK_REALTIME, &now);
+        wake_ns = std::max(static_cast<int64_t>(0),
+                           static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec
+                           - arrival_ns);
+        uint32_t wake_usec = static_cast<uint32_t>(std::min(wake_ns / 1000,
+                                                            static_cast<int64_t>(UINT32_MAX)));
+        int bucket = 0;
+        while ( bucket < gWakeLatencyBuckets - 1 && (1u << bucket) <= wake_usec ) { bucket++; }
+        mWakeLatency[bucket]++;
+        if (wake_usec > mWakeMaxUsec) { mWakeMaxUsec = wake_usec; }
+        if (caught_spinning) { mSpinCaught++; }
+    }
+
+    // The next datagram is due one period after this one arrived, the
+    // jitter is smoothed as in RFC 3550
+    int64_t arrived_ns = getMonotonicNs() - wake_ns;
+    if (mExpectedArrivalNs > 0) {
+        int64_t deviation_ns = std::abs(arrived_ns - mExpectedArrivalNs);
+        mArrivalJitterNs += (deviation_ns - mArrivalJitterNs) / 16;
+    }
+    mExpectedArrivalNs = arrived_ns + period_ns;
+#else
+    (void) timeout_msec;
+#endif
+}
+
+
 //*******************************************************************************
 void UdpDataProtocol::printUdpWaitedTooLong(int wait_msec)
 {
@@ -651,17 +1522,450 @@ void UdpDataProtocol::receivePacketRedundancy(QUdpSocket& UdpSocket,
                                               uint16_t& last_seq_num,
                                               uint16_t& newer_seq_num)
 {
-    // This is blocking until we get a packet...
-    receivePacket( UdpSocket, reinterpret_cast<char*>(full_redundant_packet),
-                   full_redundant_packet_size);
+    if (mGro) {
+        receiveCoalescedPackets(UdpSocket,
+                                full_redundant_packet, full_redundant_packet_size,
+                                full_packet_size,
+                                current_seq_num, last_seq_num, newer_seq_num);
+        return;
+    }
+    if ( mJackTrip->isPacked() ) {
+        // Packed packets have no fixed size, block until we get any packet...
+        waitForDatagram(UdpSocket);
+        int size = readDatagram(UdpSocket, reinterpret_cast<char*>(mDtxPacket),
+                                mDtxPacketSize + getCipherOverhead());
+        if ( mResumable && !checkPeer(mDtxPacket, size) ) { return; }
+        if ( mMulticastListener && !checkMulticastSender() ) { return; }
+        processPacketRedundancy(mDtxPacket, size,
+                                full_redundant_packet, full_redundant_packet_size,
+                                full_packet_size,
+                                current_seq_num, last_seq_num, newer_seq_num);
+    }
+    else {
+        // This is blocking until we get a packet, of any size as the
+        // fragments (--mtu) are smaller...
+        waitForDatagram(UdpSocket);
+        int size = readDatagram(UdpSocket, reinterpret_cast<char*>(full_redundant_packet),
+                                full_redundant_packet_size + getCipherOverhead());
+        if ( mResumable && !checkPeer(full_redundant_packet, size) ) { return; }
+        if ( mMulticastListener && !checkMulticastSender() ) { return; }
+        processPacketRedundancy(full_redundant_packet, size,
+                                full_redundant_packet, full_redundant_packet_size,
+                                full_packet_size,
+                                current_seq_num, last_seq_num, newer_seq_num);
+    }
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::setupUdpOffload(int full_redundant_packet_size)
+{
+    if ( !mJackTrip->isUdpOffload() ) { return; }
+#if defined (__LINUX__)
+    if (mRunMode == RECEIVER) {
+        int one = 1;
+        if ( ::setsockopt(mSocket, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0 ) {
+            std::cerr << "WARNING: UDP GRO is not available (Linux 5.0 or later)" << endl;
+            return;
+        }
+        mGro = true;
+        mOffloadPacket = new int8_t[gUdpOffloadMaxBytes];
+    }
+    // DTX packets don't have a fixed size, the copies of the paths go one by one
+    else if ( !mJackTrip->isPacked() && mPaths.isEmpty() ) {
+        // Probe the kernel, 0 keeps the datagrams unsegmented by default
+        int zero = 0;
+        if ( ::setsockopt(mSocket, SOL_UDP, UDP_SEGMENT, &zero, sizeof(zero)) < 0 ) {
+            std::cerr << "WARNING: UDP GSO is not available (Linux 4.18 or later)" << endl;
+            return;
+        }
+        int segment_size = full_redundant_packet_size + getCipherOverhead();
+        int segments = std::min(gUdpOffloadMaxSegments,
+                                gUdpOffloadMaxBytes / segment_size);
+        if (segments < 2) { return; }
+        mGso = true;
+        mOffloadMaxSize = segments * segment_size;
+        mOffloadPacket = new int8_t[mOffloadMaxSize];
+        mOffloadSize = 0;
+    }
+#else
+    (void) full_redundant_packet_size;
+    if (mRunMode == RECEIVER) {
+        std::cerr << "WARNING: --udpoffload is only available on Linux" << endl;
+    }
+#endif
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::receiveCoalescedPackets(QUdpSocket& UdpSocket,
+                                              int8_t* full_redundant_packet,
+                                              int full_redundant_packet_size,
+                                              int full_packet_size,
+                                              uint16_t& current_seq_num,
+                                              uint16_t& last_seq_num,
+                                              uint16_t& newer_seq_num)
+{
+#if defined (__LINUX__)
+    // Block until we get any datagram...
+    waitForDatagram(UdpSocket);
+    struct iovec iov;
+    iov.iov_base = mOffloadPacket;
+    iov.iov_len = gUdpOffloadMaxBytes;
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &mFromAddr;
+    msg.msg_namelen = sizeof(mFromAddr);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    int size = ::recvmsg(mSocket, &msg, 0);
+    mSyscallCount++;
+    if (size <= 0) { return; }
+
+    // ...which may be several datagrams of gso_size bytes, the last one shorter
+    int segment_size = size;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if ( cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO ) {
+            int gso_size;
+            std::memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+            if (gso_size > 0) { segment_size = gso_size; }
+        }
+    }
+    processSegments(mOffloadPacket, size, segment_size,
+                    full_redundant_packet, full_redundant_packet_size,
+                    full_packet_size,
+                    current_seq_num, last_seq_num, newer_seq_num);
+#else
+    (void) UdpSocket; (void) full_redundant_packet; (void) full_redundant_packet_size;
+    (void) full_packet_size; (void) current_seq_num; (void) last_seq_num; (void) newer_seq_num;
+#endif
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::processSegments(int8_t* buf, int size, int segment_size,
+                                      int8_t* full_redundant_packet,
+                                      int full_redundant_packet_size,
+                                      int full_packet_size,
+                                      uint16_t& current_seq_num,
+                                      uint16_t& last_seq_num,
+                                      uint16_t& newer_seq_num)
+{
+    for (int offset = 0; offset < size; offset += segment_size) {
+        int8_t* datagram = buf + offset;
+        int datagram_size = std::min(segment_size, size - offset);
+        if (mCapture != NULL) { mCapture->record(datagram, datagram_size); }
+        if ( mResumable && !checkPeer(datagram, datagram_size) ) { continue; }
+        if ( mMulticastListener && !checkMulticastSender() ) { continue; }
+        processPacketRedundancy(datagram, datagram_size,
+                                full_redundant_packet, full_redundant_packet_size,
+                                full_packet_size,
+                                current_seq_num, last_seq_num, newer_seq_num);
+    }
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::setupUring(int full_redundant_packet_size)
+{
+    if ( !mJackTrip->isIoUring() ) { return; }
+#if defined (__LINUX__)
+    // Packed packets (DTX, --adaptive) carry a mask of the channels, a loud
+    // one is larger than the full redundant packet. GRO hands over several.
+    int payload_size = mGro ? gUdpOffloadMaxBytes
+                            : std::max(full_redundant_packet_size, mDtxPacketSize)
+                              + getCipherOverhead();
+    int num_buffers = mGro ? gUringGroBuffers : gUringBuffers;
+    int control_size = mGro ? CMSG_SPACE(sizeof(int)) : 0;
+    mUring = new UringReceiver;
+    if ( !mUring->setup(mSocket, num_buffers, payload_size, control_size) ) {
+        std::cerr << "WARNING: io_uring is not available (Linux 6.0 or later), "
+                  << "receiving from the socket" << endl;
+        delete mUring;
+        mUring = NULL;
+    }
+#else
+    (void) full_redundant_packet_size;
+    std::cerr << "WARNING: --iouring is only available on Linux" << endl;
+#endif
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::receiveRingPackets(int8_t* full_redundant_packet,
+                                         int full_redundant_packet_size,
+                                         int full_packet_size,
+                                         uint16_t& current_seq_num,
+                                         uint16_t& last_seq_num,
+                                         uint16_t& newer_seq_num,
+                                         int& wait_msec)
+{
+    // Same notifications as waitForReady(), every 10 milliseconds
+    int emit_resolution_msec = 10;
+    int ready = mUring->wait(emit_resolution_msec * 1000);
+    mSyscallCount++;
+    if (ready < 0) {
+        std::cerr << "WARNING: io_uring receive failed (Linux 6.0 or later), "
+                  << "receiving from the socket" << endl;
+        delete mUring;
+        mUring = NULL;
+        return;
+    }
+    if (ready == 0) {
+        wait_msec += emit_resolution_msec;
+        emit signalWaitingTooLong(wait_msec);
+        return;
+    }
+    wait_msec = 0;
+
+    // The kernel copied the datagrams, with their source, to the buffer ring
+    int8_t* buf;
+    int size;
+    int segment_size;
+    while ( mUring->next(buf, size, segment_size, mFromAddr) ) {
+        processSegments(buf, size, segment_size,
+                        full_redundant_packet, full_redundant_packet_size,
+                        full_packet_size,
+                        current_seq_num, last_seq_num, newer_seq_num);
+    }
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::benchmarkOffload(std::ostream& out)
+{
+#if defined (__LINUX__)
+    // Datagrams of a 16-bit stereo session of 128 samples and full Ethernet
+    // ones, one at a time as in the steady state, and in the bursts of a late
+    // sender or of a capture at the receiver
+    static const int sizes[] = { 528, 1472 };
+    static const int bursts[] = { 1, 4, 16 };
+    const int datagrams = 16384; // a multiple of the bursts
+    int receiver = ::socket(AF_INET, SOCK_DGRAM, 0);
+    int sender = ::socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_size = sizeof(address);
+    int rcvbuf = 4 * 1024 * 1024;
+    struct timeval timeout = { 1, 0 }; // datagrams lost on the loopback end the run
+    ::setsockopt(receiver, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    ::setsockopt(receiver, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if ( receiver < 0 || sender < 0 ||
+         ::bind(receiver, (struct sockaddr *) &address, sizeof(address)) < 0 ||
+         ::getsockname(receiver, (struct sockaddr *) &address, &address_size) < 0 ||
+         ::connect(sender, (struct sockaddr *) &address, sizeof(address)) < 0 ) {
+        out << "ERROR: no UDP socket on the loopback" << endl;
+        if (receiver >= 0) { ::close(receiver); }
+        if (sender >= 0) { ::close(sender); }
+        return;
+    }
+    int zero = 0;
+    bool offload = ( ::setsockopt(sender, SOL_UDP, UDP_SEGMENT, &zero, sizeof(zero)) == 0 &&
+                     ::setsockopt(receiver, SOL_UDP, UDP_GRO, &zero, sizeof(zero)) == 0 );
+    int8_t* buf = new int8_t[gUdpOffloadMaxBytes];
+    std::memset(buf, 0x55, gUdpOffloadMaxBytes);
+
+    out << "UDP datagrams on the loopback, per datagram (syscalls both ends):" << endl;
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (unsigned int b = 0; b < sizeof(bursts) / sizeof(bursts[0]); b++) {
+            // A single datagram goes the same way with --udpoffload
+            for (int gso = 0; gso < ((offload && bursts[b] > 1) ? 2 : 1); gso++) {
+                int size = sizes[s];
+                int burst = bursts[b];
+                ::setsockopt(receiver, SOL_UDP, UDP_GRO, &gso, sizeof(gso));
+                int64_t send_ns = 0;
+                int64_t receive_ns = 0;
+                int syscalls = 0;
+                bool lost = false;
+                for (int sent = 0; sent < datagrams && !lost; sent += burst) {
+                    int64_t t0 = getMonotonicNs();
+                    if (gso) {
+                        struct iovec iov;
+                        iov.iov_base = buf;
+                        iov.iov_len = size * burst;
+                        char control[CMSG_SPACE(sizeof(uint16_t))];
+                        std::memset(control, 0, sizeof(control));
+                        struct msghdr msg;
+                        std::memset(&msg, 0, sizeof(msg));
+                        msg.msg_iov = &iov;
+                        msg.msg_iovlen = 1;
+                        msg.msg_control = control;
+                        msg.msg_controllen = sizeof(control);
+                        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+                        cmsg->cmsg_level = SOL_UDP;
+                        cmsg->cmsg_type = UDP_SEGMENT;
+                        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                        uint16_t gso_size = size;
+                        std::memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+                        ::sendmsg(sender, &msg, 0);
+                        syscalls++;
+                    }
+                    else {
+                        for (int i = 0; i < burst; i++) {
+                            ::send(sender, buf, size, 0);
+                            syscalls++;
+                        }
+                    }
+                    int64_t t1 = getMonotonicNs();
+                    int received = 0;
+                    while (received < burst) {
+                        struct iovec iov;
+                        iov.iov_base = buf;
+                        iov.iov_len = gUdpOffloadMaxBytes;
+                        char control[CMSG_SPACE(sizeof(int))];
+                        struct msghdr msg;
+                        std::memset(&msg, 0, sizeof(msg));
+                        msg.msg_iov = &iov;
+                        msg.msg_iovlen = 1;
+                        msg.msg_control = control;
+                        msg.msg_controllen = sizeof(control);
+                        int n = ::recvmsg(receiver, &msg, 0);
+                        syscalls++;
+                        if (n <= 0) { lost = true; break; }
+                        int segment_size = n;
+                        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+                             cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                            if ( cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO ) {
+                                std::memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+                            }
+                        }
+                        received += (n + segment_size - 1) / segment_size;
+                    }
+                    int64_t t2 = getMonotonicNs();
+                    send_ns += t1 - t0;
+                    receive_ns += t2 - t1;
+                }
+                out << "  " << size << " bytes, bursts of " << burst
+                    << (gso ? ", GSO/GRO" : "") << ": ";
+                if (lost) {
+                    out << "ERROR: datagrams lost on the loopback" << endl;
+                    continue;
+                }
+                out << "send " << send_ns / datagrams << " ns, receive "
+                    << receive_ns / datagrams << " ns, "
+                    << double(syscalls) / datagrams << " syscalls" << endl;
+            }
+        }
+    }
+    if (!offload) { out << "UDP GSO/GRO are not available (Linux 5.0 or later)" << endl; }
+    delete[] buf;
+    ::close(receiver);
+    ::close(sender);
+#else
+    out << "UDP GSO/GRO are only available on Linux" << endl;
+#endif
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::sendSegments(const int8_t* buf, int size, int segment_size)
+{
+#if defined (__LINUX__)
+    // Segments over the path MTU go one by one, in fragments (--mtu)
+    if ( size > segment_size &&
+         (mFragmenter == NULL || segment_size <= mFragmenter->getMaxDatagramSize()) ) {
+        struct iovec iov;
+        iov.iov_base = const_cast<int8_t*>(buf);
+        iov.iov_len = size;
+        char control[CMSG_SPACE(sizeof(uint16_t))];
+        std::memset(control, 0, sizeof(control));
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t gso_size = segment_size;
+        std::memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+
+        int n_bytes;
+        {
+            QMutexLocker lock(&mPeerMutex);
+            if (mIPv6) {
+                msg.msg_name = &mPeerAddr6;
+                msg.msg_namelen = sizeof(mPeerAddr6);
+            } else if (mResumable) { // unconnected
+                msg.msg_name = &mPeerAddr;
+                msg.msg_namelen = sizeof(mPeerAddr);
+            }
+            n_bytes = ::sendmsg(mSocket, &msg, 0);
+        }
+        mSyscallCount++;
+        // EIO: the device can't checksum the segments, send them one by one
+        if ( n_bytes >= 0 || errno != EIO ) { return; }
+        std::cerr << "WARNING: UDP GSO is not supported by the network device" << endl;
+        mGso = false;
+    }
+#endif
+    for (int offset = 0; offset < size; offset += segment_size) {
+        sendPacket(reinterpret_cast<const char*>(buf + offset), segment_size);
+    }
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::processPacketRedundancy(const int8_t* datagram, int size,
+                                              int8_t* full_redundant_packet,
+                                              int full_redundant_packet_size,
+                                              int full_packet_size,
+                                              uint16_t& current_seq_num,
+                                              uint16_t& last_seq_num,
+                                              uint16_t& newer_seq_num)
+{
+    // Datagrams sent in fragments or encrypted, go on with the whole one in
+    // the clear. The receive buffers are ours, and the captures replayed
+    // are never encrypted (mCipher is NULL).
+    datagram = unwrapDatagram(const_cast<int8_t*>(datagram), size);
+    if (datagram == NULL) { return; }
+
+    // Packets of the header only, as the capability packets
+    if ( mJackTrip->parsePeerHeader(datagram, size) ) { return; }
+
+    if ( mJackTrip->isPacked() ) {
+        // Packed packets, expand them, the rest of the algorithm doesn't change
+        int used = 0;
+        for (unsigned int i = 0; i<mUdpRedundancyFactor; i++) {
+            int8_t* full_packet = full_redundant_packet + (i*full_packet_size);
+            int n = mJackTrip->unpackDtxPacket(datagram + used, size - used, full_packet);
+            if (n < 0) {
+                if (i == 0) { return; } // not a packet, ignore it
+                // Fewer packets at the beginning of the stream, as with zeroed ones
+                std::memset(full_packet, 0, full_packet_size*(mUdpRedundancyFactor-i));
+                break;
+            }
+            used += n;
+        }
+    }
+    else {
+        if (size != full_redundant_packet_size) { return; } // not a packet of this stream
+        if (datagram != full_redundant_packet) {
+            std::memcpy(full_redundant_packet, datagram, full_redundant_packet_size);
+        }
+    }
 
     // Get Packet Sequence Number
-    newer_seq_num =
-            mJackTrip->getPeerSequenceNumber(full_redundant_packet);
+    uint16_t seq_num = mJackTrip->getPeerSequenceNumber(full_redundant_packet);
+    // The copies of the slower paths (--multipath) stop here, they would
+    // count as out of order
+    if ( mPathMerger != NULL &&
+         !mPathMerger->isFirstCopy(mFromAddr, mCipher != NULL, seq_num, getMonotonicNs()) ) {
+        return;
+    }
+    newer_seq_num = seq_num;
     current_seq_num = newer_seq_num;
 
+    int16_t lost = 0;
     if (0 != last_seq_num) {
-        int16_t lost = newer_seq_num - last_seq_num - 1;
+        lost = newer_seq_num - last_seq_num - 1;
         if (0 > lost) {
             // Out of order packet, should be ignored
             ++mOutOfOrderCount;
@@ -690,6 +1994,17 @@ void UdpDataProtocol::receivePacketRedundancy(QUdpSocket& UdpSocket,
     mRevivedCount += redun_last_index;
     //cout << endl;
 
+    if (mAdaptive != NULL) {
+        // The peer's packets tell the resolution it asks for, ours the one we
+        // ask for. The packets the redundancy revives are not lost (the first
+        // packet of the stream revives ones that were never counted).
+        int revived = std::min<int>(lost, redun_last_index);
+        mAdaptive->update(newer_seq_num, lost - revived, revived, getMonotonicNs());
+        const QualityStruct* quality = mJackTrip->getPeerQuality(full_redundant_packet);
+        if (quality != NULL) { mJackTrip->setSendBitResolution(quality->RequestedBitResolution); }
+        mJackTrip->setRequestedBitResolution(mAdaptive->getRequestedBitResolution());
+    }
+
     last_seq_num = newer_seq_num; // Save last read packet
 
     // Send to audio all available audio packets, in order
@@ -714,25 +2029,53 @@ bool UdpDataProtocol::getStats(DataProtocol::PktStat* stat)
     stat->lost = mLostCount;
     stat->outOfOrder = mOutOfOrderCount;
     stat->revived = mRevivedCount;
+    stat->syscalls = mSyscallCount;
+
+    // Wake latency percentiles, as the upper bound of their histogram bucket
+    uint32_t histogram[gWakeLatencyBuckets];
+    stat->wakeCount = 0;
+    for (int i = 0; i < gWakeLatencyBuckets; i++) {
+        histogram[i] = mWakeLatency[i].exchange(0);
+        stat->wakeCount += histogram[i];
+    }
+    stat->wakeP50Usec = stat->wakeP99Usec = 0;
+    uint32_t count = 0;
+    for (int i = 0; i < gWakeLatencyBuckets && stat->wakeCount > 0; i++) {
+        count += histogram[i];
+        if ( stat->wakeP50Usec == 0 && count * 2 >= stat->wakeCount ) {
+            stat->wakeP50Usec = 1u << i;
+        }
+        if ( stat->wakeP99Usec == 0 && count * 100 >= stat->wakeCount * 99 ) {
+            stat->wakeP99Usec = 1u << i;
+        }
+    }
+    stat->wakeMaxUsec = mWakeMaxUsec.exchange(0);
+    stat->spinCaught = mSpinCaught.exchange(0);
+    stat->spinUsec = static_cast<uint32_t>(mSpinNs.exchange(0) / 1000);
+    stat->sendDropped = mDirectDropped;
     stat->statCount = mStatCount++;
     return true;
 }
 
+//*******************************************************************************
+bool UdpDataProtocol::getPathStats(QVector<DataProtocol::PathStat>& stats)
+{
+    if (mPathMerger == NULL) { return false; }
+    mPathMerger->getStats(stats);
+    return true;
+}
+
 //*******************************************************************************
 void UdpDataProtocol::sendPacketRedundancy(int8_t* full_redundant_packet,
                                            int full_redundant_packet_size,
                                            int full_packet_size)
 {
+    sendCapabilityPacket();
     mJackTrip->readAudioBuffer( mAudioPacket );
-    mJackTrip->putHeaderInPacket(mFullPacket, mAudioPacket);
-
-    // Move older packets to end of array of redundant packets
-    std::memmove(full_redundant_packet+full_packet_size,
-                 full_redundant_packet,
-                 full_packet_size*(mUdpRedundancyFactor-1));
-    // Copy new packet to the begining of array
-    std::memcpy(full_redundant_packet,
-                mFullPacket, full_packet_size);
+    int size;
+    const int8_t* datagram = buildDatagram(mAudioPacket, full_redundant_packet,
+                                           full_redundant_packet_size, full_packet_size,
+                                           size);
 
     // 10% (or other number) packet lost simulation.
     // Uncomment the if to activate
@@ -740,15 +2083,206 @@ void UdpDataProtocol::sendPacketRedundancy(int8_t* full_redundant_packet,
     //int random_integer = rand();
     //if ( random_integer > (RAND_MAX/10) )
     //{
-    sendPacket( reinterpret_cast<char*>(full_redundant_packet),
-                full_redundant_packet_size);
+    if (mGso) {
+        // Packets queued behind this one (the sender is late) go together
+        // in one system call, the others right away. Sealed in place.
+        int8_t* segment = mOffloadPacket + mOffloadSize;
+        std::memcpy(segment, datagram, size);
+        if (mCipher != NULL) { size = mCipher->seal(segment, size); }
+        mOffloadSize += size;
+        if ( mOffloadSize + size > mOffloadMaxSize ||
+             mJackTrip->getSendQueueLength() == 0 ) {
+            sendSegments(mOffloadPacket, mOffloadSize, size);
+            mOffloadSize = 0;
+        }
+    }
+    else {
+        datagram = sealDatagram(datagram, size, mSealPacket);
+        sendPacket( reinterpret_cast<const char*>(datagram), size );
+    }
     //}
     //---------------------------------------------------------------------------------
+}
 
+
+//*******************************************************************************
+const int8_t* UdpDataProtocol::buildDatagram(const int8_t* audio_packet,
+                                             int8_t* full_redundant_packet,
+                                             int full_redundant_packet_size,
+                                             int full_packet_size,
+                                             int& size)
+{
+    mJackTrip->putHeaderInPacket(mFullPacket, audio_packet);
     mJackTrip->increaseSequenceNumber();
+
+    if ( mJackTrip->isPacked() ) {
+        // Same algorithm with packed packets: pack the new one in the extra slot,
+        // shift the older ones by its size and put it in front
+        int8_t* new_packet = mDtxPacket + mDtxPacketSize;
+        int new_size = mJackTrip->packDtxPacket(mFullPacket, new_packet);
+        int older_size = 0;
+        for (int i = mDtxSizes.size()-1; i>0; i--) {
+            mDtxSizes[i] = mDtxSizes[i-1];
+            older_size += mDtxSizes[i];
+        }
+        mDtxSizes[0] = new_size;
+        std::memmove(mDtxPacket + new_size, mDtxPacket, older_size);
+        std::memcpy(mDtxPacket, new_packet, new_size);
+        size = new_size + older_size;
+        return mDtxPacket;
+    }
+
+    // Move older packets to end of array of redundant packets
+    std::memmove(full_redundant_packet+full_packet_size,
+                 full_redundant_packet,
+                 full_packet_size*(mUdpRedundancyFactor-1));
+    // Copy new packet to the begining of array
+    std::memcpy(full_redundant_packet,
+                mFullPacket, full_packet_size);
+    size = full_redundant_packet_size;
+    return full_redundant_packet;
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::setupDirectSend(int full_redundant_packet_size, int full_packet_size)
+{
+#if defined (MSG_DONTWAIT)
+    // The sender thread sleeps on the pipe until sendDirect() queues
+    if ( ::pipe(mDirectWakeup) < 0 ||
+         ::fcntl(mDirectWakeup[0], F_SETFL, O_NONBLOCK) < 0 ||
+         ::fcntl(mDirectWakeup[1], F_SETFL, O_NONBLOCK) < 0 ) {
+        std::cerr << "WARNING: --directsend can't create its wakeup pipe, "
+                  << "sending from the sender thread" << endl;
+        mDirectUnavailable = true;
+        return;
+    }
+    mDirectRedundantPacketSize = full_redundant_packet_size;
+    mDirectPacketSize = full_packet_size;
+    mDirectRedundantPacket = new int8_t[full_redundant_packet_size];
+    std::memset(mDirectRedundantPacket, 0, full_redundant_packet_size);
+    // The queue holds the datagrams as they go on the wire, sealed (--encrypt)
+    mDirectSlotSize = std::max(full_redundant_packet_size, mDtxPacketSize) + getCipherOverhead();
+    if (mCipher != NULL) { mDirectSealPacket = new int8_t[mDirectSlotSize]; }
+    mDirectQueue = new int8_t[gDirectSendQueueSlots * mDirectSlotSize];
+    mDirectSizes = new int[gDirectSendQueueSlots];
+    mDirectWrite = 0;
+    mDirectRead = 0;
+    mDirectDropped = 0;
+#else
+    (void) full_redundant_packet_size; (void) full_packet_size;
+    std::cerr << "WARNING: --directsend is not available on this platform, "
+              << "sending from the sender thread" << endl;
+#endif
+}
+
+
+//*******************************************************************************
+bool UdpDataProtocol::sendDirect(const int8_t* audio_packet)
+{
+#if defined (MSG_DONTWAIT)
+    // The sender thread sets up the direct send state before it releases
+    // mDirectReady, none of it is touched until then. Dropped until the sender
+    // thread starts (see run()), as the RingBuffer would.
+    if ( !mDirectReady.load(std::memory_order_acquire) ) {
+        return !mDirectUnavailable.load(std::memory_order_relaxed);
+    }
+
+    // The capability packets go the same way: only one thread at a time
+    // sends, the fragment ids, the path MTU and the cipher are not shared
+    if ( mJackTrip->putCapabilityPacket(mCapsPacket, mCapsPacketSize) ) {
+        int caps_size = mCapsPacketSize;
+        if (mCipher != NULL) { caps_size = mCipher->seal(mCapsPacket, caps_size); }
+        sendOrQueueDirect(mCapsPacket, caps_size);
+    }
+    int size;
+    const int8_t* datagram = buildDatagram(audio_packet, mDirectRedundantPacket,
+                                           mDirectRedundantPacketSize, mDirectPacketSize,
+                                           size);
+    datagram = sealDatagram(datagram, size, mDirectSealPacket);
+    sendOrQueueDirect(datagram, size);
+    return true;
+#else
+    (void) audio_packet;
+    return false;
+#endif
+}
+
+
+//*******************************************************************************
+void UdpDataProtocol::sendOrQueueDirect(const int8_t* datagram, int size)
+{
+#if defined (MSG_DONTWAIT)
+    // The sender thread only sends while datagrams are queued, and releases
+    // mDirectRead after its send, so the two never send at the same time
+    unsigned int w = mDirectWrite.load(std::memory_order_relaxed);
+    unsigned int r = mDirectRead.load(std::memory_order_acquire);
+    if (w == r) {
+        // Nothing queued ahead of it: send now, unless the socket is full
+        if ( sendDatagram(reinterpret_cast<const char*>(datagram), size, MSG_DONTWAIT) >= 0 ||
+             (errno != EAGAIN && errno != EWOULDBLOCK) ) {
+            return;
+        }
+    }
+    if ( w - r >= static_cast<unsigned int>(gDirectSendQueueSlots) ) {
+        mDirectDropped++;
+        return;
+    }
+    int slot = w % gDirectSendQueueSlots;
+    std::memcpy(mDirectQueue + slot * mDirectSlotSize, datagram, size);
+    mDirectSizes[slot] = size;
+    mDirectWrite.store(w + 1, std::memory_order_release);
+    // A full pipe already wakes the sender thread
+    char wakeup = 0;
+    if ( ::write(mDirectWakeup[1], &wakeup, 1) < 0 ) {}
+#else
+    (void) datagram; (void) size;
+#endif
 }
 
 
+//*******************************************************************************
+void UdpDataProtocol::drainDirectSendQueue()
+{
+    // The audio callback builds and sends the datagrams from now on, the
+    // capability packets too, the thread only sends the ones the socket
+    // couldn't take, blocking
+    mDirectReady.store(true, std::memory_order_release);
+    while ( !mStopped ) {
+        unsigned int r = mDirectRead.load(std::memory_order_relaxed);
+        unsigned int w = mDirectWrite.load(std::memory_order_acquire);
+        if (r == w) {
+            // A datagram queued since the check above left a byte in the pipe
+            struct pollfd wakeup;
+            wakeup.fd = mDirectWakeup[0];
+            wakeup.events = POLLIN;
+            wakeup.revents = 0;
+            if ( ::poll(&wakeup, 1, gDirectSendWakeupMs) > 0 ) {
+                char bytes[gDirectSendQueueSlots];
+                while ( ::read(mDirectWakeup[0], bytes, sizeof(bytes)) > 0 ) {}
+            }
+            continue;
+        }
+        int slot = r % gDirectSendQueueSlots;
+        sendPacket( reinterpret_cast<const char*>(mDirectQueue + slot * mDirectSlotSize),
+                    mDirectSizes[slot] );
+        mDirectRead.store(r + 1, std::memory_order_release);
+    }
+    mDirectReady.store(false, std::memory_order_release);
+}
+
+
+
+//*******************************************************************************
+void UdpDataProtocol::sendCapabilityPacket()
+{
+    if ( mJackTrip->putCapabilityPacket(mCapsPacket, mCapsPacketSize) ) {
+        int size = mCapsPacketSize;
+        if (mCipher != NULL) { size = mCipher->seal(mCapsPacket, size); }
+        sendPacket( reinterpret_cast<const char*>(mCapsPacket), size );
+    }
+}
+
 /*
   The Redundancy Algorythmn works as follows. We send a packet that contains
   a mUdpRedundancyFactor number of packets (header+audio). This big packet looks
@@ -44,11 +44,19 @@
 #include <QUdpSocket>
 #include <QHostAddress>
 #include <QMutex>
+#include <QVector>
 
 #include "DataProtocol.h"
 #include "jacktrip_types.h"
 #include "jacktrip_globals.h"
 
+class PacketCapture;
+class UringReceiver;
+class Fragmenter;
+class PacketCipher;
+class PathMerger;
+class AdaptiveQuality;
+
 /** \brief UDP implementation of DataProtocol class
  *
  * The class has a <tt>bind port</tt> and a <tt>peer port</tt>. The meaning of these
@@ -116,6 +124,17 @@ public:
    */
     virtual int sendPacket(const char* buf, const size_t n);
 
+    /** \brief Builds the datagram of audio_packet and sends it without
+   * blocking, from the audio callback. What the socket can't take right away
+   * is queued for the sender thread (lock-free).
+   */
+    virtual bool sendDirect(const int8_t* audio_packet);
+
+    /** \brief Prints the cost of sending and receiving datagrams on the
+   * loopback, one system call each and with UDP GSO/GRO (--offloadbench, Linux)
+   */
+    static void benchmarkOffload(std::ostream& out);
+
     /** \brief Obtains the peer address from the first UDP packet received. This address
    * is used by the SERVER mode to connect back to the client.
    * \param peerHostAddress QHostAddress to store the peer address
@@ -143,6 +162,19 @@ public:
     virtual void run();
 
     virtual bool getStats(PktStat* stat);
+    virtual bool getPathStats(QVector<PathStat>& stats);
+
+    /// \brief Logs every received datagram to capture, set before start()
+    void setCapture(PacketCapture* capture)
+    { mCapture = capture; }
+    /// \brief Sets up the receiver to be fed with replayDatagram() instead of
+    /// running the thread
+    void setupReplay();
+    /// \brief Processes a captured datagram as if it arrived from the socket now
+    void replayDatagram(const int8_t* datagram, int size);
+    /// \brief Sends to a new peer address from now on (session resumption),
+    /// thread safe
+    void movePeer(const QHostAddress& address, uint16_t port);
 
 private slots:
     void printUdpWaitedTooLong(int wait_msec);
@@ -165,6 +197,15 @@ protected:
 #else
     int bindSocket();
 #endif
+    /** \brief Joins the multicast group of the peer address (listener), or
+   * sets the hops of the datagrams sent to it (sender). Throws
+   * std::runtime_error.
+   */
+#if defined (__WIN_32__)
+    void setupMulticast(SOCKET sock_fd);
+#else
+    void setupMulticast(int sock_fd);
+#endif
 
     /** \brief This function blocks until data is available for reading in the
    * QUdpSocket. The function will timeout after timeout_msec microseconds.
@@ -177,6 +218,73 @@ protected:
    */
     void waitForReady(QUdpSocket& UdpSocket, int timeout_msec);
 
+    /// \brief Busy polls the socket (receiver) if asked for (Linux)
+    void setupBusyPoll();
+    /** \brief Same as waitForReady(), spinning on the socket in a window
+   * around the expected arrival of the next datagram and blocking outside of it.
+   * The window follows the arrival jitter. Measures the wake latency.
+   */
+    void waitBusyPoll(int timeout_msec);
+    /// \brief True if a datagram is queued, with its kernel arrival time
+    /// (CLOCK_REALTIME, 0 if unknown)
+    bool peekArrival(int64_t& arrival_ns);
+
+    /** \brief Blocks until a datagram with data is pending. The empty ones
+   * are read and dropped, they would stay at the head of the socket.
+   */
+    void waitForDatagram(QUdpSocket& UdpSocket);
+    /// \brief Reads a datagram, keeping its source in a resumable session,
+    /// with several paths (--multipath) or as a multicast listener
+    int readDatagram(QUdpSocket& UdpSocket, char* buf, const size_t n);
+    /** \brief True if the datagram just read comes from the peer. In a resumable
+   * session, a datagram that authenticates and is newer than all the ones
+   * received moves the session to its source.
+   */
+    bool checkPeer(int8_t* datagram, int size);
+    /// \brief True if the datagram just read comes from the sender of the
+    /// multicast group, the first source heard (listener)
+    bool checkMulticastSender();
+
+    /// \brief Turns on UDP GRO (receiver) or GSO (sender) if asked for and
+    /// available (Linux)
+    void setupUdpOffload(int full_redundant_packet_size);
+    /** \brief Reads the datagrams coalesced by GRO and processes them one by
+   * one, as if each one had been read from the socket
+   */
+    void receiveCoalescedPackets(QUdpSocket& UdpSocket,
+                                 int8_t* full_redundant_packet,
+                                 int full_redundant_packet_size,
+                                 int full_packet_size,
+                                 uint16_t& current_seq_num,
+                                 uint16_t& last_seq_num,
+                                 uint16_t& newer_seq_num);
+    /** \brief Processes size bytes of back to back segment_size datagrams
+   * received in buf, as if each one had been read from the socket
+   */
+    void processSegments(int8_t* buf, int size, int segment_size,
+                         int8_t* full_redundant_packet,
+                         int full_redundant_packet_size,
+                         int full_packet_size,
+                         uint16_t& current_seq_num,
+                         uint16_t& last_seq_num,
+                         uint16_t& newer_seq_num);
+    /// \brief Receives with io_uring if asked for and available (Linux)
+    void setupUring(int full_redundant_packet_size);
+    /** \brief Waits for the datagrams received by io_uring and processes them,
+   * back to the socket if the kernel can't receive this way
+   * \param wait_msec Time waited for a datagram so far, for signalWaitingTooLong()
+   */
+    void receiveRingPackets(int8_t* full_redundant_packet,
+                            int full_redundant_packet_size,
+                            int full_packet_size,
+                            uint16_t& current_seq_num,
+                            uint16_t& last_seq_num,
+                            uint16_t& newer_seq_num,
+                            int& wait_msec);
+    /// \brief Sends size bytes of back to back segment_size datagrams in one
+    /// GSO system call, or one by one if the kernel can't
+    void sendSegments(const int8_t* buf, int size, int segment_size);
+
     /** \brief Redundancy algorythm at the receiving end
     */
     virtual void receivePacketRedundancy(QUdpSocket& UdpSocket,
@@ -186,6 +294,67 @@ protected:
                                          uint16_t& current_seq_num,
                                          uint16_t& last_seq_num,
                                          uint16_t& newer_seq_num);
+    /** \brief Redundancy algorythm on a received datagram, which is either
+   * full_redundant_packet itself or packed (DTX) or captured elsewhere
+    */
+    void processPacketRedundancy(const int8_t* datagram, int size,
+                                 int8_t* full_redundant_packet,
+                                 int full_redundant_packet_size,
+                                 int full_packet_size,
+                                 uint16_t& current_seq_num,
+                                 uint16_t& last_seq_num,
+                                 uint16_t& newer_seq_num);
+    /** \brief Whole datagram to process: reassembled if it is a fragment
+   * (--mtu), then authenticated and decrypted in place (--encrypt)
+   * \return NULL until the frame is complete, or if the datagram is forged
+    */
+    int8_t* unwrapDatagram(int8_t* datagram, int& size);
+    /** \brief Encrypted copy of a datagram in buffer (--encrypt), which takes
+   * getCipherOverhead() bytes more, or the datagram itself when not encrypted
+    */
+    const int8_t* sealDatagram(const int8_t* datagram, int& size, int8_t* buffer);
+    /// \brief Bytes an encrypted datagram has more than the plaintext, 0 if not encrypted
+    int getCipherOverhead() const;
+    /// \brief Allocates the packet buffers used by run() and the replay
+    void setupPacketBuffers();
+    /// \brief Size of a packet (header and audio) sent or received, by run mode
+    int getFullPacketSize() const;
+
+    /** \brief Puts the header on audio_packet and adds it to the redundant
+   * packet (or the packed packets in DTX mode), the next datagram to send
+   * \param size Size of the datagram
+   */
+    const int8_t* buildDatagram(const int8_t* audio_packet,
+                                int8_t* full_redundant_packet,
+                                int full_redundant_packet_size,
+                                int full_packet_size,
+                                int& size);
+    /// \brief Sends with the send flags, see sendPacket(), in fragments when
+    /// larger than the path MTU (--mtu)
+    int sendDatagram(const char* buf, const size_t n, int flags);
+    /// \brief Sends one datagram to the peer as it is
+    int sendToPeer(const char* buf, const size_t n, int flags);
+    /// \brief Finds the interface of the local address of each path (sender, --multipath)
+    void setupMultipath();
+    /// \brief Sends one copy of the datagram over each path (--multipath)
+    /// \return Its size if a path took it, -1 if none did
+    int sendToPaths(const char* buf, const size_t n, int flags);
+    /// \brief Turns on path MTU discovery on the socket (sender, --mtu)
+    void setupPathMtu();
+    /** \brief Takes the path MTU the kernel found, capped by --mtu, or the next
+   * common MTU below the current one if lower and the kernel can't tell
+   */
+    void updatePathMtu(bool lower);
+    /// \brief Allocates the state sendDirect() uses from the audio callback
+    void setupDirectSend(int full_redundant_packet_size, int full_packet_size);
+    /// \brief Sender thread loop with direct send: sends the queued datagrams
+    void drainDirectSendQueue();
+    /// \brief Sends a datagram from the audio callback, or queues it for the
+    /// sender thread if the socket is full or datagrams are queued already
+    void sendOrQueueDirect(const int8_t* datagram, int size);
+    /// \brief Sends the session settings when the header asks for it
+    /// (PacketHeader::putCapabilityPacket())
+    void sendCapabilityPacket();
 
     /** \brief Redundancy algorythm at the sender's end
     */
@@ -212,6 +381,67 @@ private:
 
     int8_t* mAudioPacket; ///< Buffer to store Audio Packets
     int8_t* mFullPacket; ///< Buffer to store Full Packet (audio+header)
+    int8_t* mDtxPacket; ///< Redundant packets as sent in DTX mode, packed back to back
+    int mDtxPacketSize; ///< Size of mDtxPacket
+    QVector<int> mDtxSizes; ///< Size of each packed packet in mDtxPacket, newest first
+    int8_t* mCapsPacket; ///< Capability packet, as large as the redundant packets
+                         ///< (sealed in place, the buffer has room for it)
+    int mCapsPacketSize; ///< Size of mCapsPacket
+    PacketCapture* mCapture; ///< Log of the received datagrams, or NULL
+    bool mResumable; ///< Hub session that follows the client to a new address
+    QMutex mPeerMutex; ///< Protects the peer address of a resumable session
+    struct sockaddr_storage mFromAddr; ///< Source of the last datagram, if resumable
+    bool mMulticastListener; ///< Listens to a multicast group (--multicast receive)
+    struct sockaddr_storage mMulticastSender; ///< Sender of the group, ss_family 0 until heard
+    bool mGro; ///< The socket coalesces the received datagrams (UDP_GRO)
+    bool mGso; ///< The queued datagrams go in one segmented send (UDP_SEGMENT)
+    int8_t* mOffloadPacket; ///< Coalesced received datagrams, or datagrams to send
+    int mOffloadSize; ///< Bytes of datagrams waiting in mOffloadPacket (GSO)
+    int mOffloadMaxSize; ///< Most bytes of datagrams in one GSO send
+    std::atomic<uint32_t> mSyscallCount; ///< Socket system calls, for the IO stats
+    Fragmenter* mFragmenter; ///< Reassembles (receiver) or fragments (sender, --mtu)
+    int mPathMtu; ///< Largest IP packet to the peer (sender, --mtu)
+    int64_t mPathMtuCheckNs; ///< Next read of the kernel path MTU (monotonic)
+    /// A network path of the sender (--multipath)
+    struct NetworkPath {
+        struct sockaddr_storage source; ///< Local address the copies go from
+        unsigned int ifindex; ///< Interface of the address
+    };
+    QVector<NetworkPath> mPaths; ///< Paths of the sender, empty = the default route
+    PathMerger* mPathMerger; ///< Drops the copies of the slower paths (receiver, --multipath), or NULL
+    AdaptiveQuality* mAdaptive; ///< Bit resolution to ask the peer for (receiver, --adaptive), or NULL
+    PacketCipher* mCipher; ///< Opens (receiver) or seals (sender) the datagrams, or NULL
+    int8_t* mSealPacket; ///< Sealed copy of the datagram to send, sender thread only
+    UringReceiver* mUring; ///< io_uring receive engine, NULL on the socket
+    int mBusyPollUsec; ///< Spin-then-block receive, SO_BUSY_POLL budget, 0 = off
+    int64_t mExpectedArrivalNs; ///< Next datagram expected (monotonic), 0 = unknown
+    int64_t mArrivalJitterNs; ///< Mean deviation from the expected arrival
+    std::atomic<uint32_t> mWakeLatency[gWakeLatencyBuckets]; ///< Histogram since the last stats
+    std::atomic<uint32_t> mWakeMaxUsec; ///< Since the last stats
+    std::atomic<uint32_t> mSpinCaught; ///< Datagrams caught spinning since the last stats
+    std::atomic<uint64_t> mSpinNs; ///< Time spent spinning since the last stats
+
+    // Direct send, the datagrams are built by the audio callback
+    std::atomic<bool> mDirectReady; ///< sendDirect() may send, set by the sender thread
+    std::atomic<bool> mDirectUnavailable; ///< Not set up, the RingBuffer carries the audio
+    int8_t* mDirectRedundantPacket; ///< Redundant packets, audio callback only
+    int8_t* mDirectSealPacket; ///< Sealed copy of the datagram, audio callback only
+    int mDirectRedundantPacketSize;
+    int mDirectPacketSize; ///< Full packet (header+audio)
+    int8_t* mDirectQueue; ///< Datagrams the socket couldn't take, gDirectSendQueueSlots
+    int mDirectSlotSize; ///< Largest datagram, size of each queue slot
+    int* mDirectSizes; ///< Size of the datagram in each slot
+    std::atomic<unsigned int> mDirectWrite; ///< Datagrams queued, written by the audio thread only
+    std::atomic<unsigned int> mDirectRead; ///< Datagrams sent, written by the sender thread only
+    std::atomic<uint32_t> mDirectDropped; ///< Datagrams dropped with the queue full
+    int mDirectWakeup[2]; ///< Pipe, sendDirect() wakes the sender thread when it queues
+
+    // Replay state, the locals of run() in a live receiver
+    int8_t* mReplayRedundantPacket;
+    bool mReplayConnected; ///< First datagram checked
+    uint16_t mReplayCurrentSeqNum;
+    uint16_t mReplayLastSeqNum;
+    uint16_t mReplayNewerSeqNum;
 
     unsigned int mUdpRedundancyFactor; ///< Factor of redundancy
     static QMutex sUdpMutex; ///< Mutex to make thread safe the binding process
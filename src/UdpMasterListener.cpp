@@ -44,9 +44,12 @@
 #include <QTcpSocket>
 #include <QStringList>
 #include <QMutexLocker>
+#include <QElapsedTimer>
 
 #include "UdpMasterListener.h"
 #include "JackTripWorker.h"
+#include "PatchManager.h"
+#include "Settings.h"
 #include "jacktrip_globals.h"
 
 using std::cout; using std::endl;
@@ -56,35 +59,37 @@ using std::cout; using std::endl;
 UdpMasterListener::UdpMasterListener(int server_port) :
     //mJTWorker(NULL),
     mServerPort(server_port),
+    mFirstFree(-1),
+    mLastFree(-1),
     mStopped(false),
     #ifdef WAIR // wair
     mWAIR(false),
     #endif // endwhere
     mTotalRunningThreads(0),
-    m_connectDefaultAudioPorts(false)
+    m_connectDefaultAudioPorts(false),
+    m_settings(NULL),
+    mPatchManager(NULL),
+    mHubMixerTopN(0),
+    mHubLoadLimit(gDefaultHubLoadLimit)
 {
     // Register JackTripWorker with the master listener
     //mJTWorker = new JackTripWorker(this);
+    // The worker vector and the client table grow on demand (see isNewAddress)
     mJTWorkers = new QVector<JackTripWorker*>;
-    for (int i = 0; i<gMaxThreads; i++) {
-        mJTWorkers->insert(i, NULL);
-    }
-
 
-    //mJTWorkers = new JackTripWorker(this);
-    mThreadPool.setExpiryTimeout(3000); // msec (-1) = forever
-    // Inizialize IP addresses
-    for (int i = 0; i<gMaxThreads; i++) {
-        mActiveAddress[i].address = ""; // Address strings
-        mActiveAddress[i].port = 0;
-    }
     // Set the base dynamic port
     // The Dynamic and/or Private Ports are those from 49152 through 65535
-    // mBasePort = ( rand() % ( (65535 - gMaxThreads) - 49152 ) ) + 49152;
+    // mBasePort = ( rand() % ( (65535 - getMaxClients()) - 49152 ) ) + 49152;
 
     // SoundWIRE ports open are UDP 61000-62000
     mBasePort = 61000;
 
+    //mJTWorkers = new JackTripWorker(this);
+    mThreadPool.setExpiryTimeout(3000); // msec (-1) = forever
+    // Every JackTripWorker blocks its pool thread for the whole session, so the
+    // pool must not queue workers behind the default (number of cores) limit
+    mThreadPool.setMaxThreadCount(getMaxClients());
+
     mUnderRunMode = JackTrip::WAVETABLE;
     mBufferQueueLength = gDefaultQueueLength;
 }
@@ -96,10 +101,14 @@ UdpMasterListener::~UdpMasterListener()
     QMutexLocker lock(&mMutex);
     mThreadPool.waitForDone();
     //delete mJTWorker;
-    for (int i = 0; i<gMaxThreads; i++) {
+    for (int i = 0; i<mJTWorkers->size(); i++) {
         delete mJTWorkers->at(i);
     }
     delete mJTWorkers;
+    delete mPatchManager;
+    for (int i = 0; i<mSessionLoads.size(); i++) {
+        delete mSessionLoads[i];
+    }
 }
 
 
@@ -125,16 +134,41 @@ void UdpMasterListener::run()
     }
 
     const int tcpTimeout = 5*1000;
+    const int statTimeout = m_settings ? m_settings->getIOStatTimeout() : 0;
+    std::ostream statStream( m_settings ? m_settings->getIOStatStream().rdbuf()
+                                        : std::cout.rdbuf() );
+    QElapsedTimer statTimer;
+    statTimer.start();
 
 
     cout << "JackTrip HUB SERVER: TCP Server Listening in Port = " << TcpServer.serverPort() << endl;
+
+    // Start the patch manager, the hub patch is kept up to date incrementally
+    // from its own thread as clients join and leave
+    if (mPatchManager == NULL) {
+        mPatchManager = new PatchManager(mHubPatch, mHubMixerTopN);
+        if (m_settings != NULL) {
+            mPatchManager->setRecorder(m_settings->getRecorder());
+            mPatchManager->setMixerRemoteControl(m_settings->isHubRemoteControl());
+        }
+        mPatchManager->setMixerLoad(&mMixerLoad);
+        mPatchManager->start();
+    }
     while ( !mStopped )
     {
         cout << "JackTrip HUB SERVER: Waiting for client connections..." << endl;
         cout << "JackTrip HUB SERVER: Hub auto audio patch setting = " << mHubPatch << endl;
         cout << "=======================================================" << endl;
         while ( !TcpServer.waitForNewConnection(1000) )
-        { if (mStopped) { return; } } // block until a new connection is received
+        {
+            if (mStopped) { return; }
+            // Export the hub and shard loads with the IO stats
+            if ( statTimeout > 0 && statTimer.elapsed() >= 1000 * statTimeout ) {
+                statTimer.restart();
+                printHubLoad(statStream);
+                if ( !mShardCpus.isEmpty() ) { printShardLoads(statStream); }
+            }
+        } // block until a new connection is received
         cout << "JackTrip HUB SERVER: Client Connection Received!" << endl;
 
         // Control loop to be able to exit if UDPs or TCPs error ocurr
@@ -150,10 +184,33 @@ void UdpMasterListener::run()
 
             // Get UDP port from client
             // ------------------------
-            peer_udp_port = readClientUdpPort(clientConnection);
+            int request_size;
+            peer_udp_port = readClientUdpPort(clientConnection, request_size);
             if ( peer_udp_port == 0 ) { break; }
             cout << "JackTrip HUB SERVER: Client UDP Port is = " << peer_udp_port << endl;
 
+            // Get the request of the client, what it uses that older clients
+            // don't, and the public key of clients that encrypt (--encrypt)
+            // ----------------------------------------------------------------
+            uint8_t request_flags = 0;
+            uint8_t client_public_key[PacketCipher::KEY_SIZE];
+            if ( request_size > 0 &&
+                 !readClientRequest(clientConnection, request_size, request_flags,
+                                    client_public_key) ) {
+                std::cerr << "JackTrip HUB SERVER: Client request is not valid, connection refused" << endl;
+                clientConnection->close();
+                delete clientConnection;
+                break;
+            }
+            bool encrypt = (request_flags & gHandshakeEncrypt);
+            if ( !encrypt && m_settings != NULL && m_settings->isEncrypt() ) {
+                std::cerr << "JackTrip HUB SERVER: Client doesn't encrypt, connection refused" << endl;
+                sendUdpPort(clientConnection, gHubEncryptionRequiredReply);
+                clientConnection->close();
+                delete clientConnection;
+                break;
+            }
+
             // Check is client is new or not
             // -----------------------------
             // Check if Address is not already in the thread pool
@@ -166,22 +223,61 @@ void UdpMasterListener::run()
                 int id_remove;
                 id_remove = getPoolID(PeerAddress.toString(), peer_udp_port);
                 // stop the thread
-                mJTWorkers->at(id_remove)->stopThread();
+                if (id_remove != -1) { mJTWorkers->at(id_remove)->stopThread(); }
                 // block until the thread has been removed from the pool
-                while ( isNewAddress(PeerAddress.toString(), peer_udp_port) == -1 ) {
-                    cout << "JackTrip HUB SERVER: Removing JackTripWorker from pool..." << endl;
-                    QThread::msleep(10);
+                if ( !waitForRelease(PeerAddress.toString(), peer_udp_port) ) {
+                    std::cerr << "JackTrip HUB SERVER: The previous session of the client "
+                              << "didn't release its slot in time, connection refused" << endl;
+                    sendUdpPort(clientConnection, gHubFullReply);
+                    clientConnection->close();
+                    delete clientConnection;
+                    break;
                 }
                 // Get a new ID for this client
-                //id = isNewAddress(PeerAddress.toIPv4Address(), peer_udp_port);
-                id = getPoolID(PeerAddress.toString(), peer_udp_port);
+                id = isNewAddress(PeerAddress.toString(), peer_udp_port);
+            }
+            if (id < 0) {
+                std::cerr << "JackTrip HUB SERVER: Hub is full (" << getMaxClients()
+                          << " clients), connection refused" << endl;
+                sendUdpPort(clientConnection, gHubFullReply);
+                clientConnection->close();
+                delete clientConnection;
+                break;
+            }
+            // Admission control: one more session must fit in the audio period
+            // along with the ones running, or the JACK cycle overruns for everyone
+            double projected_load = (mHubLoadLimit > 0.0) ? getHubLoad(true) : 0.0;
+            if ( projected_load > mHubLoadLimit ) {
+                std::cerr << "JackTrip HUB SERVER: Hub is full (projected load "
+                          << int(100 * projected_load) << "% of the period, limit "
+                          << int(100 * mHubLoadLimit) << "%), connection refused" << endl;
+                sendUdpPort(clientConnection, gHubFullReply);
+                clientConnection->close();
+                delete clientConnection;
+                freeSlot(id);
+                break;
+            }
+            {
+                QMutexLocker lock(&mMutex);
+                mActiveAddress[id].compactHeader = (request_flags & gHandshakeCompactHeader);
+            }
+            // Agree the keys with clients that encrypt
+            uint8_t public_key[PacketCipher::KEY_SIZE];
+            if ( encrypt && !setSessionKeys(id, client_public_key, public_key) ) {
+                std::cerr << "JackTrip HUB SERVER: Client key is not valid, connection refused" << endl;
+                clientConnection->close();
+                delete clientConnection;
+                freeSlot(id);
+                break;
             }
-            // Assign server port and send it to Client
+            // Assign server port and send it to Client, with the session token
+            // and our key
             server_udp_port = mBasePort+id;
-            if ( sendUdpPort(clientConnection, server_udp_port) == 0 ) {
+            if ( sendUdpPort(clientConnection, server_udp_port, getSessionToken(id),
+                             encrypt ? public_key : NULL) == 0 ) {
                 clientConnection->close();
                 delete clientConnection;
-                releaseThread(id);
+                freeSlot(id);
                 break;
             }
 
@@ -194,22 +290,30 @@ void UdpMasterListener::run()
             // Spawn Thread to Pool
             // --------------------
             // Register JackTripWorker with the master listener
+            while (mJTWorkers->size() <= id) { mJTWorkers->append(NULL); }
             delete mJTWorkers->at(id); // just in case the Worker was previously created
             mJTWorkers->replace(id, new JackTripWorker(this, mBufferQueueLength, mUnderRunMode));
             // redirect port and spawn listener
             cout << "JackTrip HUB SERVER: Spawning JackTripWorker..." << endl;
+            QString client_address;
+            uint16_t client_port;
+            int shard;
             {
                 QMutexLocker lock(&mMutex);
-                mJTWorkers->at(id)->setJackTrip(id,
-                                                mActiveAddress[id].address,
-                                                server_udp_port,
-                                                mActiveAddress[id].port,
-                                                1,
-                                                m_connectDefaultAudioPorts
-                                               ); /// \todo temp default to 1 channel
-
-                qDebug() << "mPeerAddress" << id <<  mActiveAddress[id].address << mActiveAddress[id].port;
+                client_address = mActiveAddress[id].address;
+                client_port = mActiveAddress[id].port;
+                shard = mActiveAddress[id].shard;
             }
+            mJTWorkers->at(id)->setCpuAffinity( (shard >= 0) ? mShardCpus[shard] : -1 );
+            mJTWorkers->at(id)->setJackTrip(id,
+                                            client_address,
+                                            server_udp_port,
+                                            client_port,
+                                            1,
+                                            m_connectDefaultAudioPorts
+                                           ); /// \todo temp default to 1 channel
+
+            qDebug() << "mPeerAddress" << id << client_address << client_port;
             //send one thread to the pool
             cout << "JackTrip HUB SERVER: Starting JackTripWorker..." << endl;
             mThreadPool.start(mJTWorkers->at(id), QThread::TimeCriticalPriority);
@@ -217,13 +321,15 @@ void UdpMasterListener::run()
             while (mJTWorkers->at(id)->isSpawning()) { QThread::msleep(10); }
             //mTotalRunningThreads++;
             cout << "JackTrip HUB SERVER: Total Running Threads:  " << mTotalRunningThreads << endl;
+            if ( shard >= 0 ) { printShardLoads(cout); }
+            printHubLoad(cout);
             cout << "===============================================================" << endl;
             QThread::msleep(100);
 #ifdef WAIR // WAIR
             if (isWAIR()) connectMesh(true); // invoked with -Sw
 #endif // endwhere
 
-            qDebug() << "mPeerAddress" << mActiveAddress[id].address << mActiveAddress[id].port;
+            qDebug() << "mPeerAddress" << client_address << client_port;
 
             connectPatch(true);
         }
@@ -283,13 +389,13 @@ void UdpMasterListener::run()
 
 //*******************************************************************************
 // Returns 0 on error
-int UdpMasterListener::readClientUdpPort(QTcpSocket* clientConnection)
+int UdpMasterListener::readClientUdpPort(QTcpSocket* clientConnection, int& request_size)
 {
     // Read the size of the package
     // ----------------------------
     //tcpClient.waitForReadyRead();
     cout << "JackTrip HUB SERVER: Reading UDP port from Client..." << endl;
-    while (clientConnection->bytesAvailable() < (int)sizeof(uint16_t)) {
+    while (clientConnection->bytesAvailable() < (int)sizeof(int)) {
         if (!clientConnection->waitForReadyRead()) {
             std::cerr << "TCP Socket ERROR: " << clientConnection->errorString().toStdString() <<  endl;
             return 0;
@@ -304,18 +410,86 @@ int UdpMasterListener::readClientUdpPort(QTcpSocket* clientConnection)
     char port_buf[size];
     clientConnection->read(port_buf, size);
     std::memcpy(&udp_port, port_buf, size);
-    return udp_port;
+    request_size = static_cast<uint32_t>(udp_port) >> gHandshakeRequestShift;
+    return udp_port & ((1 << gHandshakeRequestShift) - 1);
+}
+
+
+//*******************************************************************************
+bool UdpMasterListener::readClientRequest(QTcpSocket* clientConnection, int request_size,
+                                          uint8_t& flags, uint8_t* public_key)
+{
+    // The size came with the port, the request may come in later segments
+    while ( clientConnection->bytesAvailable() < request_size ) {
+        if ( !clientConnection->waitForReadyRead(gSessionTokenTimeoutMs) ) { return false; }
+    }
+    QByteArray request = clientConnection->read(request_size);
+    if ( request_size < gHandshakeRequestSize ) { return false; }
+    uint32_t magic;
+    std::memcpy(&magic, request.constData(), sizeof(magic));
+    if ( magic != gHandshakeMagic || static_cast<uint8_t>(request[4]) != gHandshakeVersion ) {
+        return false;
+    }
+    flags = static_cast<uint8_t>(request[5]);
+    if (flags & gHandshakeEncrypt) {
+        if ( request_size < gHandshakeRequestSize + PacketCipher::KEY_SIZE ) { return false; }
+        std::memcpy(public_key, request.constData() + gHandshakeRequestSize,
+                    PacketCipher::KEY_SIZE);
+    }
+    return true;
 }
 
 
 //*******************************************************************************
-int UdpMasterListener::sendUdpPort(QTcpSocket* clientConnection, int udp_port)
+bool UdpMasterListener::setSessionKeys(int id, const uint8_t* client_public_key,
+                                       uint8_t* public_key)
 {
-    // Send Port Number to Client
-    // --------------------------
-    char port_buf[sizeof(udp_port)];
+    // A new key pair for each session, the private key is not kept
+    uint8_t private_key[PacketCipher::KEY_SIZE];
+    uint8_t send_key[PacketCipher::KEY_SIZE];
+    uint8_t receive_key[PacketCipher::KEY_SIZE];
+    bool valid = PacketCipher::generateKeyPair(private_key, public_key) &&
+            PacketCipher::deriveKeys(private_key, client_public_key, false,
+                                     send_key, receive_key);
+    std::memset(private_key, 0, sizeof(private_key));
+    // Only the encrypted sessions resume from another address: the datagrams
+    // authenticate the client, the token in the clear doesn't
+    uint32_t token = 0;
+    while ( valid && token == 0 ) {
+        valid = PacketCipher::getRandomBytes(reinterpret_cast<uint8_t*>(&token), sizeof(token));
+    }
+    if (!valid) { return false; }
+    QMutexLocker lock(&mMutex);
+    mActiveAddress[id].token = token;
+    std::memcpy(mActiveAddress[id].sendKey, send_key, PacketCipher::KEY_SIZE);
+    std::memcpy(mActiveAddress[id].receiveKey, receive_key, PacketCipher::KEY_SIZE);
+    mActiveAddress[id].encrypt = true;
+    return true;
+}
+
+
+//*******************************************************************************
+int UdpMasterListener::sendUdpPort(QTcpSocket* clientConnection, int udp_port, uint32_t token,
+                                   const uint8_t* public_key)
+{
+    // Send Port Number to Client, and to clients that encrypt the Session Token
+    // and our public key
+    // ---------------------------------------------------------------------------
+    char port_buf[sizeof(udp_port) + sizeof(token) + sizeof(gKeyExchangeMagic)
+                  + PacketCipher::KEY_SIZE];
+    int size = sizeof(udp_port);
     std::memcpy(port_buf, &udp_port, sizeof(udp_port));
-    clientConnection->write(port_buf, sizeof(udp_port));
+    if (token != 0) {
+        std::memcpy(port_buf + size, &token, sizeof(token));
+        size += sizeof(token);
+    }
+    if (public_key != NULL) {
+        std::memcpy(port_buf + size, &gKeyExchangeMagic, sizeof(gKeyExchangeMagic));
+        size += sizeof(gKeyExchangeMagic);
+        std::memcpy(port_buf + size, public_key, PacketCipher::KEY_SIZE);
+        size += PacketCipher::KEY_SIZE;
+    }
+    clientConnection->write(port_buf, size);
     while ( clientConnection->bytesToWrite() > 0 ) {
         if ( clientConnection->state() == QAbstractSocket::ConnectedState ) {
             clientConnection->waitForBytesWritten(-1);
@@ -358,48 +532,48 @@ void UdpMasterListener::bindUdpSocket(QUdpSocket& udpsocket, int port)
 
 
 //*******************************************************************************
-// check by comparing 32-bit addresses
+// check by comparing address strings and ports, the table is hashed by both
 int UdpMasterListener::isNewAddress(QString address, uint16_t port)
 {
     QMutexLocker lock(&mMutex);
-    bool busyAddress = false;
-    int id = 0;
-
-    /*
-  while ( !busyAddress && (id<mThreadPool.activeThreadCount()) )
-  {
-    if ( address==mActiveAddress[id][0] &&  port==mActiveAddress[id][1]) { busyAddress = true; }
-    id++;
-  }
-  */
-    for (int i = 0; i<gMaxThreads; i++) {
-        if ( address==mActiveAddress[i].address &&  port==mActiveAddress[i].port) {
-            id = i;
-            busyAddress = true;
-        }
+    QPair<QString, uint16_t> key(address, port);
+    if ( mActiveAddressPortPair.contains(key) ) { return -1; }
+
+    int id;
+    if ( mFirstFree != -1 ) {
+        // Take the oldest released slot, giving its previous worker as much
+        // time as possible to leave the pool before the slot is reused
+        id = mFirstFree;
+        mFirstFree = mActiveAddress[id].nextFree;
+        if ( mFirstFree == -1 ) { mLastFree = -1; }
     }
-    if ( !busyAddress ) {
-        /*
-    mActiveAddress[id][0] = address;
-    mActiveAddress[id][1] = port;
-  } else {
-  */
-        id = 0;
-        bool foundEmptyAddress = false;
-        while ( !foundEmptyAddress && (id<gMaxThreads) ) {
-            if ( mActiveAddress[id].address.isEmpty() &&  (mActiveAddress[id].port == 0) ) {
-                foundEmptyAddress = true;
-                mActiveAddress[id].address = address;
-                mActiveAddress[id].port = port;
-            }  else {
-                id++;
-            }
-        }
+    else if ( mActiveAddress.size() < getMaxClients() ) {
+        id = mActiveAddress.size();
+        mActiveAddress.append(addressPortPair());
+        mSessionLoads.append(new CallbackLoad);
     }
-    if (!busyAddress) {
-        mTotalRunningThreads++;
+    else {
+        return -2; // hub is full
+    }
+    mActiveAddress[id].address = address;
+    mActiveAddress[id].port = port;
+    mActiveAddress[id].nextFree = -1;
+    mActiveAddress[id].shard = -1;
+    mActiveAddress[id].token = 0;
+    mActiveAddress[id].compactHeader = false;
+    mActiveAddress[id].encrypt = false;
+    // Sharded hub: the least loaded shard owns the new session
+    if ( !mShardCpus.isEmpty() ) {
+        int shard = 0;
+        for (int i = 1; i<mShardSessions.size(); i++) {
+            if ( mShardSessions[i] < mShardSessions[shard] ) { shard = i; }
+        }
+        mShardSessions[shard]++;
+        mActiveAddress[id].shard = shard;
     }
-    return ((busyAddress) ? -1 : id);
+    mActiveAddressPortPair.insert(key, id);
+    mTotalRunningThreads++;
+    return id;
 }
 
 
@@ -407,23 +581,33 @@ int UdpMasterListener::isNewAddress(QString address, uint16_t port)
 int UdpMasterListener::getPoolID(QString address, uint16_t port)
 {
     QMutexLocker lock(&mMutex);
-    //for (int id = 0; id<mThreadPool.activeThreadCount(); id++ )
-    for (int id = 0; id<gMaxThreads; id++ )
-    {
-        if ( address==mActiveAddress[id].address &&  port==mActiveAddress[id].port)
-        { return id; }
+    return mActiveAddressPortPair.value(qMakePair(address, port), -1);
+}
+
+
+//*******************************************************************************
+bool UdpMasterListener::waitForRelease(QString address, uint16_t port)
+{
+    QMutexLocker lock(&mMutex);
+    QPair<QString, uint16_t> key(address, port);
+    if ( !mActiveAddressPortPair.contains(key) ) { return true; }
+    cout << "JackTrip HUB SERVER: Removing JackTripWorker from pool..." << endl;
+    // Any release wakes us up, so wait for what is left of the timeout
+    QElapsedTimer timer;
+    timer.start();
+    while ( mActiveAddressPortPair.contains(key) ) {
+        qint64 remaining_ms = gSlotReleaseTimeoutMs - timer.elapsed();
+        if (remaining_ms <= 0) { return false; }
+        mThreadReleased.wait(&mMutex, static_cast<unsigned long>(remaining_ms));
     }
-    return -1;
+    return true;
 }
 
 
 //*******************************************************************************
 int UdpMasterListener::releaseThread(int id)
 {
-    QMutexLocker lock(&mMutex);
-    mActiveAddress[id].address = "";
-    mActiveAddress[id].port = 0;
-    mTotalRunningThreads--;
+    freeSlot(id);
 #ifdef WAIR // wair
     if (isWAIR()) connectMesh(false); // invoked with -Sw
 #endif // endwhere
@@ -431,6 +615,126 @@ int UdpMasterListener::releaseThread(int id)
     return 0; /// \todo Check if we really need to return an argument here
 }
 
+
+//*******************************************************************************
+void UdpMasterListener::freeSlot(int id)
+{
+    QMutexLocker lock(&mMutex);
+    mActiveAddressPortPair.remove(qMakePair(mActiveAddress[id].address,
+                                            mActiveAddress[id].port));
+    mActiveAddress[id].address = "";
+    mActiveAddress[id].port = 0;
+    mSessionLoads[id]->clear();
+    if ( mActiveAddress[id].shard >= 0 ) {
+        mShardSessions[mActiveAddress[id].shard]--;
+        mActiveAddress[id].shard = -1;
+    }
+    // Append the slot to the free list
+    mActiveAddress[id].nextFree = -1;
+    if ( mLastFree == -1 ) { mFirstFree = id; }
+    else { mActiveAddress[mLastFree].nextFree = id; }
+    mLastFree = id;
+    mTotalRunningThreads--;
+    mThreadReleased.wakeAll();
+}
+
+//*******************************************************************************
+void UdpMasterListener::setShardCpus(const QVector<int>& cpus)
+{
+    QMutexLocker lock(&mMutex);
+    mShardCpus = cpus;
+    mShardSessions.fill(0, cpus.size());
+}
+
+
+//*******************************************************************************
+CallbackLoad* UdpMasterListener::getSessionLoad(int id)
+{
+    QMutexLocker lock(&mMutex);
+    return mSessionLoads[id];
+}
+
+
+//*******************************************************************************
+uint32_t UdpMasterListener::getSessionToken(int id)
+{
+    QMutexLocker lock(&mMutex);
+    return mActiveAddress[id].token;
+}
+
+
+//*******************************************************************************
+bool UdpMasterListener::getSessionKeys(int id, uint8_t* send_key, uint8_t* receive_key)
+{
+    QMutexLocker lock(&mMutex);
+    if ( !mActiveAddress[id].encrypt ) { return false; }
+    std::memcpy(send_key, mActiveAddress[id].sendKey, PacketCipher::KEY_SIZE);
+    std::memcpy(receive_key, mActiveAddress[id].receiveKey, PacketCipher::KEY_SIZE);
+    return true;
+}
+
+
+//*******************************************************************************
+bool UdpMasterListener::isCompactHeader(int id)
+{
+    QMutexLocker lock(&mMutex);
+    return mActiveAddress[id].compactHeader;
+}
+
+
+//*******************************************************************************
+double UdpMasterListener::getHubLoad(bool join)
+{
+    QMutexLocker lock(&mMutex);
+    // All the JACK clients of the hub share the period. The costs are added up,
+    // an upper bound when JACK runs independent clients in parallel.
+    uint32_t period_ns = mMixerLoad.periodNs.load();
+    uint64_t sessions_ns = 0;
+    int num_sessions = 0;
+    for (int i = 0; i<mSessionLoads.size(); i++) {
+        uint32_t session_period_ns = mSessionLoads[i]->periodNs.load();
+        if (session_period_ns == 0) { continue; }
+        period_ns = session_period_ns;
+        sessions_ns += mSessionLoads[i]->callbackNs.load();
+        num_sessions++;
+    }
+    if (period_ns == 0) { return 0.0; } // nothing running yet
+
+    uint64_t mix_ns = mMixerLoad.callbackNs.load();
+    if ( join && num_sessions > 0 ) {
+        // One more average session, and every mix gets one more source
+        sessions_ns += sessions_ns / num_sessions;
+        mix_ns = mix_ns * (num_sessions + 1) * (num_sessions + 1)
+                / (num_sessions * num_sessions);
+    }
+    return double(sessions_ns + mix_ns) / period_ns;
+}
+
+
+//*******************************************************************************
+void UdpMasterListener::printHubLoad(std::ostream& out)
+{
+    double load = getHubLoad(false);
+    out << "JackTrip HUB SERVER: Load " << int(100 * load) << "% of the audio period";
+    if (mHubLoadLimit > 0.0) {
+        out << ", headroom " << int(100 * (mHubLoadLimit - load)) << "%";
+    }
+    out << endl;
+}
+
+
+//*******************************************************************************
+void UdpMasterListener::printShardLoads(std::ostream& out)
+{
+    QMutexLocker lock(&mMutex);
+    out << "JackTrip HUB SERVER: Shard loads (cpu:sessions):";
+    for (int i = 0; i<mShardCpus.size(); i++) {
+        out << " " << mShardCpus[i] << ":" << mShardSessions[i];
+    }
+    out << endl;
+}
+
+
 #ifdef WAIR // wair
 #include "JMess.h"
 //*******************************************************************************
@@ -446,7 +750,7 @@ void UdpMasterListener::connectMesh(bool spawn)
 //*******************************************************************************
 void UdpMasterListener::enumerateRunningThreadIDs()
 {
-    for (int id = 0; id<gMaxThreads; id++ )
+    for (int id = 0; id<mActiveAddress.size(); id++ )
     {
         if ( !mActiveAddress[id].address.isEmpty() )
         { qDebug() << id; }
@@ -454,20 +758,11 @@ void UdpMasterListener::enumerateRunningThreadIDs()
 }
 #endif // endwhere
 
-#include "JMess.h"
+//*******************************************************************************
 void UdpMasterListener::connectPatch(bool spawn)
 {
-    cout << ((spawn)?"spawning":"releasing") << " jacktripWorker so change patch" << endl;
-    JMess tmp;
-    // default is patch 0, which connects server audio to all clients
-    // these are the other cases:
-    if (getHubPatch() == JackTrip::RESERVEDMATRIX) // special patch for TU Berlin ensemble
-        tmp.connectTUB(gDefaultNumInChannels);
-    else if ((getHubPatch() == JackTrip::CLIENTECHO) || // client loopback for testing
-             (getHubPatch() == JackTrip::CLIENTFOFI) || // all clients to all clients except self
-             (getHubPatch() == JackTrip::FULLMIX)) // all clients to all clients including self
-        tmp.connectSpawnedPorts(gDefaultNumInChannels,getHubPatch());
-    // FIXME: need change to gDefaultNumInChannels if more than stereo
+    // The patch itself is applied asynchronously by the PatchManager
+    if (mPatchManager != NULL) { mPatchManager->requestPatch(spawn); }
 }
 
 // TODO:
@@ -48,16 +48,30 @@
 #include <QTcpSocket>
 #include <QTcpServer>
 #include <QMutex>
+#include <QWaitCondition>
+#include <QHash>
+#include <QPair>
+#include <QVector>
 
 #include "JackTrip.h"
 #include "jacktrip_types.h"
 #include "jacktrip_globals.h"
 class JackTripWorker; // forward declaration
 class Settings;
+class PatchManager;
 
+/// \brief Entry of the hub client table. Free entries are chained through
+/// nextFree, so a new client takes a slot without scanning the table.
 typedef struct {
     QString address;
-    int16_t port;
+    uint16_t port;
+    int nextFree; ///< Next free slot, -1 at the end of the list (unused when busy)
+    int shard; ///< Shard owning the session, -1 if not sharded
+    uint32_t token; ///< Session token given to the client, 0 = not resumable
+    bool compactHeader; ///< The client announced the compact header in the handshake
+    bool encrypt; ///< The client encrypts its datagrams, with the keys below
+    uint8_t sendKey[PacketCipher::KEY_SIZE]; ///< Key of the datagrams to the client
+    uint8_t receiveKey[PacketCipher::KEY_SIZE]; ///< Key of the datagrams from the client
 } addressPortPair;
 
 /** \brief Master UDP listener on the Server.
@@ -81,6 +95,16 @@ public:
     void stop() { mStopped = true; }
 
     int releaseThread(int id);
+    /// \brief Cost of the audio callback of session id, lives as long as the listener
+    CallbackLoad* getSessionLoad(int id);
+    /// \brief Token of session id, the client puts it in its packets to resume
+    /// the session from another address, 0 if the client doesn't encrypt
+    uint32_t getSessionToken(int id);
+    /// \brief Encryption keys of session id (--encrypt)
+    /// \return false if the client doesn't encrypt
+    bool getSessionKeys(int id, uint8_t* send_key, uint8_t* receive_key);
+    /// \brief True if the client of session id uses the compact header
+    bool isCompactHeader(int id);
 
     void setConnectDefaultAudioPorts(bool connectDefaultAudioPorts) { m_connectDefaultAudioPorts = connectDefaultAudioPorts; }
 
@@ -104,8 +128,27 @@ private:
    */
     static void bindUdpSocket(QUdpSocket& udpsocket, int port);
 
-    int readClientUdpPort(QTcpSocket* clientConnection);
-    int sendUdpPort(QTcpSocket* clientConnection, int udp_port);
+    /// \brief Reads the UDP port of the client
+    /// \param request_size Set to the size of the request that follows, 0 from older clients
+    /// \return 0 on error
+    int readClientUdpPort(QTcpSocket* clientConnection, int& request_size);
+    /// \brief Reads the handshake request of the client, all of it even when
+    /// it comes in several segments
+    /// \param flags Set to the gHandshake flags of the request
+    /// \param public_key Set to the key of the client with gHandshakeEncrypt
+    /// \return false if it's not a request of a version we know
+    bool readClientRequest(QTcpSocket* clientConnection, int request_size, uint8_t& flags,
+                           uint8_t* public_key);
+    /** \brief Agrees the encryption keys of session id with the public key of
+     * the client
+     * \param public_key Set to our public key, for the client
+     * \return false if the key of the client is not valid
+     */
+    bool setSessionKeys(int id, const uint8_t* client_public_key, uint8_t* public_key);
+    /// \brief Sends the UDP port of the session to the client, followed by
+    /// the session token if not 0, and our public key if not NULL
+    int sendUdpPort(QTcpSocket* clientConnection, int udp_port, uint32_t token = 0,
+                    const uint8_t* public_key = NULL);
 
 
     /** \brief Send the JackTripWorker to the thread pool. This will run
@@ -114,9 +157,9 @@ private:
    */
     //void sendToPoolPrototype(int id);
 
-    /** \brief Check if address is already handled, if not add to array
+    /** \brief Check if address is already handled, if not add to the client table
    * \param address as string (IPv4 or IPv6)
-   * \return -1 if address is busy, id number if not
+   * \return -1 if address is busy, -2 if the hub is full, id number if not
    */
     int isNewAddress(QString address, uint16_t port);
 
@@ -125,6 +168,27 @@ private:
     */
     int getPoolID(QString address, uint16_t port);
 
+    /** \brief Blocks until the client (address, port) has been released
+    * from the pool by its JackTripWorker (see releaseThread())
+    * \return false if it still isn't after gSlotReleaseTimeoutMs
+    */
+    bool waitForRelease(QString address, uint16_t port);
+
+    /** \brief Returns the slot id to the free list. Unlike releaseThread(), it
+    * doesn't patch JACK again, for clients refused before their session started
+    */
+    void freeSlot(int id);
+
+    /// \brief Maximum number of clients, bounded by the UDP ports above mBasePort
+    int getMaxClients() const { return 65535 - mBasePort + 1; }
+
+    /** \brief Fraction of the audio period used by the session callbacks and the
+     * mixer, projected with one more session if join is true
+     */
+    double getHubLoad(bool join);
+    /// \brief Prints the hub load and the headroom left under the load limit
+    void printHubLoad(std::ostream& out);
+
     //QUdpSocket mUdpMasterSocket; ///< The UDP socket
     //QHostAddress mPeerAddress; ///< The Peer Address
 
@@ -134,8 +198,16 @@ private:
 
     int mServerPort; //< Server known port number
     int mBasePort;
-    addressPortPair mActiveAddress[gMaxThreads]; ///< Active address pool addresses
-    QHash<QString, uint16_t> mActiveAddressPortPair;
+    QVector<addressPortPair> mActiveAddress; ///< Client table, indexed by id
+    QHash<QPair<QString, uint16_t>, int> mActiveAddressPortPair; ///< (address, port) -> id
+    int mFirstFree; ///< Head of the free slot list, -1 if empty
+    int mLastFree; ///< Tail of the free slot list, -1 if empty
+    QWaitCondition mThreadReleased; ///< Woken up by releaseThread()
+    QVector<int> mShardCpus; ///< CPU of each shard, empty if not sharded
+    QVector<int> mShardSessions; ///< Number of sessions owned by each shard
+    QVector<CallbackLoad*> mSessionLoads; ///< Cost of each session callback, indexed by id
+    CallbackLoad mMixerLoad; ///< Cost of the HubMixer
+    float mHubLoadLimit; ///< Fraction of the period new sessions may take the hub to, 0 = no limit
 
     /// Boolean stop the execution of the thread
     volatile bool mStopped;
@@ -146,6 +218,8 @@ private:
 
     bool m_connectDefaultAudioPorts;
     Settings* m_settings;
+    PatchManager* mPatchManager; ///< Applies the hub patch, created in run()
+    int mHubMixerTopN; ///< Sources in each HubMixer mix, 0 = all
 
 #ifdef WAIR // wair
     bool mWAIR;
@@ -160,6 +234,19 @@ public :
     unsigned int mHubPatch;
     void setHubPatch(unsigned int p) {mHubPatch = p;}
     unsigned int getHubPatch() {return mHubPatch;}
+    /// \brief Mixes only the n loudest sources in each mix (hubpatch 5), 0 = all
+    void setHubMixerTopN(int n) {mHubMixerTopN = n;}
+    /** \brief Refuses new clients when the projected hub load goes over limit,
+     * a fraction of the audio period, 0 = no limit
+     */
+    void setHubLoadLimit(float limit) {mHubLoadLimit = limit;}
+
+    /** \brief Runs the hub sharded, one shard per CPU of the list. Each new
+     * session goes to the least loaded shard, its threads are pinned to that CPU.
+     */
+    void setShardCpus(const QVector<int>& cpus);
+    /// \brief Prints the number of sessions of each shard
+    void printShardLoads(std::ostream& out);
 
     void setUnderRunMode(JackTrip::underrunModeT UnderRunMode) { mUnderRunMode = UnderRunMode; }
     void setBufferQueueLength(int BufferQueueLength) { mBufferQueueLength = BufferQueueLength; }
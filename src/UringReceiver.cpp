@@ -0,0 +1,452 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+/**
+ * \file UringReceiver.cpp
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#include "UringReceiver.h"
+#include "jacktrip_globals.h"
+
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#if defined (__HAVE_IO_URING__)
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netinet/udp.h>
+#ifndef UDP_GRO
+#define UDP_GRO 104 // Linux 5.0
+#endif
+
+/// \brief State shared with the kernel, see io_uring_setup(2)
+struct UringReceiver::Ring
+{
+    int fd;
+    int socket;
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+    unsigned toSubmit; ///< Submission entries queued since the last wait()
+    bool armed; ///< The multishot receive is running
+
+    /// Provided buffer ring. The kernel header's struct io_uring_buf_ring
+    /// doesn't have the C layout in C++ (flexible array), the ring is an
+    /// array of io_uring_buf with the tail in the resv field of the first one
+    struct io_uring_buf* bufRing;
+    size_t bufRingSize;
+    int8_t* buffers;
+    int numBuffers;
+    int bufferSize;
+    uint16_t bufTail;
+    int usedBuffer; ///< Buffer of the datagram given by next(), -1 if none
+
+    struct msghdr msg; ///< Name and control sizes of the multishot recvmsg
+};
+
+namespace {
+int uringSetup(unsigned entries, struct io_uring_params* params)
+{ return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params)); }
+
+int uringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+               const void* arg, size_t arg_size)
+{ return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                                    flags, arg, arg_size)); }
+
+int uringRegister(int fd, unsigned opcode, const void* arg, unsigned nr_args)
+{ return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args)); }
+}
+#else
+struct UringReceiver::Ring {};
+#endif
+
+
+//*******************************************************************************
+UringReceiver::UringReceiver() :
+    mRing(NULL), mFailed(false)
+{}
+
+
+//*******************************************************************************
+UringReceiver::~UringReceiver()
+{
+    release();
+}
+
+
+//*******************************************************************************
+void UringReceiver::release()
+{
+    if (mRing == NULL) { return; }
+#if defined (__HAVE_IO_URING__)
+    // Closing the ring cancels the receive
+    if (mRing->fd >= 0) { ::close(mRing->fd); }
+    if (mRing->sqes != MAP_FAILED) { ::munmap(mRing->sqes, mRing->sqesSize); }
+    if (mRing->cqRing != MAP_FAILED && mRing->cqRing != mRing->sqRing) {
+        ::munmap(mRing->cqRing, mRing->cqRingSize);
+    }
+    if (mRing->sqRing != MAP_FAILED) { ::munmap(mRing->sqRing, mRing->sqRingSize); }
+    if (mRing->bufRing != MAP_FAILED) { ::munmap(mRing->bufRing, mRing->bufRingSize); }
+    delete[] mRing->buffers;
+#endif
+    delete mRing;
+    mRing = NULL;
+}
+
+
+//*******************************************************************************
+bool UringReceiver::setup(int fd, int num_buffers, int payload_size, int control_size)
+{
+    release();
+    mFailed = false;
+#if defined (__HAVE_IO_URING__)
+    if ( num_buffers <= 0 || (num_buffers & (num_buffers - 1)) ) { return false; }
+    mRing = new Ring;
+    std::memset(mRing, 0, sizeof(Ring));
+    mRing->fd = -1;
+    mRing->socket = fd;
+    mRing->sqRing = mRing->cqRing = MAP_FAILED;
+    mRing->sqes = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    mRing->bufRing = static_cast<struct io_uring_buf*>(MAP_FAILED);
+    mRing->usedBuffer = -1;
+
+    // Room for a completion per buffer, the receive is the only submission
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = 2 * num_buffers;
+    mRing->fd = uringSetup(4, &params);
+    if ( mRing->fd < 0 || !(params.features & IORING_FEAT_EXT_ARG) ) {
+        release();
+        return false;
+    }
+
+    mRing->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    mRing->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        mRing->sqRingSize = mRing->cqRingSize = std::max(mRing->sqRingSize, mRing->cqRingSize);
+    }
+    mRing->sqRing = ::mmap(NULL, mRing->sqRingSize, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, mRing->fd, IORING_OFF_SQ_RING);
+    if (mRing->sqRing == MAP_FAILED) { release(); return false; }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        mRing->cqRing = mRing->sqRing;
+    } else {
+        mRing->cqRing = ::mmap(NULL, mRing->cqRingSize, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, mRing->fd, IORING_OFF_CQ_RING);
+        if (mRing->cqRing == MAP_FAILED) { release(); return false; }
+    }
+    mRing->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = ::mmap(NULL, mRing->sqesSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, mRing->fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) { release(); return false; }
+    mRing->sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(mRing->sqRing);
+    char* cq = static_cast<char*>(mRing->cqRing);
+    mRing->sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    mRing->sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    mRing->sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    mRing->cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    mRing->cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    mRing->cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    mRing->cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // Provided buffer ring (Linux 5.19), page aligned memory
+    mRing->bufRingSize = num_buffers * sizeof(struct io_uring_buf);
+    void* buf_ring = ::mmap(NULL, mRing->bufRingSize, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf_ring == MAP_FAILED) { release(); return false; }
+    mRing->bufRing = static_cast<struct io_uring_buf*>(buf_ring);
+    struct io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(mRing->bufRing);
+    reg.ring_entries = num_buffers;
+    reg.bgid = 0;
+    if ( uringRegister(mRing->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0 ) {
+        release();
+        return false;
+    }
+
+    // Each buffer gets the recvmsg header, the source address, the control
+    // messages and the payload
+    mRing->msg.msg_namelen = sizeof(struct sockaddr_storage);
+    mRing->msg.msg_controllen = control_size;
+    mRing->numBuffers = num_buffers;
+    mRing->bufferSize = sizeof(struct io_uring_recvmsg_out) + mRing->msg.msg_namelen
+            + control_size + payload_size;
+    mRing->buffers = new int8_t[num_buffers * mRing->bufferSize];
+    for (int i = 0; i < num_buffers; i++) {
+        mRing->usedBuffer = i;
+        recycleBuffer();
+    }
+
+    armReceive();
+    return true;
+#else
+    (void) fd; (void) num_buffers; (void) payload_size; (void) control_size;
+    return false;
+#endif
+}
+
+
+//*******************************************************************************
+void UringReceiver::armReceive()
+{
+#if defined (__HAVE_IO_URING__)
+    unsigned tail = *mRing->sqTail;
+    unsigned index = tail & *mRing->sqMask;
+    struct io_uring_sqe* sqe = &mRing->sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = mRing->socket;
+    sqe->addr = reinterpret_cast<uint64_t>(&mRing->msg);
+    sqe->len = 0;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    mRing->sqArray[index] = index;
+    __atomic_store_n(mRing->sqTail, tail + 1, __ATOMIC_RELEASE);
+    mRing->toSubmit++;
+    mRing->armed = true;
+#endif
+}
+
+
+//*******************************************************************************
+void UringReceiver::recycleBuffer()
+{
+#if defined (__HAVE_IO_URING__)
+    if (mRing->usedBuffer < 0) { return; }
+    struct io_uring_buf* buf = &mRing->bufRing[mRing->bufTail & (mRing->numBuffers - 1)];
+    buf->addr = reinterpret_cast<uint64_t>(mRing->buffers
+                                           + mRing->usedBuffer * mRing->bufferSize);
+    buf->len = mRing->bufferSize;
+    buf->bid = mRing->usedBuffer;
+    mRing->bufTail++;
+    __atomic_store_n(&mRing->bufRing[0].resv, mRing->bufTail, __ATOMIC_RELEASE);
+    mRing->usedBuffer = -1;
+#endif
+}
+
+
+//*******************************************************************************
+int UringReceiver::wait(int timeout_usec)
+{
+    if (mFailed || mRing == NULL) { return -1; }
+#if defined (__HAVE_IO_URING__)
+    recycleBuffer();
+    // The kernel ends the multishot receive when it runs out of buffers
+    if (!mRing->armed) { armReceive(); }
+
+    struct __kernel_timespec ts;
+    ts.tv_sec = timeout_usec / 1000000;
+    ts.tv_nsec = (timeout_usec % 1000000) * 1000;
+    struct io_uring_getevents_arg arg;
+    std::memset(&arg, 0, sizeof(arg));
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    int submitted = uringEnter(mRing->fd, mRing->toSubmit, 1,
+                               IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                               &arg, sizeof(arg));
+    if (submitted >= 0) {
+        mRing->toSubmit -= std::min(static_cast<unsigned>(submitted), mRing->toSubmit);
+    } else if (errno != ETIME && errno != EINTR && errno != EBUSY) {
+        mFailed = true;
+        return -1;
+    }
+    return __atomic_load_n(mRing->cqTail, __ATOMIC_ACQUIRE) - *mRing->cqHead;
+#else
+    (void) timeout_usec;
+    return -1;
+#endif
+}
+
+
+//*******************************************************************************
+bool UringReceiver::next(int8_t*& datagram, int& size, int& segment_size,
+                         struct sockaddr_storage& from)
+{
+    if (mFailed || mRing == NULL) { return false; }
+#if defined (__HAVE_IO_URING__)
+    recycleBuffer();
+    unsigned head = *mRing->cqHead;
+    while ( head != __atomic_load_n(mRing->cqTail, __ATOMIC_ACQUIRE) ) {
+        struct io_uring_cqe* cqe = &mRing->cqes[head & *mRing->cqMask];
+        int res = cqe->res;
+        unsigned flags = cqe->flags;
+        head++;
+        __atomic_store_n(mRing->cqHead, head, __ATOMIC_RELEASE);
+
+        if ( !(flags & IORING_CQE_F_MORE) ) { mRing->armed = false; }
+        if (res < 0) {
+            // Out of buffers (-ENOBUFS) is re-armed by wait(), anything
+            // else means this kernel can't do it
+            if (res != -ENOBUFS && res != -EINTR) { mFailed = true; return false; }
+            continue;
+        }
+        if ( !(flags & IORING_CQE_F_BUFFER) ) { continue; }
+        mRing->usedBuffer = flags >> IORING_CQE_BUFFER_SHIFT;
+        int8_t* buf = mRing->buffers + mRing->usedBuffer * mRing->bufferSize;
+
+        struct io_uring_recvmsg_out out;
+        std::memcpy(&out, buf, sizeof(out));
+        int8_t* name = buf + sizeof(out);
+        int8_t* control = name + mRing->msg.msg_namelen;
+        int8_t* payload = control + mRing->msg.msg_controllen;
+        std::memset(&from, 0, sizeof(from));
+        std::memcpy(&from, name, std::min(out.namelen, mRing->msg.msg_namelen));
+        // A truncated datagram only has what fits in the buffer
+        size = std::min(static_cast<int>(out.payloadlen),
+                        static_cast<int>(buf + res - payload));
+        if (size <= 0) { recycleBuffer(); continue; }
+
+        segment_size = size;
+        struct msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = out.controllen;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+             cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if ( cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO ) {
+                int gso_size;
+                std::memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+                if (gso_size > 0) { segment_size = gso_size; }
+            }
+        }
+        datagram = payload;
+        return true;
+    }
+    return false;
+#else
+    (void) datagram; (void) size; (void) segment_size; (void) from;
+    return false;
+#endif
+}
+
+
+//*******************************************************************************
+void UringReceiver::benchmark(std::ostream& out)
+{
+#if defined (__HAVE_IO_URING__)
+    // Datagrams of a 16-bit stereo session of 128 samples, one per wakeup as
+    // in the steady state, and in the bursts that follow a network stall
+    static const int bursts[] = { 1, 4, 16 };
+    const int size = 528;
+    const int datagrams = 16384; // a multiple of the bursts
+    int receiver = ::socket(AF_INET, SOCK_DGRAM, 0);
+    int sender = ::socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_size = sizeof(address);
+    struct timeval timeout = { 1, 0 }; // datagrams lost on the loopback end the run
+    ::setsockopt(receiver, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if ( receiver < 0 || sender < 0 ||
+         ::bind(receiver, (struct sockaddr *) &address, sizeof(address)) < 0 ||
+         ::getsockname(receiver, (struct sockaddr *) &address, &address_size) < 0 ||
+         ::connect(sender, (struct sockaddr *) &address, sizeof(address)) < 0 ) {
+        out << "ERROR: no UDP socket on the loopback" << std::endl;
+        if (receiver >= 0) { ::close(receiver); }
+        if (sender >= 0) { ::close(sender); }
+        return;
+    }
+    int8_t buf[size];
+    std::memset(buf, 0x55, size);
+
+    out << "Receive of " << size << "-byte datagrams on the loopback, per datagram:" << std::endl;
+    for (unsigned int b = 0; b < sizeof(bursts) / sizeof(bursts[0]); b++) {
+        int burst = bursts[b];
+        for (int uring = 0; uring < 2; uring++) {
+            // The same socket, the ring is set up for the second run
+            UringReceiver receive;
+            if ( uring && !receive.setup(receiver, gUringBuffers, size, 0) ) {
+                out << "  io_uring is not available (Linux 6.0 or later)" << std::endl;
+                break;
+            }
+            int64_t receive_ns = 0;
+            int syscalls = 0;
+            bool lost = false;
+            for (int sent = 0; sent < datagrams && !lost; sent += burst) {
+                for (int i = 0; i < burst; i++) { ::send(sender, buf, size, 0); }
+                int64_t t0 = getMonotonicNs();
+                int received = 0;
+                while (received < burst) {
+                    syscalls++;
+                    if (uring) {
+                        if ( receive.wait(1000000) <= 0 ) { lost = true; break; }
+                        int8_t* datagram;
+                        int datagram_size;
+                        int segment_size;
+                        struct sockaddr_storage from;
+                        while ( receive.next(datagram, datagram_size, segment_size, from) ) {
+                            received++;
+                        }
+                    }
+                    else {
+                        if ( ::recv(receiver, buf, size, 0) <= 0 ) { lost = true; break; }
+                        received++;
+                    }
+                }
+                receive_ns += getMonotonicNs() - t0;
+            }
+            out << "  bursts of " << burst << (uring ? ", io_uring" : ", recv") << ": ";
+            if (lost) {
+                out << "ERROR: datagrams lost on the loopback" << std::endl;
+                break;
+            }
+            out << receive_ns / datagrams << " ns, "
+                << double(syscalls) / datagrams << " syscalls" << std::endl;
+        }
+    }
+    ::close(receiver);
+    ::close(sender);
+#else
+    out << "io_uring is only available on Linux 6.0 or later, built with its headers" << std::endl;
+#endif
+}
@@ -0,0 +1,102 @@
+//*****************************************************************
+/*
+  JackTrip: A System for High-Quality Audio Network Performance
+  over the Internet
+
+  Copyright (c) 2008 Juan-Pablo Caceres, Chris Chafe.
+  SoundWIRE group at CCRMA, Stanford University.
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation
+  files (the "Software"), to deal in the Software without
+  restriction, including without limitation the rights to use,
+  copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following
+  conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+  HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+  WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+  OTHER DEALINGS IN THE SOFTWARE.
+*/
+//*****************************************************************
+
+/**
+ * \file UringReceiver.h
+ * \author JackTrip contributors
+ * \date October 2026
+ */
+
+#ifndef __URINGRECEIVER_H__
+#define __URINGRECEIVER_H__
+
+#include <ostream>
+
+#include "jacktrip_types.h"
+
+#if defined (__LINUX__) && defined (__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+#if defined (IORING_RECV_MULTISHOT) // Kernel headers of Linux 6.0 or later
+#define __HAVE_IO_URING__
+#endif
+
+struct sockaddr_storage;
+
+
+/** \brief io_uring receive engine for a UDP socket (Linux 6.0 or later).
+ *
+ * One multishot recvmsg stays armed on the socket, the kernel picks a buffer
+ * of a provided buffer ring for each datagram and posts a completion, so any
+ * number of datagrams costs one system call per wait(). The ring is mapped
+ * with raw system calls, no liburing. setup() fails on kernels or builds
+ * without support, the caller then keeps using the socket.
+ */
+class UringReceiver
+{
+public:
+    UringReceiver();
+    virtual ~UringReceiver();
+
+    /** \brief Arms the receive on the socket fd
+     * \param num_buffers Number of datagrams the kernel can hold, power of 2
+     * \param payload_size Largest datagram (or GRO coalesced datagrams)
+     * \param control_size Room for the control messages (e.g., UDP_GRO)
+     * \return false if io_uring or one of the features used is not available
+     */
+    bool setup(int fd, int num_buffers, int payload_size, int control_size);
+    /** \brief Waits up to timeout_usec for datagrams, one system call
+     * \return Number of datagrams ready, -1 if the kernel can't receive this way
+     */
+    int wait(int timeout_usec);
+    /** \brief Gets the next datagram ready, valid until the next call
+     * \param segment_size Size of each coalesced datagram (UDP_GRO), size if not coalesced
+     * \return false when there are no more datagrams ready
+     */
+    bool next(int8_t*& datagram, int& size, int& segment_size, struct sockaddr_storage& from);
+
+    /// \brief Prints the cost of receiving datagrams on the loopback with
+    /// recv() and with io_uring (--uringbench)
+    static void benchmark(std::ostream& out);
+
+private:
+    struct Ring; ///< Mapped rings and buffers
+    void release();
+    void armReceive();
+    void recycleBuffer();
+
+    Ring* mRing;
+    bool mFailed; ///< The kernel refused the receive, use the socket
+};
+
+#endif // __URINGRECEIVER_H__
@@ -118,6 +118,7 @@ INCLUDEPATH += ../faust-src-lair
 
 # Input
 HEADERS += DataProtocol.h \
+           HubMixer.h \
            JMess.h \
            JackTrip.h \
            jacktrip_globals.h \
@@ -127,21 +128,33 @@ HEADERS += DataProtocol.h \
            JackTripWorkerMessages.h \
            LoopBack.h \
            NetKS.h \
+           PacketCapture.h \
            PacketHeader.h \
+           PatchManager.h \
            ProcessPlugin.h \
+           Recorder.h \
+           ReplayAudioInterface.h \
            RingBuffer.h \
            RingBufferWavetable.h \
+           Reblocker.h \
+           Resampler.h \
+           Fragmenter.h \
+           PacketCipher.h \
+           PathMerger.h \
+           AdaptiveQuality.h \
            Settings.h \
            TestRingBuffer.h \
            ThreadPoolTest.h \
            UdpDataProtocol.h \
            UdpMasterListener.h \
+           UringReceiver.h \
            AudioInterface.h
 
 !nojack {
 HEADERS += JackAudioInterface.h
 }
 SOURCES += DataProtocol.cpp \
+           HubMixer.cpp \
            JMess.cpp \
            JackTrip.cpp \
            jacktrip_globals.cpp \
@@ -150,12 +163,23 @@ SOURCES += DataProtocol.cpp \
            JackTripThread.cpp \
            JackTripWorker.cpp \
            LoopBack.cpp \
+           PacketCapture.cpp \
            PacketHeader.cpp \
+           PatchManager.cpp \
            ProcessPlugin.cpp \
+           Recorder.cpp \
+           ReplayAudioInterface.cpp \
            RingBuffer.cpp \
+           Reblocker.cpp \
+           Resampler.cpp \
+           Fragmenter.cpp \
+           PacketCipher.cpp \
+           PathMerger.cpp \
+           AdaptiveQuality.cpp \
            Settings.cpp \
            UdpDataProtocol.cpp \
            UdpMasterListener.cpp \
+           UringReceiver.cpp \
            AudioInterface.cpp
 
 !nojack {
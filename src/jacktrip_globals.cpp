@@ -36,10 +36,14 @@
  */
 
 #include <iostream>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
 
 #if defined ( __LINUX__ )
     #include <sched.h>
     #include <unistd.h>
+    #include <pthread.h>
     #include <sys/types.h>
 #endif //__LINUX__
 
@@ -140,6 +144,14 @@ void setRealtimeProcessPriority() {
     return;
 }
 
+
+//*******************************************************************************
+// macOS has no hard thread affinity (affinity tags are only scheduling hints)
+bool setThreadAffinity(int /*cpu*/)
+{
+    return false;
+}
+
 #endif //__MAC_OSX__
 
 
@@ -158,6 +170,20 @@ void setRealtimeProcessPriority()
         std::cerr << "Failed to set the scheduler policy and priority." << std::endl;;
     }
 }
+
+
+//*******************************************************************************
+bool setThreadAffinity(int cpu)
+{
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) != 0) {
+        std::cerr << "Failed to pin the thread to CPU " << cpu << "." << std::endl;
+        return false;
+    }
+    return true;
+}
 #endif //__LINUX__
 
 
@@ -173,4 +199,46 @@ void setRealtimeProcessPriority()
         std::cerr << "Failed to set thread priority." << std::endl;
     }
 }
+
+
+//*******************************************************************************
+bool setThreadAffinity(int cpu)
+{
+    if (SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) == 0)
+    {
+        std::cerr << "Failed to pin the thread to CPU " << cpu << "." << std::endl;
+        return false;
+    }
+    return true;
+}
 #endif //__WIN_32__
+
+
+//*******************************************************************************
+bool isZeroBlock(const void* buf, size_t size)
+{
+    // Comparing the block with itself shifted by one byte lets memcmp do the
+    // (vectorized) work
+    const char* bytes = static_cast<const char*>(buf);
+    if (size == 0) { return true; }
+    return bytes[0] == 0 && std::memcmp(bytes, bytes + 1, size - 1) == 0;
+}
+
+
+//*******************************************************************************
+int64_t getMonotonicNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+//*******************************************************************************
+void updateLoadNs(std::atomic<uint32_t>& load, int64_t ns)
+{
+    // Peak hold: the admission control cares about the worst periods, an
+    // average would hide the spikes that make JACK miss its deadline
+    uint32_t old = load.load(std::memory_order_relaxed);
+    uint32_t decayed = old - (old >> 4);
+    load.store(std::max<int64_t>(decayed, ns), std::memory_order_relaxed);
+}
@@ -38,6 +38,8 @@
 #ifndef __JACKTRIP_GLOBALS_H__
 #define __JACKTRIP_GLOBALS_H__
 
+#include <atomic>
+
 #include "AudioInterface.h"
 //#include "JackAudioInterface.h"
 
@@ -130,15 +132,215 @@ const int gJackBitResolution = 32; ///< Audio Bit Resolution of the Jack Server
 
 void setRealtimeProcessPriority();
 
+/// \brief Pins the calling thread to one CPU (Linux and Windows only, no-op elsewhere)
+/// \return true on success
+bool setThreadAffinity(int cpu);
+
+/// \brief True if all the size bytes of buf are zero (digital silence)
+bool isZeroBlock(const void* buf, size_t size);
+
+/// \brief Monotonic clock in nanoseconds, cheap enough for the audio callbacks
+int64_t getMonotonicNs();
+
+/** \brief Processing cost of an audio callback, written by the audio thread and
+ * read by the hub admission control. Costs are in nanoseconds, peak values
+ * that decay by 1/16 per period (see updateLoadNs()).
+ */
+struct CallbackLoad {
+    std::atomic<uint32_t> callbackNs; ///< Whole callback
+    std::atomic<uint32_t> decodeNs; ///< Network to audio
+    std::atomic<uint32_t> encodeNs; ///< Audio to network
+    std::atomic<uint32_t> periodNs; ///< Audio period, 0 when the callback doesn't run
+    CallbackLoad() : callbackNs(0), decodeNs(0), encodeNs(0), periodNs(0) {}
+    void clear() { callbackNs = 0; decodeNs = 0; encodeNs = 0; periodNs = 0; }
+};
+
+/// \brief Adds a measured cost to a CallbackLoad figure (audio thread)
+void updateLoadNs(std::atomic<uint32_t>& load, int64_t ns);
+
 
 //*******************************************************************************
-/// \name JackTrip Server parameters
+/// \name Silence detection and discontinuous transmission (--dtx)
 //@{
-/// Maximum Threads that can be run at the same time
-const int gMaxThreads = 290; // some pthread limit around 297?
+/// A gated channel opens when its block RMS goes over this level (-54 dBFS)
+const float gDtxOpenRms = 0.002f;
+/// ... or when a peak goes over this level (-40 dBFS), to catch short attacks
+const float gDtxOpenPeak = 0.01f;
+/// An open channel is a candidate to close below this block RMS (-60 dBFS)
+const float gDtxCloseRms = 0.001f;
+/// Time a channel stays open after its level drops below gDtxCloseRms
+const int gDtxHangoverMs = 250;
+//@}
 
+
+//*******************************************************************************
+/// \name JackTrip Server parameters
+//@{
 /// Public well-known UDP port to where the clients will connect
 const int gServerUdpPort = 4464;
+
+/// Time a returning client waits for its previous session to leave the pool
+const int gSlotReleaseTimeoutMs = 10000;
+
+/// UDP port of the hub mixer control commands (hubpatch 5)
+const int gHubMixerControlPort = 4465;
+
+/// Time constant of the source energy in top-N mixing (hubpatch 5, --hubtopn)
+const int gHubMixerEnergyMs = 50;
+/// Crossfade time of the sources going in and out of a top-N mix
+const int gHubMixerFadeMs = 20;
+/// Energy advantage of the sources already in a top-N mix (about 3 dB)
+const float gHubMixerSelectionBias = 2.0f;
+
+/// UDP port of the trunk link between two hub servers (both ends)
+const int gHubTrunkPort = 4466;
+
+/// Default number of participants carried each way by a hub trunk link
+const int gDefaultTrunkSlots = 8;
+
+/// Default fraction of the audio period the hub sessions and mixer may use
+/// (--hubload), 0 = no limit: clients older than the full-hub reply would take
+/// it for a UDP port
+const float gDefaultHubLoadLimit = 0.0f;
+/// Reply of the TCP handshake in place of the UDP port when the hub refuses a client
+const uint32_t gHubFullReply = 0x10000;
+/// Time a client that encrypts waits for the session token and the key of the
+/// hub after the UDP port in the TCP handshake, and the hub for the request
+/// after the port of the client
+const int gSessionTokenTimeoutMs = 1000;
+/// Reply in place of the UDP port when the hub only takes encrypted clients (--encrypt)
+const uint32_t gHubEncryptionRequiredReply = 0x10001;
+/// Marks the public key of the hub (--encrypt) in the reply of the TCP handshake, "JTK1"
+const uint32_t gKeyExchangeMagic = 0x314B544A;
+/// The UDP port a client sends in the TCP handshake has the size of the request
+/// that follows it in its upper bits, 0 from older clients
+const int gHandshakeRequestShift = 16;
+/// Handshake request: gHandshakeMagic, gHandshakeVersion, the flags below, 2 bytes
+/// reserved, then the public key of the client with gHandshakeEncrypt
+const int gHandshakeRequestSize = 8;
+/// Marks the handshake request, "JTR1"
+const uint32_t gHandshakeMagic = 0x3152544A;
+const uint8_t gHandshakeVersion = 1;
+/// Flag of the handshake request, the client uses the compact header (--compactheader)
+const uint8_t gHandshakeCompactHeader = (1<<0);
+/// Flag of the handshake request, the client encrypts (--encrypt), its key follows
+const uint8_t gHandshakeEncrypt = (1<<1);
+//@}
+
+
+//*******************************************************************************
+/// \name UDP segmentation and receive coalescing (--udpoffload, Linux)
+//@{
+/// Largest datagram the kernel hands over with GRO, and sends with GSO
+const int gUdpOffloadMaxBytes = 65507;
+/// Largest number of segments in one GSO send (UDP_MAX_SEGMENTS in the kernel)
+const int gUdpOffloadMaxSegments = 64;
+//@}
+
+
+/// \name io_uring receive engine (--iouring, Linux 6.0 or later)
+//@{
+/// Datagrams the kernel can hold for a session before the receiver thread runs
+const int gUringBuffers = 64;
+/// Same with GRO, each buffer then takes gUdpOffloadMaxBytes
+const int gUringGroBuffers = 8;
+//@}
+
+
+/// \name Busy-poll receive (--busypoll, Linux)
+//@{
+/// Smallest half width of the spin window around the expected arrival
+const int gBusyPollMinWindowUsec = 20;
+/// Wake latency histogram, bucket i counts the latencies under 2^i microseconds
+const int gWakeLatencyBuckets = 16;
+//@}
+
+
+/// \name Direct send from the audio callback (--directsend)
+//@{
+/// Datagrams queued for the sender thread while the socket would block
+const int gDirectSendQueueSlots = 16;
+/// Sender thread wakeup while its queue is empty, to stop
+const int gDirectSendWakeupMs = 10;
+//@}
+
+
+/// \name Compact packet header (--compactheader)
+//@{
+/// Period of the capability packets, until the peer acknowledges them
+const int gCompactCapsIntervalUsec = 10000;
+//@}
+
+
+/// \name Datagram fragmentation (--mtu)
+//@{
+/// Largest --mtu (jumbo frames), the senders build each fragment on the stack
+const int gMaxMtu = 9000;
+/// Smallest --mtu, the IPv4 minimum reassembly size
+const int gMinMtu = 576;
+/// MTU a hub uses toward the clients that fragment, when it has no --mtu
+const int gDefaultMtu = 1500;
+/// The sender reads the path MTU found by the kernel this often
+const int gPathMtuCheckMs = 1000;
+/// Datagrams being reassembled at the same time
+const int gFragmentSlots = 4;
+//@}
+
+
+/// \name Multicast distribution (--multicast)
+//@{
+/// Hops (IPv4 TTL) of the datagrams sent to a group, past the local network
+/// when the routers forward multicast
+const int gMulticastHops = 16;
+//@}
+
+
+/// \name Multipath redundancy (--multipath)
+//@{
+/// Source addresses the receiver keeps statistics for, the sender's paths
+const int gMaxPaths = 8;
+/// Sequence numbers the receiver remembers to drop the copies of the slower
+/// paths, the longest a copy may lag behind in packets
+const int gMultipathWindow = 256;
+//@}
+
+
+/// \name Adaptive bit resolution (--adaptive)
+//@{
+/// The receiver measures the loss and jitter of the peer's packets this often
+const int gAdaptiveIntervalMs = 500;
+/// Loss ratio of an interval that lowers the resolution asked to the peer
+const float gAdaptiveDegradeLoss = 0.02f;
+/// ... and jitter, in packet periods
+const float gAdaptiveDegradeJitter = 1.0f;
+/// Loss ratio of an interval clean enough to raise it again
+const float gAdaptiveRecoverLoss = 0.005f;
+/// ... and jitter, in packet periods
+const float gAdaptiveRecoverJitter = 0.5f;
+/// Clean time before raising the resolution
+const int gAdaptiveRecoverMs = 5000;
+/// Longest clean time, doubled each time a raise has to be undone
+const int gAdaptiveMaxRecoverMs = 60000;
+//@}
+
+
+//*******************************************************************************
+/// \name Session recorder (--record)
+//@{
+/// Audio queued between an audio thread and the disk writer
+const int gRecorderQueueMs = 2000;
+/// Write buffer of each track, the disk writes are this size
+const int gRecorderWriteBufferBytes = 256 * 1024;
+/// Alignment of the write buffer and of the audio in the file
+const int gRecorderAlignment = 4096;
+//@}
+
+
+//*******************************************************************************
+/// \name Packet capture and replay (--capture, --replay)
+//@{
+/// The capture file grows by this much, remapped each time
+const int gCaptureChunkBytes = 16 * 1024 * 1024;
 //@}
 
 
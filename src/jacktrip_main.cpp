@@ -77,6 +77,9 @@ int main(int argc, char** argv)
 
     if ( testing ) {
         std::cout << "=========TESTING=========" << std::endl;
+        if ( argc > 2 && !strcmp(argv[2], "units") ) {
+            return main_unit_tests(); // unit tests, the number of failures
+        }
         //main_tests(argc, argv); // test functions
         JackTrip jacktrip;
         //RtAudioInterface rtaudio(&jacktrip);
@@ -36,10 +36,21 @@
  */
 
 #include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
 
 #include <QVector>
 
 #include "JackTripThread.h"
+#include "JackTrip.h"
+#include "Reblocker.h"
+#include "PacketHeader.h"
+#include "Resampler.h"
+#include "Fragmenter.h"
+#include "PacketCipher.h"
+#include "PathMerger.h"
 
 using std::cout; using std::endl;
 
@@ -50,6 +61,18 @@ const int base_port = 4464;
 void main_tests(int argc, char** argv);
 void test_threads_server();
 void test_threads_client(const char* peer_address);
+int main_unit_tests();
+bool test_check(bool condition, const char* test, const char* what);
+bool test_reblocker();
+bool test_compact_header();
+bool test_resampler();
+bool test_fragmenter();
+bool test_packet_cipher();
+bool test_chacha20_poly1305();
+QByteArray test_hex(const char* hex);
+bool test_path_merger();
+struct sockaddr_storage test_address(uint32_t address, uint16_t port);
+bool test_dtx_packing();
 
 
 void main_tests(int /*argc*/, char** argv)
@@ -101,3 +124,545 @@ void test_threads_client(const char* peer_address)
         //sleep(1);
     }
 }
+
+
+// Unit tests of the classes that don't need the audio or the network,
+// "jacktrip test units", returns the number of failed tests
+int main_unit_tests()
+{
+    typedef bool (*UnitTest)();
+    const UnitTest tests[] = { test_reblocker, test_compact_header, test_resampler,
+                               test_fragmenter, test_packet_cipher, test_chacha20_poly1305,
+                               test_path_merger,
+                               test_dtx_packing };
+    int failed = 0;
+    for (unsigned int i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        if ( !tests[i]() ) { failed++; }
+    }
+    if (failed == 0) { cout << "All unit tests passed" << endl; }
+    else { cout << failed << " unit tests FAILED" << endl; }
+    return failed;
+}
+
+
+// Prints the failed checks
+bool test_check(bool condition, const char* test, const char* what)
+{
+    if (!condition) { cout << test << " FAILED: " << what << endl; }
+    return condition;
+}
+
+
+// Audio periods of 3 frames regrouped into packets of 4 and back, across the
+// end of the buffer, and the oldest frames dropped when it overflows
+bool test_reblocker()
+{
+    const int channels = 2;
+    const int max_frames = 8;
+    Reblocker reblocker(channels, 1, max_frames);
+    int8_t block[channels * max_frames * 2];
+    int8_t written = 0; // Frame f of channel c holds f + 64 * c
+    int8_t expected = 0;
+    bool ok = true;
+    for (int period = 0; period < 12; period++) {
+        for (int c = 0; c < channels; c++) {
+            for (int f = 0; f < 3; f++) { block[c * 3 + f] = written + f + 64 * c; }
+        }
+        written += 3;
+        reblocker.write(block, 3);
+        while ( reblocker.read(block, 4) ) {
+            for (int c = 0; c < channels; c++) {
+                for (int f = 0; f < 4; f++) {
+                    ok &= test_check(block[c * 4 + f] == expected + f + 64 * c,
+                                     "Reblocker", "frames out of order");
+                }
+            }
+            expected += 4;
+        }
+        ok &= test_check(reblocker.getFrames() == written - expected,
+                         "Reblocker", "frames lost");
+    }
+
+    // 12 frames into 8: the first 4 are dropped, the rest are kept whole
+    reblocker.clear();
+    for (int c = 0; c < channels; c++) {
+        for (int f = 0; f < 12; f++) { block[c * 12 + f] = f + 64 * c; }
+    }
+    reblocker.write(block, 12);
+    ok &= test_check(reblocker.getFrames() == max_frames, "Reblocker", "overflow not dropped");
+    ok &= test_check(!reblocker.read(block, max_frames + 1), "Reblocker", "read more than buffered");
+    ok &= test_check(reblocker.read(block, max_frames), "Reblocker", "buffered frames not read");
+    for (int c = 0; c < channels; c++) {
+        ok &= test_check(block[c * max_frames] == 4 + 64 * c &&
+                         block[c * max_frames + max_frames - 1] == 11 + 64 * c,
+                         "Reblocker", "overflow didn't keep the newest frames");
+    }
+    return ok;
+}
+
+
+// A capability packet of a resumable session parsed back, and told apart
+// from the audio packets and from a truncated one
+bool test_compact_header()
+{
+    int8_t packet[sizeof(CompactHeaderStruct) + sizeof(uint32_t) + sizeof(CompactCapsStruct)];
+    CompactHeaderStruct header;
+    header.Version = COMPACT_HEADER_MAGIC | COMPACT_HEADER_VERSION;
+    header.Flags = CAPS_FLAG | RESUME_FLAG;
+    header.SeqNumber = 7;
+    header.TimeStamp = 123456;
+    uint32_t token = 0xA5C3E1F0;
+    CompactCapsStruct caps;
+    caps.BufferSize = 256;
+    caps.SamplingRate = 3;
+    caps.BitResolution = 16;
+    caps.ConnectionMode = RESUME_FLAG | DTX_FLAG;
+    caps.Reserved = 0;
+    caps.NumChannels = 2;
+    caps.NumOutChannels = 4;
+    std::memcpy(packet, &header, sizeof(header));
+    std::memcpy(packet + sizeof(header), &token, sizeof(token));
+    std::memcpy(packet + sizeof(header) + sizeof(token), &caps, sizeof(caps));
+    int size = sizeof(packet);
+
+    CompactHeader parser(NULL);
+    bool ok = true;
+    ok &= test_check(CompactHeader::isCapabilityPacket(packet, size),
+                     "CompactHeader", "capability packet not recognized");
+    ok &= test_check(!CompactHeader::isCapabilityPacket(packet, size - 1),
+                     "CompactHeader", "truncated capability packet taken");
+    ok &= test_check(parser.getPeerSequenceNumber(packet) == 7 &&
+                     parser.getPeerTimeStamp(packet) == 123456,
+                     "CompactHeader", "wrong sequence number or time stamp");
+    ok &= test_check(parser.getPeerSessionToken(packet) == token,
+                     "CompactHeader", "wrong session token");
+    ok &= test_check(parser.getPeerBufferSize(packet) == 256 &&
+                     parser.getPeerSamplingRate(packet) == 3 &&
+                     parser.getPeerBitResolution(packet) == 16 &&
+                     parser.getPeerConnectionMode(packet) == (RESUME_FLAG | DTX_FLAG),
+                     "CompactHeader", "wrong settings");
+    ok &= test_check(parser.getPeerNumChannels(packet) == 2 &&
+                     parser.getPeerNumOutChannels(packet) == 4,
+                     "CompactHeader", "wrong channels");
+
+    // The audio packets only carry the per packet flags
+    header.Flags = RESUME_FLAG | DTX_FLAG;
+    std::memcpy(packet, &header, sizeof(header));
+    ok &= test_check(CompactHeader::isCompactPacket(packet, size) &&
+                     !CompactHeader::isCapabilityPacket(packet, size),
+                     "CompactHeader", "audio packet taken for a capability packet");
+    ok &= test_check(parser.getPeerBufferSize(packet) == 0 &&
+                     parser.getPeerConnectionMode(packet) == (RESUME_FLAG | DTX_FLAG),
+                     "CompactHeader", "settings read from an audio packet");
+    return ok;
+}
+
+
+// 48 kHz to 44.1 kHz in periods of 128 frames: the frames come out at the
+// output rate, DC and a 1 kHz tone in the passband keep their level
+bool test_resampler()
+{
+    const int in_rate = 48000;
+    const int out_rate = 44100;
+    const int frames = 128;
+    const int blocks = 40;
+    const int sample_size = AudioInterface::BIT16;
+    Resampler resampler(2, AudioInterface::BIT16, in_rate, out_rate, frames, Resampler::HIGH);
+    QVector<int8_t> in_block(2 * frames * sample_size);
+    QVector<int8_t> out_block(2 * resampler.getMaxOutFrames() * sample_size);
+    int out_total = 0;
+    float tone_peak = 0.0f;
+    float dc_error = 0.0f;
+    bool ok = true;
+    for (int b = 0; b < blocks; b++) {
+        for (int j = 0; j < frames; j++) {
+            sample_t tone = 0.5f * std::sin(2.0 * 3.14159265358979323846 * 1000.0
+                                            * (b * frames + j) / in_rate);
+            sample_t dc = 0.25f;
+            AudioInterface::fromSampleToBitConversion(&tone, &in_block[j * sample_size],
+                                                      AudioInterface::BIT16);
+            AudioInterface::fromSampleToBitConversion(&dc, &in_block[(frames + j) * sample_size],
+                                                      AudioInterface::BIT16);
+        }
+        int out_frames = resampler.process(in_block.constData(), frames, out_block.data());
+        ok &= test_check(out_frames <= resampler.getMaxOutFrames(),
+                         "Resampler", "block larger than getMaxOutFrames()");
+        out_total += out_frames;
+        // Past the delay of the filter
+        for (int j = 0; b >= 2 && j < out_frames; j++) {
+            sample_t tone;
+            sample_t dc;
+            AudioInterface::fromBitToSampleConversion(&out_block[j * sample_size], &tone,
+                                                      AudioInterface::BIT16);
+            AudioInterface::fromBitToSampleConversion(&out_block[(out_frames + j) * sample_size],
+                                                      &dc, AudioInterface::BIT16);
+            tone_peak = std::max(tone_peak, std::fabs(tone));
+            dc_error = std::max(dc_error, std::fabs(dc - 0.25f));
+        }
+    }
+    int64_t expected = static_cast<int64_t>(blocks) * frames * out_rate / in_rate;
+    ok &= test_check(std::abs(out_total - expected) <= 1, "Resampler", "wrong number of frames");
+    ok &= test_check(dc_error < 0.002f, "Resampler", "DC level changed");
+    ok &= test_check(tone_peak > 0.495f && tone_peak < 0.505f, "Resampler", "tone level changed");
+    return ok;
+}
+
+
+// A frame cut into fragments and put back together from them out of order,
+// with a duplicate. Frames left incomplete give their slot to new ones,
+// oldest first.
+bool test_fragmenter()
+{
+    const int max_datagram = 100;
+    const int frame_size = 1000;
+    Fragmenter sender(0);
+    Fragmenter receiver(frame_size);
+    sender.setMaxDatagramSize(max_datagram);
+    int8_t frame[frame_size];
+    for (int i = 0; i < frame_size; i++) { frame[i] = static_cast<int8_t>(i * 7); }
+    bool ok = true;
+    ok &= test_check(sender.getNumFragments(max_datagram) == 1,
+                     "Fragmenter", "datagram that fits fragmented");
+    ok &= test_check(!Fragmenter::isFragment(frame, frame_size),
+                     "Fragmenter", "frame taken for a fragment");
+    int payload = max_datagram - Fragmenter::getHeaderSizeInBytes();
+    ok &= test_check(sender.getNumFragments(MAX_FRAGMENTS * payload) == MAX_FRAGMENTS &&
+                     sender.getNumFragments(MAX_FRAGMENTS * payload + 1) == 0,
+                     "Fragmenter", "more fragments than the header counts");
+
+    int count = sender.getNumFragments(frame_size);
+    QVector<QByteArray> fragments;
+    for (int i = 0; i < count; i++) {
+        int8_t datagram[max_datagram];
+        int size = Fragmenter::putFragment(frame, frame_size, 42, i, count, datagram);
+        ok &= test_check(size <= max_datagram && Fragmenter::isFragment(datagram, size),
+                         "Fragmenter", "fragment larger than the datagram, or not a fragment");
+        fragments.append(QByteArray(reinterpret_cast<const char*>(datagram), size));
+    }
+    // Last one first, the others backwards, fragment 1 twice
+    int8_t* whole = NULL;
+    int whole_size = 0;
+    for (int i = count; i >= 0; i--) {
+        const QByteArray& fragment = fragments[(i == count) ? 1 : i];
+        ok &= test_check(whole == NULL, "Fragmenter", "frame complete too early");
+        whole = receiver.reassemble(reinterpret_cast<const int8_t*>(fragment.constData()),
+                                    fragment.size(), whole_size);
+    }
+    ok &= test_check(whole != NULL && whole_size == frame_size &&
+                     std::memcmp(whole, frame, frame_size) == 0,
+                     "Fragmenter", "frame not put back together");
+
+    // One fragment of gFragmentSlots + 1 frames: the first one loses its slot
+    for (int id = 0; id <= gFragmentSlots; id++) {
+        int8_t datagram[max_datagram];
+        int size = Fragmenter::putFragment(frame, frame_size, id, 0, count, datagram);
+        receiver.reassemble(datagram, size, whole_size);
+    }
+    ok &= test_check(receiver.getIncompleteFrames() == 1, "Fragmenter", "no slot evicted");
+    // The rest of the newer frames completes them, the rest of frame 0 doesn't
+    for (int id = gFragmentSlots; id >= 0; id--) {
+        whole = NULL;
+        for (int i = 1; i < count; i++) {
+            int8_t datagram[max_datagram];
+            int size = Fragmenter::putFragment(frame, frame_size, id, i, count, datagram);
+            whole = receiver.reassemble(datagram, size, whole_size);
+        }
+        ok &= test_check((whole != NULL) == (id != 0), "Fragmenter",
+                         (id != 0) ? "newer frame evicted" : "evicted frame put back together");
+    }
+    return ok;
+}
+
+
+// Bytes of a hexadecimal string, for the test vectors
+QByteArray test_hex(const char* hex)
+{
+    return QByteArray::fromHex(QByteArray(hex));
+}
+
+
+// The X25519 vectors of RFC 7748 (section 5.2, and Alice's public key of
+// 6.1), the keys both ends derive from them, and sealed datagrams opened
+// once, in any order, and never when tampered with
+bool test_packet_cipher()
+{
+    static const char* vectors[][3] = {
+        { "a546e36bf0527c9d3b16154b82465edd62144c0ac1fc5a18506a2244ba449ac4",
+          "e6db6867583030db3594c1a424b15f7c726624ec26b3353b10a903a6d0ab1c4c",
+          "c3da55379de9c6908e94ea4df28d084f32eccf03491c71f754b4075577a28552" },
+        { "4b66e9d4d1b4673c5ad22691957d6af5c11b6421e0ea01d42ca4169e7918ba0d",
+          "e5210f12786811d3f4b7959d0538ae2c31dbe7106fc03c3efc4cd549c715a493",
+          "95cbde9476e8907d7aade45cb4b873f88b595a68799fa152e6f8f7647aac7957" },
+        { "77076d0a7318a57d3c16c17251b26645df4c2f87ebc0992ab177fba51db92c2a",
+          "0900000000000000000000000000000000000000000000000000000000000000",
+          "8520f0098930a754748b7ddcb43ef75a0dbf3a0d26381af4eba4a98eaa9b4e6a" }
+    };
+    bool ok = true;
+    for (unsigned int i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        QByteArray scalar = test_hex(vectors[i][0]);
+        QByteArray point = test_hex(vectors[i][1]);
+        uint8_t out[PacketCipher::KEY_SIZE];
+        PacketCipher::scalarMult(out, reinterpret_cast<const uint8_t*>(scalar.constData()),
+                                 reinterpret_cast<const uint8_t*>(point.constData()));
+        ok &= test_check(QByteArray(reinterpret_cast<const char*>(out), sizeof(out))
+                         == test_hex(vectors[i][2]), "PacketCipher", "wrong X25519");
+    }
+
+    uint8_t client_private[PacketCipher::KEY_SIZE];
+    uint8_t client_public[PacketCipher::KEY_SIZE];
+    uint8_t hub_private[PacketCipher::KEY_SIZE];
+    uint8_t hub_public[PacketCipher::KEY_SIZE];
+    ok &= test_check(PacketCipher::generateKeyPair(client_private, client_public) &&
+                     PacketCipher::generateKeyPair(hub_private, hub_public),
+                     "PacketCipher", "no random source");
+    uint8_t client_send[PacketCipher::KEY_SIZE];
+    uint8_t client_receive[PacketCipher::KEY_SIZE];
+    uint8_t hub_send[PacketCipher::KEY_SIZE];
+    uint8_t hub_receive[PacketCipher::KEY_SIZE];
+    ok &= test_check(PacketCipher::deriveKeys(client_private, hub_public, true,
+                                              client_send, client_receive) &&
+                     PacketCipher::deriveKeys(hub_private, client_public, false,
+                                              hub_send, hub_receive),
+                     "PacketCipher", "valid key refused");
+    ok &= test_check(std::memcmp(client_send, hub_receive, PacketCipher::KEY_SIZE) == 0 &&
+                     std::memcmp(hub_send, client_receive, PacketCipher::KEY_SIZE) == 0 &&
+                     std::memcmp(client_send, client_receive, PacketCipher::KEY_SIZE) != 0,
+                     "PacketCipher", "the ends don't agree on the keys");
+    uint8_t low_order[PacketCipher::KEY_SIZE] = { 0 };
+    ok &= test_check(!PacketCipher::deriveKeys(client_private, low_order, true,
+                                               client_send, client_receive),
+                     "PacketCipher", "low order point taken");
+
+    const int size = 528;
+    PacketCipher sender(hub_send);
+    PacketCipher receiver(client_receive);
+    int8_t plaintext[size];
+    for (int i = 0; i < size; i++) { plaintext[i] = static_cast<int8_t>(i); }
+    QVector<int8_t> first_buffer(size + PacketCipher::getOverheadInBytes());
+    QVector<int8_t> second_buffer(size + PacketCipher::getOverheadInBytes());
+    QVector<int8_t> replay_buffer(size + PacketCipher::getOverheadInBytes());
+    int8_t* first = first_buffer.data();
+    int8_t* second = second_buffer.data();
+    int8_t* replay = replay_buffer.data();
+    std::memcpy(first, plaintext, size);
+    std::memcpy(second, plaintext, size);
+    int sealed_size = sender.seal(first, size);
+    sender.seal(second, size);
+    ok &= test_check(sealed_size == size + PacketCipher::getOverheadInBytes() &&
+                     std::memcmp(first, plaintext, size) != 0,
+                     "PacketCipher", "datagram not encrypted");
+    std::memcpy(replay, first, sealed_size);
+
+    // The second one first, as the network may reorder them
+    ok &= test_check(receiver.isNewest(second, sealed_size), "PacketCipher", "newest not taken");
+    ok &= test_check(receiver.open(second, sealed_size) == size &&
+                     receiver.open(first, sealed_size) == size &&
+                     std::memcmp(first, plaintext, size) == 0 &&
+                     std::memcmp(second, plaintext, size) == 0,
+                     "PacketCipher", "sealed datagram not opened");
+    ok &= test_check(receiver.open(replay, sealed_size) < 0, "PacketCipher", "replay taken");
+    ok &= test_check(receiver.getRejected() == 1, "PacketCipher", "replay not counted");
+
+    // A flipped bit in the ciphertext, the counter or the tag
+    const int tampered[] = { 0, size, sealed_size - 1 };
+    for (unsigned int i = 0; i < sizeof(tampered) / sizeof(tampered[0]); i++) {
+        std::memcpy(first, plaintext, size);
+        sender.seal(first, size);
+        first[tampered[i]] ^= 1;
+        ok &= test_check(!receiver.isNewest(first, sealed_size) &&
+                         receiver.open(first, sealed_size) < 0,
+                         "PacketCipher", "tampered datagram taken");
+    }
+    std::memcpy(first, plaintext, size);
+    sender.seal(first, size);
+    ok &= test_check(receiver.open(first, sealed_size) == size,
+                     "PacketCipher", "datagram after the tampered ones not opened");
+    return ok;
+}
+
+
+// The known answers of RFC 8439: the ChaCha20 block function (section
+// 2.3.2), Poly1305 (2.5.2) and the AEAD construction (2.8.2), and the four
+// blocks at once of a longer message against the block function
+bool test_chacha20_poly1305()
+{
+    bool ok = true;
+    QByteArray key = test_hex("000102030405060708090a0b0c0d0e0f"
+                              "101112131415161718191a1b1c1d1e1f");
+    QByteArray nonce = test_hex("000000090000004a00000000");
+    uint8_t block[64];
+    PacketCipher::chacha20Block(reinterpret_cast<const uint8_t*>(key.constData()),
+                                reinterpret_cast<const uint8_t*>(nonce.constData()), 1, block);
+    ok &= test_check(QByteArray(reinterpret_cast<const char*>(block), sizeof(block))
+                     == test_hex("10f1e7e4d13b5915500fdd1fa32071c4c7d1f4c733c068030422aa9ac3d46c4e"
+                                 "d2826446079faa0914c2d705d98b02a2b5129cd1de164eb9cbd083e8a2503c4e"),
+                     "ChaCha20-Poly1305", "wrong ChaCha20 block");
+
+    QByteArray poly_key = test_hex("85d6be7857556d337f4452fe42d506a8"
+                                   "0103808afb0db2fd4abff6af4149f51b");
+    const char* message = "Cryptographic Forum Research Group";
+    uint8_t tag[PacketCipher::TAG_SIZE];
+    PacketCipher::poly1305(reinterpret_cast<const uint8_t*>(poly_key.constData()),
+                           reinterpret_cast<const uint8_t*>(message),
+                           static_cast<int>(std::strlen(message)), tag);
+    ok &= test_check(QByteArray(reinterpret_cast<const char*>(tag), sizeof(tag))
+                     == test_hex("a8061dc1305136c6c22b8baf0c0127a9"),
+                     "ChaCha20-Poly1305", "wrong Poly1305 tag");
+
+    QByteArray aead_key = test_hex("808182838485868788898a8b8c8d8e8f"
+                                   "909192939495969798999a9b9c9d9e9f");
+    QByteArray aead_nonce = test_hex("070000004041424344454647");
+    QByteArray aad = test_hex("50515253c0c1c2c3c4c5c6c7");
+    const char* plaintext = "Ladies and Gentlemen of the class of '99: If I could offer you "
+                            "only one tip for the future, sunscreen would be it.";
+    const int size = static_cast<int>(std::strlen(plaintext));
+    QVector<uint8_t> data(size);
+    std::memcpy(data.data(), plaintext, size);
+    PacketCipher::aeadEncrypt(reinterpret_cast<const uint8_t*>(aead_key.constData()),
+                              reinterpret_cast<const uint8_t*>(aead_nonce.constData()),
+                              reinterpret_cast<const uint8_t*>(aad.constData()), aad.size(),
+                              data.data(), size, tag);
+    ok &= test_check(QByteArray(reinterpret_cast<const char*>(data.constData()), size)
+                     == test_hex("d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6"
+                                 "3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36"
+                                 "92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+                                 "3ff4def08e4b7a9de576d26586cec64b6116"),
+                     "ChaCha20-Poly1305", "wrong AEAD ciphertext");
+    ok &= test_check(QByteArray(reinterpret_cast<const char*>(tag), sizeof(tag))
+                     == test_hex("1ae10b594f09e26a7e902ecbd0600691"),
+                     "ChaCha20-Poly1305", "wrong AEAD tag");
+
+    // Zeros encrypt to the key stream, from block 1 on
+    const int blocks = 5;
+    QVector<uint8_t> zeros(blocks * 64, 0);
+    PacketCipher::aeadEncrypt(reinterpret_cast<const uint8_t*>(key.constData()),
+                              reinterpret_cast<const uint8_t*>(nonce.constData()),
+                              NULL, 0, zeros.data(), zeros.size(), tag);
+    for (int i = 0; i < blocks; i++) {
+        PacketCipher::chacha20Block(reinterpret_cast<const uint8_t*>(key.constData()),
+                                    reinterpret_cast<const uint8_t*>(nonce.constData()),
+                                    i + 1, block);
+        ok &= test_check(std::memcmp(zeros.constData() + 64 * i, block, sizeof(block)) == 0,
+                         "ChaCha20-Poly1305", "key stream differs from the block function");
+    }
+    return ok;
+}
+
+
+// An IPv4 source of datagrams, address and port in host order
+struct sockaddr_storage test_address(uint32_t address, uint16_t port)
+{
+    struct sockaddr_storage storage;
+    std::memset(&storage, 0, sizeof(storage));
+    struct sockaddr_in* address4 = reinterpret_cast<struct sockaddr_in*>(&storage);
+    address4->sin_family = AF_INET;
+    address4->sin_addr.s_addr = htonl(address);
+    address4->sin_port = htons(port);
+    return storage;
+}
+
+
+// Two paths of the peer bring each sequence number across its wraparound,
+// the first copy goes on and the losses and delays of each path are counted.
+// A source outside the session takes no path nor sequence number, even with
+// the peer's port, unless its datagrams authenticate.
+bool test_path_merger()
+{
+    const struct sockaddr_storage peer = test_address(0x0A000001, 4464);
+    const struct sockaddr_storage other_path = test_address(0x0A000101, 4464);
+    const struct sockaddr_storage stray = test_address(0xC0A80505, 5000);
+    const struct sockaddr_storage stray_jacktrip = test_address(0xC0A80506, 4464);
+    PathMerger merger(peer);
+    bool ok = true;
+    int64_t now_ns = 0;
+    int count = 0;
+    for (uint16_t seq = 65530; seq != 11; seq++, count++) {
+        now_ns += 5000000;
+        ok &= test_check(merger.isFirstCopy(peer, false, seq, now_ns),
+                         "PathMerger", "first copy dropped");
+        // The other path loses the last two before the wraparound
+        if (seq == 65534 || seq == 65535) { continue; }
+        ok &= test_check(!merger.isFirstCopy(other_path, true, seq, now_ns + 2000000),
+                         "PathMerger", "later copy taken");
+    }
+    ok &= test_check(!merger.isFirstCopy(stray, false, 11, now_ns) &&
+                     !merger.isFirstCopy(stray_jacktrip, false, 11, now_ns) &&
+                     !merger.isFirstCopy(other_path, false, 11, now_ns),
+                     "PathMerger", "source outside the session taken");
+    ok &= test_check(merger.isFirstCopy(other_path, true, 11, now_ns),
+                     "PathMerger", "datagram hidden by a source outside the session");
+    ok &= test_check(!merger.isFirstCopy(peer, false, 11, now_ns + 1000000),
+                     "PathMerger", "later copy taken");
+
+    QVector<DataProtocol::PathStat> stats;
+    merger.getStats(stats);
+    ok &= test_check(stats.size() == 2, "PathMerger", "wrong number of paths");
+    if (stats.size() == 2) {
+        ok &= test_check(stats[0].received == static_cast<uint32_t>(count + 1) &&
+                         stats[0].first == static_cast<uint32_t>(count) &&
+                         stats[0].lost == 0 && stats[0].lateMaxUsec == 1000,
+                         "PathMerger", "wrong statistics of the first path");
+        ok &= test_check(stats[1].received == static_cast<uint32_t>(count - 1) &&
+                         stats[1].first == 1 && stats[1].lost == 2 &&
+                         stats[1].lateMeanUsec == 2000 && stats[1].lateMaxUsec == 2000,
+                         "PathMerger", "wrong statistics of the second path");
+    }
+    return ok;
+}
+
+
+// The audio of a 24-bit packet packed with its silent channels left out, at
+// each resolution adaptive packets may ask for, and expanded back to 24 bits
+// within the precision of the packed one
+bool test_dtx_packing()
+{
+    const int num_chans = 9; // two bytes of mask
+    const int frames = 32;
+    const int bytes = AudioInterface::BIT24;
+    const int active[] = { 0, 8 };
+    const int num_active = sizeof(active) / sizeof(active[0]);
+    int8_t audio[num_chans * frames * bytes];
+    std::memset(audio, 0, sizeof(audio));
+    for (int a = 0; a < num_active; a++) {
+        for (int f = 0; f < frames; f++) {
+            sample_t sample = 0.6f * std::sin(0.3f * f + a);
+            AudioInterface::fromSampleToBitConversion(
+                        &sample, audio + (active[a] * frames + f) * bytes,
+                        AudioInterface::BIT24);
+        }
+    }
+    bool ok = true;
+    int8_t dtx_audio[2 + sizeof(audio)];
+    int8_t unpacked[sizeof(audio)];
+    for (int packed_bytes = bytes; packed_bytes >= AudioInterface::BIT8; packed_bytes--) {
+        int size = JackTrip::packDtxAudio(audio, num_chans, frames, bytes, packed_bytes,
+                                          dtx_audio);
+        ok &= test_check(size == 2 + num_active * frames * packed_bytes &&
+                         static_cast<uint8_t>(dtx_audio[0]) == 0x01 && dtx_audio[1] == 0x01,
+                         "DTX packing", "wrong mask or size");
+        ok &= test_check(JackTrip::unpackDtxAudio(dtx_audio, size - 1, num_chans, frames,
+                                                  bytes, packed_bytes, unpacked) < 0 &&
+                         JackTrip::unpackDtxAudio(dtx_audio, 1, num_chans, frames,
+                                                  bytes, packed_bytes, unpacked) < 0,
+                         "DTX packing", "truncated packet taken");
+        std::memset(unpacked, 0x55, sizeof(unpacked));
+        ok &= test_check(JackTrip::unpackDtxAudio(dtx_audio, size, num_chans, frames,
+                                                  bytes, packed_bytes, unpacked) == size,
+                         "DTX packing", "packet not unpacked");
+        // One step of the packed resolution, the sample range is [-1, 1)
+        float step = 2.0f / (1 << (8 * packed_bytes));
+        float error = 0.0f;
+        for (int i = 0; i < num_chans * frames; i++) {
+            sample_t original, restored;
+            AudioInterface::fromBitToSampleConversion(audio + i * bytes, &original,
+                                                      AudioInterface::BIT24);
+            AudioInterface::fromBitToSampleConversion(unpacked + i * bytes, &restored,
+                                                      AudioInterface::BIT24);
+            error = std::max(error, std::abs(restored - original));
+        }
+        ok &= test_check(packed_bytes < bytes || std::memcmp(audio, unpacked, sizeof(audio)) == 0,
+                         "DTX packing", "full resolution not exact");
+        ok &= test_check(error <= step, "DTX packing", "audio changed beyond the packed resolution");
+    }
+    return ok;
+}